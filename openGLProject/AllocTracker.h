@@ -0,0 +1,380 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+
+// Heap allocation tracking by subsystem.
+// Replaces global operator new/delete, so exactly one .cpp must do
+//     #define ALLOC_TRACKER_IMPLEMENTATION
+//     #include "AllocTracker.h"
+// (same deal as stb_image). Everything else just includes it and uses AllocScope/HotRegion.
+// Only C++ new/delete is seen, malloc from C libraries (GLFW, stb, the GL driver) is not.
+
+enum AllocTag {
+	ALLOC_UNTAGGED,
+	ALLOC_RENDER,
+	ALLOC_SIMULATION,
+	ALLOC_SHADERS,
+	ALLOC_ASSETS,
+	ALLOC_UI,
+	ALLOC_TOOLS,
+	ALLOC_TAG_COUNT
+};
+
+// Counters for one tag. Frame counters are zeroed by AllocTracker::BeginFrame().
+struct AllocCounters
+{
+	std::atomic<long long> Allocations;
+	std::atomic<long long> Bytes;
+	std::atomic<long long> LiveBytes;
+	std::atomic<long long> FrameAllocations;
+	std::atomic<long long> FrameBytes;
+};
+
+class AllocTracker
+{
+public:
+	static const char* TagName(int tag)
+	{
+		static const char* names[ALLOC_TAG_COUNT] = { "untagged", "render", "simulation", "shaders", "assets", "ui", "tools" };
+		return tag >= 0 && tag < ALLOC_TAG_COUNT ? names[tag] : "?";
+	}
+
+	static AllocCounters& Counters(int tag)
+	{
+		return counters[tag];
+	}
+
+	// Zeroes the per-frame counters, call at the top of the frame
+	static void BeginFrame()
+	{
+		for (int t = 0; t < ALLOC_TAG_COUNT; t++)
+		{
+			counters[t].FrameAllocations.store(0, std::memory_order_relaxed);
+			counters[t].FrameBytes.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	static long long FrameAllocations()
+	{
+		long long total = 0;
+		for (int t = 0; t < ALLOC_TAG_COUNT; t++)
+			total += counters[t].FrameAllocations.load(std::memory_order_relaxed);
+		return total;
+	}
+
+	static long long FrameBytes()
+	{
+		long long total = 0;
+		for (int t = 0; t < ALLOC_TAG_COUNT; t++)
+			total += counters[t].FrameBytes.load(std::memory_order_relaxed);
+		return total;
+	}
+
+	// Heap currently held by everything we've seen allocated
+	static long long LiveBytes()
+	{
+		long long total = 0;
+		for (int t = 0; t < ALLOC_TAG_COUNT; t++)
+			total += counters[t].LiveBytes.load(std::memory_order_relaxed);
+		return total;
+	}
+
+	// Strict mode: any allocation inside a HotRegion is printed (and breaks into the debugger
+	// on MSVC if BreakOnHot is set). HotViolations counts them whether or not strict is on.
+	static std::atomic<bool> Strict;
+	static std::atomic<bool> BreakOnHot;
+	static std::atomic<long long> HotViolations;
+
+	// Current tag and hot region for this thread, managed by AllocScope/HotRegion
+	static int& CurrentTag()
+	{
+		return currentTag;
+	}
+
+	static const char*& CurrentHotRegion()
+	{
+		return hotRegion;
+	}
+
+	// One line per tag, for the console
+	static void Report(FILE* out)
+	{
+		fprintf(out, "%-12s %12s %14s %12s %12s\n", "tag", "allocs", "bytes", "live", "this frame");
+		for (int t = 0; t < ALLOC_TAG_COUNT; t++)
+		{
+			AllocCounters& c = counters[t];
+			fprintf(out, "%-12s %12lld %14lld %12lld %12lld\n", TagName(t), c.Allocations.load(), c.Bytes.load(),
+				c.LiveBytes.load(), c.FrameAllocations.load());
+		}
+		fprintf(out, "hot region violations: %lld\n", HotViolations.load());
+	}
+
+	static void* Allocate(size_t size, size_t alignment = 0);
+	static void Free(void* p);
+
+private:
+	static AllocCounters counters[ALLOC_TAG_COUNT];
+	static thread_local int currentTag;
+	static thread_local const char* hotRegion;
+	static thread_local bool reporting;
+};
+
+// Books every allocation made on this thread inside the scope against tag
+class AllocScope
+{
+public:
+	AllocScope(AllocTag tag) : previous(AllocTracker::CurrentTag())
+	{
+		AllocTracker::CurrentTag() = tag;
+	}
+
+	~AllocScope()
+	{
+		AllocTracker::CurrentTag() = previous;
+	}
+
+private:
+	int previous;
+};
+
+// Marks code that must not allocate (e.g. the frame loop body). Nests; the innermost name is
+// what gets reported.
+class HotRegion
+{
+public:
+	HotRegion(const char* name) : previous(AllocTracker::CurrentHotRegion())
+	{
+		AllocTracker::CurrentHotRegion() = name;
+	}
+
+	~HotRegion()
+	{
+		AllocTracker::CurrentHotRegion() = previous;
+	}
+
+private:
+	const char* previous;
+};
+
+// Lets code inside a hot region opt out for a known, deliberate allocation (e.g. a one-off log line)
+class ColdRegion
+{
+public:
+	ColdRegion() : previous(AllocTracker::CurrentHotRegion())
+	{
+		AllocTracker::CurrentHotRegion() = NULL;
+	}
+
+	~ColdRegion()
+	{
+		AllocTracker::CurrentHotRegion() = previous;
+	}
+
+private:
+	const char* previous;
+};
+
+#endif // ALLOC_TRACKER_H
+
+// kept outside the include guard so the implementing file still gets it when another
+// header pulled the declarations in first
+#if defined(ALLOC_TRACKER_IMPLEMENTATION) && !defined(ALLOC_TRACKER_IMPLEMENTED)
+#define ALLOC_TRACKER_IMPLEMENTED
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+AllocCounters AllocTracker::counters[ALLOC_TAG_COUNT];
+std::atomic<bool> AllocTracker::Strict(false);
+std::atomic<bool> AllocTracker::BreakOnHot(false);
+std::atomic<long long> AllocTracker::HotViolations(0);
+thread_local int AllocTracker::currentTag = ALLOC_UNTAGGED;
+thread_local const char* AllocTracker::hotRegion = NULL;
+thread_local bool AllocTracker::reporting = false;
+
+// every block carries its size, tag and distance back to malloc's pointer just in front of
+// it, so delete can book it back
+struct AllocHeader
+{
+	size_t Size;
+	int Tag;
+	unsigned int Offset;
+};
+// keep the user pointer 16-byte aligned like malloc's
+const size_t ALLOC_HEADER_SIZE = 16;
+static_assert(sizeof(AllocHeader) <= ALLOC_HEADER_SIZE, "allocation header must fit in front of the block");
+
+void* AllocTracker::Allocate(size_t size, size_t alignment)
+{
+	//over-aligned blocks get room to slide the user pointer up to the next boundary
+	const size_t extra = alignment > ALLOC_HEADER_SIZE ? alignment : 0;
+	unsigned char* raw = (unsigned char*)malloc(size + ALLOC_HEADER_SIZE + extra);
+	if (!raw)
+		return NULL;
+	uintptr_t user = (uintptr_t)raw + ALLOC_HEADER_SIZE;
+	if (extra)
+		user = (user + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	int tag = currentTag;
+	AllocHeader header;
+	header.Size = size;
+	header.Tag = tag;
+	header.Offset = (unsigned int)(user - (uintptr_t)raw);
+	memcpy(raw + header.Offset - ALLOC_HEADER_SIZE, &header, sizeof(header));
+	AllocCounters& c = counters[tag];
+	c.Allocations.fetch_add(1, std::memory_order_relaxed);
+	c.Bytes.fetch_add((long long)size, std::memory_order_relaxed);
+	c.LiveBytes.fetch_add((long long)size, std::memory_order_relaxed);
+	c.FrameAllocations.fetch_add(1, std::memory_order_relaxed);
+	c.FrameBytes.fetch_add((long long)size, std::memory_order_relaxed);
+
+	if (hotRegion && !reporting)
+	{
+		HotViolations.fetch_add(1, std::memory_order_relaxed);
+		if (Strict.load(std::memory_order_relaxed))
+		{
+			//stdio might allocate itself, don't report our own report
+			reporting = true;
+			fprintf(stderr, "ALLOC::HOT_REGION %zu bytes (%s) inside \"%s\"\n", size, TagName(tag), hotRegion);
+			reporting = false;
+#ifdef _MSC_VER
+			if (BreakOnHot.load(std::memory_order_relaxed))
+				__debugbreak();
+#endif
+		}
+	}
+	return raw + header.Offset;
+}
+
+void AllocTracker::Free(void* p)
+{
+	if (!p)
+		return;
+	//the header is outside the block the caller was given, so step back through an integer
+	//rather than indexing the user pointer (which the compiler rightly calls out of bounds)
+	AllocHeader header;
+	memcpy(&header, (const void*)((uintptr_t)p - ALLOC_HEADER_SIZE), sizeof(header));
+	counters[header.Tag].LiveBytes.fetch_sub((long long)header.Size, std::memory_order_relaxed);
+	free((void*)((uintptr_t)p - header.Offset));
+}
+
+void* operator new(size_t size)
+{
+	void* p = AllocTracker::Allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void* p = AllocTracker::Allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return AllocTracker::Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return AllocTracker::Allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+// over-aligned types (C++17 and up) come through these instead, so they need replacing too
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* p = AllocTracker::Allocate(size, (size_t)alignment);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	void* p = AllocTracker::Allocate(size, (size_t)alignment);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return AllocTracker::Allocate(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return AllocTracker::Allocate(size, (size_t)alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	AllocTracker::Free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	AllocTracker::Free(p);
+}
+#endif
+
+#endif // ALLOC_TRACKER_IMPLEMENTATION
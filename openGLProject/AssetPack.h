@@ -0,0 +1,337 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "MappedFile.h"
+#include "Checksum.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Default asset pack values
+const char ASSET_PACK_MAGIC[8] = { 'S', 'S', 'I', 'M', 'P', 'A', 'C', 'K' };
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint32_t ASSET_PACK_ALIGNMENT = 64; //every entry starts on a cache line
+const size_t ASSET_NAME_MAX = 256;
+const char* const ASSET_PACK_DEFAULT_NAME = "assets.pack";
+
+// File layout: header, index (sorted by NameHash), name table, then the entries themselves
+struct AssetPackHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t EntryCount;
+	uint64_t IndexOffset;
+	uint64_t NamesOffset;
+	uint64_t NamesBytes;
+	uint64_t DataOffset;
+	uint64_t IndexChecksum; //Hash64 over index + name table
+	uint64_t Reserved;
+};
+
+struct AssetPackEntry
+{
+	uint64_t NameHash; //Hash64 of the normalised name
+	uint64_t Offset; //from the start of the file, ASSET_PACK_ALIGNMENT aligned
+	uint64_t Size;
+	uint64_t DataHash; //Hash64 of the contents, checked by Verify()
+	uint32_t NameOffset; //into the name table, NUL terminated
+	uint32_t NameLength;
+};
+
+// Bytes of one entry, straight out of the mapping. Not NUL terminated.
+struct AssetView
+{
+	const unsigned char* Data;
+	size_t Size;
+
+	AssetView() : Data(NULL), Size(0)
+	{
+	}
+
+	bool Valid() const
+	{
+		return Data != NULL;
+	}
+};
+
+// Read-only pack of every file the game loads (shaders, textures, anything else). The whole
+// pack is one file mapped once; Find() is a binary search over the hashed index and hands
+// back a pointer into the mapping, so nothing is copied or opened per asset.
+// Names are relative paths as the code asks for them, compared case-insensitively with
+// either slash ("Assets\Earth.jpg" finds "assets/earth.jpg").
+class AssetPack
+{
+public:
+	AssetPack() : header(NULL), entries(NULL), names(NULL)
+	{
+	}
+
+	bool Open(const char* path)
+	{
+		Close();
+		if (!file.Open(path) || !file.Map())
+			return false;
+		if (file.Length() < sizeof(AssetPackHeader))
+			return Fail(path, "too small to be a pack");
+		const AssetPackHeader* h = (const AssetPackHeader*)file.Data();
+		if (memcmp(h->Magic, ASSET_PACK_MAGIC, 8) != 0 || h->Version != ASSET_PACK_VERSION)
+			return Fail(path, "not an asset pack (or an old one)");
+		uint64_t indexBytes = (uint64_t)h->EntryCount * sizeof(AssetPackEntry);
+		if (h->IndexOffset + indexBytes > file.Length() || h->NamesOffset + h->NamesBytes > file.Length() ||
+			h->NamesOffset != h->IndexOffset + indexBytes)
+			return Fail(path, "index is corrupt");
+		if (Checksum::Hash64(file.Data() + h->IndexOffset, (size_t)(indexBytes + h->NamesBytes)) != h->IndexChecksum)
+			return Fail(path, "index checksum mismatch");
+		const AssetPackEntry* e = (const AssetPackEntry*)(file.Data() + h->IndexOffset);
+		for (uint32_t k = 0; k < h->EntryCount; k++)
+			if (e[k].Offset + e[k].Size > file.Length() || e[k].NameOffset + e[k].NameLength >= h->NamesBytes)
+				return Fail(path, "entry points outside the pack");
+		header = h;
+		entries = e;
+		names = (const char*)file.Data() + h->NamesOffset;
+		location = path;
+		return true;
+	}
+
+	// Tries the pack next to the executable first, then the working directory
+	bool OpenDefault(const char* name = ASSET_PACK_DEFAULT_NAME)
+	{
+		std::string besideExe = ExecutableDirectory() + name;
+		return Open(besideExe.c_str()) || Open(name);
+	}
+
+	void Close()
+	{
+		file.Close();
+		header = NULL;
+		entries = NULL;
+		names = NULL;
+		location.clear();
+	}
+
+	bool IsOpen() const
+	{
+		return header != NULL;
+	}
+
+	const std::string& Location() const
+	{
+		return location;
+	}
+
+	uint32_t Count() const
+	{
+		return header ? header->EntryCount : 0;
+	}
+
+	const char* Name(uint32_t k) const
+	{
+		return names + entries[k].NameOffset;
+	}
+
+	AssetView Find(const char* name) const
+	{
+		AssetView view;
+		char normal[ASSET_NAME_MAX];
+		if (!header || !Normalise(name, normal))
+			return view;
+		uint64_t hash = Checksum::Hash64(normal, strlen(normal));
+		const AssetPackEntry* first = entries;
+		const AssetPackEntry* last = entries + header->EntryCount;
+		const AssetPackEntry* e = std::lower_bound(first, last, hash,
+			[](const AssetPackEntry& entry, uint64_t h) { return entry.NameHash < h; });
+		//equal hashes sit together, the name settles it
+		for (; e != last && e->NameHash == hash; ++e)
+		{
+			if (strcmp(names + e->NameOffset, normal) == 0)
+			{
+				view.Data = file.Data() + e->Offset;
+				view.Size = (size_t)e->Size;
+				return view;
+			}
+		}
+		return view;
+	}
+
+	// Hashes every entry against the index, for the packer and for paranoid startups
+	bool Verify() const
+	{
+		if (!header)
+			return false;
+		for (uint32_t k = 0; k < header->EntryCount; k++)
+			if (Checksum::Hash64(file.Data() + entries[k].Offset, (size_t)entries[k].Size) != entries[k].DataHash)
+				return false;
+		return true;
+	}
+
+	// Lower case, forward slashes, no leading "./". False if it doesn't fit.
+	static bool Normalise(const char* name, char* out)
+	{
+		while (name[0] == '.' && (name[1] == '/' || name[1] == '\\'))
+			name += 2;
+		size_t k = 0;
+		for (; name[k]; k++)
+		{
+			if (k + 1 >= ASSET_NAME_MAX)
+				return false;
+			char c = name[k];
+			if (c == '\\')
+				c = '/';
+			else if (c >= 'A' && c <= 'Z')
+				c = (char)(c - 'A' + 'a');
+			out[k] = c;
+		}
+		out[k] = '\0';
+		return k > 0;
+	}
+
+	// Builds a pack from files on disk, stored under the names given. Returns false (and says
+	// why) on a missing file or a duplicate name.
+	static bool Build(const char* path, const std::vector<std::string>& files)
+	{
+		struct Pending
+		{
+			std::string Name;
+			std::vector<char> Data;
+			AssetPackEntry Entry;
+		};
+		std::vector<Pending> pending(files.size());
+		for (size_t k = 0; k < files.size(); k++)
+		{
+			char normal[ASSET_NAME_MAX];
+			if (!Normalise(files[k].c_str(), normal))
+			{
+				std::cout << "ERROR::ASSET_PACK bad name " << files[k] << std::endl;
+				return false;
+			}
+			std::ifstream in(files[k].c_str(), std::ios::in | std::ios::binary);
+			if (!in)
+			{
+				std::cout << "ERROR::ASSET_PACK can't read " << files[k] << std::endl;
+				return false;
+			}
+			in.seekg(0, std::ios::end);
+			std::streamoff size = in.tellg();
+			in.seekg(0, std::ios::beg);
+			pending[k].Name = normal;
+			pending[k].Data.resize((size_t)size);
+			if (size > 0)
+				in.read(&pending[k].Data[0], size);
+			memset(&pending[k].Entry, 0, sizeof(AssetPackEntry));
+			pending[k].Entry.NameHash = Checksum::Hash64(normal, strlen(normal));
+			pending[k].Entry.Size = (uint64_t)size;
+			pending[k].Entry.DataHash = Checksum::Hash64(pending[k].Data.data(), pending[k].Data.size());
+		}
+		std::sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) {
+			return a.Entry.NameHash != b.Entry.NameHash ? a.Entry.NameHash < b.Entry.NameHash : a.Name < b.Name; });
+		for (size_t k = 1; k < pending.size(); k++)
+		{
+			if (pending[k].Name == pending[k - 1].Name)
+			{
+				std::cout << "ERROR::ASSET_PACK " << pending[k].Name << " is in the list twice" << std::endl;
+				return false;
+			}
+		}
+
+		//layout: header, index, names, then aligned data
+		std::string nameTable;
+		for (size_t k = 0; k < pending.size(); k++)
+		{
+			pending[k].Entry.NameOffset = (uint32_t)nameTable.size();
+			pending[k].Entry.NameLength = (uint32_t)pending[k].Name.size();
+			nameTable += pending[k].Name;
+			nameTable += '\0';
+		}
+		AssetPackHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.Magic, ASSET_PACK_MAGIC, 8);
+		h.Version = ASSET_PACK_VERSION;
+		h.EntryCount = (uint32_t)pending.size();
+		h.IndexOffset = sizeof(AssetPackHeader);
+		h.NamesOffset = h.IndexOffset + pending.size() * sizeof(AssetPackEntry);
+		h.NamesBytes = nameTable.size();
+		h.DataOffset = AlignUp(h.NamesOffset + h.NamesBytes);
+		uint64_t offset = h.DataOffset;
+		std::vector<AssetPackEntry> index(pending.size());
+		for (size_t k = 0; k < pending.size(); k++)
+		{
+			pending[k].Entry.Offset = offset;
+			offset = AlignUp(offset + pending[k].Entry.Size);
+			index[k] = pending[k].Entry;
+		}
+		std::vector<unsigned char> indexBlock(index.size() * sizeof(AssetPackEntry) + nameTable.size());
+		if (!index.empty())
+			memcpy(indexBlock.data(), index.data(), index.size() * sizeof(AssetPackEntry));
+		memcpy(indexBlock.data() + index.size() * sizeof(AssetPackEntry), nameTable.data(), nameTable.size());
+		h.IndexChecksum = Checksum::Hash64(indexBlock.data(), indexBlock.size());
+
+		FILE* out = fopen(path, "wb");
+		if (!out)
+			return false;
+		static const unsigned char padding[ASSET_PACK_ALIGNMENT] = { 0 };
+		bool ok = fwrite(&h, sizeof(h), 1, out) == 1 && fwrite(indexBlock.data(), 1, indexBlock.size(), out) == indexBlock.size();
+		uint64_t written = h.NamesOffset + h.NamesBytes;
+		for (size_t k = 0; k < pending.size() && ok; k++)
+		{
+			size_t pad = (size_t)(pending[k].Entry.Offset - written);
+			ok = fwrite(padding, 1, pad, out) == pad &&
+				fwrite(pending[k].Data.data(), 1, pending[k].Data.size(), out) == pending[k].Data.size();
+			written = pending[k].Entry.Offset + pending[k].Entry.Size;
+		}
+		ok = fclose(out) == 0 && ok;
+		if (!ok)
+			remove(path);
+		return ok;
+	}
+
+	// Directory the running executable lives in, with a trailing separator ("" if unknown)
+	static std::string ExecutableDirectory()
+	{
+		char buffer[1024];
+#ifdef _WIN32
+		DWORD length = GetModuleFileNameA(NULL, buffer, sizeof(buffer));
+		if (length == 0 || length >= sizeof(buffer))
+			return std::string();
+#else
+		ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+		if (length <= 0)
+			return std::string();
+#endif
+		std::string exe(buffer, (size_t)length);
+		size_t slash = exe.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : exe.substr(0, slash + 1);
+	}
+
+private:
+	MappedFile file;
+	const AssetPackHeader* header;
+	const AssetPackEntry* entries;
+	const char* names;
+	std::string location;
+
+	static uint64_t AlignUp(uint64_t offset)
+	{
+		return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+	}
+
+	bool Fail(const char* path, const char* why)
+	{
+		std::cout << "ERROR::ASSET_PACK " << path << ": " << why << std::endl;
+		Close();
+		return false;
+	}
+
+	AssetPack(const AssetPack&);
+	AssetPack& operator=(const AssetPack&);
+};
+#endif
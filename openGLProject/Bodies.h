@@ -0,0 +1,51 @@
+#ifndef BODIES_H
+#define BODIES_H
+
+#include <vector>
+#include <cstddef>
+
+// Structure-of-arrays storage for every simulated body. Each quantity lives in its own column so
+// the force pass and integrator stream through memory one component at a time.
+class Bodies
+{
+public:
+	// position
+	std::vector<double> x, y, z;
+	// velocity
+	std::vector<double> vx, vy, vz;
+	// acceleration from the last force pass
+	std::vector<double> ax, ay, az;
+	std::vector<double> mass;
+	std::vector<double> radius;
+
+	size_t Count() const
+	{
+		return x.size();
+	}
+
+	// Appends a body and returns its index
+	size_t Add(double px, double py, double pz, double pvx, double pvy, double pvz, double m, double r)
+	{
+		x.push_back(px); y.push_back(py); z.push_back(pz);
+		vx.push_back(pvx); vy.push_back(pvy); vz.push_back(pvz);
+		ax.push_back(0.0); ay.push_back(0.0); az.push_back(0.0);
+		mass.push_back(m);
+		radius.push_back(r);
+		return x.size() - 1;
+	}
+
+	void Resize(size_t n)
+	{
+		x.resize(n); y.resize(n); z.resize(n);
+		vx.resize(n); vy.resize(n); vz.resize(n);
+		ax.resize(n); ay.resize(n); az.resize(n);
+		mass.resize(n);
+		radius.resize(n);
+	}
+
+	void Clear()
+	{
+		Resize(0);
+	}
+};
+#endif
@@ -0,0 +1,315 @@
+#ifndef BROAD_PHASE_H
+#define BROAD_PHASE_H
+
+#include "Bodies.h"
+#include "Parallel.h"
+#include "PerfGate.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Default broad phase values
+const size_t BROAD_PARALLEL_BODIES = 1 << 15; //split over threads above this many bodies
+const double BROAD_SWEEP_OVERLAPS = 8.0; //auto picks the grid when a body expects more neighbours than this along the sweep axis
+const int BROAD_CELL_BITS = 21; //per axis in a grid cell key
+const double BROAD_CELL_SHRINK = 0.25; //grid cells are rebuilt smaller once the biggest sphere is this fraction of them
+
+enum BroadPhaseMethod
+{
+	BROAD_AUTO, //sweep for sparse scenes, grid for dense ones (see Choose)
+	BROAD_SWEEP, //sweep and prune along one axis
+	BROAD_GRID //uniform grid, cells as wide as the biggest sphere
+};
+
+// A candidate collision, A < B
+struct BroadPair
+{
+	uint32_t A, B;
+};
+
+// Finds every pair of bodies whose bounding spheres (radius + Margin) overlap, for a narrow
+// phase to look at properly. Two ways of doing it:
+//  - sweep and prune keeps the bodies sorted by the low end of their interval on one axis and
+//    only tests bodies whose intervals overlap. Good when that's few.
+//  - the uniform grid puts each body in the cell holding its centre, cells at least one diameter
+//    wide, so touching spheres are in the same or neighbouring cells. Bodies are kept sorted by
+//    cell key (x fastest, then y, then z), so each cell's 13 "later" neighbours are 5 runs of keys
+//    that move forward as the cells do, and one cursor per run walks them. No hash table, every
+//    read is sequential. Cost doesn't depend on how crowded one axis is, but a few huge bodies
+//    make every cell huge.
+// Both keep their order between calls: bodies barely move per step, so the re-sort is an
+// insertion sort that does almost nothing. Tests read positions gathered into that order, and big
+// scenes are split over threads, each into its own list.
+class BroadPhase
+{
+public:
+	BroadPhaseMethod Method;
+	double Margin; //added to every radius, e.g. how far bodies can move before the next check
+	unsigned int Threads; //0 = every hardware thread
+	std::vector<BroadPair> Pairs; //from the last Find
+	//what the last Find did
+	BroadPhaseMethod Used;
+	size_t Tests; //sphere tests made
+	double FindMs;
+
+	BroadPhase(BroadPhaseMethod method = BROAD_AUTO) : Method(method), Margin(0.0), Threads(0), Used(BROAD_SWEEP), Tests(0),
+		FindMs(0.0), axis(0), sorted(0), sortedFor(BROAD_AUTO), cellSize(0.0)
+	{
+	}
+
+	// Call when bodies are added, removed or reordered, the kept order is by index
+	void Reset()
+	{
+		sorted = 0;
+	}
+
+	// Fills Pairs
+	void Find(const Bodies& b)
+	{
+		PerfTimer timer;
+		const size_t n = b.Count();
+		Used = Method == BROAD_AUTO ? Choose(b) : Method;
+		unsigned int threads = n < BROAD_PARALLEL_BODIES ? 1 : ParallelThreads(Threads);
+		found.resize(threads);
+		tests.assign(threads, 0);
+		for (unsigned int t = 0; t < threads; t++)
+			found[t].clear();
+		if (Used == BROAD_SWEEP)
+			Sweep(b, threads);
+		else
+			Grid(b, threads);
+		Pairs.clear();
+		Tests = 0;
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			Pairs.insert(Pairs.end(), found[t].begin(), found[t].end());
+			Tests += tests[t];
+		}
+		FindMs = timer.ElapsedMs();
+	}
+
+	// What BROAD_AUTO would use: the sweep while a body's interval overlaps few others along the
+	// widest axis, else the grid
+	BroadPhaseMethod Choose(const Bodies& b) const
+	{
+		const size_t n = b.Count();
+		if (n < 2)
+			return BROAD_SWEEP;
+		double spread = 0.0;
+		for (int a = 0; a < 3; a++)
+		{
+			const std::vector<double>& p = Axis(b, a);
+			double lo = *std::min_element(p.begin(), p.end()), hi = *std::max_element(p.begin(), p.end());
+			spread = hi - lo > spread ? hi - lo : spread;
+		}
+		if (spread <= 0.0)
+			return BROAD_GRID;
+		double width = 0.0;
+		for (size_t i = 0; i < n; i++)
+			width += 2.0 * (b.radius[i] + Margin);
+		//expected overlaps along the axis if the bodies were spread evenly over it
+		return width / spread > BROAD_SWEEP_OVERLAPS ? BROAD_GRID : BROAD_SWEEP;
+	}
+
+private:
+	int axis; //the sweep's, the widest one when it last sorted from scratch
+	size_t sorted; //bodies order was built for
+	BroadPhaseMethod sortedFor; //which method order is for
+	double cellSize; //the grid's, kept while it fits so the order stays nearly sorted
+	std::vector<uint32_t> order; //bodies by sweep low end or grid cell key
+	std::vector<double> low; //sweep low end, in order
+	std::vector<uint64_t> keys; //grid cell key, in order
+	std::vector<double> px, py, pz, pr; //positions and radius + Margin, in order
+	std::vector<double> bodyLow; //sweep low end, per body
+	std::vector<uint64_t> bodyKey; //grid cell key, per body
+	std::vector<std::vector<BroadPair> > found; //per thread
+	std::vector<size_t> tests;
+
+	static const std::vector<double>& Axis(const Bodies& b, int a)
+	{
+		return a == 0 ? b.x : a == 1 ? b.y : b.z;
+	}
+
+	// Sorts order by sortKey[order[k]], from scratch when it isn't this method's order any more
+	// (or never was), else by insertion from last time's. sortKey is per body, not per slot.
+	template <typename Key>
+	void Order(std::vector<Key>& slotKey, const std::vector<Key>& sortKey, bool fresh)
+	{
+		const size_t n = order.size();
+		if (fresh)
+		{
+			for (size_t i = 0; i < n; i++)
+				order[i] = (uint32_t)i;
+			std::sort(order.begin(), order.end(), [&sortKey](uint32_t i, uint32_t j) { return sortKey[i] < sortKey[j]; });
+		}
+		for (size_t k = 0; k < n; k++)
+			slotKey[k] = sortKey[order[k]];
+		for (size_t k = 1; k < n; k++)
+		{
+			Key key = slotKey[k];
+			uint32_t body = order[k];
+			size_t m = k;
+			while (m > 0 && slotKey[m - 1] > key)
+			{
+				slotKey[m] = slotKey[m - 1];
+				order[m] = order[m - 1];
+				m--;
+			}
+			slotKey[m] = key;
+			order[m] = body;
+		}
+	}
+
+	void Gather(const Bodies& b)
+	{
+		const size_t n = b.Count();
+		px.resize(n); py.resize(n); pz.resize(n); pr.resize(n);
+		for (size_t k = 0; k < n; k++)
+		{
+			uint32_t i = order[k];
+			px[k] = b.x[i]; py[k] = b.y[i]; pz[k] = b.z[i];
+			pr[k] = b.radius[i] + Margin;
+		}
+	}
+
+	void Sweep(const Bodies& b, unsigned int threads)
+	{
+		const size_t n = b.Count();
+		bool fresh = sorted != n || sortedFor != BROAD_SWEEP;
+		if (fresh && n > 0)
+		{
+			double widest = -1.0;
+			for (int a = 0; a < 3; a++)
+			{
+				const std::vector<double>& p = Axis(b, a);
+				double lo = *std::min_element(p.begin(), p.end()), hi = *std::max_element(p.begin(), p.end());
+				if (hi - lo > widest)
+				{
+					widest = hi - lo;
+					axis = a;
+				}
+			}
+		}
+		sorted = n;
+		sortedFor = BROAD_SWEEP;
+		order.resize(n);
+		low.resize(n);
+		bodyLow.resize(n);
+		const std::vector<double>& p = Axis(b, axis);
+		for (size_t i = 0; i < n; i++)
+			bodyLow[i] = p[i] - b.radius[i] - Margin;
+		Order(low, bodyLow, fresh);
+		Gather(b);
+		const std::vector<double>& sweep = axis == 0 ? px : axis == 1 ? py : pz;
+		ParallelFor(n, threads, [this, &sweep, n](size_t begin, size_t end, unsigned int t)
+		{
+			std::vector<BroadPair>& out = found[t];
+			size_t count = 0;
+			for (size_t k = begin; k < end; k++)
+			{
+				const double high = sweep[k] + pr[k];
+				for (size_t m = k + 1; m < n && low[m] <= high; m++)
+				{
+					count++;
+					Test(k, m, out);
+				}
+			}
+			tests[t] = count;
+		});
+	}
+
+	static uint64_t CellKey(int64_t x, int64_t y, int64_t z)
+	{
+		const int64_t bias = (int64_t)1 << (BROAD_CELL_BITS - 1);
+		const uint64_t mask = ((uint64_t)1 << BROAD_CELL_BITS) - 1;
+		return ((uint64_t)(x + bias) & mask) | (((uint64_t)(y + bias) & mask) << BROAD_CELL_BITS) |
+			(((uint64_t)(z + bias) & mask) << (2 * BROAD_CELL_BITS));
+	}
+
+	void Grid(const Bodies& b, unsigned int threads)
+	{
+		const size_t n = b.Count();
+		double largest = 0.0;
+		for (size_t i = 0; i < n; i++)
+			largest = b.radius[i] > largest ? b.radius[i] : largest;
+		double wanted = 2.0 * (largest + Margin) > 0.0 ? 2.0 * (largest + Margin) : 1.0;
+		bool fresh = sorted != n || sortedFor != BROAD_GRID || wanted > cellSize || wanted < BROAD_CELL_SHRINK * cellSize;
+		if (fresh)
+			cellSize = wanted;
+		sorted = n;
+		sortedFor = BROAD_GRID;
+		const double inv = 1.0 / cellSize;
+		order.resize(n);
+		keys.resize(n);
+		bodyKey.resize(n);
+		for (size_t i = 0; i < n; i++)
+			bodyKey[i] = CellKey((int64_t)std::floor(b.x[i] * inv), (int64_t)std::floor(b.y[i] * inv), (int64_t)std::floor(b.z[i] * inv));
+		Order(keys, bodyKey, fresh);
+		Gather(b);
+
+		ParallelFor(n, threads, [this, n](size_t begin, size_t end, unsigned int t)
+		{
+			//the 13 later neighbours as runs of keys: (dy, dz) rows, x from first to last
+			static const int rows[5][4] = { { 1, 1, 0, 0 }, { -1, 1, 1, 0 }, { -1, 1, -1, 1 }, { -1, 1, 0, 1 }, { -1, 1, 1, 1 } };
+			int64_t first[5], last[5];
+			for (int r = 0; r < 5; r++)
+			{
+				first[r] = (int64_t)CellKey(rows[r][0], rows[r][2], rows[r][3]) - (int64_t)CellKey(0, 0, 0);
+				last[r] = (int64_t)CellKey(rows[r][1], rows[r][2], rows[r][3]) - (int64_t)CellKey(0, 0, 0);
+			}
+			std::vector<BroadPair>& out = found[t];
+			size_t count = 0;
+			//a cell belongs to the thread its first body falls to
+			size_t k = begin;
+			while (k > 0 && k < end && keys[k] == keys[k - 1])
+				k++;
+			size_t cursor[5];
+			for (int r = 0; r < 5; r++)
+				cursor[r] = k;
+			while (k < end)
+			{
+				const uint64_t key = keys[k];
+				size_t cellEnd = k + 1;
+				while (cellEnd < n && keys[cellEnd] == key)
+					cellEnd++;
+				for (size_t a = k; a < cellEnd; a++)
+					for (size_t c = a + 1; c < cellEnd; c++)
+					{
+						count++;
+						Test(a, c, out);
+					}
+				for (int r = 0; r < 5; r++)
+				{
+					const uint64_t lo = (uint64_t)((int64_t)key + first[r]), hi = (uint64_t)((int64_t)key + last[r]);
+					size_t& c = cursor[r];
+					while (c < n && keys[c] < lo)
+						c++;
+					for (size_t m = c; m < n && keys[m] <= hi; m++)
+						for (size_t a = k; a < cellEnd; a++)
+						{
+							count++;
+							Test(a, m, out);
+						}
+				}
+				k = cellEnd;
+			}
+			tests[t] = count;
+		});
+	}
+
+	// Slots k and m of the kept order
+	void Test(size_t k, size_t m, std::vector<BroadPair>& out) const
+	{
+		const double dx = px[m] - px[k], dy = py[m] - py[k], dz = pz[m] - pz[k];
+		const double reach = pr[k] + pr[m];
+		if (dx * dx + dy * dy + dz * dz < reach * reach)
+		{
+			uint32_t i = order[k], j = order[m];
+			BroadPair pair = { i < j ? i : j, i < j ? j : i };
+			out.push_back(pair);
+		}
+	}
+};
+#endif
@@ -0,0 +1,343 @@
+#ifndef CATALOG_IMPORTER_H
+#define CATALOG_IMPORTER_H
+
+#include "MappedFile.h"
+#include "AllocTracker.h"
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+// Default catalog values
+const size_t CATALOG_MIN_RECORD = 103; //everything up to and including the semi-major axis
+const double CATALOG_DEFAULT_SLOPE = 0.15; //G when the record leaves it blank
+
+// Osculating elements for a catalog of minor bodies, one array per element. Angles are in
+// degrees as the catalogs give them, epochs are Julian dates (TT).
+class OrbitalElements
+{
+public:
+	std::vector<double> a; //semi-major axis, AU
+	std::vector<double> e;
+	std::vector<double> i; //inclination
+	std::vector<double> node; //longitude of the ascending node
+	std::vector<double> peri; //argument of perihelion
+	std::vector<double> M; //mean anomaly at epoch
+	std::vector<double> n; //mean daily motion, degrees/day
+	std::vector<double> epoch;
+	std::vector<double> H; //absolute magnitude, NaN if the record has none
+	std::vector<double> G; //slope parameter
+	std::vector<char> designation; //packed designation, 8 chars per record, NUL padded
+
+	size_t Count() const
+	{
+		return a.size();
+	}
+
+	void Resize(size_t count)
+	{
+		a.resize(count); e.resize(count); i.resize(count); node.resize(count); peri.resize(count);
+		M.resize(count); n.resize(count); epoch.resize(count); H.resize(count); G.resize(count);
+		designation.resize(count * 8);
+	}
+
+	const char* Designation(size_t k) const
+	{
+		return &designation[k * 8];
+	}
+
+	// Heliocentric ecliptic position (AU) and velocity (AU/day) of record k at Julian date jd,
+	// two-body propagation from its epoch using the catalog's own mean motion
+	void StateAt(size_t k, double jd, double& x, double& y, double& z, double& vx, double& vy, double& vz) const
+	{
+		const double rad = 3.14159265358979323846 / 180.0;
+		const double ecc = e[k];
+		const double motion = n[k] * rad;
+		double mean = std::fmod((M[k] + n[k] * (jd - epoch[k])) * rad, 2.0 * 3.14159265358979323846);
+		//Kepler's equation by Newton, starting from M (or pi for very eccentric orbits)
+		double E = ecc < 0.8 ? mean : 3.14159265358979323846;
+		for (int iteration = 0; iteration < 30; iteration++)
+		{
+			double delta = (E - ecc * std::sin(E) - mean) / (1.0 - ecc * std::cos(E));
+			E -= delta;
+			if (std::fabs(delta) < 1e-14)
+				break;
+		}
+		const double cosE = std::cos(E), sinE = std::sin(E);
+		const double root = std::sqrt(1.0 - ecc * ecc);
+		//position and velocity in the orbital plane, perihelion along +x
+		const double px = a[k] * (cosE - ecc);
+		const double py = a[k] * root * sinE;
+		const double rate = motion / (1.0 - ecc * cosE); //dE/dt
+		const double pvx = -a[k] * sinE * rate;
+		const double pvy = a[k] * root * cosE * rate;
+		//rotate by argument of perihelion, inclination, node
+		const double cw = std::cos(peri[k] * rad), sw = std::sin(peri[k] * rad);
+		const double cn = std::cos(node[k] * rad), sn = std::sin(node[k] * rad);
+		const double ci = std::cos(i[k] * rad), si = std::sin(i[k] * rad);
+		const double xx = cw * cn - sw * sn * ci, xy = -sw * cn - cw * sn * ci;
+		const double yx = cw * sn + sw * cn * ci, yy = -sw * sn + cw * cn * ci;
+		const double zx = sw * si, zy = cw * si;
+		x = xx * px + xy * py; y = yx * px + yy * py; z = zx * px + zy * py;
+		vx = xx * pvx + xy * pvy; vy = yx * pvx + yy * pvy; vz = zx * pvx + zy * pvy;
+	}
+};
+
+// Reads MPC orbit format (MPCORB.DAT and friends: one fixed-width record per line) into
+// OrbitalElements. The file is mapped, cut into one piece per thread at line boundaries, and
+// every thread parses its lines straight into its own stretch of the element arrays. Numbers
+// are parsed by hand from the fixed columns: no locale, no strtod, no allocation per record.
+// Lines that aren't records (the MPCORB preamble, blank lines) are skipped and counted.
+class CatalogImporter
+{
+public:
+	size_t Skipped; //lines that didn't parse as a record
+	double Milliseconds; //wall time of the last Import
+
+	CatalogImporter() : Skipped(0), Milliseconds(0.0)
+	{
+	}
+
+	// threads = 0 uses every hardware thread
+	bool Import(const char* path, OrbitalElements& out, unsigned int threads = 0)
+	{
+		AllocScope scope(ALLOC_ASSETS);
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		out.Resize(0);
+		Skipped = 0;
+		MappedFile file;
+		if (!file.Open(path) || !file.Map())
+			return false;
+		file.AdviseSequential();
+		const char* data = (const char*)file.Data();
+		const size_t length = file.Length();
+		if (length == 0)
+			return true;
+
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+		//not worth a thread per core for a small file
+		if (length / threads < (1 << 20))
+			threads = (unsigned int)(length >> 20) + 1;
+
+		//cut points, each moved forward to just past a newline
+		std::vector<size_t> cuts(threads + 1);
+		cuts[0] = 0;
+		cuts[threads] = length;
+		for (unsigned int t = 1; t < threads; t++)
+		{
+			size_t cut = length / threads * t;
+			const char* newline = (const char*)memchr(data + cut, '\n', length - cut);
+			cuts[t] = newline ? (size_t)(newline - data) + 1 : length;
+			if (cuts[t] < cuts[t - 1])
+				cuts[t] = cuts[t - 1];
+		}
+
+		//count lines first so every thread knows where its records start
+		std::vector<size_t> firstRecord(threads + 1, 0);
+		std::vector<std::thread> workers;
+		for (unsigned int t = 0; t < threads; t++)
+			workers.push_back(std::thread([&, t]() { firstRecord[t + 1] = CountLines(data + cuts[t], data + cuts[t + 1]); }));
+		for (size_t w = 0; w < workers.size(); w++)
+			workers[w].join();
+		for (unsigned int t = 0; t < threads; t++)
+			firstRecord[t + 1] += firstRecord[t];
+		out.Resize(firstRecord[threads]);
+
+		std::vector<size_t> parsed(threads, 0);
+		workers.clear();
+		for (unsigned int t = 0; t < threads; t++)
+			workers.push_back(std::thread([&, t]() { parsed[t] = ParseRange(data + cuts[t], data + cuts[t + 1], out, firstRecord[t]); }));
+		for (size_t w = 0; w < workers.size(); w++)
+			workers[w].join();
+
+		//close the gaps left by skipped lines
+		size_t total = parsed[0];
+		for (unsigned int t = 1; t < threads; t++)
+		{
+			if (firstRecord[t] != total)
+				Move(out, firstRecord[t], total, parsed[t]);
+			total += parsed[t];
+		}
+		Skipped = firstRecord[threads] - total;
+		out.Resize(total);
+		Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		return true;
+	}
+
+	// Fixed-point number in [begin, end): optional spaces, sign, digits, optional fraction,
+	// spaces. Up to 18 digits are accepted. The digits are gathered exactly as an integer, but
+	// converting that to double and dividing by the power of ten round once each, so the result
+	// can be an ulp or two off strtod's (correctly rounded) one. That's far below the precision
+	// of any catalog-width field.
+	static bool ParseNumber(const char* begin, const char* end, double& out)
+	{
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+			1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+		const char* p = begin;
+		while (p < end && *p == ' ')
+			p++;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+		uint64_t mantissa = 0;
+		int digits = 0, fraction = 0;
+		bool point = false;
+		for (; p < end; p++)
+		{
+			char c = *p;
+			if (c >= '0' && c <= '9')
+			{
+				if (++digits > 18)
+					return false;
+				mantissa = mantissa * 10 + (uint64_t)(c - '0');
+				if (point)
+					fraction++;
+			}
+			else if (c == '.' && !point)
+				point = true;
+			else
+				break;
+		}
+		while (p < end && *p == ' ')
+			p++;
+		if (digits == 0 || p != end)
+			return false;
+		double value = (double)mantissa / powers[fraction];
+		out = negative ? -value : value;
+		return true;
+	}
+
+	// MPC packed date ("K194R" is 2019-04-27) to the Julian date of 0h TT that day
+	static bool UnpackEpoch(const char* packed, double& jd)
+	{
+		int century;
+		switch (packed[0])
+		{
+		case 'I': century = 1800; break;
+		case 'J': century = 1900; break;
+		case 'K': century = 2000; break;
+		case 'L': century = 2100; break;
+		default: return false;
+		}
+		if (packed[1] < '0' || packed[1] > '9' || packed[2] < '0' || packed[2] > '9')
+			return false;
+		int year = century + (packed[1] - '0') * 10 + (packed[2] - '0');
+		int month = PackedDigit(packed[3]);
+		int day = PackedDigit(packed[4]);
+		if (month < 1 || month > 12 || day < 1 || day > 31)
+			return false;
+		//Fliegel & Van Flandern, gives the day number at noon
+		int a = (14 - month) / 12;
+		int y = year + 4800 - a;
+		int m = month + 12 * a - 3;
+		long dayNumber = day + (153 * m + 2) / 5 + 365L * y + y / 4 - y / 100 + y / 400 - 32045;
+		jd = dayNumber - 0.5;
+		return true;
+	}
+
+	// Parses one line into slot k of out, false if it isn't a record
+	static bool ParseRecord(const char* line, size_t length, OrbitalElements& out, size_t k)
+	{
+		if (length < CATALOG_MIN_RECORD)
+			return false;
+		double h, g;
+		if (IsBlank(line + 8, line + 13))
+			h = std::numeric_limits<double>::quiet_NaN();
+		else if (!ParseNumber(line + 8, line + 13, h))
+			return false;
+		if (IsBlank(line + 14, line + 19))
+			g = CATALOG_DEFAULT_SLOPE;
+		else if (!ParseNumber(line + 14, line + 19, g))
+			return false;
+		//columns from the MPC's format description, 1-based inclusive ranges in the comments
+		if (!UnpackEpoch(line + 20, out.epoch[k]) || //21-25
+			!ParseNumber(line + 26, line + 35, out.M[k]) || //27-35
+			!ParseNumber(line + 37, line + 46, out.peri[k]) || //38-46
+			!ParseNumber(line + 48, line + 57, out.node[k]) || //49-57
+			!ParseNumber(line + 59, line + 68, out.i[k]) || //60-68
+			!ParseNumber(line + 70, line + 79, out.e[k]) || //71-79
+			!ParseNumber(line + 80, line + 91, out.n[k]) || //81-91
+			!ParseNumber(line + 92, line + 103, out.a[k])) //93-103
+			return false;
+		out.H[k] = h;
+		out.G[k] = g;
+		char* name = &out.designation[k * 8];
+		size_t used = 7;
+		while (used > 0 && line[used - 1] == ' ')
+			used--;
+		memcpy(name, line, used);
+		memset(name + used, 0, 8 - used);
+		return true;
+	}
+
+private:
+	static bool IsBlank(const char* begin, const char* end)
+	{
+		for (const char* p = begin; p < end; p++)
+			if (*p != ' ')
+				return false;
+		return true;
+	}
+
+	// 1-9 then A-V for 10-31
+	static int PackedDigit(char c)
+	{
+		if (c >= '1' && c <= '9')
+			return c - '0';
+		if (c >= 'A' && c <= 'V')
+			return c - 'A' + 10;
+		return 0;
+	}
+
+	static size_t CountLines(const char* begin, const char* end)
+	{
+		size_t lines = 0;
+		const char* p = begin;
+		while (p < end)
+		{
+			const char* newline = (const char*)memchr(p, '\n', end - p);
+			lines++;
+			if (!newline)
+				break;
+			p = newline + 1;
+		}
+		return lines;
+	}
+
+	// Parses every line in [begin, end) into out starting at slot first, returns how many were records
+	static size_t ParseRange(const char* begin, const char* end, OrbitalElements& out, size_t first)
+	{
+		size_t k = first;
+		const char* p = begin;
+		while (p < end)
+		{
+			const char* newline = (const char*)memchr(p, '\n', end - p);
+			const char* lineEnd = newline ? newline : end;
+			size_t length = lineEnd - p;
+			if (length > 0 && p[length - 1] == '\r')
+				length--;
+			if (ParseRecord(p, length, out, k))
+				k++;
+			if (!newline)
+				break;
+			p = newline + 1;
+		}
+		return k - first;
+	}
+
+	static void Move(OrbitalElements& out, size_t from, size_t to, size_t count)
+	{
+		std::vector<double>* columns[] = { &out.a, &out.e, &out.i, &out.node, &out.peri, &out.M, &out.n, &out.epoch, &out.H, &out.G };
+		for (int c = 0; c < 10; c++)
+			memmove(columns[c]->data() + to, columns[c]->data() + from, count * sizeof(double));
+		memmove(&out.designation[to * 8], &out.designation[from * 8], count * 8);
+	}
+};
+#endif
@@ -0,0 +1,685 @@
+#ifndef CHEBYSHEV_ARCHIVE_H
+#define CHEBYSHEV_ARCHIVE_H
+
+#include "Bodies.h"
+#include "MappedFile.h"
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+
+// Default archive values
+const char CHEBYSHEV_MAGIC[8] = { 'S', 'S', 'I', 'M', 'C', 'H', 'E', 'B' };
+const uint32_t CHEBYSHEV_VERSION = 2; //2 added the per body piece counts, 1 is still read
+const uint32_t CHEBYSHEV_HEADER_BYTES = 256;
+const int CHEBYSHEV_MAX_DEGREE = 16;
+const int CHEBYSHEV_MIN_DEGREE = 2;
+const size_t CHEBYSHEV_MAX_PIECES = 64; //most a body's segment is split into to meet the tolerance
+
+// File header. SegmentCount and IndexOffset are written on Close(); a reader handed a file
+// without them walks the segment headers instead.
+struct ChebyshevHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t HeaderBytes;
+	uint64_t BodyCount;
+	double StartTime;
+	double SegmentSeconds;
+	double Tolerance;
+	uint64_t SegmentCount;
+	uint64_t IndexOffset; //SegmentCount uint64 file offsets, one per segment
+};
+
+// Each segment: this, then a degree byte per body, a piece count byte per body (version 2 on), a
+// uint32 coefficient offset per body (each padded to 8 bytes), then per body and piece
+// 3 * (degree + 1) doubles, x then y then z. A body's pieces split the segment evenly.
+struct ChebyshevSegment
+{
+	double Start;
+	double Length; //the last segment can be short
+	uint32_t BodyCount;
+	uint32_t Reserved;
+	uint64_t Bytes; //whole segment including this header
+};
+
+// Fits every body's path to a Chebyshev series per fixed interval of simulated time and writes
+// the coefficients. Each body gets the lowest degree that stays inside Tolerance at every
+// sample; one the maximum degree can't fit has its segment split into pieces until it fits.
+// Anything still over once the pieces run short of samples is counted in ToleranceMisses, and
+// makes Close() return false.
+// Samples go in with Add() in time order; all bodies share the sample times, so the
+// least-squares system is factored once per segment and reused for every body.
+class ChebyshevWriter
+{
+public:
+	uint64_t Segments;
+	uint64_t Samples;
+	uint64_t BytesWritten;
+	uint64_t ToleranceMisses; //body segments no degree or split brought inside the tolerance
+	double MaxError; //worst fit error seen at any sample
+
+	ChebyshevWriter() : file(NULL), bodyCount(0), maxDegree(CHEBYSHEV_MAX_DEGREE), projected(NULL), projectedBody(0)
+	{
+		memset(&header, 0, sizeof(header));
+		Reset();
+	}
+
+	~ChebyshevWriter()
+	{
+		Close();
+	}
+
+	bool Open(const char* path, size_t bodies, double startTime, double segmentSeconds, double tolerance,
+		int degreeLimit = CHEBYSHEV_MAX_DEGREE)
+	{
+		Close();
+		if (bodies == 0 || segmentSeconds <= 0.0 || tolerance <= 0.0)
+			return false;
+		file = fopen(path, "wb");
+		if (!file)
+			return false;
+		bodyCount = bodies;
+		maxDegree = degreeLimit < CHEBYSHEV_MIN_DEGREE ? CHEBYSHEV_MIN_DEGREE : degreeLimit;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.Magic, CHEBYSHEV_MAGIC, 8);
+		header.Version = CHEBYSHEV_VERSION;
+		header.HeaderBytes = CHEBYSHEV_HEADER_BYTES;
+		header.BodyCount = bodies;
+		header.StartTime = startTime;
+		header.SegmentSeconds = segmentSeconds;
+		header.Tolerance = tolerance;
+		Reset();
+		segmentStart = startTime;
+		times.clear();
+		positions.clear();
+		offsets.clear();
+		return WriteHeader();
+	}
+
+	bool IsOpen() const
+	{
+		return file != NULL;
+	}
+
+	// Positions of the first BodyCount bodies at time, in time order. Crossing a segment
+	// boundary fits and writes the finished segment; the samples either side of the boundary
+	// are used by both segments so neither has to extrapolate far.
+	bool Add(double time, const Bodies& b)
+	{
+		if (!file || b.Count() < bodyCount || time < segmentStart || (!times.empty() && time < times.back()))
+			return false;
+		if (times.empty() || times.back() != time)
+			Append(time, b);
+		while (time >= segmentStart + header.SegmentSeconds)
+		{
+			if (!Flush(header.SegmentSeconds))
+				return false;
+			segmentStart = header.StartTime + Segments * header.SegmentSeconds;
+		}
+		Samples++;
+		return true;
+	}
+
+	// Writes whatever is buffered as a short final segment, then the index and header. False if
+	// writing failed or any body segment missed the tolerance.
+	bool Close()
+	{
+		if (!file)
+			return true;
+		bool ok = true;
+		if (times.size() > 1 && times.back() > segmentStart)
+			ok = Flush(times.back() - segmentStart);
+		header.SegmentCount = offsets.size();
+		header.IndexOffset = BytesWritten;
+		if (ok && !offsets.empty())
+			ok = fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+		if (ok)
+			ok = fseek(file, 0, SEEK_SET) == 0 && WriteHeader();
+		ok = fclose(file) == 0 && ok;
+		file = NULL;
+		//the file is complete, but positions in it are further out than it says they are
+		if (ToleranceMisses > 0)
+		{
+			std::cout << "ERROR::CHEBYSHEV " << ToleranceMisses << " body segment(s) over the " << header.Tolerance
+				<< " tolerance (max error " << MaxError << "), try shorter segments or a higher degree" << std::endl;
+			ok = false;
+		}
+		return ok;
+	}
+
+	// What the same samples would take as raw double positions and velocities
+	uint64_t RawBytes() const
+	{
+		return Samples * bodyCount * 6 * sizeof(double);
+	}
+
+private:
+	// Least-squares system for one run of samples: basis A[s][j] = T_j(tau_s) over [Start,
+	// Start + Length], factored A = QR by modified Gram-Schmidt
+	struct ChebyshevFit
+	{
+		size_t First, Count, Columns;
+		double Start, Length;
+		std::vector<double> Basis, Q, R;
+	};
+
+	FILE* file;
+	ChebyshevHeader header;
+	size_t bodyCount;
+	int maxDegree;
+	double segmentStart;
+	std::vector<double> times;
+	std::vector<double> positions; //sample-major, x y z per body
+	std::vector<uint64_t> offsets; //file offset of every segment written
+	//per segment scratch, sized once
+	std::vector<std::vector<ChebyshevFit> > levels; //the whole segment, then split in 2, 4...
+	std::vector<double> projections, sumSquares, coefficients;
+	const ChebyshevFit* projected; //whose projections are in projections, and for which body
+	size_t projectedBody;
+	std::vector<unsigned char> degrees, pieces;
+	std::vector<uint32_t> starts;
+	std::vector<double> output;
+
+	void Reset()
+	{
+		Segments = Samples = BytesWritten = ToleranceMisses = 0;
+		MaxError = 0.0;
+		segmentStart = 0.0;
+	}
+
+	void Append(double time, const Bodies& b)
+	{
+		times.push_back(time);
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			positions.push_back(b.x[i]);
+			positions.push_back(b.y[i]);
+			positions.push_back(b.z[i]);
+		}
+	}
+
+	bool WriteHeader()
+	{
+		unsigned char block[CHEBYSHEV_HEADER_BYTES];
+		memset(block, 0, sizeof(block));
+		memcpy(block, &header, sizeof(header));
+		bool ok = fwrite(block, 1, sizeof(block), file) == sizeof(block);
+		if (BytesWritten == 0)
+			BytesWritten = sizeof(block);
+		return ok;
+	}
+
+	void Factor(ChebyshevFit& fit, size_t first, size_t count, double start, double length)
+	{
+		int degreeCap = (int)count - 1 < maxDegree ? (int)count - 1 : maxDegree;
+		if (degreeCap < 0)
+			degreeCap = 0;
+		const size_t columns = degreeCap + 1;
+		fit.First = first;
+		fit.Count = count;
+		fit.Columns = columns;
+		fit.Start = start;
+		fit.Length = length;
+		projected = NULL;
+		fit.Basis.resize(count * columns);
+		for (size_t s = 0; s < count; s++)
+		{
+			double tau = length > 0.0 ? 2.0 * (times[first + s] - start) / length - 1.0 : 0.0;
+			double* row = &fit.Basis[s * columns];
+			row[0] = 1.0;
+			if (columns > 1)
+				row[1] = tau;
+			for (size_t j = 2; j < columns; j++)
+				row[j] = 2.0 * tau * row[j - 1] - row[j - 2];
+		}
+		std::vector<double>& q = fit.Q;
+		std::vector<double>& r = fit.R;
+		q = fit.Basis;
+		r.assign(columns * columns, 0.0);
+		for (size_t j = 0; j < columns; j++)
+		{
+			for (size_t k = 0; k < j; k++)
+			{
+				double dot = 0.0;
+				for (size_t s = 0; s < count; s++)
+					dot += q[s * columns + k] * q[s * columns + j];
+				r[k * columns + j] = dot;
+				for (size_t s = 0; s < count; s++)
+					q[s * columns + j] -= dot * q[s * columns + k];
+			}
+			double norm = 0.0;
+			for (size_t s = 0; s < count; s++)
+				norm += q[s * columns + j] * q[s * columns + j];
+			norm = std::sqrt(norm);
+			r[j * columns + j] = norm;
+			for (size_t s = 0; s < count; s++)
+				q[s * columns + j] = norm > 0.0 ? q[s * columns + j] / norm : 0.0;
+		}
+	}
+
+	// Lowest degree (from minDegree up) that fits body inside tolerance on fit's samples, or
+	// the highest there is. Leaves the coefficients in coefficients and returns the max error.
+	double FitBody(const ChebyshevFit& fit, size_t body, int minDegree, int& degree)
+	{
+		const size_t m = fit.Count, columns = fit.Columns;
+		const int degreeCap = (int)columns - 1;
+		const double tolerance = header.Tolerance;
+		//Q^T y for each axis, and |y|^2 for the cheap residual bound
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double yy = 0.0;
+			for (size_t s = 0; s < m; s++)
+			{
+				double y = positions[(fit.First + s) * bodyCount * 3 + body * 3 + axis];
+				yy += y * y;
+			}
+			sumSquares[axis] = yy;
+			for (size_t j = 0; j < columns; j++)
+			{
+				double dot = 0.0;
+				for (size_t s = 0; s < m; s++)
+					dot += fit.Q[s * columns + j] * positions[(fit.First + s) * bodyCount * 3 + body * 3 + axis];
+				projections[axis * columns + j] = dot;
+			}
+		}
+		projected = &fit;
+		projectedBody = body;
+
+		degree = degreeCap < minDegree ? degreeCap : minDegree;
+		double error = 0.0;
+		for (;; degree++)
+		{
+			//the RMS residual can't exceed the max error, so only check properly once it's small
+			bool candidate = degree == degreeCap;
+			if (!candidate)
+			{
+				candidate = true;
+				for (int axis = 0; axis < 3 && candidate; axis++)
+				{
+					double explained = 0.0;
+					for (int j = 0; j <= degree; j++)
+						explained += projections[axis * columns + j] * projections[axis * columns + j];
+					double residual = sumSquares[axis] - explained;
+					//(or once the subtraction is down to rounding noise)
+					candidate = residual <= tolerance * tolerance * m || residual <= 1e-12 * sumSquares[axis];
+				}
+			}
+			if (!candidate)
+				continue;
+			error = Solve(fit, degree, body);
+			if (error <= tolerance || degree >= degreeCap)
+				break;
+		}
+		return error;
+	}
+
+	// Fits the buffered samples over [segmentStart, segmentStart + length] and writes them.
+	// A body no degree fits over the whole segment (a close encounter, usually) is split into
+	// 2, 4, 8... equal pieces with a series each, until they fit or run short of samples.
+	bool Flush(double length)
+	{
+		const size_t m = times.size();
+		if (m == 0)
+			return true;
+		if (levels.empty())
+			levels.resize(1);
+		levels[0].resize(1);
+		Factor(levels[0][0], 0, m, segmentStart, length);
+		//finer splits are only factored when some body needs them
+		size_t factored = 1;
+		bool exhausted = false;
+
+		const double tolerance = header.Tolerance;
+		degrees.resize(bodyCount);
+		pieces.resize(bodyCount);
+		starts.resize(bodyCount);
+		output.clear();
+		projections.resize(3 * (maxDegree + 1));
+		sumSquares.resize(3);
+		coefficients.resize(3 * (maxDegree + 1));
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			int degree = 0;
+			double error = FitBody(levels[0][0], i, CHEBYSHEV_MIN_DEGREE, degree);
+			size_t level = 0;
+			while (error > tolerance && (size_t)2 << level <= CHEBYSHEV_MAX_PIECES)
+			{
+				if (level + 1 >= factored)
+				{
+					if (exhausted || !FactorPieces(level + 1, length))
+					{
+						exhausted = true;
+						break;
+					}
+					factored = level + 2;
+				}
+				level++;
+				//one degree for every piece keeps them the same size: the highest any piece needs
+				degree = CHEBYSHEV_MIN_DEGREE;
+				for (size_t k = 0; k < levels[level].size(); k++)
+				{
+					int needed = 0;
+					FitBody(levels[level][k], i, degree, needed);
+					if (needed > degree)
+						degree = needed;
+				}
+				error = 0.0;
+				for (size_t k = 0; k < levels[level].size(); k++)
+				{
+					const ChebyshevFit& fit = levels[level][k];
+					int used = degree < (int)fit.Columns - 1 ? degree : (int)fit.Columns - 1;
+					double e = Solve(fit, used, i);
+					if (e > error)
+						error = e;
+				}
+			}
+			if (error > tolerance)
+				ToleranceMisses++;
+			if (error > MaxError)
+				MaxError = error;
+			degrees[i] = (unsigned char)degree;
+			pieces[i] = (unsigned char)levels[level].size();
+			starts[i] = (uint32_t)output.size();
+			for (size_t k = 0; k < levels[level].size(); k++)
+			{
+				const ChebyshevFit& fit = levels[level][k];
+				if (level > 0)
+					Solve(fit, degree < (int)fit.Columns - 1 ? degree : (int)fit.Columns - 1, i);
+				//a piece too short for the degree is padded with zero coefficients
+				for (int axis = 0; axis < 3; axis++)
+					for (int j = 0; j <= degree; j++)
+						output.push_back(j < (int)fit.Columns ? coefficients[axis * fit.Columns + j] : 0.0);
+			}
+		}
+
+		ChebyshevSegment segment;
+		segment.Start = segmentStart;
+		segment.Length = length;
+		segment.BodyCount = (uint32_t)bodyCount;
+		segment.Reserved = 0;
+		size_t byteArray = Pad(bodyCount);
+		size_t startBytes = Pad(bodyCount * sizeof(uint32_t));
+		segment.Bytes = sizeof(segment) + 2 * byteArray + startBytes + output.size() * sizeof(double);
+		static const unsigned char padding[8] = { 0 };
+		bool ok = fwrite(&segment, sizeof(segment), 1, file) == 1 &&
+			fwrite(degrees.data(), 1, bodyCount, file) == bodyCount &&
+			fwrite(padding, 1, byteArray - bodyCount, file) == byteArray - bodyCount &&
+			fwrite(pieces.data(), 1, bodyCount, file) == bodyCount &&
+			fwrite(padding, 1, byteArray - bodyCount, file) == byteArray - bodyCount &&
+			fwrite(starts.data(), sizeof(uint32_t), bodyCount, file) == bodyCount &&
+			fwrite(padding, 1, startBytes - bodyCount * sizeof(uint32_t), file) == startBytes - bodyCount * sizeof(uint32_t) &&
+			fwrite(output.data(), sizeof(double), output.size(), file) == output.size();
+		offsets.push_back(BytesWritten);
+		BytesWritten += segment.Bytes;
+		Segments++;
+
+		//the last sample before the boundary and the first past it start the next segment, so the
+		//final segment always has two samples to go on, however soon after a boundary it ends
+		const size_t keep = m < 2 ? m : 2;
+		times.erase(times.begin(), times.end() - keep);
+		positions.erase(positions.begin(), positions.end() - keep * bodyCount * 3);
+		return ok;
+	}
+
+	// Factors the segment split into 2^level equal pieces, each taking the samples on its
+	// span (a sample on a boundary goes to both). False if a piece would have too few samples
+	// to be worth fitting.
+	bool FactorPieces(size_t level, double length)
+	{
+		const size_t count = (size_t)1 << level;
+		if (levels.size() <= level)
+			levels.resize(level + 1);
+		levels[level].resize(count);
+		const double width = length / count, slack = 1e-9 * width;
+		size_t first = 0;
+		for (size_t k = 0; k < count; k++)
+		{
+			const double start = segmentStart + k * width, end = start + width;
+			while (first < times.size() && times[first] < start - slack)
+				first++;
+			size_t last = first;
+			while (last < times.size() && times[last] <= end + slack)
+				last++;
+			if (last - first < (size_t)CHEBYSHEV_MIN_DEGREE + 2)
+				return false;
+			Factor(levels[level][k], first, last - first, start, width);
+		}
+		return true;
+	}
+
+	// Back-substitutes R c = Q^T y for degree (using the projections FitBody left for body) and
+	// returns the max error over fit's samples
+	double Solve(const ChebyshevFit& fit, int degree, size_t body)
+	{
+		const size_t columns = fit.Columns;
+		//projections belong to whichever fit FitBody ran last, redo them if that wasn't this one
+		if (&fit != projected || body != projectedBody)
+		{
+			for (int axis = 0; axis < 3; axis++)
+				for (size_t j = 0; j < columns; j++)
+				{
+					double dot = 0.0;
+					for (size_t s = 0; s < fit.Count; s++)
+						dot += fit.Q[s * columns + j] * positions[(fit.First + s) * bodyCount * 3 + body * 3 + axis];
+					projections[axis * columns + j] = dot;
+				}
+			projected = &fit;
+			projectedBody = body;
+		}
+		double worst = 0.0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double* c = &coefficients[axis * columns];
+			for (int j = degree; j >= 0; j--)
+			{
+				double sum = projections[axis * columns + j];
+				for (int k = j + 1; k <= degree; k++)
+					sum -= fit.R[j * columns + k] * c[k];
+				double diagonal = fit.R[j * columns + j];
+				c[j] = diagonal != 0.0 ? sum / diagonal : 0.0;
+			}
+			for (int j = degree + 1; j < (int)columns; j++)
+				c[j] = 0.0;
+			for (size_t s = 0; s < fit.Count; s++)
+			{
+				const double* row = &fit.Basis[s * columns];
+				double value = 0.0;
+				for (int j = 0; j <= degree; j++)
+					value += row[j] * c[j];
+				double error = std::fabs(value - positions[(fit.First + s) * bodyCount * 3 + body * 3 + axis]);
+				if (error > worst)
+					worst = error;
+			}
+		}
+		return worst;
+	}
+
+	static size_t Pad(size_t bytes)
+	{
+		return (bytes + 7) / 8 * 8;
+	}
+
+	ChebyshevWriter(const ChebyshevWriter&);
+	ChebyshevWriter& operator=(const ChebyshevWriter&);
+};
+
+// Evaluates an archive written by ChebyshevWriter. Only the segment being evaluated is mapped,
+// so memory use doesn't depend on how long the archive is.
+class ChebyshevReader
+{
+public:
+	ChebyshevReader() : current(UINT64_MAX), segmentCount(0)
+	{
+		memset(&header, 0, sizeof(header));
+	}
+
+	bool Open(const char* path)
+	{
+		Close();
+		if (!file.Open(path) || !file.Map(0, CHEBYSHEV_HEADER_BYTES) || file.Length() < sizeof(ChebyshevHeader))
+			return Fail(path, "can't open/map file");
+		memcpy(&header, file.Data(), sizeof(header));
+		if (memcmp(header.Magic, CHEBYSHEV_MAGIC, 8) != 0)
+			return Fail(path, "not a Chebyshev archive");
+		if (header.Version < 1 || header.Version > CHEBYSHEV_VERSION || header.HeaderBytes != CHEBYSHEV_HEADER_BYTES || header.SegmentSeconds <= 0.0)
+			return Fail(path, "unsupported archive version");
+		if (header.SegmentCount > 0 && header.IndexOffset + header.SegmentCount * sizeof(uint64_t) <= file.FileSize() &&
+			index.Open(path) && index.Map(header.IndexOffset, (size_t)(header.SegmentCount * sizeof(uint64_t))))
+			segmentCount = header.SegmentCount;
+		else
+		{
+			//unfinished archive, find the segments by walking their headers
+			uint64_t offset = CHEBYSHEV_HEADER_BYTES;
+			while (offset + sizeof(ChebyshevSegment) <= file.FileSize() && file.Map(offset, sizeof(ChebyshevSegment)))
+			{
+				const ChebyshevSegment* s = (const ChebyshevSegment*)file.Data();
+				if (s->Bytes < sizeof(ChebyshevSegment) || offset + s->Bytes > file.FileSize())
+					break;
+				walked.push_back(offset);
+				offset += s->Bytes;
+			}
+			segmentCount = walked.size();
+		}
+		if (segmentCount == 0)
+			return Fail(path, "no segments");
+		current = UINT64_MAX;
+		return true;
+	}
+
+	void Close()
+	{
+		file.Close();
+		index.Close();
+		walked.clear();
+		segmentCount = 0;
+		current = UINT64_MAX;
+	}
+
+	bool IsOpen() const
+	{
+		return segmentCount > 0;
+	}
+
+	const ChebyshevHeader& Header() const
+	{
+		return header;
+	}
+
+	uint64_t SegmentCount() const
+	{
+		return segmentCount;
+	}
+
+	double StartTime() const
+	{
+		return header.StartTime;
+	}
+
+	double EndTime()
+	{
+		if (!Load(segmentCount - 1))
+			return header.StartTime;
+		const ChebyshevSegment* s = (const ChebyshevSegment*)file.Data();
+		return s->Start + s->Length;
+	}
+
+	// Position (and velocity, if asked for) of body at time, clamped to the archive's span
+	bool Evaluate(size_t body, double time, double position[3], double* velocity = NULL)
+	{
+		if (!IsOpen() || body >= header.BodyCount)
+			return false;
+		double offset = (time - header.StartTime) / header.SegmentSeconds;
+		uint64_t k = offset <= 0.0 ? 0 : (uint64_t)offset;
+		if (k >= segmentCount)
+			k = segmentCount - 1;
+		if (!Load(k))
+			return false;
+		const unsigned char* data = file.Data();
+		const ChebyshevSegment* s = (const ChebyshevSegment*)data;
+		const size_t n = s->BodyCount;
+		const unsigned char* degrees = data + sizeof(ChebyshevSegment);
+		//version 1 has no piece counts, every body is one piece
+		const unsigned char* pieces = header.Version >= 2 ? degrees + (n + 7) / 8 * 8 : NULL;
+		const uint32_t* starts = (const uint32_t*)(degrees + (n + 7) / 8 * 8 * (pieces ? 2 : 1));
+		const double* coefficients = (const double*)((const unsigned char*)starts + (n * sizeof(uint32_t) + 7) / 8 * 8);
+		const int degree = degrees[body];
+		const int count = pieces && pieces[body] > 0 ? pieces[body] : 1;
+
+		double u = s->Length > 0.0 ? (time - s->Start) / s->Length * count : 0.0;
+		if (u < 0.0)
+			u = 0.0;
+		if (u > count)
+			u = count;
+		int piece = (int)u < count ? (int)u : count - 1;
+		const double* c = coefficients + starts[body] + (size_t)piece * 3 * (degree + 1);
+		const double tau = 2.0 * (u - piece) - 1.0;
+		const double scale = s->Length > 0.0 ? 2.0 * count / s->Length : 0.0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const double* a = c + axis * (degree + 1);
+			//T_j and T'_j by their recurrences
+			double t0 = 1.0, t1 = tau, d0 = 0.0, d1 = 1.0;
+			double value = a[0], slope = 0.0;
+			if (degree >= 1)
+			{
+				value += a[1] * t1;
+				slope += a[1] * d1;
+			}
+			for (int j = 2; j <= degree; j++)
+			{
+				double t2 = 2.0 * tau * t1 - t0;
+				double d2 = 2.0 * t1 + 2.0 * tau * d1 - d0;
+				value += a[j] * t2;
+				slope += a[j] * d2;
+				t0 = t1; t1 = t2;
+				d0 = d1; d1 = d2;
+			}
+			position[axis] = value;
+			if (velocity)
+				velocity[axis] = slope * scale;
+		}
+		return true;
+	}
+
+private:
+	MappedFile file; //the current segment
+	MappedFile index;
+	std::vector<uint64_t> walked; //segment offsets for archives without an index
+	ChebyshevHeader header;
+	uint64_t current;
+	uint64_t segmentCount;
+
+	uint64_t SegmentOffset(uint64_t k) const
+	{
+		return walked.empty() ? ((const uint64_t*)index.Data())[k] : walked[(size_t)k];
+	}
+
+	bool Load(uint64_t k)
+	{
+		if (k == current)
+			return true;
+		uint64_t offset = SegmentOffset(k);
+		if (!file.Map(offset, sizeof(ChebyshevSegment)))
+			return false;
+		uint64_t bytes = ((const ChebyshevSegment*)file.Data())->Bytes;
+		if (!file.Map(offset, (size_t)bytes))
+		{
+			current = UINT64_MAX;
+			return false;
+		}
+		current = k;
+		return true;
+	}
+
+	bool Fail(const char* path, const char* why)
+	{
+		std::cout << "ERROR::CHEBYSHEV " << path << ": " << why << std::endl;
+		Close();
+		return false;
+	}
+};
+#endif
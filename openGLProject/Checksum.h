@@ -0,0 +1,104 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// 64-bit xxHash (XXH64). Chews through four 8-byte lanes at a time, so checksumming a
+// multi-GB checkpoint runs at memory speed instead of being the slow part of a save/load.
+// Chain calls through seed to hash several buffers as one: h = Hash64(b, n, Hash64(a, m)).
+class Checksum
+{
+public:
+	static uint64_t Hash64(const void* input, size_t length, uint64_t seed = 0)
+	{
+		const unsigned char* p = (const unsigned char*)input;
+		const unsigned char* end = p + length;
+		uint64_t h;
+		if (length >= 32)
+		{
+			const unsigned char* limit = end - 32;
+			uint64_t v1 = seed + PRIME1 + PRIME2;
+			uint64_t v2 = seed + PRIME2;
+			uint64_t v3 = seed;
+			uint64_t v4 = seed - PRIME1;
+			do
+			{
+				v1 = Round(v1, Read64(p)); p += 8;
+				v2 = Round(v2, Read64(p)); p += 8;
+				v3 = Round(v3, Read64(p)); p += 8;
+				v4 = Round(v4, Read64(p)); p += 8;
+			} while (p <= limit);
+			h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+			h = MergeRound(h, v1);
+			h = MergeRound(h, v2);
+			h = MergeRound(h, v3);
+			h = MergeRound(h, v4);
+		}
+		else
+		{
+			h = seed + PRIME5;
+		}
+		h += (uint64_t)length;
+		while (p + 8 <= end)
+		{
+			h ^= Round(0, Read64(p));
+			h = Rotl(h, 27) * PRIME1 + PRIME4;
+			p += 8;
+		}
+		if (p + 4 <= end)
+		{
+			uint32_t k;
+			memcpy(&k, p, 4);
+			h ^= (uint64_t)k * PRIME1;
+			h = Rotl(h, 23) * PRIME2 + PRIME3;
+			p += 4;
+		}
+		while (p < end)
+		{
+			h ^= (*p) * PRIME5;
+			h = Rotl(h, 11) * PRIME1;
+			p++;
+		}
+		h ^= h >> 33;
+		h *= PRIME2;
+		h ^= h >> 29;
+		h *= PRIME3;
+		h ^= h >> 32;
+		return h;
+	}
+
+private:
+	static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+	static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+	static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+	static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+	static const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+	static uint64_t Rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	static uint64_t Read64(const unsigned char* p)
+	{
+		uint64_t v;
+		memcpy(&v, p, 8);
+		return v;
+	}
+
+	static uint64_t Round(uint64_t acc, uint64_t input)
+	{
+		acc += input * PRIME2;
+		acc = Rotl(acc, 31);
+		return acc * PRIME1;
+	}
+
+	static uint64_t MergeRound(uint64_t acc, uint64_t val)
+	{
+		acc ^= Round(0, val);
+		return acc * PRIME1 + PRIME4;
+	}
+};
+#endif
@@ -0,0 +1,116 @@
+#ifndef CONSERVATION_MONITOR_H
+#define CONSERVATION_MONITOR_H
+
+#include "Simulation.h"
+
+#include <cstdio>
+#include <cmath>
+
+// Default monitor values
+const double CONSERVATION_LOG_INTERVAL = 1.0; //simulated seconds between log lines
+
+// Tracks how far the simulation's invariants have wandered from where they started.
+// It only reads Simulation::Conserved(), one pass over the bodies per frame whatever the
+// number of steps, plus a handful of subtractions.
+class ConservationMonitor
+{
+public:
+	Invariants Initial;
+	// relative drifts since Reset
+	double EnergyDrift;
+	double MomentumDrift;
+	double AngularMomentumDrift;
+	// worst |EnergyDrift| seen so far
+	double MaxEnergyDrift;
+	double LogInterval;
+
+	ConservationMonitor() : EnergyDrift(0.0), MomentumDrift(0.0), AngularMomentumDrift(0.0), MaxEnergyDrift(0.0),
+		LogInterval(CONSERVATION_LOG_INTERVAL), log(NULL), lastLogTime(0.0), started(false),
+		energyScale(0.0), momentumScale(0.0), angularMomentumScale(0.0)
+	{
+		Initial = Invariants();
+	}
+
+	~ConservationMonitor()
+	{
+		CloseLog();
+	}
+
+	// Starts writing CSV lines to path, returns false if the file can't be opened
+	bool OpenLog(const char* path)
+	{
+		CloseLog();
+		log = fopen(path, "w");
+		if (!log)
+			return false;
+		fprintf(log, "time,energy,kinetic,potential,energy_drift,momentum_drift,angular_momentum_drift\n");
+		return true;
+	}
+
+	void CloseLog()
+	{
+		if (log)
+			fclose(log);
+		log = NULL;
+	}
+
+	// Takes the current invariants as the reference point
+	void Reset(const Invariants& now, double time)
+	{
+		Initial = now;
+		//reciprocals of the reference scales, so a frame's update multiplies rather than divides
+		const double e0 = std::fabs(now.Energy());
+		energyScale = e0 != 0.0 ? 1.0 / e0 : 0.0;
+		momentumScale = now.MomentumScale > 0.0 ? 1.0 / now.MomentumScale : 0.0;
+		angularMomentumScale = now.AngularMomentumScale > 0.0 ? 1.0 / now.AngularMomentumScale : 0.0;
+		EnergyDrift = MomentumDrift = AngularMomentumDrift = MaxEnergyDrift = 0.0;
+		lastLogTime = time;
+		started = true;
+		WriteLine(now, time);
+	}
+
+	// Call after the simulation has stepped
+	void Update(const Invariants& now, double time)
+	{
+		if (!started)
+		{
+			Reset(now, time);
+			return;
+		}
+		EnergyDrift = (now.Energy() - Initial.Energy()) * energyScale;
+		double dpx = now.Px - Initial.Px, dpy = now.Py - Initial.Py, dpz = now.Pz - Initial.Pz;
+		MomentumDrift = std::sqrt(dpx * dpx + dpy * dpy + dpz * dpz) * momentumScale;
+		double dlx = now.Lx - Initial.Lx, dly = now.Ly - Initial.Ly, dlz = now.Lz - Initial.Lz;
+		AngularMomentumDrift = std::sqrt(dlx * dlx + dly * dly + dlz * dlz) * angularMomentumScale;
+		if (std::fabs(EnergyDrift) > MaxEnergyDrift)
+			MaxEnergyDrift = std::fabs(EnergyDrift);
+
+		if (time - lastLogTime >= LogInterval)
+		{
+			lastLogTime = time;
+			WriteLine(now, time);
+		}
+	}
+
+	// Short summary for the window title, e.g. "dE: -1.2e-07 dP: 3.0e-16 dL: 4.1e-15"
+	void Format(char* buffer, size_t size) const
+	{
+		snprintf(buffer, size, "dE: %+.1e (max %.1e) dP: %.1e dL: %.1e", EnergyDrift, MaxEnergyDrift, MomentumDrift, AngularMomentumDrift);
+	}
+
+private:
+	FILE* log;
+	double lastLogTime;
+	bool started;
+	double energyScale, momentumScale, angularMomentumScale; //1 / the reference scales, 0 when there's nothing to scale by
+
+	void WriteLine(const Invariants& now, double time)
+	{
+		if (!log)
+			return;
+		fprintf(log, "%.6f,%.12e,%.12e,%.12e,%.6e,%.6e,%.6e\n", time, now.Energy(), now.Kinetic, now.Potential,
+			EnergyDrift, MomentumDrift, AngularMomentumDrift);
+		fflush(log);
+	}
+};
+#endif
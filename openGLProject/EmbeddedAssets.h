@@ -0,0 +1,108 @@
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include "AssetPack.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Assets compiled into the executable. Building with EmbedAssets=true (msbuild
+// /p:EmbedAssets=true) runs embed_assets.ps1 before compiling, which turns every file listed
+// in assets.manifest into a constexpr byte array in $(IntDir)EmbeddedAssetData.h and defines
+// EMBED_ASSETS. Without it this header compiles to an empty table and Find() finds nothing.
+//
+// The generated data checks itself while it compiles: shaders must start with #version,
+// images must carry a JPEG/PNG signature, and anything small enough has its contents hashed by
+// the compiler against the hash the generator wrote down. Larger files are hashed by Verify().
+
+// Multiplier of the polynomial content hash, h = sum data[k] * P^(n-1-k) mod 2^64
+constexpr uint64_t EMBED_HASH_PRIME = 0x100000001B3ULL;
+// Files up to this size are hashed at compile time, bigger ones would blow the constexpr budget
+const size_t EMBED_COMPILE_TIME_HASH_LIMIT = 16 * 1024;
+
+// C++11-style constexpr (one return statement) so VS2015 accepts them
+constexpr uint64_t EmbedPow(uint64_t base, size_t exponent)
+{
+	return exponent == 0 ? 1 : (exponent % 2 ? base : 1) * EmbedPow(base * base, exponent / 2);
+}
+
+// Hash of data[begin, end), split in halves so recursion stays log(n) deep
+constexpr uint64_t EmbedHash(const unsigned char* data, size_t begin, size_t end)
+{
+	return end - begin == 0 ? 0 : end - begin == 1 ? data[begin] :
+		EmbedHash(data, begin, begin + (end - begin) / 2) * EmbedPow(EMBED_HASH_PRIME, end - begin - (end - begin) / 2) +
+		EmbedHash(data, begin + (end - begin) / 2, end);
+}
+
+constexpr bool EmbedStartsWith(const unsigned char* data, size_t size, const char* prefix, size_t k = 0)
+{
+	return prefix[k] == '\0' || (k < size && data[k] == (unsigned char)prefix[k] && EmbedStartsWith(data, size, prefix, k + 1));
+}
+
+// Same hash at run time
+inline uint64_t EmbedHashRuntime(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 0;
+	for (size_t k = 0; k < size; k++)
+		hash = hash * EMBED_HASH_PRIME + data[k];
+	return hash;
+}
+
+struct EmbeddedAsset
+{
+	const char* Name; //normalised like AssetPack names
+	const unsigned char* Data;
+	size_t Size;
+	uint64_t Hash;
+};
+
+#ifdef EMBED_ASSETS
+#include "EmbeddedAssetData.h" //generated, defines embeddedAssets[] and embeddedAssetCount
+#else
+const EmbeddedAsset* const embeddedAssets = NULL;
+const size_t embeddedAssetCount = 0;
+#endif
+
+class EmbeddedAssets
+{
+public:
+	static size_t Count()
+	{
+		return embeddedAssetCount;
+	}
+
+	static const EmbeddedAsset& Get(size_t k)
+	{
+		return embeddedAssets[k];
+	}
+
+	// Same lookup rules as AssetPack::Find, invalid view if it wasn't embedded
+	static AssetView Find(const char* name)
+	{
+		AssetView view;
+		char normal[ASSET_NAME_MAX];
+		if (embeddedAssetCount == 0 || !AssetPack::Normalise(name, normal))
+			return view;
+		for (size_t k = 0; k < embeddedAssetCount; k++)
+		{
+			if (strcmp(embeddedAssets[k].Name, normal) == 0)
+			{
+				view.Data = embeddedAssets[k].Data;
+				view.Size = embeddedAssets[k].Size;
+				break;
+			}
+		}
+		return view;
+	}
+
+	// Rehashes everything, including the files too big to hash at compile time
+	static bool Verify()
+	{
+		for (size_t k = 0; k < embeddedAssetCount; k++)
+			if (EmbedHashRuntime(embeddedAssets[k].Data, embeddedAssets[k].Size) != embeddedAssets[k].Hash)
+				return false;
+		return true;
+	}
+};
+#endif
@@ -0,0 +1,309 @@
+#ifndef ENCKE_H
+#define ENCKE_H
+
+#include "Bodies.h"
+#include "Kepler.h"
+#include "Parallel.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstddef>
+
+// Default Encke values
+const double ENCKE_RECTIFY = 0.001; //start a new reference orbit once |deviation| passes this fraction of |reference|
+const size_t ENCKE_BLOCK = 256; //particles per kernel block, other massive bodies loop over each block
+const size_t ENCKE_PARALLEL = 1 << 12; //split over threads above this many particles
+
+// Massless minor bodies (asteroids, comets) that spend their lives on near-Keplerian orbits
+// about one dominant body, integrated the Encke way: each keeps an osculating two-body
+// reference orbit about the central body, moved exactly by KeplerDrift, and the integrator only
+// carries the small deviation from it. Its acceleration is the difference between the true
+// heliocentric pull (central body, softened, plus the other massive bodies and the indirect
+// term from the central body's own acceleration) and the reference's, with Battin's f(q) so
+// that difference doesn't cancel away. Truncation error scales with the deviation rather than
+// the orbit, so steps can be far longer than a full Cowell integration of the same particles
+// needs for the same accuracy.
+//
+// When a deviation grows past Rectify of its reference distance the particle is rectified:
+// the true state becomes the new reference and the deviation starts again from zero.
+//
+// Step() has the same contract as TestParticles::Step, and the deviation goes through the same
+// drift-kick-drift, with every force taken at the middle of the step. Reference orbits are only
+// needed there, so they are kept half a step ahead of the deviations and each step costs one
+// Kepler drift per particle (two on a rectification, or when the step length changes). As in
+// TestParticles the kernel goes a block at a time, with the pull of the other massive bodies
+// summed sources-outside so that loop vectorises; the Kepler drifts stay per particle.
+class EnckeParticles
+{
+public:
+	double Rectify;
+	// massive body the reference orbits are about, the heaviest when the first particle is added
+	size_t Central;
+	// rectifications in the last Step, and since the particles were added
+	size_t Rectified, TotalRectified;
+	// Kepler drifts that failed to converge (those particles are left where they were)
+	size_t Failures;
+
+	EnckeParticles() : Rectify(ENCKE_RECTIFY), Central(0), Rectified(0), TotalRectified(0), Failures(0), lead(0.0), gmLead(0.0)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			centre[k] = 0.0;
+			centreVelocity[k] = 0.0;
+		}
+	}
+
+	size_t Count() const
+	{
+		return rx.size();
+	}
+
+	// Adds a particle at absolute position p and velocity v, with massive's positions and
+	// velocities at the same time. Returns its index.
+	size_t Add(const Bodies& massive, const double* p, const double* v)
+	{
+		if (Count() == 0)
+		{
+			Centre(massive);
+			lead = 0.0;
+		}
+		double r[3] = { p[0] - centre[0], p[1] - centre[1], p[2] - centre[2] };
+		double u[3] = { v[0] - centreVelocity[0], v[1] - centreVelocity[1], v[2] - centreVelocity[2] };
+		//in step with the other reference orbits
+		if (lead != 0.0 && !KeplerDrift(gmLead, r, u, lead))
+			Failures++;
+		rx.push_back(r[0]); ry.push_back(r[1]); rz.push_back(r[2]);
+		ux.push_back(u[0]); uy.push_back(u[1]); uz.push_back(u[2]);
+		dx.push_back(0.0); dy.push_back(0.0); dz.push_back(0.0);
+		dvx.push_back(0.0); dvy.push_back(0.0); dvz.push_back(0.0);
+		return rx.size() - 1;
+	}
+
+	void Clear()
+	{
+		std::vector<double>* columns[] = { &rx, &ry, &rz, &ux, &uy, &uz, &dx, &dy, &dz, &dvx, &dvy, &dvz };
+		for (size_t k = 0; k < sizeof(columns) / sizeof(columns[0]); k++)
+			columns[k]->clear();
+		Rectified = TotalRectified = Failures = 0;
+		lead = 0.0;
+	}
+
+	// Absolute position and velocity of particle i as of the last Step (or Add)
+	void Get(size_t i, double* p, double* v) const
+	{
+		double r[3] = { rx[i], ry[i], rz[i] }, u[3] = { ux[i], uy[i], uz[i] };
+		if (lead != 0.0)
+			KeplerDrift(gmLead, r, u, -lead);
+		p[0] = centre[0] + r[0] + dx[i]; p[1] = centre[1] + r[1] + dy[i]; p[2] = centre[2] + r[2] + dz[i];
+		v[0] = centreVelocity[0] + u[0] + dvx[i]; v[1] = centreVelocity[1] + u[1] + dvy[i]; v[2] = centreVelocity[2] + u[2] + dvz[i];
+	}
+
+	// Advances every particle by h. massive is the bodies after their opening half kick and
+	// before their drift, i.e. velocities are at t + h/2 and positions at t.
+	void Step(const Bodies& massive, double G, double softening, double h, unsigned int threads)
+	{
+		const size_t n = Count();
+		Rectified = 0;
+		if (n == 0 || Central >= massive.Count())
+			return;
+		//everything at t + h/2, relative to the central body
+		const size_t c = Central;
+		const double half = 0.5 * h;
+		const double cx = massive.x[c] + massive.vx[c] * half;
+		const double cy = massive.y[c] + massive.vy[c] * half;
+		const double cz = massive.z[c] + massive.vz[c] * half;
+		const double eps2 = softening * softening;
+		px.clear(); py.clear(); pz.clear(); gm.clear();
+		double ax = 0.0, ay = 0.0, az = 0.0;
+		for (size_t j = 0; j < massive.Count(); j++)
+		{
+			if (j == c || massive.mass[j] <= 0.0)
+				continue;
+			const double qx = massive.x[j] + massive.vx[j] * half - cx;
+			const double qy = massive.y[j] + massive.vy[j] * half - cy;
+			const double qz = massive.z[j] + massive.vz[j] * half - cz;
+			const double g = G * massive.mass[j];
+			px.push_back(qx); py.push_back(qy); pz.push_back(qz); gm.push_back(g);
+			//the central body falls towards each of them, and the heliocentric frame with it
+			const double invR = 1.0 / std::sqrt(qx * qx + qy * qy + qz * qz + eps2);
+			const double f = g * invR * invR * invR;
+			ax += qx * f; ay += qy * f; az += qz * f;
+		}
+		indirect[0] = ax; indirect[1] = ay; indirect[2] = az;
+		const double gmCentral = G * massive.mass[c];
+		//reference orbits are lead ahead and need to be at the half step
+		if (lead != 0.0 && gmLead != gmCentral)
+			RealignReferences(gmCentral);
+		const double toMiddle = half - lead;
+		const size_t blocks = (n + ENCKE_BLOCK - 1) / ENCKE_BLOCK;
+		const unsigned int workers = n < ENCKE_PARALLEL ? 1 : ParallelThreads(threads);
+		counts.assign((size_t)workers * 2, 0);
+		ParallelFor(blocks, workers, [this, n, h, toMiddle, eps2, gmCentral](size_t begin, size_t end, unsigned int t)
+		{
+			for (size_t block = begin; block < end; block++)
+			{
+				const size_t last = (block + 1) * ENCKE_BLOCK < n ? (block + 1) * ENCKE_BLOCK : n;
+				StepBlock(block * ENCKE_BLOCK, last, h, toMiddle, eps2, gmCentral, counts[t * 2], counts[t * 2 + 1]);
+			}
+		});
+		lead = half;
+		gmLead = gmCentral;
+		for (size_t t = 0; t < counts.size(); t += 2)
+		{
+			Rectified += counts[t];
+			Failures += counts[t + 1];
+		}
+		TotalRectified += Rectified;
+		centre[0] = massive.x[c] + massive.vx[c] * h;
+		centre[1] = massive.y[c] + massive.vy[c] * h;
+		centre[2] = massive.z[c] + massive.vz[c] * h;
+		//the central body's velocity at the half step, finished off with its kick from the others
+		centreVelocity[0] = massive.vx[c] + ax * half;
+		centreVelocity[1] = massive.vy[c] + ay * half;
+		centreVelocity[2] = massive.vz[c] + az * half;
+	}
+
+private:
+	// reference orbit state about the central body, at the current time
+	std::vector<double> rx, ry, rz, ux, uy, uz;
+	// deviation from it
+	std::vector<double> dx, dy, dz, dvx, dvy, dvz;
+	// other massive bodies at the half step relative to the central one, G m
+	std::vector<double> px, py, pz, gm;
+	double indirect[3];
+	double centre[3], centreVelocity[3];
+	// how far ahead of the deviations the reference orbits are, and the G M they were drifted with
+	double lead, gmLead;
+	// per worker rectifications and failures
+	std::vector<size_t> counts;
+
+	void Centre(const Bodies& massive)
+	{
+		Central = 0;
+		for (size_t j = 1; j < massive.Count(); j++)
+			Central = massive.mass[j] > massive.mass[Central] ? j : Central;
+		if (Central >= massive.Count())
+			return;
+		centre[0] = massive.x[Central]; centre[1] = massive.y[Central]; centre[2] = massive.z[Central];
+		centreVelocity[0] = massive.vx[Central]; centreVelocity[1] = massive.vy[Central]; centreVelocity[2] = massive.vz[Central];
+	}
+
+	// References back to the particles' time with the G M they were drifted with, for when the
+	// central mass has changed under them
+	void RealignReferences(double gmCentral)
+	{
+		for (size_t i = 0; i < Count(); i++)
+		{
+			double r[3] = { rx[i], ry[i], rz[i] }, u[3] = { ux[i], uy[i], uz[i] };
+			if (!KeplerDrift(gmLead, r, u, -lead))
+			{
+				Failures++;
+				continue;
+			}
+			rx[i] = r[0]; ry[i] = r[1]; rz[i] = r[2];
+			ux[i] = u[0]; uy[i] = u[1]; uz[i] = u[2];
+		}
+		lead = 0.0;
+		gmLead = gmCentral;
+	}
+
+	// toMiddle is how far the reference orbits have to go to reach the half step, 0 when the
+	// step length hasn't changed
+	void StepBlock(size_t first, size_t last, double h, double toMiddle, double eps2, double gmCentral, size_t& rectified, size_t& failed)
+	{
+		const size_t count = last - first;
+		const double half = 0.5 * h;
+		//per particle: deviation drifted to the half step, true position there, acceleration
+		double ex[ENCKE_BLOCK], ey[ENCKE_BLOCK], ez[ENCKE_BLOCK];
+		double sx[ENCKE_BLOCK], sy[ENCKE_BLOCK], sz[ENCKE_BLOCK];
+		double ax[ENCKE_BLOCK], ay[ENCKE_BLOCK], az[ENCKE_BLOCK];
+		double rho2[ENCKE_BLOCK];
+		bool ok[ENCKE_BLOCK];
+		for (size_t k = 0; k < count; k++)
+		{
+			const size_t i = first + k;
+			double r[3] = { rx[i], ry[i], rz[i] }, u[3] = { ux[i], uy[i], uz[i] };
+			ok[k] = toMiddle == 0.0 || KeplerDrift(gmCentral, r, u, toMiddle);
+			if (ok[k])
+			{
+				rx[i] = r[0]; ry[i] = r[1]; rz[i] = r[2];
+				ux[i] = u[0]; uy[i] = u[1]; uz[i] = u[2];
+			}
+			else
+				failed++;
+			const double d[3] = { dx[i] + dvx[i] * half, dy[i] + dvy[i] * half, dz[i] + dvz[i] * half };
+			ex[k] = d[0]; ey[k] = d[1]; ez[k] = d[2];
+			//true position, and Battin's f(q) = (rho / r)^3 - 1 without the cancellation
+			const double px0 = r[0] + d[0], py0 = r[1] + d[1], pz0 = r[2] + d[2];
+			sx[k] = px0; sy[k] = py0; sz[k] = pz0;
+			const double s2 = px0 * px0 + py0 * py0 + pz0 * pz0;
+			const double q = (d[0] * (d[0] - 2.0 * px0) + d[1] * (d[1] - 2.0 * py0) + d[2] * (d[2] - 2.0 * pz0)) / s2;
+			const double root = std::sqrt(1.0 + q);
+			const double fq = q * (3.0 + 3.0 * q + q * q) / (1.0 + (1.0 + q) * root);
+			rho2[k] = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+			const double c = -gmCentral / (rho2[k] * std::sqrt(rho2[k]));
+			double f = 0.0;
+			//softening of the central pull, which the reference orbit leaves out
+			if (eps2 > 0.0)
+			{
+				const double invR = 1.0 / std::sqrt(s2), invS = 1.0 / std::sqrt(s2 + eps2);
+				f = gmCentral * (invR * invR * invR - invS * invS * invS);
+			}
+			ax[k] = c * (d[0] + fq * px0) + px0 * f - indirect[0];
+			ay[k] = c * (d[1] + fq * py0) + py0 * f - indirect[1];
+			az[k] = c * (d[2] + fq * pz0) + pz0 * f - indirect[2];
+		}
+		//the other massive bodies (their pull on the central body is in indirect)
+		for (size_t j = 0; j < gm.size(); j++)
+		{
+			const double cx = px[j], cy = py[j], cz = pz[j], g = gm[j];
+			for (size_t k = 0; k < count; k++)
+			{
+				const double dxj = cx - sx[k], dyj = cy - sy[k], dzj = cz - sz[k];
+				const double invR = 1.0 / std::sqrt(dxj * dxj + dyj * dyj + dzj * dzj + eps2);
+				const double f = g * invR * invR * invR;
+				ax[k] += dxj * f; ay[k] += dyj * f; az[k] += dzj * f;
+			}
+		}
+		for (size_t k = 0; k < count; k++)
+		{
+			if (!ok[k])
+				continue;
+			const size_t i = first + k;
+			double r[3] = { rx[i], ry[i], rz[i] }, u[3] = { ux[i], uy[i], uz[i] };
+			double dv[3] = { dvx[i] + ax[k] * h, dvy[i] + ay[k] * h, dvz[i] + az[k] * h };
+			double d[3] = { ex[k] + dv[0] * half, ey[k] + dv[1] * half, ez[k] + dv[2] * half };
+			//rectifying needs the reference where the deviation is, at the end of the step
+			double advance = h;
+			if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > Rectify * Rectify * rho2[k])
+			{
+				if (!KeplerDrift(gmCentral, r, u, half))
+				{
+					failed++;
+					continue;
+				}
+				for (int c = 0; c < 3; c++)
+				{
+					r[c] += d[c];
+					u[c] += dv[c];
+					d[c] = 0.0;
+					dv[c] = 0.0;
+				}
+				advance = half;
+				rectified++;
+			}
+			//and on to the next half step
+			if (!KeplerDrift(gmCentral, r, u, advance))
+			{
+				failed++;
+				continue;
+			}
+			rx[i] = r[0]; ry[i] = r[1]; rz[i] = r[2];
+			ux[i] = u[0]; uy[i] = u[1]; uz[i] = u[2];
+			dx[i] = d[0]; dy[i] = d[1]; dz[i] = d[2];
+			dvx[i] = dv[0]; dvy[i] = dv[1]; dvz[i] = dv[2];
+		}
+	}
+};
+#endif
@@ -0,0 +1,383 @@
+#ifndef ENCOUNTERS_H
+#define ENCOUNTERS_H
+
+#include "Bodies.h"
+#include "BroadPhase.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+
+// Default encounter values
+const double ENCOUNTER_FACTOR = 3.0; //close encounters are logged inside this many times the two radii
+const double ENCOUNTER_RESTITUTION = 1.0; //bounces keep this fraction of the normal speed
+const int ENCOUNTER_NEWTON_STEPS = 8; //refining event times on the cubic path
+const uint32_t ENCOUNTER_NONE = 0xFFFFFFFFu;
+
+enum CollisionResponse
+{
+	COLLIDE_MERGE, //perfectly inelastic, one body keeps the mass, momentum and volume of both
+	COLLIDE_BOUNCE, //impulse along the contact normal, see Restitution
+	COLLIDE_IGNORE //log it, leave the bodies alone
+};
+
+enum EncounterKind
+{
+	ENCOUNTER_CLOSE,
+	ENCOUNTER_MERGE,
+	ENCOUNTER_BOUNCE,
+	ENCOUNTER_CONTACT //touched with COLLIDE_IGNORE
+};
+
+// A body as it was before Check() merged or bounced it, see Encounters::Moved
+struct EncounterMove
+{
+	uint32_t Body;
+	double X, Y, Z;
+	double Mass;
+};
+
+struct EncounterEvent
+{
+	double Time; //closest approach, or first contact
+	uint32_t A, B;
+	EncounterKind Kind;
+	double Distance; //between centres then
+	double Speed; //relative, then
+};
+
+// Catches what happens between steps instead of only at them, so big steps don't let fast bodies
+// tunnel through each other. Begin() keeps every body's state at the start of the step; Check()
+// runs afterwards with the end state, broad phases spheres swept over the step (centred half way,
+// grown by half the distance moved), and for each candidate pair works out on straight-line
+// relative motion whether and when they came within reach. Those times are then refined with
+// Newton on the cubic Hermite path through both ends' positions and velocities, which is what the
+// leapfrog actually followed to third order. The step itself is never shortened.
+// Collisions are resolved at the end of the step: merges in place (the lighter body becomes a
+// massless, zero-radius passenger riding with the survivor, so body indices stay valid), bounces
+// by an impulse at the contact time whose effect is carried on to the end of the step.
+class Encounters
+{
+public:
+	bool Enabled;
+	CollisionResponse Response;
+	double Restitution;
+	double EncounterFactor;
+	BroadPhase Broad;
+	std::vector<EncounterEvent> Events; //from the last Check, in time order
+	std::vector<uint32_t> MergedInto; //per body, ENCOUNTER_NONE unless it's been absorbed
+	std::vector<EncounterMove> Moved; //bodies the last Check changed, as they were before it
+	//running totals
+	size_t CloseCalls, Merges, Bounces;
+
+	Encounters() : Enabled(false), Response(COLLIDE_MERGE), Restitution(ENCOUNTER_RESTITUTION), EncounterFactor(ENCOUNTER_FACTOR),
+		CloseCalls(0), Merges(0), Bounces(0), log(NULL)
+	{
+	}
+
+	~Encounters()
+	{
+		CloseLog();
+	}
+
+	// Every event goes to path as a CSV line as well, returns false if it can't be opened
+	bool OpenLog(const char* path)
+	{
+		CloseLog();
+		log = fopen(path, "w");
+		if (!log)
+			return false;
+		fprintf(log, "time,kind,a,b,distance,speed\n");
+		return true;
+	}
+
+	void CloseLog()
+	{
+		if (log)
+			fclose(log);
+		log = NULL;
+	}
+
+	// Forget merges, for when the bodies have been replaced or edited
+	void Reset()
+	{
+		MergedInto.clear();
+	}
+
+	// Where everything is at the start of the step
+	void Begin(const Bodies& b)
+	{
+		x0 = b.x; y0 = b.y; z0 = b.z;
+		vx0 = b.vx; vy0 = b.vy; vz0 = b.vz;
+		if (MergedInto.size() != b.Count())
+		{
+			MergedInto.assign(b.Count(), ENCOUNTER_NONE);
+			Broad.Reset();
+		}
+	}
+
+	// After a step of h from t0. Returns true if any body was changed, the caller's forces and
+	// invariants are stale then; Moved says which and where they were.
+	bool Check(Bodies& b, double t0, double h)
+	{
+		Events.clear();
+		Moved.clear();
+		const size_t n = b.Count();
+		if (x0.size() != n || n < 2 || h <= 0.0)
+			return false;
+		//spheres swept over the step
+		swept.Resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			double dx = b.x[i] - x0[i], dy = b.y[i] - y0[i], dz = b.z[i] - z0[i];
+			swept.x[i] = 0.5 * (b.x[i] + x0[i]);
+			swept.y[i] = 0.5 * (b.y[i] + y0[i]);
+			swept.z[i] = 0.5 * (b.z[i] + z0[i]);
+			swept.radius[i] = MergedInto[i] != ENCOUNTER_NONE ? 0.0 :
+				EncounterFactor * b.radius[i] + 0.5 * std::sqrt(dx * dx + dy * dy + dz * dz);
+		}
+		Broad.Find(swept);
+
+		hits.clear();
+		for (size_t k = 0; k < Broad.Pairs.size(); k++)
+		{
+			uint32_t i = Broad.Pairs[k].A, j = Broad.Pairs[k].B;
+			if (MergedInto[i] != ENCOUNTER_NONE || MergedInto[j] != ENCOUNTER_NONE)
+				continue;
+			Narrow(b, i, j, t0, h);
+		}
+		std::sort(hits.begin(), hits.end(), [](const EncounterEvent& a, const EncounterEvent& e) { return a.Time < e.Time; });
+
+		//earliest contact first; a body only collides once per step, anything after that is
+		//against where it no longer is, and gets picked up next step if it still happens
+		bool changed = false;
+		touched.assign(n, 0);
+		for (size_t k = 0; k < hits.size(); k++)
+		{
+			EncounterEvent e = hits[k];
+			if (e.Kind != ENCOUNTER_CLOSE)
+			{
+				if (touched[e.A] || touched[e.B])
+					continue;
+				touched[e.A] = touched[e.B] = 1;
+				if (Response == COLLIDE_MERGE)
+				{
+					Merge(b, e.A, e.B);
+					e.Kind = ENCOUNTER_MERGE;
+					Merges++;
+					changed = true;
+				}
+				else if (Response == COLLIDE_BOUNCE)
+				{
+					if (!Bounce(b, e.A, e.B, (e.Time - t0) / h, h))
+						continue;
+					e.Kind = ENCOUNTER_BOUNCE;
+					Bounces++;
+					changed = true;
+				}
+				else
+					e.Kind = ENCOUNTER_CONTACT;
+			}
+			else
+				CloseCalls++;
+			Events.push_back(e);
+			Write(e);
+		}
+		return changed;
+	}
+
+private:
+	std::vector<double> x0, y0, z0, vx0, vy0, vz0;
+	Bodies swept;
+	std::vector<EncounterEvent> hits;
+	std::vector<unsigned char> touched;
+	FILE* log;
+
+	// Relative position of j from i on the cubic through both ends, as c0 + c1 s + c2 s^2 + c3 s^3
+	// for s = 0..1 over the step
+	void Path(const Bodies& b, uint32_t i, uint32_t j, double h, double c[3][4]) const
+	{
+		const double p0[3] = { x0[j] - x0[i], y0[j] - y0[i], z0[j] - z0[i] };
+		const double p1[3] = { b.x[j] - b.x[i], b.y[j] - b.y[i], b.z[j] - b.z[i] };
+		const double v0[3] = { vx0[j] - vx0[i], vy0[j] - vy0[i], vz0[j] - vz0[i] };
+		const double v1[3] = { b.vx[j] - b.vx[i], b.vy[j] - b.vy[i], b.vz[j] - b.vz[i] };
+		for (int a = 0; a < 3; a++)
+		{
+			c[a][0] = p0[a];
+			c[a][1] = h * v0[a];
+			c[a][2] = 3.0 * (p1[a] - p0[a]) - h * (2.0 * v0[a] + v1[a]);
+			c[a][3] = 2.0 * (p0[a] - p1[a]) + h * (v0[a] + v1[a]);
+		}
+	}
+
+	// Position, and its first and second s derivatives, on the path
+	static void Evaluate(const double c[3][4], double s, double p[3], double d1[3], double d2[3])
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			p[a] = c[a][0] + s * (c[a][1] + s * (c[a][2] + s * c[a][3]));
+			d1[a] = c[a][1] + s * (2.0 * c[a][2] + s * 3.0 * c[a][3]);
+			d2[a] = 2.0 * c[a][2] + 6.0 * s * c[a][3];
+		}
+	}
+
+	static double Dot(const double a[3], const double b[3])
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	void Narrow(const Bodies& b, uint32_t i, uint32_t j, double t0, double h)
+	{
+		//straight line first: d0 + s dd
+		const double d0[3] = { x0[j] - x0[i], y0[j] - y0[i], z0[j] - z0[i] };
+		const double dd[3] = { b.x[j] - b.x[i] - d0[0], b.y[j] - b.y[i] - d0[1], b.z[j] - b.z[i] - d0[2] };
+		const double contact = b.radius[i] + b.radius[j];
+		const double reach = EncounterFactor * contact;
+		const double aa = Dot(dd, dd), ab = Dot(d0, dd), cc = Dot(d0, d0);
+		//still overlapping from a bounce last step and moving apart
+		if (cc <= contact * contact && ab >= 0.0)
+			return;
+		double closest = aa > 0.0 ? -ab / aa : 0.0;
+		closest = closest < 0.0 ? 0.0 : closest > 1.0 ? 1.0 : closest;
+		double nearest2 = cc + closest * (2.0 * ab + closest * aa);
+		if (nearest2 >= reach * reach)
+			return;
+
+		double c[3][4], p[3], d1[3], d2[3];
+		Path(b, i, j, h, c);
+		EncounterEvent e;
+		e.A = i;
+		e.B = j;
+		//contact: first root of |d|^2 = contact^2
+		double s = -1.0;
+		if (cc <= contact * contact)
+			s = 0.0;
+		else if (aa > 0.0)
+		{
+			double disc = ab * ab - aa * (cc - contact * contact);
+			if (disc >= 0.0)
+			{
+				double root = (-ab - std::sqrt(disc)) / aa;
+				if (root >= 0.0 && root <= 1.0)
+					s = root;
+			}
+		}
+		if (s >= 0.0)
+		{
+			for (int k = 0; k < ENCOUNTER_NEWTON_STEPS && s > 0.0; k++)
+			{
+				Evaluate(c, s, p, d1, d2);
+				double g = Dot(p, p) - contact * contact, slope = 2.0 * Dot(p, d1);
+				if (slope == 0.0)
+					break;
+				double next = s - g / slope;
+				s = next < 0.0 ? 0.0 : next > 1.0 ? 1.0 : next;
+			}
+			Evaluate(c, s, p, d1, d2);
+			e.Kind = ENCOUNTER_CONTACT;
+		}
+		else
+		{
+			//closest approach is only this step's if it's inside it, otherwise a neighbour step has it
+			if (closest <= 0.0 || closest >= 1.0)
+				return;
+			s = closest;
+			for (int k = 0; k < ENCOUNTER_NEWTON_STEPS; k++)
+			{
+				Evaluate(c, s, p, d1, d2);
+				double f = Dot(p, d1), slope = Dot(d1, d1) + Dot(p, d2);
+				if (slope <= 0.0)
+					break;
+				double next = s - f / slope;
+				s = next < 0.0 ? 0.0 : next > 1.0 ? 1.0 : next;
+			}
+			Evaluate(c, s, p, d1, d2);
+			if (Dot(p, p) >= reach * reach)
+				return;
+			e.Kind = ENCOUNTER_CLOSE;
+		}
+		e.Time = t0 + s * h;
+		e.Distance = std::sqrt(Dot(p, p));
+		e.Speed = std::sqrt(Dot(d1, d1)) / h;
+		hits.push_back(e);
+	}
+
+	void Merge(Bodies& b, uint32_t i, uint32_t j)
+	{
+		//the heavier one survives, ties to the lower index
+		uint32_t keep = b.mass[j] > b.mass[i] ? j : i, gone = keep == i ? j : i;
+		Remember(b, keep);
+		Remember(b, gone);
+		double m = b.mass[keep] + b.mass[gone];
+		double wk = m > 0.0 ? b.mass[keep] / m : 0.5, wg = 1.0 - wk;
+		b.x[keep] = wk * b.x[keep] + wg * b.x[gone];
+		b.y[keep] = wk * b.y[keep] + wg * b.y[gone];
+		b.z[keep] = wk * b.z[keep] + wg * b.z[gone];
+		b.vx[keep] = wk * b.vx[keep] + wg * b.vx[gone];
+		b.vy[keep] = wk * b.vy[keep] + wg * b.vy[gone];
+		b.vz[keep] = wk * b.vz[keep] + wg * b.vz[gone];
+		b.radius[keep] = std::cbrt(b.radius[keep] * b.radius[keep] * b.radius[keep] + b.radius[gone] * b.radius[gone] * b.radius[gone]);
+		b.mass[keep] = m;
+		b.x[gone] = b.x[keep]; b.y[gone] = b.y[keep]; b.z[gone] = b.z[keep];
+		b.vx[gone] = b.vx[keep]; b.vy[gone] = b.vy[keep]; b.vz[gone] = b.vz[keep];
+		b.mass[gone] = 0.0;
+		b.radius[gone] = 0.0;
+		MergedInto[gone] = keep;
+	}
+
+	// Impulse at contact time s (fraction of the step), carried to the end of it. False if they
+	// were already separating.
+	bool Bounce(Bodies& b, uint32_t i, uint32_t j, double s, double h)
+	{
+		double c[3][4], p[3], d1[3], d2[3];
+		Path(b, i, j, h, c);
+		Evaluate(c, s, p, d1, d2);
+		double distance = std::sqrt(Dot(p, p));
+		if (distance == 0.0)
+			return false;
+		double normal[3] = { p[0] / distance, p[1] / distance, p[2] / distance };
+		double approach = Dot(d1, normal) / h;
+		if (approach >= 0.0)
+			return false;
+		//a massless body bounces off whatever it hits
+		double wi = b.mass[i] > 0.0 ? 1.0 / b.mass[i] : 0.0, wj = b.mass[j] > 0.0 ? 1.0 / b.mass[j] : 0.0;
+		if (b.mass[i] <= 0.0 || b.mass[j] <= 0.0)
+		{
+			wi = b.mass[i] <= 0.0 ? 1.0 : 0.0;
+			wj = b.mass[j] <= 0.0 ? 1.0 : 0.0;
+		}
+		double impulse = -(1.0 + Restitution) * approach / (wi + wj);
+		Remember(b, i);
+		Remember(b, j);
+		double remaining = (1.0 - s) * h;
+		for (int a = 0; a < 3; a++)
+		{
+			double dvi = -impulse * wi * normal[a], dvj = impulse * wj * normal[a];
+			std::vector<double>& pi = a == 0 ? b.x : a == 1 ? b.y : b.z;
+			std::vector<double>& vi = a == 0 ? b.vx : a == 1 ? b.vy : b.vz;
+			vi[i] += dvi;
+			vi[j] += dvj;
+			pi[i] += dvi * remaining;
+			pi[j] += dvj * remaining;
+		}
+		return true;
+	}
+
+	void Remember(const Bodies& b, uint32_t i)
+	{
+		EncounterMove m = { i, b.x[i], b.y[i], b.z[i], b.mass[i] };
+		Moved.push_back(m);
+	}
+
+	void Write(const EncounterEvent& e)
+	{
+		if (!log)
+			return;
+		static const char* kinds[4] = { "close", "merge", "bounce", "contact" };
+		fprintf(log, "%.12f,%s,%u,%u,%.9e,%.9e\n", e.Time, kinds[e.Kind], e.A, e.B, e.Distance, e.Speed);
+		fflush(log);
+	}
+};
+#endif
@@ -0,0 +1,431 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "Bodies.h"
+#include "Parallel.h"
+#include "Simulation.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+
+// Default ensemble values
+const size_t ENSEMBLE_LANES = 8; //members advanced together by one kernel, two AVX registers of doubles
+const double ENSEMBLE_ESCAPE_RADIUS = 1000.0; //a member stops once any body is this far from the origin
+const double ENSEMBLE_SAMPLE_INTERVAL = 1.0; //simulated seconds between summary lines
+
+enum EnsembleOutcome
+{
+	ENSEMBLE_RUNNING, //still being stepped
+	ENSEMBLE_ESCAPED, //a body passed EscapeRadius (or the state stopped being finite)
+	ENSEMBLE_COLLIDED //two bodies came within the sum of their radii
+};
+
+// Summary over all members at one time, what gets streamed to the log
+struct EnsembleSummary
+{
+	double Time;
+	size_t Running, Escaped, Collided;
+	// relative energy drift of the members still running
+	double MeanEnergyDrift, MaxEnergyDrift;
+	// distance between bodies WatchA and WatchB over the members still running
+	double MeanSeparation, SeparationSpread, MinSeparation;
+};
+
+// Many copies ("members") of one small system, each with its own initial conditions, stepped
+// in lockstep with the same kick-drift-kick leapfrog and direct forces as Simulation.
+//
+// Members are stored ENSEMBLE_LANES at a time: for each block of lanes, every column is laid
+// out body by body with that body's value for every lane side by side, so the kernels' inner
+// loop runs across members over a fixed count and vectorises, while the loops over bodies and
+// pairs stay scalar. Blocks are independent and are split over threads.
+//
+// Members stop when a body escapes or two bodies touch. A stopped lane keeps being computed
+// with the rest of its block, but its kicks and drifts are multiplied by a zero mask so its
+// state stays where it stopped, which keeps the kernel free of per-lane branches. A block
+// stops once every lane in it has.
+class Ensemble
+{
+public:
+	double G;
+	double Softening;
+	double TimeStep;
+	double Time;
+	double EscapeRadius;
+	unsigned int Threads;
+	// bodies whose separation the summary tracks
+	size_t WatchA, WatchB;
+	// per member, why and when it stopped
+	std::vector<int> Outcome;
+	std::vector<double> StopTime;
+
+	Ensemble(double timeStep = SIM_TIMESTEP, double g = SIM_G, double softening = SIM_SOFTENING)
+		: G(g), Softening(softening), TimeStep(timeStep), Time(0.0), EscapeRadius(ENSEMBLE_ESCAPE_RADIUS), Threads(0),
+		WatchA(0), WatchB(1), members(0), bodies(0), blocks(0), log(NULL), started(false)
+	{
+	}
+
+	~Ensemble()
+	{
+		CloseLog();
+	}
+
+	size_t Members() const
+	{
+		return members;
+	}
+
+	size_t BodyCount() const
+	{
+		return bodies;
+	}
+
+	// Makes room for count members of n bodies each, all empty (zero mass) and stopped until Set
+	void Resize(size_t count, size_t n)
+	{
+		members = count;
+		bodies = n;
+		blocks = (count + ENSEMBLE_LANES - 1) / ENSEMBLE_LANES;
+		const size_t size = blocks * bodies * ENSEMBLE_LANES;
+		std::vector<double>* columns[] = { &x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az, &mass };
+		for (size_t k = 0; k < sizeof(columns) / sizeof(columns[0]); k++)
+			columns[k]->assign(size, 0.0);
+		radius.assign(bodies, 0.0);
+		const size_t lanes = blocks * ENSEMBLE_LANES;
+		mask.assign(lanes, 0.0);
+		kinetic.assign(lanes, 0.0);
+		potential.assign(lanes, 0.0);
+		initialEnergy.assign(lanes, 0.0);
+		Outcome.assign(count, ENSEMBLE_ESCAPED);
+		StopTime.assign(count, 0.0);
+		Time = 0.0;
+		started = false;
+	}
+
+	// Loads one member's initial state. Radii are shared, so they are taken from the last Set.
+	void Set(size_t member, const Bodies& state)
+	{
+		if (member >= members || state.Count() != bodies)
+		{
+			printf("ERROR::ENSEMBLE member %zu doesn't fit (%zu members of %zu bodies)\n", member, members, bodies);
+			return;
+		}
+		for (size_t i = 0; i < bodies; i++)
+		{
+			const size_t k = Index(member, i);
+			x[k] = state.x[i]; y[k] = state.y[i]; z[k] = state.z[i];
+			vx[k] = state.vx[i]; vy[k] = state.vy[i]; vz[k] = state.vz[i];
+			mass[k] = state.mass[i];
+			radius[i] = state.radius[i];
+		}
+		mask[member] = 1.0;
+		Outcome[member] = ENSEMBLE_RUNNING;
+		StopTime[member] = 0.0;
+		started = false;
+	}
+
+	// One member's current state, accelerations included
+	void Get(size_t member, Bodies& state) const
+	{
+		state.Resize(bodies);
+		for (size_t i = 0; i < bodies; i++)
+		{
+			const size_t k = Index(member, i);
+			state.x[i] = x[k]; state.y[i] = y[k]; state.z[i] = z[k];
+			state.vx[i] = vx[k]; state.vy[i] = vy[k]; state.vz[i] = vz[k];
+			state.ax[i] = ax[k]; state.ay[i] = ay[k]; state.az[i] = az[k];
+			state.mass[i] = mass[k];
+			state.radius[i] = radius[i];
+		}
+	}
+
+	// Members that haven't stopped
+	size_t Running() const
+	{
+		size_t running = 0;
+		for (size_t m = 0; m < members; m++)
+			running += Outcome[m] == ENSEMBLE_RUNNING;
+		return running;
+	}
+
+	// Starts writing a summary line per Run sample to path, returns false if the file can't be opened
+	bool OpenLog(const char* path)
+	{
+		CloseLog();
+		log = fopen(path, "w");
+		if (!log)
+			return false;
+		fprintf(log, "time,running,escaped,collided,mean_energy_drift,max_energy_drift,mean_separation,separation_spread,min_separation\n");
+		return true;
+	}
+
+	void CloseLog()
+	{
+		if (log)
+			fclose(log);
+		log = NULL;
+	}
+
+	// Steps every running member count times
+	void Step(int count)
+	{
+		Start();
+		const double h = TimeStep;
+		const double t0 = Time;
+		ParallelFor(blocks, ParallelThreads(Threads), [this, count, h, t0](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t block = begin; block < end; block++)
+				StepBlock(block, count, h, t0);
+		});
+		Time = t0 + count * h;
+	}
+
+	// Steps until duration has passed or every member has stopped, logging a summary every
+	// interval of simulated time. Returns the last summary.
+	EnsembleSummary Run(double duration, double interval = ENSEMBLE_SAMPLE_INTERVAL)
+	{
+		Start();
+		const double end = Time + duration;
+		int perSample = (int)(interval / TimeStep + 0.5);
+		if (perSample < 1)
+			perSample = 1;
+		EnsembleSummary summary = Summarise();
+		WriteLine(summary);
+		while (Time < end - 0.5 * TimeStep && summary.Running > 0)
+		{
+			int remaining = (int)((end - Time) / TimeStep + 0.5);
+			Step(perSample < remaining ? perSample : remaining);
+			summary = Summarise();
+			WriteLine(summary);
+		}
+		return summary;
+	}
+
+	// Statistics over the members as they are now
+	EnsembleSummary Summarise() const
+	{
+		EnsembleSummary s = EnsembleSummary();
+		s.Time = Time;
+		double drifts = 0.0, separations = 0.0, squares = 0.0;
+		s.MinSeparation = HUGE_VAL;
+		for (size_t m = 0; m < members; m++)
+		{
+			if (Outcome[m] == ENSEMBLE_ESCAPED)
+				s.Escaped++;
+			if (Outcome[m] == ENSEMBLE_COLLIDED)
+				s.Collided++;
+			if (Outcome[m] != ENSEMBLE_RUNNING)
+				continue;
+			s.Running++;
+			const double e0 = initialEnergy[m];
+			const double drift = e0 != 0.0 ? std::fabs((kinetic[m] + potential[m] - e0) / e0) : 0.0;
+			drifts += drift;
+			s.MaxEnergyDrift = std::max(s.MaxEnergyDrift, drift);
+			if (WatchA < bodies && WatchB < bodies)
+			{
+				const size_t a = Index(m, WatchA), b = Index(m, WatchB);
+				const double dx = x[b] - x[a], dy = y[b] - y[a], dz = z[b] - z[a];
+				const double d = std::sqrt(dx * dx + dy * dy + dz * dz);
+				separations += d;
+				squares += d * d;
+				s.MinSeparation = std::min(s.MinSeparation, d);
+			}
+		}
+		if (s.Running > 0)
+		{
+			s.MeanEnergyDrift = drifts / s.Running;
+			s.MeanSeparation = separations / s.Running;
+			const double variance = squares / s.Running - s.MeanSeparation * s.MeanSeparation;
+			s.SeparationSpread = variance > 0.0 ? std::sqrt(variance) : 0.0;
+		}
+		else
+			s.MinSeparation = 0.0;
+		return s;
+	}
+
+private:
+	size_t members, bodies, blocks;
+	// block-major, then body, then lane
+	std::vector<double> x, y, z;
+	std::vector<double> vx, vy, vz;
+	std::vector<double> ax, ay, az;
+	std::vector<double> mass;
+	std::vector<double> radius;
+	// per lane: 1 while running, 0 once stopped (and for the padding lanes of the last block)
+	std::vector<double> mask;
+	std::vector<double> kinetic, potential, initialEnergy;
+	FILE* log;
+	bool started;
+
+	size_t Index(size_t member, size_t body) const
+	{
+		return ((member / ENSEMBLE_LANES) * bodies + body) * ENSEMBLE_LANES + member % ENSEMBLE_LANES;
+	}
+
+	// Forces and energies for the state as loaded, once before the first step
+	void Start()
+	{
+		if (started)
+			return;
+		ParallelFor(blocks, ParallelThreads(Threads), [this](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t block = begin; block < end; block++)
+			{
+				double closest[ENSEMBLE_LANES], farthest[ENSEMBLE_LANES];
+				Forces(block, closest, farthest);
+				double* ke = &kinetic[block * ENSEMBLE_LANES];
+				for (size_t l = 0; l < ENSEMBLE_LANES; l++)
+					ke[l] = 0.0;
+				for (size_t i = 0; i < bodies; i++)
+				{
+					const size_t k = (block * bodies + i) * ENSEMBLE_LANES;
+					for (size_t l = 0; l < ENSEMBLE_LANES; l++)
+						ke[l] += 0.5 * mass[k + l] * (vx[k + l] * vx[k + l] + vy[k + l] * vy[k + l] + vz[k + l] * vz[k + l]);
+				}
+				for (size_t l = 0; l < ENSEMBLE_LANES; l++)
+				{
+					const size_t lane = block * ENSEMBLE_LANES + l;
+					initialEnergy[lane] = ke[l] + potential[lane];
+				}
+			}
+		});
+		started = true;
+	}
+
+	// Accelerations and potential energy for every lane of a block, plus per lane the smallest
+	// (distance^2 - contact^2) over all pairs and the largest distance^2 from the origin
+	void Forces(size_t block, double* closest, double* farthest)
+	{
+		const size_t L = ENSEMBLE_LANES;
+		const size_t base = block * bodies * L;
+		double* px = &x[base]; double* py = &y[base]; double* pz = &z[base];
+		double* pax = &ax[base]; double* pay = &ay[base]; double* paz = &az[base];
+		const double* m = &mass[base];
+		double* pe = &potential[block * L];
+		const double eps2 = Softening * Softening;
+		for (size_t k = 0; k < bodies * L; k++)
+		{
+			pax[k] = 0.0; pay[k] = 0.0; paz[k] = 0.0;
+		}
+		for (size_t l = 0; l < L; l++)
+		{
+			pe[l] = 0.0;
+			closest[l] = HUGE_VAL;
+			farthest[l] = 0.0;
+		}
+		for (size_t i = 0; i < bodies; i++)
+		{
+			const size_t a = i * L;
+			for (size_t l = 0; l < L; l++)
+				farthest[l] = std::max(farthest[l], px[a + l] * px[a + l] + py[a + l] * py[a + l] + pz[a + l] * pz[a + l]);
+			for (size_t j = i + 1; j < bodies; j++)
+			{
+				const size_t b = j * L;
+				const double contact = radius[i] + radius[j];
+				const double contact2 = contact * contact;
+				for (size_t l = 0; l < L; l++)
+				{
+					const double dx = px[b + l] - px[a + l];
+					const double dy = py[b + l] - py[a + l];
+					const double dz = pz[b + l] - pz[a + l];
+					const double d2 = dx * dx + dy * dy + dz * dz;
+					const double invR = 1.0 / std::sqrt(d2 + eps2);
+					const double invR3 = G * invR * invR * invR;
+					const double sj = m[b + l] * invR3;
+					const double si = m[a + l] * invR3;
+					pax[a + l] += dx * sj; pay[a + l] += dy * sj; paz[a + l] += dz * sj;
+					pax[b + l] -= dx * si; pay[b + l] -= dy * si; paz[b + l] -= dz * si;
+					pe[l] -= G * m[a + l] * m[b + l] * invR;
+					closest[l] = std::min(closest[l], d2 - contact2);
+				}
+			}
+		}
+	}
+
+	void StepBlock(size_t block, int count, double h, double t0)
+	{
+		const size_t L = ENSEMBLE_LANES;
+		const size_t base = block * bodies * L;
+		double* px = &x[base]; double* py = &y[base]; double* pz = &z[base];
+		double* pvx = &vx[base]; double* pvy = &vy[base]; double* pvz = &vz[base];
+		const double* pax = &ax[base]; const double* pay = &ay[base]; const double* paz = &az[base];
+		const double* m = &mass[base];
+		double* lanes = &mask[block * L];
+		double* ke = &kinetic[block * L];
+		const double escape2 = EscapeRadius * EscapeRadius;
+		for (int step = 0; step < count; step++)
+		{
+			double running = 0.0;
+			for (size_t l = 0; l < L; l++)
+				running += lanes[l];
+			if (running == 0.0)
+				return;
+			//masked step lengths, stopped lanes don't move
+			double kick[ENSEMBLE_LANES], drift[ENSEMBLE_LANES];
+			for (size_t l = 0; l < L; l++)
+			{
+				kick[l] = 0.5 * h * lanes[l];
+				drift[l] = h * lanes[l];
+			}
+			for (size_t i = 0; i < bodies; i++)
+			{
+				const size_t a = i * L;
+				for (size_t l = 0; l < L; l++)
+				{
+					pvx[a + l] += pax[a + l] * kick[l];
+					pvy[a + l] += pay[a + l] * kick[l];
+					pvz[a + l] += paz[a + l] * kick[l];
+					px[a + l] += pvx[a + l] * drift[l];
+					py[a + l] += pvy[a + l] * drift[l];
+					pz[a + l] += pvz[a + l] * drift[l];
+				}
+			}
+			double closest[ENSEMBLE_LANES], farthest[ENSEMBLE_LANES];
+			Forces(block, closest, farthest);
+			for (size_t l = 0; l < L; l++)
+				ke[l] = 0.0;
+			for (size_t i = 0; i < bodies; i++)
+			{
+				const size_t a = i * L;
+				for (size_t l = 0; l < L; l++)
+				{
+					pvx[a + l] += pax[a + l] * kick[l];
+					pvy[a + l] += pay[a + l] * kick[l];
+					pvz[a + l] += paz[a + l] * kick[l];
+					ke[l] += 0.5 * m[a + l] * (pvx[a + l] * pvx[a + l] + pvy[a + l] * pvy[a + l] + pvz[a + l] * pvz[a + l]);
+				}
+			}
+			//retire lanes that escaped or collided this step, the only per-lane branch and only on a stop
+			const double t = t0 + (step + 1) * h;
+			for (size_t l = 0; l < L; l++)
+			{
+				const size_t member = block * L + l;
+				if (lanes[l] == 0.0)
+					continue;
+				//NaN compares false, so a blown-up member counts as escaped
+				if (!(farthest[l] <= escape2))
+					Retire(member, ENSEMBLE_ESCAPED, t);
+				else if (closest[l] < 0.0)
+					Retire(member, ENSEMBLE_COLLIDED, t);
+			}
+		}
+	}
+
+	void Retire(size_t member, int outcome, double t)
+	{
+		mask[member] = 0.0;
+		Outcome[member] = outcome;
+		StopTime[member] = t;
+	}
+
+	void WriteLine(const EnsembleSummary& s)
+	{
+		if (!log)
+			return;
+		fprintf(log, "%.9g,%zu,%zu,%zu,%.6e,%.6e,%.9g,%.9g,%.9g\n", s.Time, s.Running, s.Escaped, s.Collided,
+			s.MeanEnergyDrift, s.MaxEnergyDrift, s.MeanSeparation, s.SeparationSpread, s.MinSeparation);
+	}
+};
+#endif
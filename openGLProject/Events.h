@@ -0,0 +1,606 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "Bodies.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <cstdint>
+
+// Default event values
+const int EVENT_MAX_ITERATIONS = 100; //Brent steps on one root before settling for what it has
+const double EVENT_TOLERANCE = 1e-12; //event times are refined to this fraction of the step
+const double EVENT_NOISE = 1e-12; //sign changes this small against the function's own scale are rounding, not events
+const uint32_t EVENT_NONE = 0xFFFFFFFFu;
+
+//tells the compiler a loop's iterations are independent, so it vectorizes without checking aliasing
+#ifdef _MSC_VER
+#define EVENT_IVDEP __pragma(loop(ivdep))
+#else
+#define EVENT_IVDEP _Pragma("GCC ivdep")
+#endif
+
+enum EventKind
+{
+	EVENT_PERIAPSIS, //closest point of the orbit about Reference: r.v rises through 0
+	EVENT_APOAPSIS, //furthest point: r.v falls through 0
+	EVENT_CONJUNCTION, //body and Reference line up as seen from Third, about the plane with normal Normal
+	EVENT_ECLIPSE, //body enters (falling) or leaves (rising) the cylindrical shadow Reference casts from Third
+	EVENT_SURFACE, //distance from Reference's centre crosses its radius plus Altitude, falling on the way down
+	EVENT_CUSTOM //Function, a sign change either way unless Direction says otherwise
+};
+
+enum EventDirection
+{
+	EVENT_RISING,
+	EVENT_FALLING,
+	EVENT_EITHER
+};
+
+// Where a body, its reference and the third body are at one instant, on the step's dense output
+struct EventSample
+{
+	double Time;
+	double P[3], V[3], A[3]; //the body
+	double RefP[3], RefV[3], RefA[3];
+	double ThirdP[3], ThirdV[3], ThirdA[3];
+	double RefRadius;
+};
+
+typedef std::function<double(const EventSample&)> EventFunction;
+
+// One registered event, checked for each of Targets (every body but Reference and Third if empty)
+struct EventSpec
+{
+	std::string Name;
+	EventKind Kind;
+	EventDirection Direction;
+	uint32_t Reference, Third;
+	double Altitude;
+	double Normal[3];
+	EventFunction Function;
+	std::vector<uint32_t> Targets;
+};
+
+struct EventHit
+{
+	double Time;
+	uint32_t Event, Body;
+	bool Rising;
+};
+
+// Value, time derivative and scale (what rounding in the value is relative to) of the built in
+// event functions. The rate only has to be good enough to spot a function turning round inside
+// a step, the event times come from the value alone. The body's own state comes in apart from
+// the sample (which supplies the reference and third body) so a sweep can keep it in registers.
+template <EventKind K>
+inline void EventValue(const EventSpec& e, const EventSample& s, const double* p, const double* pv, const double* pa,
+	double& value, double& rate, double& scale)
+{
+	double r[3], v[3], a[3];
+	for (int k = 0; k < 3; k++)
+	{
+		r[k] = p[k] - s.RefP[k];
+		v[k] = pv[k] - s.RefV[k];
+		a[k] = pa[k] - s.RefA[k];
+	}
+	const double r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+	const double v2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+	const double rv = r[0] * v[0] + r[1] * v[1] + r[2] * v[2];
+	if (K == EVENT_PERIAPSIS || K == EVENT_APOAPSIS)
+	{
+		value = rv;
+		rate = v2 + r[0] * a[0] + r[1] * a[1] + r[2] * a[2];
+		scale = std::sqrt(r2 * v2);
+	}
+	else if (K == EVENT_SURFACE)
+	{
+		const double distance = std::sqrt(r2);
+		value = distance - s.RefRadius - e.Altitude;
+		rate = distance > 0.0 ? rv / distance : 0.0;
+		scale = distance;
+	}
+	else if (K == EVENT_CONJUNCTION)
+	{
+		//(d x dr) . n for the body and reference as seen from the third
+		double d[3], dv[3], q[3], qv[3];
+		for (int k = 0; k < 3; k++)
+		{
+			d[k] = p[k] - s.ThirdP[k];
+			dv[k] = pv[k] - s.ThirdV[k];
+			q[k] = s.RefP[k] - s.ThirdP[k];
+			qv[k] = s.RefV[k] - s.ThirdV[k];
+		}
+		const double* n = e.Normal;
+		value = n[0] * (d[1] * q[2] - d[2] * q[1]) + n[1] * (d[2] * q[0] - d[0] * q[2]) + n[2] * (d[0] * q[1] - d[1] * q[0]);
+		rate = n[0] * (dv[1] * q[2] - dv[2] * q[1] + d[1] * qv[2] - d[2] * qv[1])
+			+ n[1] * (dv[2] * q[0] - dv[0] * q[2] + d[2] * qv[0] - d[0] * qv[2])
+			+ n[2] * (dv[0] * q[1] - dv[1] * q[0] + d[0] * qv[1] - d[1] * qv[0]);
+		//this is zero at opposition too, Refine throws those out
+		scale = std::sqrt((d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) * (q[0] * q[0] + q[1] * q[1] + q[2] * q[2]));
+	}
+	else if (K == EVENT_ECLIPSE)
+	{
+		//distance from the shadow axis (light through occluder) less the occluder's radius, behind it
+		double u[3];
+		for (int k = 0; k < 3; k++)
+			u[k] = s.RefP[k] - s.ThirdP[k];
+		const double length = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+		for (int k = 0; k < 3; k++)
+			u[k] = length > 0.0 ? u[k] / length : 0.0;
+		const double along = r[0] * u[0] + r[1] * u[1] + r[2] * u[2];
+		const double distance = std::sqrt(r2);
+		if (along > 0.0)
+		{
+			double w[3];
+			for (int k = 0; k < 3; k++)
+				w[k] = r[k] - along * u[k];
+			const double off = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+			value = off - s.RefRadius;
+			rate = off > 0.0 ? (w[0] * v[0] + w[1] * v[1] + w[2] * v[2]) / off : 0.0;
+		}
+		else
+		{
+			value = distance - s.RefRadius;
+			rate = distance > 0.0 ? rv / distance : 0.0;
+		}
+		scale = distance;
+	}
+	else
+	{
+		EventSample full = s;
+		for (int k = 0; k < 3; k++)
+		{
+			full.P[k] = p[k];
+			full.V[k] = pv[k];
+			full.A[k] = pa[k];
+		}
+		value = e.Function ? e.Function(full) : 0.0;
+		rate = 0.0;
+		scale = 0.0;
+	}
+}
+
+// Exact times of events that happen between steps. Each registered event is a scalar function of
+// a body's state (and its reference's and a third body's), and happens where that crosses zero.
+// After every step the functions are evaluated for every target at the new state in one tight
+// pass per event, alongside the values kept from the last step, so the check costs one function
+// per target per step. A sign change brackets a root; a function that turned round inside the
+// step (its rate changed sign towards and then away from zero) is searched for a double crossing.
+// The roots are then refined with Brent's method on the dense output, the cubic Hermite path
+// through each body's positions and velocities at both ends of the step, which is what the
+// leapfrog followed to third order. The steps themselves are never shortened.
+class EventDetector
+{
+public:
+	std::vector<EventSpec> Specs;
+	std::vector<EventHit> Hits; //from the last Check, in time order
+	size_t Total; //running count of hits
+
+	EventDetector() : Total(0), primed(false), log(NULL)
+	{
+	}
+
+	~EventDetector()
+	{
+		CloseLog();
+	}
+
+	bool Active() const
+	{
+		return !Specs.empty();
+	}
+
+	// Registers an event and returns its index in Specs. Targets empty means every body but the
+	// reference and third.
+	uint32_t Add(const EventSpec& spec)
+	{
+		Specs.push_back(spec);
+		primed = false;
+		return (uint32_t)Specs.size() - 1;
+	}
+
+	uint32_t AddPeriapsis(uint32_t reference, const std::vector<uint32_t>& targets = std::vector<uint32_t>())
+	{
+		return Add(Spec("periapsis", EVENT_PERIAPSIS, EVENT_RISING, reference, EVENT_NONE, targets));
+	}
+
+	uint32_t AddApoapsis(uint32_t reference, const std::vector<uint32_t>& targets = std::vector<uint32_t>())
+	{
+		return Add(Spec("apoapsis", EVENT_APOAPSIS, EVENT_FALLING, reference, EVENT_NONE, targets));
+	}
+
+	// Lined up with reference as seen from observer, in projection on the plane with that normal
+	uint32_t AddConjunction(uint32_t observer, uint32_t reference, const double normal[3], const std::vector<uint32_t>& targets = std::vector<uint32_t>())
+	{
+		EventSpec spec = Spec("conjunction", EVENT_CONJUNCTION, EVENT_EITHER, reference, observer, targets);
+		for (int k = 0; k < 3; k++)
+			spec.Normal[k] = normal[k];
+		return Add(spec);
+	}
+
+	// In and out of the shadow occluder casts from source
+	uint32_t AddEclipse(uint32_t source, uint32_t occluder, const std::vector<uint32_t>& targets = std::vector<uint32_t>())
+	{
+		return Add(Spec("eclipse", EVENT_ECLIPSE, EVENT_EITHER, occluder, source, targets));
+	}
+
+	// Through altitude above reference's surface, either way
+	uint32_t AddSurface(uint32_t reference, double altitude, const std::vector<uint32_t>& targets = std::vector<uint32_t>())
+	{
+		EventSpec spec = Spec("surface", EVENT_SURFACE, EVENT_EITHER, reference, EVENT_NONE, targets);
+		spec.Altitude = altitude;
+		return Add(spec);
+	}
+
+	uint32_t AddCustom(const std::string& name, const EventFunction& function, EventDirection direction, uint32_t reference, uint32_t third,
+		const std::vector<uint32_t>& targets = std::vector<uint32_t>())
+	{
+		EventSpec spec = Spec(name, EVENT_CUSTOM, direction, reference, third, targets);
+		spec.Function = function;
+		return Add(spec);
+	}
+
+	// Every hit goes to path as a CSV line as well, returns false if it can't be opened
+	bool OpenLog(const char* path)
+	{
+		CloseLog();
+		log = fopen(path, "w");
+		if (!log)
+			return false;
+		fprintf(log, "time,event,name,body,direction\n");
+		return true;
+	}
+
+	void CloseLog()
+	{
+		if (log)
+			fclose(log);
+		log = NULL;
+	}
+
+	// Forget the values kept from the last step, for when the bodies have been replaced or edited
+	void Reset()
+	{
+		primed = false;
+	}
+
+	// Where everything is at the start of the step, with the accelerations for it
+	void Begin(const Bodies& b, double t)
+	{
+		x0 = b.x; y0 = b.y; z0 = b.z;
+		vx0 = b.vx; vy0 = b.vy; vz0 = b.vz;
+		ax0 = b.ax; ay0 = b.ay; az0 = b.az;
+		if (!primed || targets.size() != Specs.size() || bodyCount != b.Count())
+		{
+			Resolve(b.Count());
+			for (size_t e = 0; e < Specs.size(); e++)
+				Sweep(b, t, e, last[e]);
+			primed = true;
+		}
+	}
+
+	// After a step of h from t0, with the end state's accelerations. Fills Hits and returns how
+	// many there were.
+	size_t Check(const Bodies& b, double t0, double h)
+	{
+		Hits.clear();
+		if (!primed || x0.size() != b.Count() || h <= 0.0)
+			return 0;
+		for (size_t e = 0; e < Specs.size(); e++)
+		{
+			const EventSpec& spec = Specs[e];
+			Sweep(b, t0 + h, e, next);
+			const std::vector<uint32_t>& list = targets[e];
+			const EventValues& before = last[e];
+			for (size_t k = 0; k < list.size(); k++)
+			{
+				if (list[k] == spec.Reference || list[k] == spec.Third)
+					continue;
+				const double f0 = before.Value[k], f1 = next.Value[k];
+				const double noise = EVENT_NOISE * std::max(before.Scale[k], next.Scale[k]);
+				//a value that was exactly 0 at the start was counted at the end of the last step
+				if ((f0 < 0.0 && f1 >= 0.0) || (f0 > 0.0 && f1 <= 0.0))
+				{
+					if (std::max(std::fabs(f0), std::fabs(f1)) > noise)
+						Refine(b, t0, h, (uint32_t)e, list[k], 0.0, 1.0, f0, f1);
+				}
+				else if (spec.Kind != EVENT_CUSTOM && std::fabs(f0) > noise)
+				{
+					//heading for zero at the start and away at the end: it may have dipped through
+					const double r0 = before.Rate[k], r1 = next.Rate[k];
+					if ((f0 > 0.0 && r0 < 0.0 && r1 > 0.0) || (f0 < 0.0 && r0 > 0.0 && r1 < 0.0))
+						DoubleCrossing(b, t0, h, (uint32_t)e, list[k], f0, f1, r0, r1);
+				}
+			}
+			last[e].Value.swap(next.Value);
+			last[e].Rate.swap(next.Rate);
+			last[e].Scale.swap(next.Scale);
+		}
+		std::sort(Hits.begin(), Hits.end(), [](const EventHit& a, const EventHit& c) { return a.Time < c.Time; });
+		Total += Hits.size();
+		if (log)
+			for (size_t k = 0; k < Hits.size(); k++)
+				fprintf(log, "%.12f,%u,%s,%u,%s\n", Hits[k].Time, Hits[k].Event, Specs[Hits[k].Event].Name.c_str(), Hits[k].Body,
+					Hits[k].Rising ? "rising" : "falling");
+		return Hits.size();
+	}
+
+private:
+	struct EventValues
+	{
+		std::vector<double> Value, Rate, Scale;
+	};
+	std::vector<double> x0, y0, z0, vx0, vy0, vz0, ax0, ay0, az0;
+	std::vector<std::vector<uint32_t> > targets; //per event, resolved
+	std::vector<EventValues> last; //per event and target, at the start of the step
+	EventValues next;
+	size_t bodyCount;
+	bool primed;
+	FILE* log;
+
+	static EventSpec Spec(const std::string& name, EventKind kind, EventDirection direction, uint32_t reference, uint32_t third,
+		const std::vector<uint32_t>& targets)
+	{
+		EventSpec spec;
+		spec.Name = name;
+		spec.Kind = kind;
+		spec.Direction = direction;
+		spec.Reference = reference;
+		spec.Third = third;
+		spec.Altitude = 0.0;
+		spec.Normal[0] = 0.0; spec.Normal[1] = 1.0; spec.Normal[2] = 0.0;
+		spec.Targets = targets;
+		return spec;
+	}
+
+	void Resolve(size_t n)
+	{
+		bodyCount = n;
+		targets.resize(Specs.size());
+		last.resize(Specs.size());
+		for (size_t e = 0; e < Specs.size(); e++)
+		{
+			const EventSpec& spec = Specs[e];
+			std::vector<uint32_t>& list = targets[e];
+			list.clear();
+			//every body is swept straight through, reference and third included (and skipped later)
+			if (spec.Targets.empty())
+			{
+				for (uint32_t i = 0; i < (uint32_t)n; i++)
+					list.push_back(i);
+			}
+			else
+				for (size_t k = 0; k < spec.Targets.size(); k++)
+					if (spec.Targets[k] < n)
+						list.push_back(spec.Targets[k]);
+		}
+	}
+
+	// Event e's function for all its targets at the current state of b
+	void Sweep(const Bodies& b, double t, size_t e, EventValues& out) const
+	{
+		if (Specs[e].Targets.empty())
+			SweepKind<true>(b, t, e, out);
+		else
+			SweepKind<false>(b, t, e, out);
+	}
+
+	template <bool Every>
+	void SweepKind(const Bodies& b, double t, size_t e, EventValues& out) const
+	{
+		switch (Specs[e].Kind)
+		{
+		case EVENT_PERIAPSIS: SweepTargets<EVENT_PERIAPSIS, Every>(b, t, e, out); break;
+		case EVENT_APOAPSIS: SweepTargets<EVENT_APOAPSIS, Every>(b, t, e, out); break;
+		case EVENT_CONJUNCTION: SweepTargets<EVENT_CONJUNCTION, Every>(b, t, e, out); break;
+		case EVENT_ECLIPSE: SweepTargets<EVENT_ECLIPSE, Every>(b, t, e, out); break;
+		case EVENT_SURFACE: SweepTargets<EVENT_SURFACE, Every>(b, t, e, out); break;
+		default: SweepTargets<EVENT_CUSTOM, Every>(b, t, e, out); break;
+		}
+	}
+
+	// The kind and whether the targets are every body are template arguments, so the loop over
+	// targets has no branching on them and (for the built in kinds on every body) reads the body
+	// arrays straight through, which the compiler vectorizes
+	template <EventKind K, bool Every>
+	void SweepTargets(const Bodies& b, double t, size_t e, EventValues& out) const
+	{
+		const EventSpec& spec = Specs[e];
+		const std::vector<uint32_t>& list = targets[e];
+		const size_t count = list.size();
+		out.Value.resize(count);
+		out.Rate.resize(count);
+		out.Scale.resize(count);
+		EventSample s;
+		s.Time = t;
+		Load(b, spec.Reference, s.RefP, s.RefV, s.RefA);
+		Load(b, spec.Third, s.ThirdP, s.ThirdV, s.ThirdA);
+		s.RefRadius = spec.Reference < b.Count() ? b.radius[spec.Reference] : 0.0;
+		const uint32_t* index = list.data();
+		const double* x = b.x.data(); const double* y = b.y.data(); const double* z = b.z.data();
+		const double* vx = b.vx.data(); const double* vy = b.vy.data(); const double* vz = b.vz.data();
+		const double* ax = b.ax.data(); const double* ay = b.ay.data(); const double* az = b.az.data();
+		double* value = out.Value.data();
+		double* rate = out.Rate.data();
+		double* scale = out.Scale.data();
+		//the outputs never alias the body arrays or each other, and saying so spares the vectorizer checking
+		EVENT_IVDEP
+		for (size_t k = 0; k < count; k++)
+		{
+			const size_t i = Every ? k : index[k];
+			const double p[3] = { x[i], y[i], z[i] };
+			const double v[3] = { vx[i], vy[i], vz[i] };
+			const double a[3] = { ax[i], ay[i], az[i] };
+			EventValue<K>(spec, s, p, v, a, value[k], rate[k], scale[k]);
+		}
+	}
+
+	static void Load(const Bodies& b, uint32_t i, double* p, double* v, double* a)
+	{
+		const bool ok = i < b.Count();
+		p[0] = ok ? b.x[i] : 0.0; p[1] = ok ? b.y[i] : 0.0; p[2] = ok ? b.z[i] : 0.0;
+		v[0] = ok ? b.vx[i] : 0.0; v[1] = ok ? b.vy[i] : 0.0; v[2] = ok ? b.vz[i] : 0.0;
+		a[0] = ok ? b.ax[i] : 0.0; a[1] = ok ? b.ay[i] : 0.0; a[2] = ok ? b.az[i] : 0.0;
+	}
+
+	// Body i's position, velocity and acceleration at s = 0..1 through the step, on the cubic
+	// through both ends
+	void Dense(const Bodies& b, uint32_t i, double h, double s, double* p, double* v, double* a) const
+	{
+		if (i >= b.Count())
+		{
+			for (int k = 0; k < 3; k++)
+				p[k] = v[k] = a[k] = 0.0;
+			return;
+		}
+		const double p0[3] = { x0[i], y0[i], z0[i] }, p1[3] = { b.x[i], b.y[i], b.z[i] };
+		const double v0[3] = { vx0[i], vy0[i], vz0[i] }, v1[3] = { b.vx[i], b.vy[i], b.vz[i] };
+		for (int k = 0; k < 3; k++)
+		{
+			const double c1 = h * v0[k];
+			const double c2 = 3.0 * (p1[k] - p0[k]) - h * (2.0 * v0[k] + v1[k]);
+			const double c3 = 2.0 * (p0[k] - p1[k]) + h * (v0[k] + v1[k]);
+			p[k] = p0[k] + s * (c1 + s * (c2 + s * c3));
+			v[k] = (c1 + s * (2.0 * c2 + s * 3.0 * c3)) / h;
+			a[k] = (2.0 * c2 + 6.0 * s * c3) / (h * h);
+		}
+	}
+
+	// Event e's value (and rate) for body i at s through the step
+	double At(const Bodies& b, double t0, double h, uint32_t e, uint32_t i, double s, double& rate) const
+	{
+		EventSample sample;
+		return At(b, t0, h, e, i, s, rate, sample);
+	}
+
+	double At(const Bodies& b, double t0, double h, uint32_t e, uint32_t i, double s, double& rate, EventSample& sample) const
+	{
+		const EventSpec& spec = Specs[e];
+		sample.Time = t0 + s * h;
+		Dense(b, i, h, s, sample.P, sample.V, sample.A);
+		Dense(b, spec.Reference, h, s, sample.RefP, sample.RefV, sample.RefA);
+		Dense(b, spec.Third, h, s, sample.ThirdP, sample.ThirdV, sample.ThirdA);
+		sample.RefRadius = spec.Reference < b.Count() ? b.radius[spec.Reference] : 0.0;
+		double value, scale;
+		switch (spec.Kind)
+		{
+		case EVENT_PERIAPSIS: EventValue<EVENT_PERIAPSIS>(spec, sample, sample.P, sample.V, sample.A, value, rate, scale); break;
+		case EVENT_APOAPSIS: EventValue<EVENT_APOAPSIS>(spec, sample, sample.P, sample.V, sample.A, value, rate, scale); break;
+		case EVENT_CONJUNCTION: EventValue<EVENT_CONJUNCTION>(spec, sample, sample.P, sample.V, sample.A, value, rate, scale); break;
+		case EVENT_ECLIPSE: EventValue<EVENT_ECLIPSE>(spec, sample, sample.P, sample.V, sample.A, value, rate, scale); break;
+		case EVENT_SURFACE: EventValue<EVENT_SURFACE>(spec, sample, sample.P, sample.V, sample.A, value, rate, scale); break;
+		default: EventValue<EVENT_CUSTOM>(spec, sample, sample.P, sample.V, sample.A, value, rate, scale); break;
+		}
+		return value;
+	}
+
+	// Brent's method: the root of g in [a, c], where ga and gc differ in sign, to tol in s
+	template <typename F>
+	static double Brent(const F& g, double a, double c, double ga, double gc, double tol)
+	{
+		double b = c, gb = gc;
+		double d = c - a, e = d;
+		for (int k = 0; k < EVENT_MAX_ITERATIONS; k++)
+		{
+			//keep the root between b and c, with b the better guess
+			if ((gb > 0.0) == (gc > 0.0))
+			{
+				c = a; gc = ga;
+				d = e = b - a;
+			}
+			if (std::fabs(gc) < std::fabs(gb))
+			{
+				a = b; b = c; c = a;
+				ga = gb; gb = gc; gc = ga;
+			}
+			const double limit = 2.0 * DBL_EPSILON * std::fabs(b) + 0.5 * tol;
+			const double half = 0.5 * (c - b);
+			if (std::fabs(half) <= limit || gb == 0.0)
+				return b;
+			if (std::fabs(e) >= limit && std::fabs(ga) > std::fabs(gb))
+			{
+				//inverse quadratic interpolation, or the secant if only two points are distinct
+				double p, q;
+				const double sb = gb / ga;
+				if (a == c)
+				{
+					p = 2.0 * half * sb;
+					q = 1.0 - sb;
+				}
+				else
+				{
+					const double qa = ga / gc, rb = gb / gc;
+					p = sb * (2.0 * half * qa * (qa - rb) - (b - a) * (rb - 1.0));
+					q = (qa - 1.0) * (rb - 1.0) * (sb - 1.0);
+				}
+				if (p > 0.0)
+					q = -q;
+				p = std::fabs(p);
+				//take it only if it lands inside and converges faster than bisection is
+				if (2.0 * p < std::min(3.0 * half * q - std::fabs(limit * q), std::fabs(e * q)))
+				{
+					e = d;
+					d = p / q;
+				}
+				else
+					d = e = half;
+			}
+			else
+				d = e = half;
+			a = b;
+			ga = gb;
+			b += std::fabs(d) > limit ? d : (half > 0.0 ? limit : -limit);
+			gb = g(b);
+		}
+		return b;
+	}
+
+	// A root of event e for body i in [lo, hi], where f changes sign, recorded if it's the
+	// direction the event wants
+	void Refine(const Bodies& b, double t0, double h, uint32_t e, uint32_t i, double lo, double hi, double flo, double fhi)
+	{
+		const EventSpec& spec = Specs[e];
+		const bool rising = flo < fhi;
+		if ((spec.Direction == EVENT_RISING && !rising) || (spec.Direction == EVENT_FALLING && rising))
+			return;
+		double rate;
+		const double s = Brent([&](double x) { return At(b, t0, h, e, i, x, rate); }, lo, hi, flo, fhi, EVENT_TOLERANCE);
+		if (spec.Kind == EVENT_CONJUNCTION)
+		{
+			//lined up on the far side is an opposition
+			EventSample sample;
+			At(b, t0, h, e, i, s, rate, sample);
+			double along = 0.0;
+			for (int k = 0; k < 3; k++)
+				along += (sample.P[k] - sample.ThirdP[k]) * (sample.RefP[k] - sample.ThirdP[k]);
+			if (along < 0.0)
+				return;
+		}
+		EventHit hit;
+		hit.Time = t0 + s * h;
+		hit.Event = e;
+		hit.Body = i;
+		hit.Rising = rising;
+		Hits.push_back(hit);
+	}
+
+	// f kept its sign over the step but turned round: find where the rate is zero and, if f got
+	// to the other side there, refine both crossings
+	void DoubleCrossing(const Bodies& b, double t0, double h, uint32_t e, uint32_t i, double f0, double f1, double r0, double r1)
+	{
+		double value = 0.0, rate;
+		const double turn = Brent([&](double x) { At(b, t0, h, e, i, x, rate); return rate; }, 0.0, 1.0, r0, r1, EVENT_TOLERANCE);
+		value = At(b, t0, h, e, i, turn, rate);
+		if ((value < 0.0) == (f0 < 0.0))
+			return;
+		Refine(b, t0, h, e, i, 0.0, turn, f0, value);
+		Refine(b, t0, h, e, i, turn, 1.0, value, f1);
+	}
+};
+#endif
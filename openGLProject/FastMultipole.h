@@ -0,0 +1,631 @@
+#ifndef FAST_MULTIPOLE_H
+#define FAST_MULTIPOLE_H
+
+#include "Bodies.h"
+#include "Parallel.h"
+#include "PerfGate.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+// Default fast multipole values
+const int FMM_ORDER = 4; //expansion order p, error falls roughly as theta^(p + 1)
+const int FMM_MAX_ORDER = 12;
+const double FMM_THETA = 0.5; //cells interact through expansions when (rA + rB) < theta * distance
+const int FMM_LEAF_SIZE = 32; //most bodies in a cell before it's split
+const int FMM_LANES = 8; //M2L interactions evaluated side by side
+const int FMM_MAX_DEPTH = 48; //coincident bodies stop splitting here
+
+// Cartesian fast multipole method. Bodies go into an octree; each cell gets a Taylor multipole
+// expansion about its centre of mass (upward pass), cells far enough apart for the MAC swap
+// multipoles for local expansions (M2L), near cells sum directly (P2P), and local expansions are
+// pushed down to the bodies (downward pass). Work is O(N) for a fixed order and theta.
+// The dual-tree walk only records who interacts with whom; the interactions are then done per
+// target cell on every thread, M2L FMM_LANES sources at a time with the derivative tensors and
+// contractions laid out lane-innermost so they vectorise.
+// Near field is softened like the direct sum; far field is plain 1/r, the MAC keeps it far.
+class FastMultipole
+{
+public:
+	int Order;
+	double Theta;
+	int LeafSize;
+	unsigned int Threads; //0 = every hardware thread
+	double Potential; //sum of 0.5 m phi from the last Compute
+	//where the last Compute went
+	double BuildMs;
+	double UpwardMs;
+	double InteractMs;
+	double DownwardMs;
+	size_t M2LCount; //cell-cell expansions
+	size_t P2PCount; //body-body pairs summed directly
+
+	FastMultipole(int order = FMM_ORDER, double theta = FMM_THETA, int leafSize = FMM_LEAF_SIZE)
+		: Order(order), Theta(theta), LeafSize(leafSize), Threads(0), Potential(0.0), BuildMs(0.0), UpwardMs(0.0),
+		InteractMs(0.0), DownwardMs(0.0), M2LCount(0), P2PCount(0), planned(-1), count(0)
+	{
+	}
+
+	// Fills ax/ay/az for every body and sets Potential
+	void Compute(Bodies& b, double G, double softening)
+	{
+		if (Order < 1)
+			Order = 1;
+		if (Order > FMM_MAX_ORDER)
+			Order = FMM_MAX_ORDER;
+		if (LeafSize < 1)
+			LeafSize = 1;
+		Plan(Order);
+		const size_t n = b.Count();
+		if (n == 0)
+		{
+			Potential = 0.0;
+			return;
+		}
+
+		PerfTimer timer;
+		Build(b);
+		BuildMs = timer.ElapsedMs();
+
+		timer.Restart();
+		Upward();
+		UpwardMs = timer.ElapsedMs();
+
+		timer.Restart();
+		Traverse();
+		const double eps2 = softening * softening;
+		accel.assign(n * 4, 0.0);
+		local.assign(nodes.size() * count, 0.0);
+		ParallelFor(m2lStart.size() - 1, Threads, [this](size_t begin, size_t end, unsigned int)
+		{
+			std::vector<double> scratch(Scratch());
+			for (size_t target = begin; target < end; target++)
+				if (m2lStart[target + 1] > m2lStart[target])
+					M2L((int)target, scratch.data());
+		});
+		ParallelFor(p2pStart.size() - 1, Threads, [this, eps2](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t target = begin; target < end; target++)
+				for (size_t k = p2pStart[target]; k < p2pStart[target + 1]; k++)
+					P2P((int)target, p2pSource[k], eps2);
+		});
+		InteractMs = timer.ElapsedMs();
+
+		timer.Restart();
+		Downward();
+		//back to the caller's order, acceleration is G grad(sum m / r), phi is -G sum m / r
+		double potential = 0.0;
+		for (size_t k = 0; k < n; k++)
+		{
+			size_t i = index[k];
+			b.ax[i] = G * accel[k * 4];
+			b.ay[i] = G * accel[k * 4 + 1];
+			b.az[i] = G * accel[k * 4 + 2];
+			potential -= 0.5 * G * pm[k] * accel[k * 4 + 3];
+		}
+		Potential = potential;
+		DownwardMs = timer.ElapsedMs();
+	}
+
+private:
+	struct Node
+	{
+		double Center[3]; //centre of mass, where the expansions are taken
+		double Radius; //no body in the cell is further than this from Center
+		double Box[3]; //geometric centre and half side, for splitting
+		double Half;
+		uint32_t Begin, End; //bodies, in tree order
+		int32_t FirstChild; //-1 for a leaf
+		int32_t ChildCount;
+	};
+
+	// One term of a contraction: out[Out] += a[A] * b[B]
+	struct Term
+	{
+		int Out, A, B;
+	};
+
+	int planned; //order the tables below are for
+	int count; //coefficients per expansion, (p + 1)(p + 2)(p + 3) / 6
+	std::vector<int> nx, ny, nz; //multi-index of each coefficient, by total degree
+	std::vector<double> invFactorial; //1 / (nx! ny! nz!)
+	std::vector<int> lookup; //(p + 1)^3 -> coefficient, -1 past the order
+	//derivative recurrence per coefficient: which axis to step along, from which two coefficients
+	std::vector<int> stepAxis, stepFrom, stepFrom2;
+	std::vector<Term> m2lTerms; //L[k] += M[n] D[n + k]
+	std::vector<Term> m2mTerms; //M[n] += M'[k] (-d)^(n - k) / (n - k)!
+	std::vector<Term> l2lTerms; //L'[k] += L[n] d^(n - k) / (n - k)!
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> index; //tree order -> caller's body
+	std::vector<double> px, py, pz, pm; //bodies in tree order
+	std::vector<double> multipole, local; //count per node
+	std::vector<double> accel; //ax, ay, az, psi per body in tree order
+	std::vector<std::pair<int, int> > m2lPairs, p2pPairs;
+	std::vector<size_t> m2lStart, p2pStart; //per target node, into the sources below
+	std::vector<int> m2lSource, p2pSource;
+
+	int Index(int x, int y, int z) const
+	{
+		return lookup[(x * (planned + 1) + y) * (planned + 1) + z];
+	}
+
+	void Plan(int order)
+	{
+		if (planned == order)
+			return;
+		planned = order;
+		nx.clear(); ny.clear(); nz.clear(); invFactorial.clear();
+		lookup.assign((order + 1) * (order + 1) * (order + 1), -1);
+		double factorial[FMM_MAX_ORDER + 1];
+		factorial[0] = 1.0;
+		for (int k = 1; k <= FMM_MAX_ORDER; k++)
+			factorial[k] = factorial[k - 1] * k;
+		for (int degree = 0; degree <= order; degree++)
+			for (int x = degree; x >= 0; x--)
+				for (int y = degree - x; y >= 0; y--)
+				{
+					int z = degree - x - y;
+					lookup[(x * (order + 1) + y) * (order + 1) + z] = (int)nx.size();
+					nx.push_back(x); ny.push_back(y); nz.push_back(z);
+					invFactorial.push_back(1.0 / (factorial[x] * factorial[y] * factorial[z]));
+				}
+		count = (int)nx.size();
+
+		stepAxis.assign(count, 0);
+		stepFrom.assign(count, -1);
+		stepFrom2.assign(count, -1);
+		for (int c = 1; c < count; c++)
+		{
+			int n[3] = { nx[c], ny[c], nz[c] };
+			int axis = n[0] > 0 ? 0 : n[1] > 0 ? 1 : 2;
+			n[axis]--;
+			stepAxis[c] = axis;
+			stepFrom[c] = Index(n[0], n[1], n[2]);
+			if (n[axis] > 0)
+			{
+				n[axis]--;
+				stepFrom2[c] = Index(n[0], n[1], n[2]);
+			}
+		}
+
+		m2lTerms.clear();
+		m2mTerms.clear();
+		l2lTerms.clear();
+		for (int k = 0; k < count; k++)
+			for (int j = 0; j < count; j++)
+			{
+				if (nx[k] + ny[k] + nz[k] + nx[j] + ny[j] + nz[j] > order)
+					continue;
+				int sum = Index(nx[k] + nx[j], ny[k] + ny[j], nz[k] + nz[j]);
+				Term m2l = { k, j, sum };
+				m2lTerms.push_back(m2l);
+				//shifts: out = k + j from k, and out = k from k + j, both with the j power
+				Term m2m = { sum, k, j };
+				m2mTerms.push_back(m2m);
+				Term l2l = { k, sum, j };
+				l2lTerms.push_back(l2l);
+			}
+	}
+
+	// d^n / n! for every coefficient
+	void Powers(double dx, double dy, double dz, double* out) const
+	{
+		double x[FMM_MAX_ORDER + 1], y[FMM_MAX_ORDER + 1], z[FMM_MAX_ORDER + 1];
+		x[0] = y[0] = z[0] = 1.0;
+		for (int k = 1; k <= planned; k++)
+		{
+			x[k] = x[k - 1] * dx;
+			y[k] = y[k - 1] * dy;
+			z[k] = z[k - 1] * dz;
+		}
+		for (int c = 0; c < count; c++)
+			out[c] = x[nx[c]] * y[ny[c]] * z[nz[c]] * invFactorial[c];
+	}
+
+	void Build(const Bodies& b)
+	{
+		const size_t n = b.Count();
+		index.resize(n);
+		px.resize(n); py.resize(n); pz.resize(n); pm.resize(n);
+		double low[3] = { b.x[0], b.y[0], b.z[0] }, high[3] = { b.x[0], b.y[0], b.z[0] };
+		for (size_t i = 0; i < n; i++)
+		{
+			index[i] = (uint32_t)i;
+			double p[3] = { b.x[i], b.y[i], b.z[i] };
+			for (int axis = 0; axis < 3; axis++)
+			{
+				low[axis] = p[axis] < low[axis] ? p[axis] : low[axis];
+				high[axis] = p[axis] > high[axis] ? p[axis] : high[axis];
+			}
+		}
+		nodes.clear();
+		Node root;
+		root.Half = 0.0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			root.Box[axis] = 0.5 * (low[axis] + high[axis]);
+			double half = 0.5 * (high[axis] - low[axis]);
+			root.Half = half > root.Half ? half : root.Half;
+		}
+		root.Half = root.Half * 1.0001 + 1e-12;
+		root.Begin = 0;
+		root.End = (uint32_t)n;
+		nodes.push_back(root);
+		std::vector<uint32_t> scratch(n);
+		Split(0, b, scratch, 0);
+		for (size_t k = 0; k < n; k++)
+		{
+			size_t i = index[k];
+			px[k] = b.x[i]; py[k] = b.y[i]; pz[k] = b.z[i]; pm[k] = b.mass[i];
+		}
+	}
+
+	// Children of a cell are made together, so they sit next to each other (and after their parent)
+	void Split(int node, const Bodies& b, std::vector<uint32_t>& scratch, int depth)
+	{
+		Node cell = nodes[node];
+		nodes[node].FirstChild = -1;
+		nodes[node].ChildCount = 0;
+		if ((int)(cell.End - cell.Begin) <= LeafSize || depth >= FMM_MAX_DEPTH)
+			return;
+		size_t counts[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+		for (uint32_t k = cell.Begin; k < cell.End; k++)
+			counts[Octant(cell, b, index[k])]++;
+		size_t offsets[8];
+		size_t running = cell.Begin;
+		for (int o = 0; o < 8; o++)
+		{
+			offsets[o] = running;
+			running += counts[o];
+		}
+		for (uint32_t k = cell.Begin; k < cell.End; k++)
+			scratch[offsets[Octant(cell, b, index[k])]++] = index[k];
+		for (uint32_t k = cell.Begin; k < cell.End; k++)
+			index[k] = scratch[k];
+
+		int first = (int)nodes.size();
+		size_t begin = cell.Begin;
+		for (int o = 0; o < 8; o++)
+		{
+			if (counts[o] == 0)
+				continue;
+			Node child;
+			child.Half = 0.5 * cell.Half;
+			child.Box[0] = cell.Box[0] + (o & 1 ? child.Half : -child.Half);
+			child.Box[1] = cell.Box[1] + (o & 2 ? child.Half : -child.Half);
+			child.Box[2] = cell.Box[2] + (o & 4 ? child.Half : -child.Half);
+			child.Begin = (uint32_t)begin;
+			child.End = (uint32_t)(begin + counts[o]);
+			begin += counts[o];
+			nodes.push_back(child);
+		}
+		int children = (int)nodes.size() - first;
+		nodes[node].FirstChild = first;
+		nodes[node].ChildCount = children;
+		for (int c = 0; c < children; c++)
+			Split(first + c, b, scratch, depth + 1);
+	}
+
+	static int Octant(const Node& cell, const Bodies& b, size_t i)
+	{
+		return (b.x[i] >= cell.Box[0] ? 1 : 0) | (b.y[i] >= cell.Box[1] ? 2 : 0) | (b.z[i] >= cell.Box[2] ? 4 : 0);
+	}
+
+	// Centres, radii and multipoles, children before parents
+	void Upward()
+	{
+		multipole.assign(nodes.size() * count, 0.0);
+		std::vector<double> powers(count);
+		for (int k = (int)nodes.size() - 1; k >= 0; k--)
+		{
+			Node& cell = nodes[k];
+			double* m = &multipole[(size_t)k * count];
+			double mass = 0.0, cx = 0.0, cy = 0.0, cz = 0.0;
+			if (cell.FirstChild < 0)
+			{
+				for (uint32_t i = cell.Begin; i < cell.End; i++)
+				{
+					mass += pm[i];
+					cx += pm[i] * px[i]; cy += pm[i] * py[i]; cz += pm[i] * pz[i];
+				}
+			}
+			else
+			{
+				for (int c = cell.FirstChild; c < cell.FirstChild + cell.ChildCount; c++)
+				{
+					double cm = multipole[(size_t)c * count];
+					mass += cm;
+					cx += cm * nodes[c].Center[0]; cy += cm * nodes[c].Center[1]; cz += cm * nodes[c].Center[2];
+				}
+			}
+			//massless cells (test particles) expand about the box centre
+			if (mass != 0.0)
+			{
+				cell.Center[0] = cx / mass; cell.Center[1] = cy / mass; cell.Center[2] = cz / mass;
+			}
+			else
+			{
+				cell.Center[0] = cell.Box[0]; cell.Center[1] = cell.Box[1]; cell.Center[2] = cell.Box[2];
+			}
+
+			double radius = 0.0;
+			if (cell.FirstChild < 0)
+			{
+				//P2M: M[n] = sum m (-s)^n / n!
+				for (uint32_t i = cell.Begin; i < cell.End; i++)
+				{
+					double dx = px[i] - cell.Center[0], dy = py[i] - cell.Center[1], dz = pz[i] - cell.Center[2];
+					double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+					radius = r > radius ? r : radius;
+					Powers(-dx, -dy, -dz, powers.data());
+					for (int c = 0; c < count; c++)
+						m[c] += pm[i] * powers[c];
+				}
+			}
+			else
+			{
+				//M2M, shifting each child's expansion to this centre
+				for (int c = cell.FirstChild; c < cell.FirstChild + cell.ChildCount; c++)
+				{
+					const Node& child = nodes[c];
+					double dx = child.Center[0] - cell.Center[0], dy = child.Center[1] - cell.Center[1], dz = child.Center[2] - cell.Center[2];
+					double r = std::sqrt(dx * dx + dy * dy + dz * dz) + child.Radius;
+					radius = r > radius ? r : radius;
+					Powers(-dx, -dy, -dz, powers.data());
+					const double* from = &multipole[(size_t)c * count];
+					for (size_t t = 0; t < m2mTerms.size(); t++)
+						m[m2mTerms[t].Out] += from[m2mTerms[t].A] * powers[m2mTerms[t].B];
+				}
+			}
+			cell.Radius = radius;
+		}
+	}
+
+	bool WellSeparated(const Node& a, const Node& b) const
+	{
+		double dx = a.Center[0] - b.Center[0], dy = a.Center[1] - b.Center[1], dz = a.Center[2] - b.Center[2];
+		double reach = a.Radius + b.Radius;
+		return reach * reach < Theta * Theta * (dx * dx + dy * dy + dz * dz);
+	}
+
+	// Dual-tree walk, one-directional (sources B on targets A), into per-target lists
+	void Traverse()
+	{
+		m2lPairs.clear();
+		p2pPairs.clear();
+		std::vector<std::pair<int, int> > stack;
+		stack.push_back(std::make_pair(0, 0));
+		while (!stack.empty())
+		{
+			std::pair<int, int> pair = stack.back();
+			stack.pop_back();
+			const Node& a = nodes[pair.first];
+			const Node& b = nodes[pair.second];
+			bool aLeaf = a.FirstChild < 0, bLeaf = b.FirstChild < 0;
+			if (pair.first == pair.second)
+			{
+				if (aLeaf)
+					p2pPairs.push_back(pair);
+				else
+					for (int i = a.FirstChild; i < a.FirstChild + a.ChildCount; i++)
+						for (int j = a.FirstChild; j < a.FirstChild + a.ChildCount; j++)
+							stack.push_back(std::make_pair(i, j));
+			}
+			else if (WellSeparated(a, b))
+				m2lPairs.push_back(pair);
+			else if (aLeaf && bLeaf)
+				p2pPairs.push_back(pair);
+			else if (bLeaf || (!aLeaf && a.Radius >= b.Radius))
+			{
+				for (int i = a.FirstChild; i < a.FirstChild + a.ChildCount; i++)
+					stack.push_back(std::make_pair(i, pair.second));
+			}
+			else
+			{
+				for (int j = b.FirstChild; j < b.FirstChild + b.ChildCount; j++)
+					stack.push_back(std::make_pair(pair.first, j));
+			}
+		}
+		Group(m2lPairs, m2lStart, m2lSource);
+		Group(p2pPairs, p2pStart, p2pSource);
+		M2LCount = m2lPairs.size();
+		P2PCount = 0;
+		for (size_t k = 0; k < p2pPairs.size(); k++)
+			P2PCount += (size_t)(nodes[p2pPairs[k].first].End - nodes[p2pPairs[k].first].Begin) *
+				(nodes[p2pPairs[k].second].End - nodes[p2pPairs[k].second].Begin);
+	}
+
+	// Counting sort of (target, source) pairs by target
+	void Group(const std::vector<std::pair<int, int> >& pairs, std::vector<size_t>& start, std::vector<int>& source) const
+	{
+		start.assign(nodes.size() + 1, 0);
+		for (size_t k = 0; k < pairs.size(); k++)
+			start[pairs[k].first + 1]++;
+		for (size_t k = 0; k < nodes.size(); k++)
+			start[k + 1] += start[k];
+		source.resize(pairs.size());
+		std::vector<size_t> next(start.begin(), start.end() - 1);
+		for (size_t k = 0; k < pairs.size(); k++)
+			source[next[pairs[k].first]++] = pairs[k].second;
+	}
+
+	// Per-thread M2L scratch: R^(m) table, M lanes, L lanes
+	size_t Scratch() const
+	{
+		return ((size_t)(planned + 1) * count + count * 2 + 3) * FMM_LANES;
+	}
+
+	// Every source in target's M2L list onto its local expansion, FMM_LANES at a time.
+	// D[n] = d^n (1/r) comes from the McMurchie-Davidson recurrence
+	//   R(m)[0] = (-1)^m (2m - 1)!! / r^(2m + 1),  R(m)[n + e] = (n_e) R(m + 1)[n - e] + X_e R(m + 1)[n]
+	// with D[n] = R(0)[n], every step a loop over lanes.
+	void M2L(int target, double* scratch)
+	{
+		const int L = FMM_LANES;
+		double* R = scratch; //[(m * count + c) * L + lane]
+		double* M = R + (size_t)(planned + 1) * count * L; //[c * L + lane]
+		double* acc = M + (size_t)count * L; //[c * L + lane]
+		double* X = acc + (size_t)count * L; //[axis * L + lane]
+		for (int c = 0; c < count * L; c++)
+			acc[c] = 0.0;
+		const Node& t = nodes[target];
+		for (size_t k = m2lStart[target]; k < m2lStart[target + 1]; k += L)
+		{
+			size_t lanes = m2lStart[target + 1] - k < (size_t)L ? m2lStart[target + 1] - k : (size_t)L;
+			for (int l = 0; l < L; l++)
+			{
+				if ((size_t)l < lanes)
+				{
+					const Node& s = nodes[m2lSource[k + l]];
+					X[l] = t.Center[0] - s.Center[0];
+					X[L + l] = t.Center[1] - s.Center[1];
+					X[2 * L + l] = t.Center[2] - s.Center[2];
+					const double* from = &multipole[(size_t)m2lSource[k + l] * count];
+					for (int c = 0; c < count; c++)
+						M[c * L + l] = from[c];
+				}
+				else
+				{
+					//empty lane: harmless distance, no mass
+					X[l] = 1.0;
+					X[L + l] = X[2 * L + l] = 0.0;
+					for (int c = 0; c < count; c++)
+						M[c * L + l] = 0.0;
+				}
+			}
+			//R(m)[0] for every m
+			for (int l = 0; l < L; l++)
+			{
+				double r2 = X[l] * X[l] + X[L + l] * X[L + l] + X[2 * L + l] * X[2 * L + l];
+				double inv2 = 1.0 / r2;
+				double g = std::sqrt(inv2);
+				for (int m = 0; m <= planned; m++)
+				{
+					R[((size_t)m * count) * L + l] = g;
+					g *= -(2 * m + 1) * inv2;
+				}
+			}
+			for (int c = 1; c < count; c++)
+			{
+				int degree = nx[c] + ny[c] + nz[c];
+				const double* x = X + stepAxis[c] * L;
+				int from = stepFrom[c], from2 = stepFrom2[c];
+				int n = (stepAxis[c] == 0 ? nx[c] : stepAxis[c] == 1 ? ny[c] : nz[c]) - 1;
+				for (int m = 0; m + degree <= planned; m++)
+				{
+					double* out = R + ((size_t)m * count + c) * L;
+					const double* a = R + ((size_t)(m + 1) * count + from) * L;
+					if (from2 >= 0)
+					{
+						const double* b = R + ((size_t)(m + 1) * count + from2) * L;
+						for (int l = 0; l < L; l++)
+							out[l] = n * b[l] + x[l] * a[l];
+					}
+					else
+						for (int l = 0; l < L; l++)
+							out[l] = x[l] * a[l];
+				}
+			}
+			//L[k] += M[n] D[n + k]
+			for (size_t term = 0; term < m2lTerms.size(); term++)
+			{
+				double* out = acc + m2lTerms[term].Out * L;
+				const double* a = M + m2lTerms[term].A * L;
+				const double* d = R + m2lTerms[term].B * L;
+				for (int l = 0; l < L; l++)
+					out[l] += a[l] * d[l];
+			}
+		}
+		double* to = &local[(size_t)target * count];
+		for (int c = 0; c < count; c++)
+		{
+			double sum = 0.0;
+			for (int l = 0; l < L; l++)
+				sum += acc[c * L + l];
+			to[c] += sum;
+		}
+	}
+
+	// Sources' bodies straight onto the target's, into accel (grad psi and psi)
+	void P2P(int target, int source, double eps2)
+	{
+		const Node& t = nodes[target];
+		const Node& s = nodes[source];
+		double* out = accel.data();
+		for (uint32_t i = t.Begin; i < t.End; i++)
+		{
+			double ax = 0.0, ay = 0.0, az = 0.0, psi = 0.0;
+			const double xi = px[i], yi = py[i], zi = pz[i];
+			for (uint32_t j = s.Begin; j < s.End; j++)
+			{
+				double dx = px[j] - xi, dy = py[j] - yi, dz = pz[j] - zi;
+				double r2 = dx * dx + dy * dy + dz * dz + eps2;
+				//the body itself (same leaf), or an exact duplicate with no softening
+				double invR = i == j || r2 == 0.0 ? 0.0 : 1.0 / std::sqrt(r2);
+				double mr = pm[j] * invR;
+				double mr3 = mr * invR * invR;
+				ax += dx * mr3; ay += dy * mr3; az += dz * mr3;
+				psi += mr;
+			}
+			out[i * 4] += ax;
+			out[i * 4 + 1] += ay;
+			out[i * 4 + 2] += az;
+			out[i * 4 + 3] += psi;
+		}
+	}
+
+	// L2L parents to children, then L2P at the leaves
+	void Downward()
+	{
+		std::vector<double> powers(count);
+		for (size_t k = 0; k < nodes.size(); k++)
+		{
+			const Node& cell = nodes[k];
+			if (cell.FirstChild < 0)
+				continue;
+			const double* from = &local[k * count];
+			for (int c = cell.FirstChild; c < cell.FirstChild + cell.ChildCount; c++)
+			{
+				const Node& child = nodes[c];
+				Powers(child.Center[0] - cell.Center[0], child.Center[1] - cell.Center[1], child.Center[2] - cell.Center[2], powers.data());
+				double* to = &local[(size_t)c * count];
+				for (size_t t = 0; t < l2lTerms.size(); t++)
+					to[l2lTerms[t].Out] += from[l2lTerms[t].A] * powers[l2lTerms[t].B];
+			}
+		}
+		ParallelFor(nodes.size(), Threads, [this](size_t begin, size_t end, unsigned int)
+		{
+			std::vector<double> powers(count);
+			for (size_t k = begin; k < end; k++)
+			{
+				const Node& cell = nodes[k];
+				if (cell.FirstChild >= 0)
+					continue;
+				const double* l = &local[k * count];
+				for (uint32_t i = cell.Begin; i < cell.End; i++)
+				{
+					//psi = sum L[k] t^k / k!, and its gradient from the terms one degree up
+					Powers(px[i] - cell.Center[0], py[i] - cell.Center[1], pz[i] - cell.Center[2], powers.data());
+					double psi = 0.0, gx = 0.0, gy = 0.0, gz = 0.0;
+					for (int c = 0; c < count; c++)
+					{
+						psi += l[c] * powers[c];
+						if (nx[c] + ny[c] + nz[c] == planned)
+							continue;
+						gx += l[Index(nx[c] + 1, ny[c], nz[c])] * powers[c];
+						gy += l[Index(nx[c], ny[c] + 1, nz[c])] * powers[c];
+						gz += l[Index(nx[c], ny[c], nz[c] + 1)] * powers[c];
+					}
+					accel[i * 4] += gx;
+					accel[i * 4 + 1] += gy;
+					accel[i * 4 + 2] += gz;
+					accel[i * 4 + 3] += psi;
+				}
+			}
+		});
+	}
+};
+#endif
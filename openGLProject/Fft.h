@@ -0,0 +1,221 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include "Parallel.h"
+
+#include <vector>
+#include <complex>
+#include <cmath>
+
+typedef std::complex<double> Complex;
+
+const double FFT_PI = 3.14159265358979323846;
+
+// Radix-2 complex FFT of one power-of-two length, twiddles and bit reversal worked out once.
+// Forward is exp(-2 pi i jk / n), inverse exp(+...) and unnormalised.
+class Fft
+{
+public:
+	Fft() : n(0)
+	{
+	}
+
+	void Plan(size_t length)
+	{
+		n = length;
+		twiddle.resize(n / 2);
+		for (size_t k = 0; k < n / 2; k++)
+			twiddle[k] = std::polar(1.0, -2.0 * FFT_PI * k / n);
+		reverse.resize(n);
+		int bits = 0;
+		while (((size_t)1 << bits) < n)
+			bits++;
+		for (size_t k = 0; k < n; k++)
+		{
+			size_t r = 0;
+			for (int b = 0; b < bits; b++)
+				r |= ((k >> b) & 1) << (bits - 1 - b);
+			reverse[k] = r;
+		}
+	}
+
+	size_t Length() const
+	{
+		return n;
+	}
+
+	void Transform(Complex* data, bool inverse) const
+	{
+		for (size_t k = 0; k < n; k++)
+			if (k < reverse[k])
+				std::swap(data[k], data[reverse[k]]);
+		for (size_t half = 1, stride = n / 2; half < n; half *= 2, stride /= 2)
+		{
+			for (size_t start = 0; start < n; start += half * 2)
+			{
+				for (size_t k = 0; k < half; k++)
+				{
+					Complex w = inverse ? std::conj(twiddle[k * stride]) : twiddle[k * stride];
+					Complex a = data[start + k];
+					Complex b = data[start + k + half] * w;
+					data[start + k] = a + b;
+					data[start + k + half] = a - b;
+				}
+			}
+		}
+	}
+
+private:
+	size_t n;
+	std::vector<Complex> twiddle;
+	std::vector<size_t> reverse;
+};
+
+// Real-to-complex 3D FFT of an M x M x M grid, M a power of two, done in place the way FFTW
+// lays it out: x rows of real values padded to 2 (M/2 + 1) doubles, which become M/2 + 1
+// complex values (the other half of the spectrum is the conjugate). Real x rows go through an
+// M/2 complex FFT with the even/odd split, y and z are plain complex FFTs on gathered lines.
+// Every pass is split over lines between threads.
+class RealFft3
+{
+public:
+	int M;
+	unsigned int Threads; //0 = every hardware thread
+
+	RealFft3() : M(0), Threads(0)
+	{
+	}
+
+	void Plan(int size)
+	{
+		M = size;
+		lines.Plan(M);
+		halfRows.Plan(M / 2);
+		split.resize(M / 2 + 1);
+		for (int k = 0; k <= M / 2; k++)
+			split[k] = std::polar(1.0, -2.0 * FFT_PI * k / M);
+	}
+
+	// Complex values per x row of the spectrum
+	int HalfX() const
+	{
+		return M / 2 + 1;
+	}
+
+	// Doubles the grid needs, padding included
+	size_t Doubles() const
+	{
+		return (size_t)2 * HalfX() * M * M;
+	}
+
+	// Offset of real value (x, y, z)
+	size_t RealIndex(int x, int y, int z) const
+	{
+		return ((size_t)z * M + y) * 2 * HalfX() + x;
+	}
+
+	// Offset of spectrum value (kx, ky, kz), in Complex
+	size_t ComplexIndex(int kx, int ky, int kz) const
+	{
+		return ((size_t)kz * M + ky) * HalfX() + kx;
+	}
+
+	void Forward(double* grid)
+	{
+		Complex* spectrum = (Complex*)grid;
+		ParallelFor((size_t)M * M, Threads, [&](size_t begin, size_t end, unsigned int)
+		{
+			std::vector<Complex> scratch(M / 2);
+			for (size_t row = begin; row < end; row++)
+				RowForward(grid + row * 2 * HalfX(), scratch.data());
+		});
+		Columns(spectrum, false);
+	}
+
+	// Unnormalised, so Inverse(Forward(g)) is M^3 g
+	void Inverse(double* grid)
+	{
+		Complex* spectrum = (Complex*)grid;
+		Columns(spectrum, true);
+		ParallelFor((size_t)M * M, Threads, [&](size_t begin, size_t end, unsigned int)
+		{
+			std::vector<Complex> scratch(M / 2);
+			for (size_t row = begin; row < end; row++)
+				RowInverse(grid + row * 2 * HalfX(), scratch.data());
+		});
+	}
+
+private:
+	Fft lines;
+	Fft halfRows;
+	std::vector<Complex> split; //exp(-2 pi i k / M), k = 0..M/2
+
+	// M reals to M/2 + 1 complex, in place in a padded row
+	void RowForward(double* row, Complex* z) const
+	{
+		const int h = M / 2;
+		for (int k = 0; k < h; k++)
+			z[k] = Complex(row[2 * k], row[2 * k + 1]);
+		halfRows.Transform(z, false);
+		Complex* out = (Complex*)row;
+		for (int k = 0; k <= h / 2; k++)
+		{
+			//X[k] and X[h - k] both come from Z[k] and Z[h - k]
+			int j = (h - k) % h;
+			Complex a = z[k], b = std::conj(z[j]);
+			Complex even = 0.5 * (a + b), odd = Complex(0.0, -0.5) * (a - b);
+			Complex aj = z[j], bj = std::conj(z[k]);
+			Complex evenJ = 0.5 * (aj + bj), oddJ = Complex(0.0, -0.5) * (aj - bj);
+			out[k] = even + split[k] * odd;
+			out[h - k] = evenJ + split[h - k] * oddJ;
+		}
+	}
+
+	// M/2 + 1 complex to M reals (times M), in place
+	void RowInverse(double* row, Complex* z) const
+	{
+		const int h = M / 2;
+		const Complex* in = (const Complex*)row;
+		for (int k = 0; k < h; k++)
+		{
+			Complex a = in[k], b = std::conj(in[h - k]);
+			Complex even = a + b;
+			Complex odd = (a - b) * std::conj(split[k]);
+			z[k] = even + Complex(0.0, 1.0) * odd;
+		}
+		halfRows.Transform(z, true);
+		for (int k = 0; k < h; k++)
+		{
+			row[2 * k] = z[k].real();
+			row[2 * k + 1] = z[k].imag();
+		}
+		row[M] = row[M + 1] = 0.0;
+	}
+
+	// y then z forward, z then y inverse
+	void Columns(Complex* spectrum, bool inverse)
+	{
+		const int hx = HalfX();
+		for (int pass = 0; pass < 2; pass++)
+		{
+			bool alongY = (pass == 0) != inverse;
+			ParallelFor((size_t)M * hx, Threads, [&](size_t begin, size_t end, unsigned int)
+			{
+				std::vector<Complex> line(M);
+				for (size_t index = begin; index < end; index++)
+				{
+					//alongY: index is (z, kx), otherwise (y, kx)
+					int other = (int)(index / hx), kx = (int)(index % hx);
+					size_t base = alongY ? ComplexIndex(kx, 0, other) : ComplexIndex(kx, other, 0);
+					size_t stride = alongY ? (size_t)hx : (size_t)hx * M;
+					for (int k = 0; k < M; k++)
+						line[k] = spectrum[base + stride * k];
+					lines.Transform(line.data(), inverse);
+					for (int k = 0; k < M; k++)
+						spectrum[base + stride * k] = line[k];
+				}
+			});
+		}
+	}
+};
+#endif
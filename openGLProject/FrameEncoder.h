@@ -0,0 +1,252 @@
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include "PngWriter.h"
+#include "PerfGate.h"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Default frame encoder values
+const int FRAME_BUFFERS_PER_THREAD = 2; //one being encoded, one waiting
+
+enum FrameFormat
+{
+	FRAME_PNG, //frame_000000.png, 8-bit RGB
+	FRAME_RAW //frame_000000.rgba, top row first, for ffmpeg -f rawvideo -pix_fmt rgba
+};
+
+// Writes rendered frames to numbered files on a pool of threads. The renderer takes a free
+// buffer with Acquire(), copies a frame into it and hands it back with Submit(); workers encode
+// and write in whatever order they finish. Buffers are allocated once in Open(), so when
+// every one is busy Acquire() waits, and WaitMs() says how long the renderer was held up
+// (close to zero means rendering is the bottleneck, which is the point).
+// Frames are RGBA8 rows bottom first, as glReadPixels gives them.
+class FrameEncoder
+{
+public:
+	FrameEncoder() : width(0), height(0), format(FRAME_PNG), closing(false), written(0), failed(0), waitMs(0.0), encodeMicros(0), bytesOut(0)
+	{
+	}
+
+	~FrameEncoder()
+	{
+		Close();
+	}
+
+	bool Open(const std::string& dir, int frameWidth, int frameHeight, FrameFormat frameFormat, int threads)
+	{
+		Close();
+		if (!MakeDirectory(dir))
+		{
+			std::cout << "ERROR::FRAME_ENCODER can't create " << dir << std::endl;
+			return false;
+		}
+		directory = dir;
+		width = frameWidth;
+		height = frameHeight;
+		format = frameFormat;
+		closing = false;
+		written = 0;
+		failed = 0;
+		waitMs = 0.0;
+		encodeMicros = 0;
+		bytesOut = 0;
+		if (threads < 1)
+			threads = 1;
+		buffers.assign(threads * FRAME_BUFFERS_PER_THREAD, std::vector<unsigned char>(FrameBytes()));
+		spare.clear();
+		for (size_t k = 0; k < buffers.size(); k++)
+			spare.push_back(buffers[k].data());
+		for (int k = 0; k < threads; k++)
+			workers.push_back(std::thread(&FrameEncoder::Work, this));
+		return true;
+	}
+
+	// Blocks until a buffer is free
+	unsigned char* Acquire()
+	{
+		PerfTimer timer;
+		std::unique_lock<std::mutex> lock(mutex);
+		bufferFree.wait(lock, [this]() { return !spare.empty(); });
+		unsigned char* pixels = spare.back();
+		spare.pop_back();
+		waitMs += timer.ElapsedMs();
+		return pixels;
+	}
+
+	void Submit(unsigned char* pixels, long long frame)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Job job = { pixels, frame };
+			jobs.push_back(job);
+		}
+		jobReady.notify_one();
+	}
+
+	// Finishes every submitted frame and stops the workers
+	void Close()
+	{
+		if (workers.empty())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		jobReady.notify_all();
+		for (size_t k = 0; k < workers.size(); k++)
+			workers[k].join();
+		workers.clear();
+		buffers.clear();
+		spare.clear();
+	}
+
+	size_t FrameBytes() const
+	{
+		return (size_t)width * height * 4;
+	}
+
+	long long Written() const
+	{
+		return written;
+	}
+
+	long long Failed() const
+	{
+		return failed;
+	}
+
+	// Time the renderer spent in Acquire() waiting for a buffer
+	double WaitMs() const
+	{
+		return waitMs;
+	}
+
+	// Encode + write time summed over every worker
+	double EncodeMs() const
+	{
+		return encodeMicros / 1000.0;
+	}
+
+	long long BytesOut() const
+	{
+		return bytesOut;
+	}
+
+	int Threads() const
+	{
+		return (int)workers.size();
+	}
+
+private:
+	struct Job
+	{
+		unsigned char* Pixels;
+		long long Frame;
+	};
+
+	std::string directory;
+	int width, height;
+	FrameFormat format;
+	std::vector<std::vector<unsigned char> > buffers;
+	std::vector<unsigned char*> spare; //buffers not being filled or encoded
+	std::deque<Job> jobs;
+	std::mutex mutex;
+	std::condition_variable jobReady;
+	std::condition_variable bufferFree;
+	std::vector<std::thread> workers;
+	bool closing;
+	std::atomic<long long> written;
+	std::atomic<long long> failed;
+	double waitMs;
+	std::atomic<long long> encodeMicros;
+	std::atomic<long long> bytesOut;
+
+	void Work()
+	{
+		PngWriter png;
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobReady.wait(lock, [this]() { return closing || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+				job = jobs.front();
+				jobs.pop_front();
+			}
+
+			PerfTimer timer;
+			char path[64];
+			snprintf(path, sizeof(path), format == FRAME_PNG ? "/frame_%06lld.png" : "/frame_%06lld.rgba", job.Frame);
+			std::string file = directory + path;
+			bool ok;
+			if (format == FRAME_PNG)
+			{
+				ok = png.Write(file.c_str(), job.Pixels, width, height, true);
+				if (ok)
+					bytesOut += (long long)png.EncodedBytes();
+			}
+			else
+				ok = WriteRaw(file.c_str(), job.Pixels);
+			encodeMicros += (long long)(timer.ElapsedMs() * 1000.0);
+			if (ok)
+				written++;
+			else
+				failed++;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				spare.push_back(job.Pixels);
+			}
+			bufferFree.notify_one();
+		}
+	}
+
+	// Flipped to top row first on the way out
+	bool WriteRaw(const char* path, const unsigned char* pixels)
+	{
+		FILE* file = fopen(path, "wb");
+		if (!file)
+			return false;
+		size_t rowBytes = (size_t)width * 4;
+		bool ok = true;
+		for (int y = height - 1; y >= 0 && ok; y--)
+			ok = fwrite(pixels + rowBytes * y, 1, rowBytes, file) == rowBytes;
+		ok = fclose(file) == 0 && ok;
+		if (ok)
+			bytesOut += (long long)FrameBytes();
+		else
+			remove(path);
+		return ok;
+	}
+
+	static bool MakeDirectory(const std::string& dir)
+	{
+#ifdef _WIN32
+		return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+
+	FrameEncoder(const FrameEncoder&);
+	FrameEncoder& operator=(const FrameEncoder&);
+};
+#endif
@@ -0,0 +1,242 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <glad/glad.h>
+
+#include <map>
+#include <string>
+#include <iostream>
+#include <cstdio>
+
+// Default GPU memory values
+const double GPU_MEMORY_BUDGET_MB = 256.0;
+
+enum GpuResourceKind {
+	GPU_TEXTURE,
+	GPU_BUFFER,
+	GPU_PROGRAM,
+	GPU_RENDERBUFFER,
+	GPU_RESOURCE_KIND_COUNT
+};
+
+// One live GL allocation
+struct GpuAllocation
+{
+	GpuResourceKind Kind;
+	unsigned int ID;
+	size_t Bytes;
+	int Width, Height; //textures and renderbuffers only
+	GLenum Format; //internal format for textures and renderbuffers, usage hint for buffers
+	int MipLevels;
+	std::string Owner; //subsystem that created it, e.g. "planets", "hud", "shaders"
+};
+
+// Bookkeeping for everything we've asked the driver to allocate. GL can't tell us how much
+// VRAM we're using, so every glTexImage/glBufferData/glCreateProgram registers here with the
+// size we asked for and releases when it's deleted. Sizes are what the driver will most likely
+// store, not exactly what it does (RGB8 is padded to 4 bytes a texel on nearly every GPU).
+class GpuMemory
+{
+public:
+	typedef std::pair<int, unsigned int> Key; //(kind, GL name)
+	size_t BudgetBytes; //warn once when the total goes over this
+
+	static GpuMemory& Get()
+	{
+		static GpuMemory instance;
+		return instance;
+	}
+
+	// Full mip chain length for a w x h texture
+	static int MipCount(int width, int height)
+	{
+		int levels = 1;
+		int size = width > height ? width : height;
+		while (size > 1)
+		{
+			size >>= 1;
+			levels++;
+		}
+		return levels;
+	}
+
+	static size_t BytesPerTexel(GLenum internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_RED: case GL_R8: return 1;
+		case GL_RG: case GL_RG8: case GL_R16F: return 2;
+		case GL_RGB: case GL_RGB8: case GL_RGBA: case GL_RGBA8: case GL_SRGB8: case GL_SRGB8_ALPHA8:
+		case GL_DEPTH24_STENCIL8: case GL_DEPTH_COMPONENT24: case GL_R32F: return 4;
+		case GL_RGBA16F: return 8;
+		case GL_RGB32F: case GL_RGBA32F: return 16;
+		default: return 4;
+		}
+	}
+
+	// Size of a 2D texture including mipLevels levels of its chain
+	static size_t TextureBytes(int width, int height, GLenum internalFormat, int mipLevels)
+	{
+		size_t texel = BytesPerTexel(internalFormat);
+		size_t total = 0;
+		for (int level = 0; level < mipLevels; level++)
+		{
+			size_t w = width >> level, h = height >> level;
+			total += (w ? w : 1) * (h ? h : 1) * texel;
+		}
+		return total;
+	}
+
+	void RegisterTexture(unsigned int id, int width, int height, GLenum internalFormat, int mipLevels, const std::string& owner)
+	{
+		GpuAllocation a = Make(GPU_TEXTURE, id, TextureBytes(width, height, internalFormat, mipLevels), owner);
+		a.Width = width;
+		a.Height = height;
+		a.Format = internalFormat;
+		a.MipLevels = mipLevels;
+		Insert(a);
+	}
+
+	void RegisterBuffer(unsigned int id, size_t bytes, GLenum usage, const std::string& owner)
+	{
+		GpuAllocation a = Make(GPU_BUFFER, id, bytes, owner);
+		a.Format = usage;
+		Insert(a);
+	}
+
+	void RegisterRenderbuffer(unsigned int id, int width, int height, GLenum internalFormat, const std::string& owner)
+	{
+		GpuAllocation a = Make(GPU_RENDERBUFFER, id, TextureBytes(width, height, internalFormat, 1), owner);
+		a.Width = width;
+		a.Height = height;
+		a.Format = internalFormat;
+		a.MipLevels = 1;
+		Insert(a);
+	}
+
+	// The driver keeps compiled programs in memory we can't see, so they're counted but sized
+	// by whatever estimate the caller has (source length is a fair lower bound)
+	void RegisterProgram(unsigned int id, size_t estimatedBytes, const std::string& owner)
+	{
+		Insert(Make(GPU_PROGRAM, id, estimatedBytes, owner));
+	}
+
+	void Release(GpuResourceKind kind, unsigned int id)
+	{
+		std::map<Key, GpuAllocation>::iterator it = allocations.find(Key(kind, id));
+		if (it == allocations.end())
+			return;
+		totals[kind] -= it->second.Bytes;
+		counts[kind]--;
+		allocations.erase(it);
+		if (TotalBytes() <= BudgetBytes)
+			overBudget = false;
+	}
+
+	size_t TotalBytes() const
+	{
+		size_t total = 0;
+		for (int k = 0; k < GPU_RESOURCE_KIND_COUNT; k++)
+			total += totals[k];
+		return total;
+	}
+
+	size_t TotalBytes(GpuResourceKind kind) const
+	{
+		return totals[kind];
+	}
+
+	int Count(GpuResourceKind kind) const
+	{
+		return counts[kind];
+	}
+
+	size_t OwnerBytes(const std::string& owner) const
+	{
+		size_t total = 0;
+		for (std::map<Key, GpuAllocation>::const_iterator it = allocations.begin(); it != allocations.end(); ++it)
+			if (it->second.Owner == owner)
+				total += it->second.Bytes;
+		return total;
+	}
+
+	const std::map<Key, GpuAllocation>& Allocations() const
+	{
+		return allocations;
+	}
+
+	// One line for the debug overlay, e.g. "VRAM 12.4/256 MB (tex 4: 12.3, buf 6: 0.1, prog 6, rb 0: 0.0)"
+	void Format(char* buffer, size_t size) const
+	{
+		const double mb = 1.0 / (1024.0 * 1024.0);
+		snprintf(buffer, size, "VRAM %.1f/%.0f MB (tex %d: %.1f, buf %d: %.2f, prog %d, rb %d: %.1f)%s",
+			TotalBytes() * mb, BudgetBytes * mb, counts[GPU_TEXTURE], totals[GPU_TEXTURE] * mb,
+			counts[GPU_BUFFER], totals[GPU_BUFFER] * mb, counts[GPU_PROGRAM],
+			counts[GPU_RENDERBUFFER], totals[GPU_RENDERBUFFER] * mb, overBudget ? " OVER BUDGET" : "");
+	}
+
+	// Dumps every live allocation followed by the totals
+	void Report(std::ostream& out) const
+	{
+		static const char* kindNames[] = { "texture", "buffer", "program", "rbuffer" };
+		char line[256];
+		out << "GPU allocations:" << std::endl;
+		for (std::map<Key, GpuAllocation>::const_iterator it = allocations.begin(); it != allocations.end(); ++it)
+		{
+			const GpuAllocation& a = it->second;
+			if (a.Kind == GPU_TEXTURE || a.Kind == GPU_RENDERBUFFER)
+				snprintf(line, sizeof(line), "  %-8s %4u %-12s %10.1f KB  %dx%d fmt 0x%04X mips %d", kindNames[a.Kind], a.ID,
+					a.Owner.c_str(), a.Bytes / 1024.0, a.Width, a.Height, a.Format, a.MipLevels);
+			else
+				snprintf(line, sizeof(line), "  %-8s %4u %-12s %10.1f KB", kindNames[a.Kind], a.ID, a.Owner.c_str(), a.Bytes / 1024.0);
+			out << line << std::endl;
+		}
+		char summary[256];
+		Format(summary, sizeof(summary));
+		out << "  " << summary << std::endl;
+	}
+
+private:
+	std::map<Key, GpuAllocation> allocations;
+	size_t totals[GPU_RESOURCE_KIND_COUNT];
+	int counts[GPU_RESOURCE_KIND_COUNT];
+	bool overBudget;
+
+	GpuMemory() : BudgetBytes((size_t)(GPU_MEMORY_BUDGET_MB * 1024.0 * 1024.0)), overBudget(false)
+	{
+		for (int k = 0; k < GPU_RESOURCE_KIND_COUNT; k++)
+		{
+			totals[k] = 0;
+			counts[k] = 0;
+		}
+	}
+
+	static GpuAllocation Make(GpuResourceKind kind, unsigned int id, size_t bytes, const std::string& owner)
+	{
+		GpuAllocation a;
+		a.Kind = kind;
+		a.ID = id;
+		a.Bytes = bytes;
+		a.Width = a.Height = 0;
+		a.Format = 0;
+		a.MipLevels = 0;
+		a.Owner = owner;
+		return a;
+	}
+
+	void Insert(const GpuAllocation& a)
+	{
+		//re-uploading into an existing name (glTexImage2D/glBufferData again) replaces the old storage
+		Release(a.Kind, a.ID);
+		allocations[Key(a.Kind, a.ID)] = a;
+		totals[a.Kind] += a.Bytes;
+		counts[a.Kind]++;
+		if (!overBudget && TotalBytes() > BudgetBytes)
+		{
+			overBudget = true;
+			std::cout << "WARNING::GPU_MEMORY over budget: " << TotalBytes() / (1024 * 1024) << " MB used of "
+				<< BudgetBytes / (1024 * 1024) << " MB after " << a.Owner << " allocated " << a.Bytes / 1024 << " KB" << std::endl;
+		}
+	}
+};
+#endif
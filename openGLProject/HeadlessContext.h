@@ -0,0 +1,215 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+//msbuild /p:HeadlessContext=egl or =osmesa compiles one of these in (and links libEGL / OSMesa)
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifdef HEADLESS_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+// Default headless context values
+const int HEADLESS_GL_MAJOR = 3;
+const int HEADLESS_GL_MINOR = 3;
+const int HEADLESS_PBUFFER_SIZE = 16; //the default framebuffer is never drawn to, everything goes into an FBO
+
+// An OpenGL 3.3 core context with no window system behind it, for rendering on machines with no
+// X11 or Wayland (build servers, containers). Frames go into an OffscreenTarget, so the context
+// only needs a throwaway default framebuffer, or none at all.
+// "egl": Mesa's surfaceless platform (EGL_MESA_platform_surfaceless), made current with no
+// surface, falling back to a tiny pbuffer when the driver wants one.
+// "osmesa": Mesa's software rasteriser drawing into a small buffer in our own memory.
+// Both need the matching build option; asking for one that wasn't built in fails with a message
+// saying so rather than quietly opening a window.
+class HeadlessContext
+{
+public:
+	HeadlessContext()
+	{
+#ifdef HEADLESS_EGL
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+		surface = EGL_NO_SURFACE;
+#endif
+#ifdef HEADLESS_OSMESA
+		osmesa = NULL;
+#endif
+	}
+
+	~HeadlessContext()
+	{
+		Destroy();
+	}
+
+	//api is "egl" or "osmesa", leaves the context current and GLAD loaded
+	bool Create(const std::string& api)
+	{
+		Destroy();
+		if (api == "egl")
+			return createEgl();
+		if (api == "osmesa")
+			return createOsMesa();
+		std::cout << "ERROR::HEADLESS unknown context api '" << api << "' (egl or osmesa)" << std::endl;
+		return false;
+	}
+
+	void Destroy()
+	{
+#ifdef HEADLESS_EGL
+		if (display != EGL_NO_DISPLAY)
+		{
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (surface != EGL_NO_SURFACE)
+				eglDestroySurface(display, surface);
+			if (context != EGL_NO_CONTEXT)
+				eglDestroyContext(display, context);
+			eglTerminate(display);
+		}
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+		surface = EGL_NO_SURFACE;
+#endif
+#ifdef HEADLESS_OSMESA
+		if (osmesa != NULL)
+			OSMesaDestroyContext(osmesa);
+		osmesa = NULL;
+		pixels.clear();
+#endif
+	}
+
+private:
+#ifdef HEADLESS_EGL
+	EGLDisplay display;
+	EGLContext context;
+	EGLSurface surface;
+#endif
+#ifdef HEADLESS_OSMESA
+	OSMesaContext osmesa;
+	std::vector<unsigned char> pixels;
+#endif
+
+	bool createEgl()
+	{
+#ifdef HEADLESS_EGL
+		//the surfaceless platform is an extension, so it has to be looked up rather than linked
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (getPlatformDisplay == NULL || clientExtensions == NULL || std::string(clientExtensions).find("EGL_MESA_platform_surfaceless") == std::string::npos)
+		{
+			std::cout << "ERROR::HEADLESS this EGL has no surfaceless platform (EGL_MESA_platform_surfaceless), try --context osmesa" << std::endl;
+			return false;
+		}
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		EGLint major = 0, minor = 0;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+		{
+			std::cout << "ERROR::HEADLESS eglInitialize failed on the surfaceless platform (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+			display = EGL_NO_DISPLAY;
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			std::cout << "ERROR::HEADLESS EGL " << major << "." << minor << " can't do desktop OpenGL" << std::endl;
+			Destroy();
+			return false;
+		}
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_NONE
+		};
+		EGLConfig config = NULL;
+		EGLint configCount = 0;
+		eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, HEADLESS_GL_MAJOR,
+			EGL_CONTEXT_MINOR_VERSION, HEADLESS_GL_MINOR,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		//with no config (EGL_KHR_no_config_context) the context can only be made current surfaceless
+		context = eglCreateContext(display, configCount > 0 ? config : (EGLConfig)NULL, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT)
+		{
+			std::cout << "ERROR::HEADLESS couldn't create an OpenGL " << HEADLESS_GL_MAJOR << "." << HEADLESS_GL_MINOR
+				<< " core context over EGL (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+			Destroy();
+			return false;
+		}
+		if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			//drivers without EGL_KHR_surfaceless_context still want something to draw on
+			const EGLint pbufferAttributes[] = { EGL_WIDTH, HEADLESS_PBUFFER_SIZE, EGL_HEIGHT, HEADLESS_PBUFFER_SIZE, EGL_NONE };
+			if (configCount > 0)
+				surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+			if (surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context))
+			{
+				std::cout << "ERROR::HEADLESS couldn't make the EGL context current, surfaceless or with a pbuffer (0x"
+					<< std::hex << eglGetError() << std::dec << ")" << std::endl;
+				Destroy();
+				return false;
+			}
+		}
+		if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+		{
+			std::cout << "ERROR::HEADLESS GLAD failed to load through EGL" << std::endl;
+			Destroy();
+			return false;
+		}
+		return true;
+#else
+		std::cout << "ERROR::HEADLESS built without EGL, rebuild with msbuild /p:HeadlessContext=egl (defines HEADLESS_EGL, links libEGL)" << std::endl;
+		return false;
+#endif
+	}
+
+	bool createOsMesa()
+	{
+#ifdef HEADLESS_OSMESA
+		const int attributes[] = {
+			OSMESA_FORMAT, OSMESA_RGBA,
+			OSMESA_DEPTH_BITS, 24,
+			OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+			OSMESA_CONTEXT_MAJOR_VERSION, HEADLESS_GL_MAJOR,
+			OSMESA_CONTEXT_MINOR_VERSION, HEADLESS_GL_MINOR,
+			0
+		};
+		osmesa = OSMesaCreateContextAttribs(attributes, NULL);
+		if (osmesa == NULL)
+		{
+			std::cout << "ERROR::HEADLESS OSMesa couldn't create an OpenGL " << HEADLESS_GL_MAJOR << "." << HEADLESS_GL_MINOR << " core context" << std::endl;
+			return false;
+		}
+		pixels.assign((size_t)HEADLESS_PBUFFER_SIZE * HEADLESS_PBUFFER_SIZE * 4, 0);
+		if (!OSMesaMakeCurrent(osmesa, pixels.data(), GL_UNSIGNED_BYTE, HEADLESS_PBUFFER_SIZE, HEADLESS_PBUFFER_SIZE))
+		{
+			std::cout << "ERROR::HEADLESS OSMesa couldn't make the context current" << std::endl;
+			Destroy();
+			return false;
+		}
+		if (!gladLoadGLLoader((GLADloadproc)OSMesaGetProcAddress))
+		{
+			std::cout << "ERROR::HEADLESS GLAD failed to load through OSMesa" << std::endl;
+			Destroy();
+			return false;
+		}
+		return true;
+#else
+		std::cout << "ERROR::HEADLESS built without OSMesa, rebuild with msbuild /p:HeadlessContext=osmesa (defines HEADLESS_OSMESA, links OSMesa)" << std::endl;
+		return false;
+#endif
+	}
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#include "Fft.h"
+
+#include <cmath>
+
+// Default Kepler solver values
+const int KEPLER_MAX_ITERATIONS = 50; //Newton iterations on the universal anomaly before giving up
+const double KEPLER_TOLERANCE = 1e-9; //relative Newton step after which the anomaly is good to rounding (convergence is quadratic)
+const double KEPLER_SERIES = 0.1; //|z| below which the Stumpff functions use their series
+
+// Stumpff functions C(z) = (1 - cos sqrt z) / z and S(z) = (sqrt z - sin sqrt z) / sqrt z^3,
+// continued through z <= 0 with cosh and sinh, and by series near 0 where both cancel
+inline void Stumpff(double z, double& c, double& s)
+{
+	if (std::fabs(z) < KEPLER_SERIES)
+	{
+		c = 1.0 / 2.0 - z * (1.0 / 24.0 - z * (1.0 / 720.0 - z * (1.0 / 40320.0 - z * (1.0 / 3628800.0 - z * (1.0 / 479001600.0)))));
+		s = 1.0 / 6.0 - z * (1.0 / 120.0 - z * (1.0 / 5040.0 - z * (1.0 / 362880.0 - z * (1.0 / 39916800.0 - z * (1.0 / 6227020800.0)))));
+	}
+	else if (z > 0.0)
+	{
+		const double q = std::sqrt(z);
+		c = (1.0 - std::cos(q)) / z;
+		s = (q - std::sin(q)) / (z * q);
+	}
+	else
+	{
+		const double q = std::sqrt(-z);
+		c = (std::cosh(q) - 1.0) / -z;
+		s = (std::sinh(q) - q) / (-z * q);
+	}
+}
+
+// Moves (r, v) along its two-body orbit about a fixed mass with G M = gm for time dt, any
+// conic, forwards or backwards, using the universal anomaly and f and g functions. Returns
+// false (and leaves r, v alone) if the anomaly doesn't converge.
+inline bool KeplerDrift(double gm, double* r, double* v, double dt)
+{
+	const double r0 = std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+	const double v2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+	if (r0 == 0.0 || gm <= 0.0)
+		return false;
+	const double rootGm = std::sqrt(gm);
+	const double sigma = (r[0] * v[0] + r[1] * v[1] + r[2] * v[2]) / rootGm;
+	const double alpha = 2.0 / r0 - v2 / gm; //1 / semi-major axis
+	//short drifts (every step of an integrator) start from the anomaly's series in time, good
+	//enough that one Newton step finishes the job
+	double t = rootGm * dt;
+	const double r3 = r0 * r0 * r0;
+	double chi = t / r0 - sigma * t * t / (2.0 * r3) + t * t * t * (3.0 * sigma * sigma - r0 * (1.0 - alpha * r0)) / (6.0 * r3 * r0 * r0);
+	if (!(std::fabs(alpha) * chi * chi < 1.0))
+	{
+		//long ones drop the whole periods of a bound orbit, which change nothing, and start from the mean motion
+		if (alpha > 0.0)
+		{
+			const double period = 2.0 * FFT_PI / (alpha * std::sqrt(alpha) * rootGm);
+			if (std::fabs(dt) > period)
+				dt = std::fmod(dt, period);
+			t = rootGm * dt;
+			chi = t * alpha;
+		}
+		else
+		{
+			//unbound ones grow exponentially in the anomaly, so start from the asymptote
+			//(Vallado's hyperbolic guess), or the linear one if that doesn't apply
+			const double sign = dt < 0.0 ? -1.0 : 1.0;
+			const double root = std::sqrt(-1.0 / alpha);
+			const double arg = -2.0 * alpha * t / (sigma + sign * root * (1.0 - r0 * alpha));
+			chi = alpha < 0.0 && arg > 0.0 ? sign * root * std::log(arg) : t / r0;
+		}
+	}
+	double c = 0.5, s = 1.0 / 6.0, rNew = r0;
+	bool converged = false;
+	for (int k = 0; k < KEPLER_MAX_ITERATIONS && !converged; k++)
+	{
+		const double chi2 = chi * chi;
+		Stumpff(alpha * chi2, c, s);
+		const double f = sigma * chi2 * c + (1.0 - alpha * r0) * chi2 * chi * s + r0 * chi - t;
+		rNew = sigma * chi * (1.0 - alpha * chi2 * s) + (1.0 - alpha * r0) * chi2 * c + r0;
+		const double step = f / rNew;
+		chi -= step;
+		converged = std::fabs(step) <= KEPLER_TOLERANCE * (std::fabs(chi) + KEPLER_TOLERANCE);
+	}
+	if (!converged || !(rNew > 0.0))
+		return false;
+	const double chi2 = chi * chi;
+	Stumpff(alpha * chi2, c, s);
+	rNew = sigma * chi * (1.0 - alpha * chi2 * s) + (1.0 - alpha * r0) * chi2 * c + r0;
+	const double f = 1.0 - chi2 / r0 * c;
+	const double g = dt - chi2 * chi / rootGm * s;
+	const double fDot = rootGm / (rNew * r0) * chi * (alpha * chi2 * s - 1.0);
+	const double gDot = 1.0 - chi2 / rNew * c;
+	for (int k = 0; k < 3; k++)
+	{
+		const double rk = r[k], vk = v[k];
+		r[k] = f * rk + g * vk;
+		v[k] = fDot * rk + gDot * vk;
+	}
+	return true;
+}
+#endif
@@ -0,0 +1,204 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a file. Open() only opens the handle; Map() then maps either the
+// whole file or a window of it, so files bigger than the address space (32-bit builds, 100 GB
+// recordings) can be walked a piece at a time. Mapping a new window drops the previous one.
+class MappedFile
+{
+public:
+	MappedFile() : fileSize(0), view(NULL), viewBytes(0), data(NULL), length(0)
+#ifdef _WIN32
+		, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#else
+		, fd(-1)
+#endif
+	{
+	}
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	bool Open(const char* path)
+	{
+		Close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			Close();
+			return false;
+		}
+		fileSize = (uint64_t)size.QuadPart;
+		if (fileSize > 0)
+		{
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (!mapping)
+			{
+				Close();
+				return false;
+			}
+		}
+#else
+		fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			Close();
+			return false;
+		}
+		fileSize = (uint64_t)st.st_size;
+#endif
+		return true;
+	}
+
+	// Maps [offset, offset + bytes) of the file, bytes = 0 means to the end. Data() then points
+	// at offset itself, the alignment the OS wants is handled here.
+	bool Map(uint64_t offset = 0, size_t bytes = 0)
+	{
+		Unmap();
+		if (offset > fileSize)
+			return false;
+		if (bytes == 0 || offset + bytes > fileSize)
+			bytes = (size_t)(fileSize - offset);
+		if (bytes == 0)
+			return true;
+		uint64_t aligned = offset - offset % Granularity();
+		size_t slack = (size_t)(offset - aligned);
+#ifdef _WIN32
+		view = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(aligned >> 32), (DWORD)aligned, bytes + slack);
+		if (!view)
+			return false;
+#else
+		void* p = mmap(NULL, bytes + slack, PROT_READ, MAP_SHARED, fd, (off_t)aligned);
+		if (p == MAP_FAILED)
+			return false;
+		view = p;
+#endif
+		viewBytes = bytes + slack;
+		data = (const unsigned char*)view + slack;
+		length = bytes;
+		return true;
+	}
+
+	// Tells the OS we'll read the current view front to back (prefetch, drop behind)
+	void AdviseSequential()
+	{
+#ifndef _WIN32
+		if (view)
+			madvise(view, viewBytes, MADV_SEQUENTIAL);
+#endif
+	}
+
+	void Unmap()
+	{
+		if (view)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(view);
+#else
+			munmap(view, viewBytes);
+#endif
+		}
+		view = NULL;
+		viewBytes = 0;
+		data = NULL;
+		length = 0;
+	}
+
+	void Close()
+	{
+		Unmap();
+#ifdef _WIN32
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (fd >= 0)
+			::close(fd);
+		fd = -1;
+#endif
+		fileSize = 0;
+	}
+
+	const unsigned char* Data() const
+	{
+		return data;
+	}
+
+	size_t Length() const
+	{
+		return length;
+	}
+
+	uint64_t FileSize() const
+	{
+		return fileSize;
+	}
+
+	bool IsOpen() const
+	{
+#ifdef _WIN32
+		return file != INVALID_HANDLE_VALUE;
+#else
+		return fd >= 0;
+#endif
+	}
+
+	// Map offsets have to be a multiple of this
+	static size_t Granularity()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwAllocationGranularity;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+
+private:
+	uint64_t fileSize;
+	void* view;
+	size_t viewBytes;
+	const unsigned char* data;
+	size_t length;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+#endif
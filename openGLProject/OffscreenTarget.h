@@ -0,0 +1,184 @@
+#ifndef OFFSCREEN_TARGET_H
+#define OFFSCREEN_TARGET_H
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "PerfGate.h"
+
+#include <vector>
+#include <iostream>
+
+// Default offscreen values
+const int OFFSCREEN_PBO_COUNT = 3; //frames between glReadPixels and copying the pixels out
+const GLuint64 OFFSCREEN_FENCE_TIMEOUT = 1000000000; //ns per wait before checking again
+
+// A framebuffer to render into without showing anything, plus a ring of pixel pack buffers so
+// reading frames back doesn't stall the pipeline. Capture() queues a glReadPixels of the frame
+// just drawn into the next PBO and fences it; the GPU does the copy whenever it gets there.
+// A PBO is only mapped once it's OFFSCREEN_PBO_COUNT frames old, by which time its fence has
+// normally signalled, so mapping costs a memcpy rather than a round trip. StallMs adds up the
+// time that wasn't true.
+// Pixels come out RGBA8, bottom row first.
+class OffscreenTarget
+{
+public:
+	int Width;
+	int Height;
+	double StallMs; //waiting on fences and mapping, should stay near zero
+
+	OffscreenTarget() : Width(0), Height(0), StallMs(0.0), framebuffer(0), colour(0), depth(0), head(0), pending(0), captured(0)
+	{
+	}
+
+	~OffscreenTarget()
+	{
+		Destroy();
+	}
+
+	bool Create(int width, int height, int pboCount = OFFSCREEN_PBO_COUNT)
+	{
+		Destroy();
+		Width = width;
+		Height = height;
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glGenRenderbuffers(1, &colour);
+		glBindRenderbuffer(GL_RENDERBUFFER, colour);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour);
+		GpuMemory::Get().RegisterRenderbuffer(colour, width, height, GL_RGBA8, "offscreen");
+		glGenRenderbuffers(1, &depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+		GpuMemory::Get().RegisterRenderbuffer(depth, width, height, GL_DEPTH24_STENCIL8, "offscreen");
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (!complete)
+		{
+			std::cout << "ERROR::OFFSCREEN framebuffer " << width << "x" << height << " is incomplete" << std::endl;
+			Destroy();
+			return false;
+		}
+
+		pbos.assign(pboCount < 1 ? 1 : pboCount, 0);
+		fences.assign(pbos.size(), (GLsync)0);
+		frames.assign(pbos.size(), 0);
+		glGenBuffers((GLsizei)pbos.size(), pbos.data());
+		for (size_t k = 0; k < pbos.size(); k++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[k]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, FrameBytes(), NULL, GL_STREAM_READ);
+			GpuMemory::Get().RegisterBuffer(pbos[k], FrameBytes(), GL_STREAM_READ, "offscreen");
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return true;
+	}
+
+	// Renders go here (and the viewport covers it) until something else is bound
+	void Bind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, Width, Height);
+	}
+
+	// Queues a readback of what's in the framebuffer now. When every PBO is in flight the
+	// oldest is finished first and handed to consume(const unsigned char* pixels, long long frame).
+	template <typename Consume>
+	void Capture(Consume consume)
+	{
+		if (pending == pbos.size())
+			Retire(consume);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[head]);
+		glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		frames[head] = captured++;
+		head = (head + 1) % pbos.size();
+		pending++;
+	}
+
+	// Hands over every frame still in flight
+	template <typename Consume>
+	void Flush(Consume consume)
+	{
+		while (pending > 0)
+			Retire(consume);
+	}
+
+	size_t FrameBytes() const
+	{
+		return (size_t)Width * Height * 4;
+	}
+
+	void Destroy()
+	{
+		for (size_t k = 0; k < fences.size(); k++)
+			if (fences[k])
+				glDeleteSync(fences[k]);
+		if (!pbos.empty())
+			glDeleteBuffers((GLsizei)pbos.size(), pbos.data());
+		for (size_t k = 0; k < pbos.size(); k++)
+			GpuMemory::Get().Release(GPU_BUFFER, pbos[k]);
+		unsigned int renderbuffers[] = { colour, depth };
+		for (int k = 0; k < 2; k++)
+		{
+			if (!renderbuffers[k])
+				continue;
+			glDeleteRenderbuffers(1, &renderbuffers[k]);
+			GpuMemory::Get().Release(GPU_RENDERBUFFER, renderbuffers[k]);
+		}
+		if (framebuffer)
+			glDeleteFramebuffers(1, &framebuffer);
+		pbos.clear();
+		fences.clear();
+		frames.clear();
+		framebuffer = colour = depth = 0;
+		head = pending = 0;
+	}
+
+private:
+	unsigned int framebuffer;
+	unsigned int colour;
+	unsigned int depth;
+	std::vector<unsigned int> pbos;
+	std::vector<GLsync> fences;
+	std::vector<long long> frames;
+	size_t head; //next PBO to read into
+	size_t pending; //PBOs holding a frame nobody has taken yet
+	long long captured;
+
+	template <typename Consume>
+	void Retire(Consume consume)
+	{
+		size_t slot = (head + pbos.size() - pending) % pbos.size();
+		PerfTimer timer;
+		GLenum result = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, OFFSCREEN_FENCE_TIMEOUT);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fences[slot], 0, OFFSCREEN_FENCE_TIMEOUT);
+		if (result == GL_WAIT_FAILED)
+			std::cout << "ERROR::OFFSCREEN fence wait failed on frame " << frames[slot] << std::endl;
+		glDeleteSync(fences[slot]);
+		fences[slot] = 0;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+		const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, FrameBytes(), GL_MAP_READ_BIT);
+		StallMs += timer.ElapsedMs();
+		if (pixels)
+		{
+			consume(pixels, frames[slot]);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		else
+			std::cout << "ERROR::OFFSCREEN couldn't map frame " << frames[slot] << std::endl;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		pending--;
+	}
+
+	OffscreenTarget(const OffscreenTarget&);
+	OffscreenTarget& operator=(const OffscreenTarget&);
+};
+#endif
@@ -0,0 +1,155 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+#include "AllocTracker.h"
+
+// threads = 0 means every hardware thread
+inline unsigned int ParallelThreads(unsigned int threads)
+{
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	return threads == 0 ? 1 : threads;
+}
+
+// Threads that stay up for the life of the process and take one ParallelFor at a time, so a
+// pass run every frame or every step costs a wake-up rather than starting and joining threads
+// (and the heap allocations that come with them). Workers are only started the first time a
+// call needs that many, so steady-state calls never allocate. The job is a pointer to the
+// caller's function object plus a plain function that calls it, not a std::function, for the
+// same reason.
+// One job at a time: a call made while the pool is busy (from inside a job, or from another
+// thread) returns false and the caller falls back to threads of its own.
+class WorkerPool
+{
+public:
+	static WorkerPool& Get()
+	{
+		static WorkerPool instance;
+		return instance;
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+
+	// Runs fn(begin, end, thread) over threads contiguous ranges of [0, count), the last on the
+	// calling thread. threads must already be clamped to [1, count].
+	template <typename Fn>
+	bool Run(size_t count, unsigned int threads, Fn& fn)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (busy || stopping)
+				return false;
+			busy = true;
+			if (workers.size() + 1 < threads)
+			{
+				ColdRegion cold;//once per worker for the life of the process
+				while (workers.size() + 1 < threads)
+					workers.push_back(std::thread(&WorkerPool::Work, this, (unsigned int)workers.size()));
+			}
+			job = &fn;
+			call = &Call<Fn>;
+			jobCount = count;
+			jobThreads = threads;
+			remaining = threads - 1;
+			generation++;
+		}
+		wake.notify_all();
+		fn(count * (threads - 1) / threads, count, threads - 1);
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this]() { return remaining == 0; });
+		busy = false;
+		return true;
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable wake; //a new job, or stopping
+	std::condition_variable finished; //remaining reached 0
+	std::vector<std::thread> workers;
+	void* job;
+	void (*call)(void* fn, size_t begin, size_t end, unsigned int thread);
+	size_t jobCount;
+	unsigned int jobThreads;
+	unsigned int remaining; //worker ranges of the current job still running
+	unsigned long long generation; //bumped per job, so a worker never runs the same one twice
+	bool busy;
+	bool stopping;
+
+	WorkerPool() : job(NULL), call(NULL), jobCount(0), jobThreads(0), remaining(0), generation(0), busy(false), stopping(false)
+	{
+	}
+
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator=(const WorkerPool&);
+
+	template <typename Fn>
+	static void Call(void* fn, size_t begin, size_t end, unsigned int thread)
+	{
+		(*(Fn*)fn)(begin, end, thread);
+	}
+
+	void Work(unsigned int index)
+	{
+		unsigned long long seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			wake.wait(lock, [this, seen]() { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+			//workers past this job's thread count sit it out
+			if (index + 1 >= jobThreads)
+				continue;
+			void* fn = job;
+			void (*run)(void*, size_t, size_t, unsigned int) = call;
+			const size_t begin = jobCount * index / jobThreads, end = jobCount * (index + 1) / jobThreads;
+			lock.unlock();
+			run(fn, begin, end, index);
+			lock.lock();
+			if (--remaining == 0)
+				finished.notify_one();
+		}
+	}
+};
+
+// Splits [0, count) into one contiguous range per thread and calls fn(begin, end, thread) on
+// each, the last range on the calling thread. Runs on the WorkerPool; only a call made while
+// that's busy starts threads of its own. Still meant for passes big enough to split, a wake-up
+// costs microseconds.
+template <typename Fn>
+void ParallelFor(size_t count, unsigned int threads, Fn fn)
+{
+	threads = ParallelThreads(threads);
+	if ((size_t)threads > count)
+		threads = count > 0 ? (unsigned int)count : 1;
+	if (threads == 1)
+	{
+		fn(0, count, 0);
+		return;
+	}
+	if (WorkerPool::Get().Run(count, threads, fn))
+		return;
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t + 1 < threads; t++)
+		workers.push_back(std::thread(fn, count * t / threads, count * (t + 1) / threads, t));
+	fn(count * (threads - 1) / threads, count, threads - 1);
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+#endif
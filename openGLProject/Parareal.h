@@ -0,0 +1,347 @@
+#ifndef PARAREAL_H
+#define PARAREAL_H
+
+#include "Bodies.h"
+#include "Kepler.h"
+#include "Parallel.h"
+#include "PerfGate.h"
+#include "Simulation.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstddef>
+
+// Default parareal values
+const int PARAREAL_SLICES = 32; //time slices, one per worker
+const int PARAREAL_COARSE_FACTOR = 64; //coarse step = fine step x this
+const int PARAREAL_MAX_ITERATIONS = 8; //corrections before giving up on convergence
+const double PARAREAL_TOLERANCE = 1e-10; //largest state change between iterations, relative to the state's scale
+
+enum PararealCoarse
+{
+	PARAREAL_KEPLER, //Wisdom-Holman: Kepler orbits about the heaviest body, kicks from the rest; planetary systems
+	PARAREAL_LEAPFROG //the fine integrator at the coarse step, for anything without one dominant mass
+};
+
+// How one iteration went
+struct PararealIteration
+{
+	double Change; //largest relative change of any slice boundary state
+	int Converged; //slices whose start state can no longer change
+	double CoarseMs; //serial coarse sweep
+	double FineMs; //all fine slices, whatever threads they ran on
+	double SliceMs; //the slowest fine slice, the parallel part's wall time with a core per slice
+};
+
+// Parallel-in-time integration of one run [Time, Time + duration) for systems too small to
+// split across cores by bodies.
+//
+// The interval is cut into Slices. A coarse propagator at CoarseFactor times the step sweeps
+// serially across the slices to guess each slice's start state, then every slice is integrated
+// with the fine propagator (sim's leapfrog at TimeStep) in parallel from its guess. Each
+// iteration corrects the guesses with
+//     U[n+1] = Coarse(new U[n]) + Fine(old U[n]) - Coarse(old U[n])
+// and stops once no boundary state moves more than Tolerance. After k iterations the first k
+// slices are exactly the serial fine run, so it always converges by Slices iterations; the
+// point is that for smooth problems it converges in a few.
+//
+// The serial coarse sweeps bound the speedup, so the coarse step has to be far longer than the
+// fine one and still close to right. A leapfrog that long loses orbital phase and parareal
+// barely converges; the default Wisdom-Holman map (democratic heliocentric coordinates, exact
+// Kepler drifts about the heaviest body, planet-planet kicks) keeps its error at the planet to
+// star mass ratio even at a few dozen steps an orbit.
+//
+// Forces are direct summation on one thread per slice, whatever sim.Method says.
+class Parareal
+{
+public:
+	int Slices;
+	PararealCoarse Coarse;
+	int CoarseFactor;
+	int MaxIterations;
+	double Tolerance;
+	unsigned int Threads;
+	// per iteration, from the last Run
+	std::vector<PararealIteration> Iterations;
+
+	Parareal() : Slices(PARAREAL_SLICES), Coarse(PARAREAL_KEPLER), CoarseFactor(PARAREAL_COARSE_FACTOR), MaxIterations(PARAREAL_MAX_ITERATIONS),
+		Tolerance(PARAREAL_TOLERANCE), Threads(0)
+	{
+	}
+
+	// Advances sim by duration (rounded to whole fine steps per slice), returns true if it
+	// converged within Tolerance. sim.State ends up at the last slice's fine end state.
+	bool Run(Simulation& sim, double duration)
+	{
+		Iterations.clear();
+		const int slices = Slices > 0 ? Slices : 1;
+		const int coarseFactor = CoarseFactor > 0 ? CoarseFactor : 1;
+		const int fineSteps = FineStepsPerSlice(sim, duration);
+		if (fineSteps <= 0)
+		{
+			printf("ERROR::PARAREAL %g s is too short to split into %d slices of %g s steps\n", duration, slices, sim.TimeStep);
+			return false;
+		}
+		const int coarseSteps = fineSteps / coarseFactor;
+		const double sliceLength = fineSteps * sim.TimeStep;
+		const double coarseStep = sliceLength / coarseSteps;
+
+		//start states per slice boundary, and what each propagator made of the previous ones
+		std::vector<Bodies> start((size_t)slices + 1, sim.State), fine((size_t)slices), coarse((size_t)slices);
+		PerfTimer timer;
+		for (int n = 0; n < slices; n++)
+		{
+			coarse[n] = PropagateCoarse(sim, start[n], coarseStep, coarseSteps);
+			start[n + 1] = coarse[n];
+		}
+		const double firstCoarseMs = timer.ElapsedMs();
+
+		std::vector<double> sliceMs((size_t)slices, 0.0);
+		bool converged = false;
+		int done = 0; //slices whose start state is final
+		for (int k = 0; k < MaxIterations && !converged && done < slices; k++)
+		{
+			PararealIteration it = PararealIteration();
+			if (k == 0)
+				it.CoarseMs = firstCoarseMs;
+			timer.Restart();
+			const int first = done;
+			ParallelFor((size_t)(slices - first), ParallelThreads(Threads),
+				[this, &sim, &start, &fine, &sliceMs, first, fineSteps](size_t begin, size_t end, unsigned int)
+			{
+				for (size_t s = begin; s < end; s++)
+				{
+					PerfTimer sliceTimer;
+					const size_t n = first + s;
+					fine[n] = Propagate(sim, start[n], sim.TimeStep, fineSteps);
+					sliceMs[n] = sliceTimer.ElapsedMs();
+				}
+			});
+			it.FineMs = timer.ElapsedMs();
+			for (int n = first; n < slices; n++)
+				it.SliceMs = sliceMs[n] > it.SliceMs ? sliceMs[n] : it.SliceMs;
+
+			//serial correction sweep; slice first's start was already exact, so its end is now too
+			timer.Restart();
+			double change = 0.0;
+			start[first + 1] = fine[first];
+			for (int n = first + 1; n < slices; n++)
+			{
+				Bodies guess = PropagateCoarse(sim, start[n], coarseStep, coarseSteps);
+				Bodies next = guess;
+				Correct(next, fine[n], coarse[n]);
+				double moved = Difference(next, start[n + 1]);
+				change = moved > change ? moved : change;
+				coarse[n] = guess;
+				start[n + 1] = next;
+			}
+			it.CoarseMs += timer.ElapsedMs();
+			done = first + 1;
+			it.Change = change;
+			it.Converged = done;
+			Iterations.push_back(it);
+			converged = change <= Tolerance;
+		}
+
+		sim.State = start[slices];
+		sim.Time += slices * sliceLength;
+		sim.Invalidate();
+		sim.Observe();
+		return converged || done == slices;
+	}
+
+	// Fine steps per slice Run will take for a duration, so a serial reference can match it
+	int FineStepsPerSlice(const Simulation& sim, double duration) const
+	{
+		const int slices = Slices > 0 ? Slices : 1;
+		const int coarseFactor = CoarseFactor > 0 ? CoarseFactor : 1;
+		const int fineSteps = (int)(duration / slices / sim.TimeStep + 0.5);
+		return (fineSteps + coarseFactor - 1) / coarseFactor * coarseFactor;
+	}
+
+private:
+	// from state, steps of h with sim's constants
+	static Bodies Propagate(const Simulation& sim, const Bodies& state, double h, int steps)
+	{
+		Simulation run(h, sim.G, sim.Softening);
+		run.Threads = 1;
+		run.State = state;
+		run.Invalidate();
+		for (int s = 0; s < steps; s++)
+			run.Step();
+		return run.State;
+	}
+
+	Bodies PropagateCoarse(const Simulation& sim, const Bodies& state, double h, int steps) const
+	{
+		if (Coarse == PARAREAL_LEAPFROG)
+			return Propagate(sim, state, h, steps);
+		Bodies out = state;
+		if (!WisdomHolman(out, sim.G, sim.Softening, h, steps))
+		{
+			printf("ERROR::PARAREAL Kepler drift failed, coarse step falls back to the leapfrog\n");
+			return Propagate(sim, state, h, steps);
+		}
+		return out;
+	}
+
+	// Wisdom-Holman steps of h in democratic heliocentric coordinates: positions relative to the
+	// heaviest body, velocities barycentric. Each step is half an interaction kick, half a
+	// drift of everything with the central body's momentum, a Kepler drift of each body about
+	// the central mass, then the two halves again. The kicks also carry the difference between the
+	// softened pull of the central body and the Kepler one, so this is the same Hamiltonian the
+	// leapfrog integrates and the two only differ by their truncation errors.
+	static bool WisdomHolman(Bodies& b, double G, double softening, double h, int steps)
+	{
+		const size_t n = b.Count();
+		size_t central = 0;
+		double total = 0.0;
+		for (size_t i = 0; i < n; i++)
+		{
+			central = b.mass[i] > b.mass[central] ? i : central;
+			total += b.mass[i];
+		}
+		const double m0 = b.mass[central];
+		if (n < 2 || m0 <= 0.0)
+			return false;
+		//barycentre, which moves in a straight line
+		double cm[3] = { 0.0, 0.0, 0.0 }, vcm[3] = { 0.0, 0.0, 0.0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			cm[0] += b.mass[i] * b.x[i]; cm[1] += b.mass[i] * b.y[i]; cm[2] += b.mass[i] * b.z[i];
+			vcm[0] += b.mass[i] * b.vx[i]; vcm[1] += b.mass[i] * b.vy[i]; vcm[2] += b.mass[i] * b.vz[i];
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			cm[k] /= total;
+			vcm[k] /= total;
+		}
+		//q, u: heliocentric position and barycentric velocity of every body, the central one's left at zero
+		std::vector<double> q(n * 3, 0.0), u(n * 3, 0.0);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (i == central)
+				continue;
+			q[i * 3] = b.x[i] - b.x[central]; q[i * 3 + 1] = b.y[i] - b.y[central]; q[i * 3 + 2] = b.z[i] - b.z[central];
+			u[i * 3] = b.vx[i] - vcm[0]; u[i * 3 + 1] = b.vy[i] - vcm[1]; u[i * 3 + 2] = b.vz[i] - vcm[2];
+		}
+		const double gm = G * m0;
+		const double eps2 = softening * softening;
+		for (int step = 0; step < steps; step++)
+		{
+			InteractionKick(b, central, q, u, G, eps2, 0.5 * h);
+			CentralDrift(b, central, q, u, m0, 0.5 * h);
+			for (size_t i = 0; i < n; i++)
+				if (i != central && !KeplerDrift(gm, &q[i * 3], &u[i * 3], h))
+					return false;
+			CentralDrift(b, central, q, u, m0, 0.5 * h);
+			InteractionKick(b, central, q, u, G, eps2, 0.5 * h);
+		}
+		//back to positions and velocities about the drifted barycentre
+		const double t = h * steps;
+		double mq[3] = { 0.0, 0.0, 0.0 }, mu[3] = { 0.0, 0.0, 0.0 };
+		for (size_t i = 0; i < n; i++)
+			for (int k = 0; k < 3; k++)
+			{
+				mq[k] += b.mass[i] * q[i * 3 + k];
+				mu[k] += b.mass[i] * u[i * 3 + k];
+			}
+		double centre[3];
+		for (int k = 0; k < 3; k++)
+			centre[k] = cm[k] + vcm[k] * t - mq[k] / total;
+		for (size_t i = 0; i < n; i++)
+		{
+			b.x[i] = centre[0] + q[i * 3]; b.y[i] = centre[1] + q[i * 3 + 1]; b.z[i] = centre[2] + q[i * 3 + 2];
+			if (i == central)
+			{
+				b.vx[i] = vcm[0] - mu[0] / m0; b.vy[i] = vcm[1] - mu[1] / m0; b.vz[i] = vcm[2] - mu[2] / m0;
+			}
+			else
+			{
+				b.vx[i] = vcm[0] + u[i * 3]; b.vy[i] = vcm[1] + u[i * 3 + 1]; b.vz[i] = vcm[2] + u[i * 3 + 2];
+			}
+		}
+		return true;
+	}
+
+	// Pulls between the non-central bodies, plus the central body's softening, on the barycentric velocities
+	static void InteractionKick(const Bodies& b, size_t central, const std::vector<double>& q, std::vector<double>& u, double G, double eps2, double h)
+	{
+		const size_t n = b.Count();
+		const double gm = G * b.mass[central] * h;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (i == central)
+				continue;
+			if (eps2 > 0.0)
+			{
+				const double r2 = q[i * 3] * q[i * 3] + q[i * 3 + 1] * q[i * 3 + 1] + q[i * 3 + 2] * q[i * 3 + 2];
+				const double invR = 1.0 / std::sqrt(r2), invS = 1.0 / std::sqrt(r2 + eps2);
+				const double f = gm * (invR * invR * invR - invS * invS * invS);
+				u[i * 3] += q[i * 3] * f; u[i * 3 + 1] += q[i * 3 + 1] * f; u[i * 3 + 2] += q[i * 3 + 2] * f;
+			}
+			for (size_t j = i + 1; j < n; j++)
+			{
+				if (j == central)
+					continue;
+				const double dx = q[j * 3] - q[i * 3];
+				const double dy = q[j * 3 + 1] - q[i * 3 + 1];
+				const double dz = q[j * 3 + 2] - q[i * 3 + 2];
+				const double invR = 1.0 / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+				const double invR3 = G * invR * invR * invR * h;
+				const double sj = b.mass[j] * invR3, si = b.mass[i] * invR3;
+				u[i * 3] += dx * sj; u[i * 3 + 1] += dy * sj; u[i * 3 + 2] += dz * sj;
+				u[j * 3] -= dx * si; u[j * 3 + 1] -= dy * si; u[j * 3 + 2] -= dz * si;
+			}
+		}
+	}
+
+	// Every heliocentric position shifted by the central body's own motion, sum(m u) / m0
+	static void CentralDrift(const Bodies& b, size_t central, std::vector<double>& q, const std::vector<double>& u, double m0, double h)
+	{
+		const size_t n = b.Count();
+		double p[3] = { 0.0, 0.0, 0.0 };
+		for (size_t i = 0; i < n; i++)
+			for (int k = 0; k < 3; k++)
+				p[k] += b.mass[i] * u[i * 3 + k];
+		for (size_t i = 0; i < n; i++)
+			if (i != central)
+				for (int k = 0; k < 3; k++)
+					q[i * 3 + k] += p[k] / m0 * h;
+	}
+
+	// out += fine - coarse, on positions and velocities
+	static void Correct(Bodies& out, const Bodies& fine, const Bodies& coarse)
+	{
+		for (size_t i = 0; i < out.Count(); i++)
+		{
+			out.x[i] += fine.x[i] - coarse.x[i];
+			out.y[i] += fine.y[i] - coarse.y[i];
+			out.z[i] += fine.z[i] - coarse.z[i];
+			out.vx[i] += fine.vx[i] - coarse.vx[i];
+			out.vy[i] += fine.vy[i] - coarse.vy[i];
+			out.vz[i] += fine.vz[i] - coarse.vz[i];
+		}
+	}
+
+	// Largest position change over the largest distance from the origin, and the same for
+	// velocities, whichever is worse
+	static double Difference(const Bodies& a, const Bodies& b)
+	{
+		double dr = 0.0, dv = 0.0, r = 0.0, v = 0.0;
+		for (size_t i = 0; i < a.Count(); i++)
+		{
+			const double ex = a.x[i] - b.x[i], ey = a.y[i] - b.y[i], ez = a.z[i] - b.z[i];
+			const double eu = a.vx[i] - b.vx[i], ev = a.vy[i] - b.vy[i], ew = a.vz[i] - b.vz[i];
+			dr = std::fmax(dr, std::sqrt(ex * ex + ey * ey + ez * ez));
+			dv = std::fmax(dv, std::sqrt(eu * eu + ev * ev + ew * ew));
+			r = std::fmax(r, std::sqrt(a.x[i] * a.x[i] + a.y[i] * a.y[i] + a.z[i] * a.z[i]));
+			v = std::fmax(v, std::sqrt(a.vx[i] * a.vx[i] + a.vy[i] * a.vy[i] + a.vz[i] * a.vz[i]));
+		}
+		//NaN fails every comparison, make it never converge instead
+		double change = std::fmax(r > 0.0 ? dr / r : dr, v > 0.0 ? dv / v : dv);
+		return change == change ? change : HUGE_VAL;
+	}
+};
+#endif
@@ -0,0 +1,435 @@
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+
+#include "Bodies.h"
+#include "Fft.h"
+#include "Parallel.h"
+#include "PerfGate.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+// Default particle mesh values
+const int PM_GRID = 128; //cells per side
+const double PM_MARGIN = 1.25; //an isolated grid refits to this much more than the particles span
+const int PM_SLABS_PER_THREAD = 4;
+
+enum PmBoundary
+{
+	PM_PERIODIC, //the box repeats forever, BoxSize must be set
+	PM_ISOLATED //nothing outside the particles, the grid follows them
+};
+
+// Particle-mesh gravity for particle counts where pairwise sums are hopeless. Mass goes onto a
+// Grid^3 mesh with cloud-in-cell weights, the potential comes from one forward and one inverse
+// real FFT, and each force component is a 4-point difference of it interpolated back with the
+// same weights (so a particle exerts no force on itself). Periodic boxes solve -4 pi G rho / k^2
+// with the CIC window divided out; isolated ones zero-pad to (2 Grid)^3 and convolve with the
+// sampled 1/r kernel, which is exact free-space gravity at mesh resolution.
+// Forces are smoothed over a cell or two, so this is for galaxy and disk scale dynamics, not
+// close encounters.
+class ParticleMesh
+{
+public:
+	int Grid;
+	PmBoundary Boundary;
+	double BoxSize; //side of the region the grid covers; isolated grids set this themselves
+	double Origin[3]; //its lowest corner
+	unsigned int Threads; //0 = every hardware thread
+	double Potential; //sum of 0.5 m phi from the last Compute
+	//where the last Compute went
+	double AssignMs;
+	double FftMs;
+	double InterpolateMs;
+	int Refits; //times an isolated grid has had to move or grow to keep every particle on it
+
+	ParticleMesh(int grid = PM_GRID, PmBoundary boundary = PM_ISOLATED, double boxSize = 0.0)
+		: Grid(grid), Boundary(boundary), BoxSize(boxSize), Threads(0), Potential(0.0), AssignMs(0.0), FftMs(0.0),
+		InterpolateMs(0.0), Refits(0), planned(0), greenCell(0.0), greenSoftening(-1.0)
+	{
+		Origin[0] = Origin[1] = Origin[2] = boundary == PM_PERIODIC ? -0.5 * boxSize : 0.0;
+	}
+
+	// Cell size
+	double Spacing() const
+	{
+		return BoxSize / Grid;
+	}
+
+	// Fills ax/ay/az for every body and sets Potential
+	void Compute(Bodies& b, double G, double softening)
+	{
+		if (Grid < 8)
+			Grid = 8;
+		//power of two for the FFT
+		int grid = 8;
+		while (grid < Grid)
+			grid *= 2;
+		Grid = grid;
+		if (Boundary == PM_ISOLATED)
+			Fit(b);
+		else if (BoxSize <= 0.0)
+			Fit(b); //a periodic box nobody sized: the particles' extent, from now on
+		Prepare(G, softening);
+		const double h = Spacing();
+
+		PerfTimer timer;
+		Assign(b);
+		AssignMs = timer.ElapsedMs();
+
+		timer.Restart();
+		fft.Threads = Threads;
+		fft.Forward(mesh.data());
+		Convolve(G);
+		fft.Inverse(mesh.data());
+		FftMs = timer.ElapsedMs();
+
+		timer.Restart();
+		//the potential at each particle, then one gradient component at a time through the same weights
+		std::vector<double> perThread(ParallelThreads(Threads), 0.0);
+		Gather(b, [this](int x, int y, int z) { return mesh[fft.RealIndex(x, y, z)]; }, [&b, &perThread](size_t p, double phi, unsigned int t)
+		{
+			perThread[t] += 0.5 * b.mass[p] * phi;
+		});
+		Potential = 0.0;
+		for (size_t t = 0; t < perThread.size(); t++)
+			Potential += perThread[t];
+		std::vector<double>* out[3] = { &b.ax, &b.ay, &b.az };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Gradient(axis, h);
+			std::vector<double>& a = *out[axis];
+			Gather(b, [this](int x, int y, int z) { return gradient[((size_t)z * Grid + y) * Grid + x]; }, [&a](size_t p, double value, unsigned int)
+			{
+				a[p] = value;
+			});
+		}
+		InterpolateMs = timer.ElapsedMs();
+	}
+
+private:
+	RealFft3 fft;
+	int planned; //FFT size the buffers are sized for
+	std::vector<double> mesh; //mass, then its spectrum, then the potential, in fft's padded layout
+	std::vector<double> gradient; //one acceleration component on the Grid^3 cells, compact
+	std::vector<double> green; //isolated: real spectrum of the 1/r kernel, scaled; periodic: unused
+	double greenCell, greenSoftening; //what green was built for
+	std::vector<uint32_t> order; //particle indices sorted by x slab
+	std::vector<size_t> slabStart;
+	//periodic: per axis index, k^2 and the CIC window sinc^2
+	std::vector<double> k2;
+	std::vector<double> windowed;
+
+	bool Periodic() const
+	{
+		return Boundary == PM_PERIODIC;
+	}
+
+	// FFT size: doubled for isolated grids so the convolution doesn't wrap
+	int FftSize() const
+	{
+		return Periodic() ? Grid : Grid * 2;
+	}
+
+	// Isolated: keep every particle two cells inside the grid (the difference stencil reaches
+	// two cells beyond the ones it weights), refitting when one strays
+	void Fit(Bodies& b)
+	{
+		const size_t n = b.Count();
+		unsigned int threads = ParallelThreads(Threads);
+		std::vector<double> lo(threads * 3, 1e300), hi(threads * 3, -1e300);
+		const std::vector<double>* axes[3] = { &b.x, &b.y, &b.z };
+		ParallelFor(n, threads, [&](size_t begin, size_t end, unsigned int t)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const std::vector<double>& v = *axes[axis];
+				double l = 1e300, u = -1e300;
+				for (size_t p = begin; p < end; p++)
+				{
+					l = v[p] < l ? v[p] : l;
+					u = v[p] > u ? v[p] : u;
+				}
+				lo[t * 3 + axis] = l;
+				hi[t * 3 + axis] = u;
+			}
+		});
+		double low[3] = { 1e300, 1e300, 1e300 }, high[3] = { -1e300, -1e300, -1e300 };
+		for (unsigned int t = 0; t < threads; t++)
+			for (int axis = 0; axis < 3; axis++)
+			{
+				low[axis] = lo[t * 3 + axis] < low[axis] ? lo[t * 3 + axis] : low[axis];
+				high[axis] = hi[t * 3 + axis] > high[axis] ? hi[t * 3 + axis] : high[axis];
+			}
+		if (n == 0)
+			for (int axis = 0; axis < 3; axis++)
+				low[axis] = high[axis] = 0.0;
+
+		if (BoxSize > 0.0)
+		{
+			double h = Spacing();
+			bool inside = true;
+			for (int axis = 0; axis < 3; axis++)
+				inside &= low[axis] >= Origin[axis] + 2.5 * h && high[axis] < Origin[axis] + (Grid - 2.5) * h;
+			if (inside)
+				return;
+		}
+		double extent = 0.0;
+		for (int axis = 0; axis < 3; axis++)
+			extent = high[axis] - low[axis] > extent ? high[axis] - low[axis] : extent;
+		if (extent <= 0.0)
+			extent = 1.0;
+		double h = extent * PM_MARGIN / (Grid - 6);
+		BoxSize = h * Grid;
+		for (int axis = 0; axis < 3; axis++)
+			Origin[axis] = 0.5 * (low[axis] + high[axis]) - 0.5 * BoxSize;
+		Refits++;
+	}
+
+	// Sizes buffers for the current grid and rebuilds whichever Green's function is stale
+	void Prepare(double G, double softening)
+	{
+		const int m = FftSize();
+		if (planned != m)
+		{
+			fft.Plan(m);
+			mesh.assign(fft.Doubles(), 0.0);
+			gradient.assign((size_t)Grid * Grid * Grid, 0.0);
+			planned = m;
+			greenCell = 0.0;
+		}
+		const double h = Spacing();
+		if (Periodic())
+		{
+			//per axis: k^2 and the CIC window sinc^2, combined per cell in Convolve
+			k2.resize(m);
+			windowed.resize(m);
+			for (int i = 0; i < m; i++)
+			{
+				int signedIndex = i <= m / 2 ? i : i - m;
+				double k = 2.0 * FFT_PI * signedIndex / BoxSize;
+				double x = FFT_PI * signedIndex / m;
+				double sinc = signedIndex == 0 ? 1.0 : std::sin(x) / x;
+				k2[i] = k * k;
+				windowed[i] = sinc * sinc;
+			}
+			return;
+		}
+		if (greenCell == h && greenSoftening == softening)
+			return;
+
+		//free-space kernel, sampled at wrapped separations; softened to at least half a cell so
+		//the particle's own cell doesn't dominate the potential
+		double eps = softening > 0.5 * h ? softening : 0.5 * h;
+		ParallelFor((size_t)m, Threads, [&](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t z = begin; z < end; z++)
+				for (int y = 0; y < m; y++)
+					for (int x = 0; x < m; x++)
+					{
+						double dx = (x <= m / 2 ? x : x - m) * h;
+						double dy = (y <= m / 2 ? y : y - m) * h;
+						double dz = ((int)z <= m / 2 ? (int)z : (int)z - m) * h;
+						mesh[fft.RealIndex(x, y, (int)z)] = -G / std::sqrt(dx * dx + dy * dy + dz * dz + eps * eps);
+					}
+		});
+		fft.Threads = Threads;
+		fft.Forward(mesh.data());
+		//it's real and even, so the spectrum is real; fold the inverse FFT's 1/m^3 in
+		const double scale = 1.0 / ((double)m * m * m);
+		green.resize(mesh.size() / 2);
+		const Complex* spectrum = (const Complex*)mesh.data();
+		for (size_t k = 0; k < green.size(); k++)
+			green[k] = spectrum[k].real() * scale;
+		greenCell = h;
+		greenSoftening = softening;
+	}
+
+	// Base cell and weight of the upper neighbour along one axis
+	void Cell(double position, int axis, int& cell, double& weight) const
+	{
+		double u = (position - Origin[axis]) / Spacing() - 0.5;
+		double base = std::floor(u);
+		weight = u - base;
+		if (Periodic())
+		{
+			long long c = (long long)base % Grid;
+			cell = (int)(c < 0 ? c + Grid : c);
+		}
+		else
+			cell = (int)base;
+	}
+
+	int Wrap(int cell) const
+	{
+		return cell >= Grid ? cell - Grid : cell < 0 ? cell + Grid : cell;
+	}
+
+	// CIC mass assignment. Particles are bucketed by x slab first; even slabs are spread in
+	// parallel, then odd ones, so no two threads ever add into the same plane.
+	void Assign(const Bodies& b)
+	{
+		const size_t n = b.Count();
+		unsigned int threads = ParallelThreads(Threads);
+		int slabs = 2;
+		while (slabs * 2 <= Grid && slabs < (int)threads * PM_SLABS_PER_THREAD)
+			slabs *= 2;
+		const int slabWidth = Grid / slabs;
+
+		std::fill(mesh.begin(), mesh.end(), 0.0);
+		std::vector<size_t> counts((size_t)threads * slabs, 0);
+		ParallelFor(n, threads, [&](size_t begin, size_t end, unsigned int t)
+		{
+			for (size_t p = begin; p < end; p++)
+			{
+				int cell;
+				double weight;
+				Cell(b.x[p], 0, cell, weight);
+				counts[(size_t)t * slabs + cell / slabWidth]++;
+			}
+		});
+		//exclusive prefix over (slab, thread) so each thread scatters into its own stretch
+		slabStart.assign(slabs + 1, 0);
+		size_t running = 0;
+		for (int s = 0; s < slabs; s++)
+		{
+			slabStart[s] = running;
+			for (unsigned int t = 0; t < threads; t++)
+			{
+				size_t c = counts[(size_t)t * slabs + s];
+				counts[(size_t)t * slabs + s] = running;
+				running += c;
+			}
+		}
+		slabStart[slabs] = running;
+		order.resize(n);
+		ParallelFor(n, threads, [&](size_t begin, size_t end, unsigned int t)
+		{
+			for (size_t p = begin; p < end; p++)
+			{
+				int cell;
+				double weight;
+				Cell(b.x[p], 0, cell, weight);
+				order[counts[(size_t)t * slabs + cell / slabWidth]++] = (uint32_t)p;
+			}
+		});
+
+		for (int phase = 0; phase < 2; phase++)
+		{
+			ParallelFor((size_t)slabs / 2, threads, [&](size_t begin, size_t end, unsigned int)
+			{
+				for (size_t s = begin; s < end; s++)
+				{
+					size_t slab = s * 2 + phase;
+					for (size_t k = slabStart[slab]; k < slabStart[slab + 1]; k++)
+					{
+						size_t p = order[k];
+						int c[3];
+						double w[3];
+						Cell(b.x[p], 0, c[0], w[0]);
+						Cell(b.y[p], 1, c[1], w[1]);
+						Cell(b.z[p], 2, c[2], w[2]);
+						double m = b.mass[p];
+						for (int dz = 0; dz < 2; dz++)
+							for (int dy = 0; dy < 2; dy++)
+							{
+								double wyz = m * (dz ? w[2] : 1.0 - w[2]) * (dy ? w[1] : 1.0 - w[1]);
+								double* row = &mesh[fft.RealIndex(0, Wrap(c[1] + dy), Wrap(c[2] + dz))];
+								row[c[0]] += wyz * (1.0 - w[0]);
+								row[Wrap(c[0] + 1)] += wyz * w[0];
+							}
+					}
+				}
+			});
+		}
+	}
+
+	// Spectrum of the mass times the Green's function, in place
+	void Convolve(double G)
+	{
+		const int m = FftSize();
+		const int hx = fft.HalfX();
+		Complex* spectrum = (Complex*)mesh.data();
+		const double h = Spacing();
+		//periodic: mass per cell / h^3 is density, and the inverse FFT wants 1/m^3
+		const double scale = -4.0 * FFT_PI * G / (h * h * h) / ((double)m * m * m);
+		ParallelFor((size_t)m, Threads, [&](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t kz = begin; kz < end; kz++)
+				for (int ky = 0; ky < m; ky++)
+				{
+					size_t row = fft.ComplexIndex(0, ky, (int)kz);
+					if (!Periodic())
+					{
+						for (int kx = 0; kx < hx; kx++)
+							spectrum[row + kx] *= green[row + kx];
+						continue;
+					}
+					for (int kx = 0; kx < hx; kx++)
+					{
+						double kk = k2[kx] + k2[ky] + k2[kz];
+						double w = windowed[kx] * windowed[ky] * windowed[kz];
+						//k = 0 is the mean density, which a periodic universe doesn't feel
+						spectrum[row + kx] *= kk > 0.0 ? scale / (kk * w * w) : 0.0;
+					}
+				}
+		});
+	}
+
+	// -d phi / d axis on every cell, 4-point central difference
+	void Gradient(int axis, double h)
+	{
+		const double inv12h = 1.0 / (12.0 * h);
+		const int m = FftSize();
+		ParallelFor((size_t)Grid, Threads, [&](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t z = begin; z < end; z++)
+				for (int y = 0; y < Grid; y++)
+					for (int x = 0; x < Grid; x++)
+					{
+						int c[3] = { x, y, (int)z };
+						double phi[4];
+						static const int offsets[4] = { -2, -1, 1, 2 };
+						for (int k = 0; k < 4; k++)
+						{
+							int at[3] = { c[0], c[1], c[2] };
+							//isolated grids keep particles off the edges, so stepping off it only happens
+							//on cells nobody reads; wrapping keeps that in bounds
+							at[axis] = (at[axis] + offsets[k] + m) % m;
+							phi[k] = mesh[fft.RealIndex(at[0], at[1], at[2])];
+						}
+						gradient[((size_t)z * Grid + y) * Grid + x] = -(8.0 * (phi[2] - phi[1]) - (phi[3] - phi[0])) * inv12h;
+					}
+		});
+	}
+
+	// Reads lookup(x, y, z) at every particle with its CIC weights and hands the result to
+	// store(particle, value, thread), in slab order so neighbouring particles share cache lines
+	template <typename Lookup, typename Store>
+	void Gather(const Bodies& b, Lookup lookup, Store store) const
+	{
+		ParallelFor(order.size(), Threads, [&](size_t begin, size_t end, unsigned int t)
+		{
+			for (size_t k = begin; k < end; k++)
+			{
+				size_t p = order[k];
+				int c[3];
+				double w[3];
+				Cell(b.x[p], 0, c[0], w[0]);
+				Cell(b.y[p], 1, c[1], w[1]);
+				Cell(b.z[p], 2, c[2], w[2]);
+				double value = 0.0;
+				for (int dz = 0; dz < 2; dz++)
+					for (int dy = 0; dy < 2; dy++)
+					{
+						double wyz = (dz ? w[2] : 1.0 - w[2]) * (dy ? w[1] : 1.0 - w[1]);
+						int y = Wrap(c[1] + dy), z = Wrap(c[2] + dz);
+						value += wyz * ((1.0 - w[0]) * lookup(c[0], y, z) + w[0] * lookup(Wrap(c[0] + 1), y, z));
+					}
+				store(p, value, t);
+			}
+		});
+	}
+};
+#endif
@@ -0,0 +1,429 @@
+#ifndef PERF_GATE_H
+#define PERF_GATE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+// Default perf gate values
+const int PERF_REPETITIONS = 15;
+const int PERF_WARMUPS = 3;
+const double PERF_MIN_SAMPLE_MS = 20.0; //batch up iterations until one sample takes at least this long
+const double PERF_DEFAULT_TOLERANCE = 0.20; //median soaks up scheduler noise, so it gets the looser default
+const double PERF_DEFAULT_MIN_TOLERANCE = 0.15;
+const double PERF_NOISE_MADS = 3.0; //a slowdown has to clear this many MADs of noise as well as the tolerance
+const int PERF_CONFIRM_RUNS = 2; //regressed scenarios are re-measured this many times before we believe them
+
+// Wall clock stopwatch, starts on construction
+class PerfTimer
+{
+public:
+	PerfTimer() : start(std::chrono::steady_clock::now())
+	{
+	}
+
+	void Restart()
+	{
+		start = std::chrono::steady_clock::now();
+	}
+
+	double ElapsedMs() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+// Robust summary of one scenario's samples, all in milliseconds per iteration
+struct PerfStats
+{
+	double Median;
+	double Mad; //median absolute deviation
+	double Min;
+	double Max;
+	int Samples;
+	int BatchSize;
+};
+
+// One entry of the baseline file: "<scenario>.<metric>": { "value": v, "tolerance": t }
+struct PerfMetric
+{
+	double Value;
+	double Tolerance; //allowed relative slowdown, 0.15 = 15%
+};
+
+// Runs a fixed list of scenarios several times each and compares them against a baseline file.
+// Every scenario is calibrated so one sample is a batch of iterations lasting PERF_MIN_SAMPLE_MS.
+// Samples are taken in rounds (every scenario once per round) so a burst of load from a
+// neighbour smears across all scenarios instead of landing on one, and median/MAD/min keep a
+// few bad rounds from failing the gate.
+class PerfGate
+{
+public:
+	int Repetitions;
+	int Warmups;
+
+	PerfGate(int repetitions = PERF_REPETITIONS, int warmups = PERF_WARMUPS)
+		: Repetitions(repetitions), Warmups(warmups)
+	{
+	}
+
+	// setup runs before every sample (untimed), run is one timed iteration
+	void Add(const std::string& name, std::function<void()> setup, std::function<void()> run)
+	{
+		Scenario s;
+		s.Name = name;
+		s.Setup = setup;
+		s.Run = run;
+		scenarios.push_back(s);
+	}
+
+	// Pins us to one core and bumps priority where the OS lets us, so the scheduler
+	// doesn't migrate us mid-sample. Failure is harmless, the stats just get noisier.
+	static void StabiliseProcess()
+	{
+#ifdef _WIN32
+		SetThreadAffinityMask(GetCurrentThread(), 1);
+		SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
+#elif defined(__linux__)
+		int cpu = sched_getcpu();
+		if (cpu >= 0)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpu, &set);
+			sched_setaffinity(0, sizeof(set), &set);
+		}
+#endif
+	}
+
+	// Measures every scenario, or only those named in 'only' when it isn't empty
+	std::map<std::string, PerfStats> RunAll(const std::vector<std::string>& only = std::vector<std::string>())
+	{
+		std::vector<Scenario*> active;
+		for (size_t i = 0; i < scenarios.size(); i++)
+			if (only.empty() || std::find(only.begin(), only.end(), scenarios[i].Name) != only.end())
+				active.push_back(&scenarios[i]);
+
+		for (size_t i = 0; i < active.size(); i++)
+		{
+			Scenario& s = *active[i];
+			if (s.Setup)
+				s.Setup();
+			s.BatchSize = Calibrate(s.Run);
+			s.Samples.clear();
+			for (int w = 0; w < Warmups; w++)
+				TimeBatch(s);
+		}
+		for (int r = 0; r < Repetitions; r++)
+		{
+			for (size_t i = 0; i < active.size(); i++)
+			{
+				Scenario& s = *active[i];
+				if (s.Setup)
+					s.Setup();
+				s.Run(); //untimed, pulls this scenario's data back into cache
+				s.Samples.push_back(TimeBatch(s));
+			}
+		}
+
+		std::map<std::string, PerfStats> results;
+		for (size_t i = 0; i < active.size(); i++)
+		{
+			Scenario& s = *active[i];
+			PerfStats stats = Summarise(s.Samples);
+			stats.BatchSize = s.BatchSize;
+			results[s.Name] = stats;
+			printf("  %-28s median %10.4f ms  mad %8.4f  min %10.4f  (%d x %d)\n", s.Name.c_str(),
+				stats.Median, stats.Mad, stats.Min, stats.Samples, stats.BatchSize);
+		}
+		return results;
+	}
+
+	// Runs everything, then re-measures whatever looks regressed and keeps the better of the runs
+	// for it. A real slowdown shows up every time, a noisy neighbour usually doesn't.
+	std::map<std::string, PerfStats> RunConfirmed(const std::map<std::string, PerfMetric>& baseline)
+	{
+		std::map<std::string, PerfStats> results = RunAll();
+		for (int c = 0; c < PERF_CONFIRM_RUNS; c++)
+		{
+			std::vector<std::string> suspects;
+			for (std::map<std::string, PerfMetric>::const_iterator it = baseline.begin(); it != baseline.end(); ++it)
+			{
+				std::string scenario, metric;
+				SplitKey(it->first, scenario, metric);
+				std::map<std::string, PerfStats>::const_iterator found = results.find(scenario);
+				if (found != results.end() && IsRegression(found->second, metric, it->second) &&
+					std::find(suspects.begin(), suspects.end(), scenario) == suspects.end())
+					suspects.push_back(scenario);
+			}
+			if (suspects.empty())
+				break;
+			printf("Re-measuring %d suspect scenario(s)...\n", (int)suspects.size());
+			std::map<std::string, PerfStats> retry = RunAll(suspects);
+			for (std::map<std::string, PerfStats>::iterator it = retry.begin(); it != retry.end(); ++it)
+				if (it->second.Median < results[it->first].Median)
+					results[it->first] = it->second;
+		}
+		return results;
+	}
+
+	static bool IsRegression(const PerfStats& stats, const std::string& metric, const PerfMetric& base)
+	{
+		double current = MetricValue(stats, metric);
+		double change = base.Value > 0.0 ? (current - base.Value) / base.Value : 0.0;
+		return change > base.Tolerance && (current - base.Value) > PERF_NOISE_MADS * stats.Mad;
+	}
+
+	// Compares results to the baseline, prints a diff table and returns the number of regressions
+	static int Compare(const std::map<std::string, PerfStats>& results, const std::map<std::string, PerfMetric>& baseline)
+	{
+		int regressions = 0;
+		printf("\n%-38s %12s %12s %9s %7s  %s\n", "metric", "baseline", "current", "change", "tol", "status");
+		for (std::map<std::string, PerfMetric>::const_iterator it = baseline.begin(); it != baseline.end(); ++it)
+		{
+			std::string scenario, metric;
+			SplitKey(it->first, scenario, metric);
+			std::map<std::string, PerfStats>::const_iterator found = results.find(scenario);
+			if (found == results.end())
+			{
+				printf("%-38s %12.4f %12s %9s %6.0f%%  MISSING\n", it->first.c_str(), it->second.Value, "-", "-", it->second.Tolerance * 100.0);
+				regressions++;
+				continue;
+			}
+			double current = MetricValue(found->second, metric);
+			double change = it->second.Value > 0.0 ? (current - it->second.Value) / it->second.Value : 0.0;
+			bool slower = IsRegression(found->second, metric, it->second);
+			//past the tolerance but inside the run's own noise doesn't fail the gate, but it's still drift worth seeing
+			const char* status = slower ? "REGRESSION" : change > it->second.Tolerance ? "over tol (noise)" :
+				change < -it->second.Tolerance ? "faster" : "ok";
+			if (slower)
+				regressions++;
+			printf("%-38s %12.4f %12.4f %+8.1f%% %6.0f%%  %s\n", it->first.c_str(), it->second.Value, current,
+				change * 100.0, it->second.Tolerance * 100.0, status);
+		}
+		for (std::map<std::string, PerfStats>::const_iterator it = results.begin(); it != results.end(); ++it)
+		{
+			if (baseline.find(it->first + ".median_ms") == baseline.end())
+				printf("%-38s %12s %12.4f %9s %7s  NEW (not in baseline)\n", (it->first + ".median_ms").c_str(), "-", it->second.Median, "-", "-");
+		}
+		return regressions;
+	}
+
+	// Reads the flat baseline object. Returns false if the file is missing or malformed.
+	static bool LoadBaseline(const char* path, std::map<std::string, PerfMetric>& baseline)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+		std::stringstream ss;
+		ss << file.rdbuf();
+		std::string text = ss.str();
+		size_t pos = 0;
+		if (!Expect(text, pos, '{'))
+			return false;
+		SkipSpace(text, pos);
+		if (pos < text.size() && text[pos] == '}')
+			return true;
+		while (pos < text.size())
+		{
+			std::string key;
+			if (!ReadString(text, pos, key) || !Expect(text, pos, ':') || !Expect(text, pos, '{'))
+				return false;
+			PerfMetric metric;
+			metric.Value = 0.0;
+			metric.Tolerance = PERF_DEFAULT_TOLERANCE;
+			while (true)
+			{
+				std::string field;
+				double number;
+				if (!ReadString(text, pos, field) || !Expect(text, pos, ':') || !ReadNumber(text, pos, number))
+					return false;
+				if (field == "value")
+					metric.Value = number;
+				else if (field == "tolerance")
+					metric.Tolerance = number;
+				SkipSpace(text, pos);
+				if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+				if (!Expect(text, pos, '}'))
+					return false;
+				break;
+			}
+			baseline[key] = metric;
+			SkipSpace(text, pos);
+			if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+			return Expect(text, pos, '}');
+		}
+		return false;
+	}
+
+	// Writes results as a new baseline, keeping tolerances from the old one where they exist
+	static bool SaveBaseline(const char* path, const std::map<std::string, PerfStats>& results, const std::map<std::string, PerfMetric>& previous)
+	{
+		std::ofstream file(path);
+		if (!file)
+			return false;
+		file << "{\n";
+		bool first = true;
+		for (std::map<std::string, PerfStats>::const_iterator it = results.begin(); it != results.end(); ++it)
+		{
+			const char* metrics[] = { "median_ms", "min_ms" };
+			for (int m = 0; m < 2; m++)
+			{
+				std::string key = it->first + "." + metrics[m];
+				std::map<std::string, PerfMetric>::const_iterator old = previous.find(key);
+				double tolerance = old != previous.end() ? old->second.Tolerance : (m == 0 ? PERF_DEFAULT_TOLERANCE : PERF_DEFAULT_MIN_TOLERANCE);
+				char line[256];
+				snprintf(line, sizeof(line), "%s  \"%s\": { \"value\": %.6f, \"tolerance\": %.2f }", first ? "" : ",\n",
+					key.c_str(), MetricValue(it->second, metrics[m]), tolerance);
+				file << line;
+				first = false;
+			}
+		}
+		file << "\n}\n";
+		return true;
+	}
+
+private:
+	struct Scenario
+	{
+		std::string Name;
+		std::function<void()> Setup;
+		std::function<void()> Run;
+		int BatchSize;
+		std::vector<double> Samples;
+	};
+	std::vector<Scenario> scenarios;
+
+	static double NowMs()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// doubles the batch until one batch is long enough to time reliably
+	static int Calibrate(const std::function<void()>& run)
+	{
+		int batch = 1;
+		while (true)
+		{
+			double start = NowMs();
+			for (int i = 0; i < batch; i++)
+				run();
+			double elapsed = NowMs() - start;
+			if (elapsed >= PERF_MIN_SAMPLE_MS || batch >= (1 << 24))
+				return batch;
+			batch *= 2;
+		}
+	}
+
+	// returns milliseconds per iteration
+	static double TimeBatch(Scenario& s)
+	{
+		double start = NowMs();
+		for (int i = 0; i < s.BatchSize; i++)
+			s.Run();
+		return (NowMs() - start) / s.BatchSize;
+	}
+
+	static PerfStats Summarise(const std::vector<double>& samples)
+	{
+		PerfStats stats;
+		stats.Samples = (int)samples.size();
+		stats.BatchSize = 0;
+		stats.Median = Median(samples);
+		stats.Min = samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+		stats.Max = samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+		std::vector<double> deviations;
+		for (size_t i = 0; i < samples.size(); i++)
+			deviations.push_back(std::fabs(samples[i] - stats.Median));
+		stats.Mad = Median(deviations);
+		return stats;
+	}
+
+	static double Median(std::vector<double> values)
+	{
+		if (values.empty())
+			return 0.0;
+		std::sort(values.begin(), values.end());
+		size_t mid = values.size() / 2;
+		return values.size() % 2 ? values[mid] : 0.5 * (values[mid - 1] + values[mid]);
+	}
+
+	static double MetricValue(const PerfStats& stats, const std::string& metric)
+	{
+		if (metric == "min_ms")
+			return stats.Min;
+		return stats.Median;
+	}
+
+	static void SplitKey(const std::string& key, std::string& scenario, std::string& metric)
+	{
+		size_t dot = key.rfind('.');
+		scenario = key.substr(0, dot);
+		metric = dot == std::string::npos ? "median_ms" : key.substr(dot + 1);
+	}
+
+	// tiny JSON reader, only enough for the baseline file
+	static void SkipSpace(const std::string& text, size_t& pos)
+	{
+		while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t'))
+			pos++;
+	}
+
+	static bool Expect(const std::string& text, size_t& pos, char c)
+	{
+		SkipSpace(text, pos);
+		if (pos >= text.size() || text[pos] != c)
+			return false;
+		pos++;
+		return true;
+	}
+
+	static bool ReadString(const std::string& text, size_t& pos, std::string& out)
+	{
+		if (!Expect(text, pos, '"'))
+			return false;
+		size_t end = text.find('"', pos);
+		if (end == std::string::npos)
+			return false;
+		out = text.substr(pos, end - pos);
+		pos = end + 1;
+		return true;
+	}
+
+	static bool ReadNumber(const std::string& text, size_t& pos, double& out)
+	{
+		SkipSpace(text, pos);
+		const char* start = text.c_str() + pos;
+		char* end;
+		out = strtod(start, &end);
+		if (end == start)
+			return false;
+		pos += end - start;
+		return true;
+	}
+};
+#endif
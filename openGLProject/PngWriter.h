@@ -0,0 +1,331 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+// Default PNG writer values
+const int PNG_HASH_BITS = 15;
+const int PNG_WINDOW = 32768; //deflate's largest distance
+const int PNG_MIN_MATCH = 3;
+const int PNG_MAX_MATCH = 258;
+const int PNG_MAX_CHAIN = 8; //candidates tried per position, more is smaller and slower
+
+// RGBA8 frames to 8-bit RGB PNGs, no zlib needed. Each row gets whichever of the Sub, Up and
+// Paeth filters leaves the smallest residuals, then the lot goes through a greedy LZ77 with
+// hash chains into a single fixed-Huffman deflate block. That's nowhere near zlib -9 but
+// rendered frames are mostly flat colour, which it squeezes well, and it's quick enough for
+// a few encoder threads to keep up with the renderer.
+// Not thread safe; give each thread its own writer so the scratch buffers are reused.
+class PngWriter
+{
+public:
+	// bottomUp: rows are in GL order (first row is the bottom of the image)
+	bool Write(const char* path, const unsigned char* rgba, int width, int height, bool bottomUp)
+	{
+		Encode(rgba, width, height, bottomUp);
+		FILE* file = fopen(path, "wb");
+		if (!file)
+			return false;
+		bool ok = fwrite(png.data(), 1, png.size(), file) == png.size();
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+			remove(path);
+		return ok;
+	}
+
+	const std::vector<unsigned char>& Encode(const unsigned char* rgba, int width, int height, bool bottomUp)
+	{
+		Filter(rgba, width, height, bottomUp);
+
+		//zlib stream: header, one deflate block, Adler-32 of the uncompressed data
+		stream.clear();
+		stream.reserve(filtered.size() / 4 + 1024);
+		stream.push_back(0x78);
+		stream.push_back(0x01);
+		Deflate(filtered.data(), filtered.size());
+		PutBig(stream, Adler32(filtered.data(), filtered.size()));
+
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		png.assign(signature, signature + 8);
+		unsigned char header[13];
+		PutBig(header, (uint32_t)width);
+		PutBig(header + 4, (uint32_t)height);
+		header[8] = 8; //bits per channel
+		header[9] = 2; //RGB
+		header[10] = header[11] = header[12] = 0; //deflate, adaptive filtering, no interlace
+		Chunk("IHDR", header, sizeof(header));
+		Chunk("IDAT", stream.data(), stream.size());
+		Chunk("IEND", NULL, 0);
+		return png;
+	}
+
+	// Size of the last PNG encoded
+	size_t EncodedBytes() const
+	{
+		return png.size();
+	}
+
+	static uint32_t Crc32(const unsigned char* data, size_t length, uint32_t crc = 0)
+	{
+		//built once, thread-safely, the first time any writer needs it
+		static const CrcTable table;
+		crc = ~crc;
+		for (size_t k = 0; k < length; k++)
+			crc = table.Entry[(crc ^ data[k]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	static uint32_t Adler32(const unsigned char* data, size_t length)
+	{
+		uint32_t a = 1, b = 0;
+		while (length > 0)
+		{
+			//5552 is the most bytes before b can overflow
+			size_t block = length < 5552 ? length : 5552;
+			length -= block;
+			for (size_t k = 0; k < block; k++)
+			{
+				a += data[k];
+				b += a;
+			}
+			data += block;
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	}
+
+private:
+	struct CrcTable
+	{
+		uint32_t Entry[256];
+
+		CrcTable()
+		{
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				Entry[n] = c;
+			}
+		}
+	};
+
+	std::vector<unsigned char> filtered; //filter byte + RGB row, per row
+	std::vector<unsigned char> stream;
+	std::vector<unsigned char> png;
+	std::vector<unsigned char> rows; //previous and current RGB row, then one candidate row per filter
+	std::vector<int> head;
+	std::vector<int> chain;
+	uint64_t bits;
+	int bitCount;
+
+	void Filter(const unsigned char* rgba, int width, int height, bool bottomUp)
+	{
+		size_t rowBytes = (size_t)width * 3;
+		filtered.resize((rowBytes + 1) * height);
+		rows.assign(rowBytes * 5, 0);
+		unsigned char* previous = &rows[0];
+		unsigned char* current = &rows[rowBytes];
+		unsigned char* candidate[3] = { &rows[rowBytes * 2], &rows[rowBytes * 3], &rows[rowBytes * 4] };
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char* source = rgba + (size_t)(bottomUp ? height - 1 - y : y) * width * 4;
+			for (int x = 0; x < width; x++)
+			{
+				current[x * 3] = source[x * 4];
+				current[x * 3 + 1] = source[x * 4 + 1];
+				current[x * 3 + 2] = source[x * 4 + 2];
+			}
+
+			//Sub, Up and Paeth, keep whichever has the smallest sum of |residual|
+			unsigned long cost[3] = { 0, 0, 0 };
+			for (size_t k = 0; k < rowBytes; k++)
+			{
+				int left = k >= 3 ? current[k - 3] : 0;
+				int up = previous[k];
+				int upLeft = k >= 3 ? previous[k - 3] : 0;
+				unsigned char residual[3] = {
+					(unsigned char)(current[k] - left),
+					(unsigned char)(current[k] - up),
+					(unsigned char)(current[k] - Paeth(left, up, upLeft)) };
+				for (int f = 0; f < 3; f++)
+				{
+					candidate[f][k] = residual[f];
+					cost[f] += residual[f] < 128 ? residual[f] : 256 - residual[f];
+				}
+			}
+			int best = cost[0] <= cost[1] && cost[0] <= cost[2] ? 0 : cost[1] <= cost[2] ? 1 : 2;
+			static const unsigned char filterType[3] = { 1, 2, 4 };
+			unsigned char* out = &filtered[(rowBytes + 1) * y];
+			out[0] = filterType[best];
+			memcpy(out + 1, candidate[best], rowBytes);
+
+			unsigned char* swap = previous;
+			previous = current;
+			current = swap;
+		}
+	}
+
+	void Deflate(const unsigned char* data, size_t length)
+	{
+		bits = 0;
+		bitCount = 0;
+		PutBits(1, 1); //final block
+		PutBits(1, 2); //fixed Huffman codes
+		head.assign((size_t)1 << PNG_HASH_BITS, -1);
+		chain.assign(PNG_WINDOW, -1);
+		size_t i = 0;
+		while (i < length)
+		{
+			int bestLength = 0;
+			int bestDistance = 0;
+			if (i + PNG_MIN_MATCH <= length)
+			{
+				uint32_t h = Hash(data + i);
+				int limit = (int)(length - i < (size_t)PNG_MAX_MATCH ? length - i : PNG_MAX_MATCH);
+				int candidate = head[h];
+				for (int probe = 0; probe < PNG_MAX_CHAIN && candidate >= 0 && (int)i - candidate <= PNG_WINDOW; probe++)
+				{
+					const unsigned char* a = data + candidate;
+					const unsigned char* b = data + i;
+					if (a[bestLength] == b[bestLength])
+					{
+						int n = 0;
+						while (n < limit && a[n] == b[n])
+							n++;
+						if (n > bestLength)
+						{
+							bestLength = n;
+							bestDistance = (int)i - candidate;
+							if (n == limit)
+								break;
+						}
+					}
+					candidate = chain[candidate & (PNG_WINDOW - 1)];
+				}
+				chain[i & (PNG_WINDOW - 1)] = head[h];
+				head[h] = (int)i;
+			}
+			if (bestLength >= PNG_MIN_MATCH)
+			{
+				PutLength(bestLength);
+				PutDistance(bestDistance);
+				for (size_t k = i + 1; k < i + bestLength && k + PNG_MIN_MATCH <= length; k++)
+				{
+					uint32_t h = Hash(data + k);
+					chain[k & (PNG_WINDOW - 1)] = head[h];
+					head[h] = (int)k;
+				}
+				i += bestLength;
+			}
+			else
+				PutSymbol(data[i++]);
+		}
+		PutSymbol(256); //end of block
+		if (bitCount > 0)
+			stream.push_back((unsigned char)bits);
+	}
+
+	static uint32_t Hash(const unsigned char* p)
+	{
+		return (((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761u) >> (32 - PNG_HASH_BITS);
+	}
+
+	static int Paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+		return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+	}
+
+	void PutBits(uint32_t value, int count)
+	{
+		bits |= (uint64_t)value << bitCount;
+		bitCount += count;
+		while (bitCount >= 8)
+		{
+			stream.push_back((unsigned char)bits);
+			bits >>= 8;
+			bitCount -= 8;
+		}
+	}
+
+	// Huffman codes go in most significant bit first, everything else least significant first
+	void PutCode(uint32_t code, int count)
+	{
+		uint32_t reversed = 0;
+		for (int k = 0; k < count; k++)
+			reversed |= ((code >> k) & 1) << (count - 1 - k);
+		PutBits(reversed, count);
+	}
+
+	// Fixed literal/length code (RFC 1951 3.2.6)
+	void PutSymbol(int symbol)
+	{
+		if (symbol < 144)
+			PutCode(0x30 + symbol, 8);
+		else if (symbol < 256)
+			PutCode(0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			PutCode(symbol - 256, 7);
+		else
+			PutCode(0xC0 + symbol - 280, 8);
+	}
+
+	void PutLength(int length)
+	{
+		static const int base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const int extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		int code = 28;
+		while (base[code] > length)
+			code--;
+		PutSymbol(257 + code);
+		PutBits(length - base[code], extra[code]);
+	}
+
+	void PutDistance(int distance)
+	{
+		static const int base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+			4097, 6145, 8193, 12289, 16385, 24577 };
+		static const int extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		int code = 29;
+		while (base[code] > distance)
+			code--;
+		PutCode(code, 5);
+		PutBits(distance - base[code], extra[code]);
+	}
+
+	void Chunk(const char* type, const unsigned char* data, size_t length)
+	{
+		size_t start = png.size();
+		png.resize(start + 12 + length);
+		PutBig(&png[start], (uint32_t)length);
+		memcpy(&png[start + 4], type, 4);
+		if (length > 0)
+			memcpy(&png[start + 8], data, length);
+		//the CRC covers the type and the data
+		PutBig(&png[start + 8 + length], Crc32(&png[start + 4], length + 4));
+	}
+
+	static void PutBig(unsigned char* out, uint32_t value)
+	{
+		out[0] = (unsigned char)(value >> 24);
+		out[1] = (unsigned char)(value >> 16);
+		out[2] = (unsigned char)(value >> 8);
+		out[3] = (unsigned char)value;
+	}
+
+	static void PutBig(std::vector<unsigned char>& out, uint32_t value)
+	{
+		unsigned char bytes[4];
+		PutBig(bytes, value);
+		out.insert(out.end(), bytes, bytes + 4);
+	}
+};
+#endif
@@ -0,0 +1,426 @@
+#ifndef REGULARIZATION_H
+#define REGULARIZATION_H
+
+#include "Bodies.h"
+#include "Kepler.h"
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+// Default regularization values
+const double KS_STEPS = 16.0; //pairs whose two-body timescale is under this many global steps get regularized
+const double KS_MAX_PERTURBATION = 0.05; //largest outside tidal pull, relative to the pair's own, still worth regularizing
+const double KS_DISSOLVE = 2.0; //hysteresis: a receding pair's timescale has to pass this many times the limit to dissolve
+const int KS_MAX_ITERATIONS = 100; //Newton/bisection steps for the fictitious time of one drift
+const double KS_TOLERANCE = 1e-12; //relative Newton step on the fictitious time after which it is good to rounding (convergence is quadratic)
+
+// Kustaanheimo-Stiefel coordinates: relative position q = L(u) u with u in four dimensions and
+// physical time running at dt = |q| ds in the fictitious time s. A Kepler orbit becomes a
+// harmonic oscillator u'' = (h / 2) u (h the orbit's energy per unit reduced mass), which has
+// no singularity at q = 0; collision orbits just pass through.
+
+// u from q, picking the branch that keeps the square root away from cancellation
+inline void KsFromPosition(const double* q, double* u)
+{
+	const double r = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+	if (q[0] >= 0.0)
+	{
+		u[0] = std::sqrt(0.5 * (r + q[0]));
+		u[1] = u[0] > 0.0 ? 0.5 * q[1] / u[0] : 0.0;
+		u[2] = u[0] > 0.0 ? 0.5 * q[2] / u[0] : 0.0;
+		u[3] = 0.0;
+	}
+	else
+	{
+		u[1] = std::sqrt(0.5 * (r - q[0]));
+		u[0] = 0.5 * q[1] / u[1];
+		u[3] = 0.5 * q[2] / u[1];
+		u[2] = 0.0;
+	}
+}
+
+// u' = L(u)^T v / 2
+inline void KsFromVelocity(const double* u, const double* v, double* du)
+{
+	du[0] = 0.5 * (u[0] * v[0] + u[1] * v[1] + u[2] * v[2]);
+	du[1] = 0.5 * (-u[1] * v[0] + u[0] * v[1] + u[3] * v[2]);
+	du[2] = 0.5 * (-u[2] * v[0] - u[3] * v[1] + u[0] * v[2]);
+	du[3] = 0.5 * (u[3] * v[0] - u[2] * v[1] + u[1] * v[2]);
+}
+
+// q = L(u) u and v = 2 L(u) u' / |u|^2
+inline void KsToCartesian(const double* u, const double* du, double* q, double* v)
+{
+	q[0] = u[0] * u[0] - u[1] * u[1] - u[2] * u[2] + u[3] * u[3];
+	q[1] = 2.0 * (u[0] * u[1] - u[2] * u[3]);
+	q[2] = 2.0 * (u[0] * u[2] + u[1] * u[3]);
+	const double r = u[0] * u[0] + u[1] * u[1] + u[2] * u[2] + u[3] * u[3];
+	const double k = r > 0.0 ? 2.0 / r : 0.0;
+	v[0] = k * (u[0] * du[0] - u[1] * du[1] - u[2] * du[2] + u[3] * du[3]);
+	v[1] = k * (u[1] * du[0] + u[0] * du[1] - u[3] * du[2] - u[2] * du[3]);
+	v[2] = k * (u[2] * du[0] + u[3] * du[1] + u[0] * du[2] + u[1] * du[3]);
+}
+
+// Physical time elapsed after fictitious time s on the oscillator with frequency^2 beta, from
+// u0 . u0 = a, u0' . u0' = b and u0 . u0' = c: the integral of |u(s)|^2, in Stumpff functions so
+// it holds for bound, parabolic and unbound orbits alike. dt/ds (|u(s)|^2) comes back in rate.
+inline double KsTime(double beta, double a, double b, double c, double s, double& rate)
+{
+	double c2, s3;
+	//|u|^2 at s from the single-angle functions, the integral from the double-angle ones
+	Stumpff(beta * s * s, c2, s3);
+	const double c0 = 1.0 - beta * s * s * c2, c1 = s * (1.0 - beta * s * s * s3);
+	rate = a * c0 * c0 + b * c1 * c1 + 2.0 * c * c0 * c1;
+	const double x = 4.0 * beta * s * s;
+	Stumpff(x, c2, s3);
+	return a * (s - 0.5 * s * x * s3) + 2.0 * b * s * s * s * s3 + 2.0 * c * s * s * c2;
+}
+
+// Moves relative position q and velocity v of a pair with G (m1 + m2) = gm along their
+// unperturbed two-body orbit for dt >= 0, exactly, by solving the KS oscillator for the
+// fictitious time that takes. Unlike KeplerDrift it goes through (or starts at) q = 0.
+// Returns false (and leaves q, v alone) if the fictitious time doesn't converge.
+inline bool KsDrift(double gm, double* q, double* v, double dt)
+{
+	double u[4], du[4];
+	KsFromPosition(q, u);
+	KsFromVelocity(u, v, du);
+	const double a = u[0] * u[0] + u[1] * u[1] + u[2] * u[2] + u[3] * u[3];
+	const double b = du[0] * du[0] + du[1] * du[1] + du[2] * du[2] + du[3] * du[3];
+	const double c = u[0] * du[0] + u[1] * du[1] + u[2] * du[2] + u[3] * du[3];
+	if (dt <= 0.0 || (a == 0.0 && b == 0.0))
+		return dt == 0.0;
+	//energy per unit reduced mass, h = (2 |u'|^2 - gm) / |u|^2, and the oscillator's frequency^2
+	const double beta = a > 0.0 ? -0.5 * (2.0 * b - gm) / a : 0.0;
+	//whole orbits of a bound pair change nothing, and r repeats every half oscillation
+	double halfPeriod = HUGE_VAL;
+	if (beta > 0.0)
+	{
+		halfPeriod = FFT_PI / std::sqrt(beta);
+		double rate;
+		const double period = KsTime(beta, a, b, c, halfPeriod, rate);
+		if (dt > period)
+			dt = std::fmod(dt, period);
+	}
+	//bracket s within a factor of two of the first guess (the time is monotonic in s, and
+	//exponential in it on unbound orbits, where Newton from far off crawls), then Newton kept
+	//inside the bracket
+	double rate;
+	double s = a > 0.0 ? dt / a : std::cbrt(3.0 * dt / b);
+	double lo = s, hi = s;
+	if (KsTime(beta, a, b, c, s, rate) < dt)
+		for (int k = 0; k < KS_MAX_ITERATIONS && KsTime(beta, a, b, c, hi, rate) < dt; k++)
+		{
+			lo = hi;
+			hi *= 2.0;
+		}
+	else
+		for (int k = 0; k < KS_MAX_ITERATIONS && KsTime(beta, a, b, c, lo, rate) > dt; k++)
+		{
+			hi = lo;
+			lo *= 0.5;
+		}
+	if (hi > halfPeriod)
+		hi = halfPeriod;
+	if (!(s > lo && s < hi))
+		s = 0.5 * (lo + hi);
+	bool converged = false;
+	for (int k = 0; k < KS_MAX_ITERATIONS && !converged; k++)
+	{
+		const double t = KsTime(beta, a, b, c, s, rate) - dt;
+		if (t < 0.0)
+			lo = s;
+		else
+			hi = s;
+		double next = rate > 0.0 ? s - t / rate : 0.5 * (lo + hi);
+		if (!(next > lo && next < hi))
+			next = 0.5 * (lo + hi);
+		converged = std::fabs(next - s) <= KS_TOLERANCE * s || hi - lo <= KS_TOLERANCE * s;
+		s = next;
+	}
+	if (!converged)
+		return false;
+	double c2, s3;
+	Stumpff(beta * s * s, c2, s3);
+	const double c0 = 1.0 - beta * s * s * c2, c1 = s * (1.0 - beta * s * s * s3);
+	double un[4], dun[4];
+	for (int k = 0; k < 4; k++)
+	{
+		un[k] = u[k] * c0 + du[k] * c1;
+		dun[k] = -beta * u[k] * c1 + du[k] * c0;
+	}
+	KsToCartesian(un, dun, q, v);
+	return true;
+}
+
+// One regularized pair, A < B
+struct KsPair
+{
+	size_t A, B;
+	// relative state and centre of mass when the step's drift began
+	double Q[3], V[3];
+	double Centre[3], CentreVelocity[3];
+	// outside tidal pull relative to the pair's own, when last checked
+	double Perturbation;
+};
+
+// Finds close pairs after each step, takes them out of the global force pass and drifts their
+// relative motion exactly through KsDrift instead of a straight line, so a hard binary or a
+// close flyby no longer needs the global step cut down to resolve it.
+//
+// While regularized, the pair's mutual pull is removed from the accelerations the global
+// leapfrog kicks with, which leaves exactly the outside tidal pull on the relative motion and
+// the outside pull on the centre of mass; the drift then moves the centre of mass in a straight
+// line and the relative motion along its two-body orbit. That is the same kick / Kepler-drift
+// split as a Wisdom-Holman map, so an isolated pair is integrated exactly whatever the step and
+// a perturbed one carries an error proportional to its perturbation.
+//
+// A pair is formed when its two-body timescale (the orbital one, or the crossing one for a fast
+// flyby, whichever is shorter) is under Steps global steps and the outside perturbation under
+// MaxPerturbation, and dissolved once it is receding past Dissolve times that timescale. A
+// pair that gets strongly perturbed later stays put: split in kicks and Kepler drifts it still
+// does far better than the leapfrog would at a few steps per orbit. Regularized pairs are
+// unsoftened.
+//
+// Only used with direct summation, where the mutual pull can be taken out exactly.
+class KsRegularization
+{
+public:
+	bool Enabled;
+	double Steps;
+	double MaxPerturbation;
+	double Dissolve;
+	std::vector<KsPair> Pairs;
+	// pairs formed and dissolved so far, drifts that failed to converge
+	size_t Formed, Dissolved, Failures;
+
+	KsRegularization() : Enabled(false), Steps(KS_STEPS), MaxPerturbation(KS_MAX_PERTURBATION), Dissolve(KS_DISSOLVE),
+		Formed(0), Dissolved(0), Failures(0)
+	{
+	}
+
+	// Forget every pair, for when the bodies have been replaced
+	void Reset()
+	{
+		Pairs.clear();
+		partner.clear();
+	}
+
+	// After a full force pass: takes each pair's softened mutual pull back out of the
+	// accelerations and returns the change to the potential energy, which swaps the pair's
+	// softened potential for the exact one its regularized motion follows
+	double RemoveMutual(Bodies& b, double G, double softening) const
+	{
+		double potential = 0.0;
+		for (size_t p = 0; p < Pairs.size(); p++)
+			potential += Mutual(b, Pairs[p].A, Pairs[p].B, G, softening, -1.0);
+		return potential;
+	}
+
+	// Before the drift: the state it starts from, so the drift doesn't rely on the straight-line
+	// one that Simulation gives every body
+	void Begin(const Bodies& b)
+	{
+		for (size_t p = 0; p < Pairs.size(); p++)
+		{
+			KsPair& pair = Pairs[p];
+			const size_t i = pair.A, j = pair.B;
+			const double mi = b.mass[i], mj = b.mass[j], m = mi + mj;
+			const double xi[3] = { b.x[i], b.y[i], b.z[i] }, xj[3] = { b.x[j], b.y[j], b.z[j] };
+			const double vi[3] = { b.vx[i], b.vy[i], b.vz[i] }, vj[3] = { b.vx[j], b.vy[j], b.vz[j] };
+			for (int k = 0; k < 3; k++)
+			{
+				pair.Q[k] = xj[k] - xi[k];
+				pair.V[k] = vj[k] - vi[k];
+				pair.Centre[k] = (mi * xi[k] + mj * xj[k]) / m;
+				pair.CentreVelocity[k] = (mi * vi[k] + mj * vj[k]) / m;
+			}
+		}
+	}
+
+	// After the straight-line drift of h: puts each pair's members where their centre of mass
+	// and two-body orbit say
+	void Drift(Bodies& b, double G, double h)
+	{
+		for (size_t p = 0; p < Pairs.size(); p++)
+		{
+			KsPair& pair = Pairs[p];
+			const size_t i = pair.A, j = pair.B;
+			const double mi = b.mass[i], mj = b.mass[j], m = mi + mj;
+			double q[3] = { pair.Q[0], pair.Q[1], pair.Q[2] }, v[3] = { pair.V[0], pair.V[1], pair.V[2] };
+			if (!KsDrift(G * m, q, v, h))
+			{
+				//leave them on their straight lines, the pair goes at the next Update
+				Failures++;
+				pair.Perturbation = HUGE_VAL;
+				continue;
+			}
+			double c[3];
+			for (int k = 0; k < 3; k++)
+				c[k] = pair.Centre[k] + pair.CentreVelocity[k] * h;
+			b.x[i] = c[0] - mj / m * q[0]; b.y[i] = c[1] - mj / m * q[1]; b.z[i] = c[2] - mj / m * q[2];
+			b.x[j] = c[0] + mi / m * q[0]; b.y[j] = c[1] + mi / m * q[1]; b.z[j] = c[2] + mi / m * q[2];
+			const double* w = pair.CentreVelocity;
+			b.vx[i] = w[0] - mj / m * v[0]; b.vy[i] = w[1] - mj / m * v[1]; b.vz[i] = w[2] - mj / m * v[2];
+			b.vx[j] = w[0] + mi / m * v[0]; b.vy[j] = w[1] + mi / m * v[1]; b.vz[j] = w[2] + mi / m * v[2];
+		}
+	}
+
+	// After a step, with the accelerations for the new positions: dissolves pairs that have
+	// come apart and forms new ones, fixing up the accelerations to match. Returns the change
+	// to the potential energy.
+	double Update(Bodies& b, double G, double softening, double timeStep)
+	{
+		const size_t n = b.Count();
+		partner.assign(n, n);
+		double potential = 0.0;
+		const double limit = Steps * timeStep;
+		//dissolve first, so their members can pair up differently
+		for (size_t p = 0; p < Pairs.size();)
+		{
+			KsPair& pair = Pairs[p];
+			double q[3], v[3], tidal[3];
+			Relative(b, pair.A, pair.B, q, v);
+			for (int k = 0; k < 3; k++)
+				tidal[k] = Component(b, pair.B, k) - Component(b, pair.A, k);
+			const double m = b.mass[pair.A] + b.mass[pair.B];
+			const double r = Length(q);
+			pair.Perturbation = m > 0.0 && b.mass[pair.A] > 0.0 && b.mass[pair.B] > 0.0 ? Length(tidal) * r * r / (G * m) : HUGE_VAL;
+			const bool receding = q[0] * v[0] + q[1] * v[1] + q[2] * v[2] > 0.0;
+			if (pair.Perturbation == HUGE_VAL || (receding && Timescale(G * m, q, v) > Dissolve * limit))
+			{
+				potential += Mutual(b, pair.A, pair.B, G, softening, 1.0);
+				Pairs[p] = Pairs.back();
+				Pairs.pop_back();
+				Dissolved++;
+				continue;
+			}
+			partner[pair.A] = pair.B;
+			partner[pair.B] = pair.A;
+			p++;
+		}
+		//each free body's tightest free neighbour, then pair up tightest first
+		candidates.clear();
+		const double eps2 = softening * softening;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (partner[i] < n || b.mass[i] <= 0.0)
+				continue;
+			size_t best = n;
+			double bestTime = limit;
+			for (size_t j = i + 1; j < n; j++)
+			{
+				if (partner[j] < n || b.mass[j] <= 0.0)
+					continue;
+				double q[3], v[3];
+				Relative(b, i, j, q, v);
+				//cheap reject: even a crossing at the current speed takes longer than the limit
+				const double r2 = q[0] * q[0] + q[1] * q[1] + q[2] * q[2];
+				const double v2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+				const double gm = G * (b.mass[i] + b.mass[j]);
+				if (r2 * r2 * r2 > gm * gm * limit * limit * limit * limit && r2 > v2 * limit * limit)
+					continue;
+				const double time = Timescale(gm, q, v);
+				if (time < bestTime)
+				{
+					bestTime = time;
+					best = j;
+				}
+			}
+			if (best < n)
+			{
+				KsCandidate c = { i, best, bestTime };
+				candidates.push_back(c);
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const KsCandidate& x, const KsCandidate& y) { return x.Time < y.Time; });
+		for (size_t k = 0; k < candidates.size(); k++)
+		{
+			const size_t i = candidates[k].A, j = candidates[k].B;
+			if (partner[i] < n || partner[j] < n)
+				continue;
+			//the accelerations still have the softened mutual pull in them
+			double q[3], v[3], tidal[3];
+			Relative(b, i, j, q, v);
+			const double m = b.mass[i] + b.mass[j];
+			const double r2 = q[0] * q[0] + q[1] * q[1] + q[2] * q[2];
+			const double invR = 1.0 / std::sqrt(r2 + eps2);
+			const double pull = G * m * invR * invR * invR;
+			for (int c = 0; c < 3; c++)
+				tidal[c] = Component(b, j, c) - Component(b, i, c) + q[c] * pull;
+			const double perturbation = Length(tidal) * r2 / (G * m);
+			if (perturbation > MaxPerturbation)
+				continue;
+			KsPair pair = KsPair();
+			pair.A = i;
+			pair.B = j;
+			pair.Perturbation = perturbation;
+			Pairs.push_back(pair);
+			partner[i] = j;
+			partner[j] = i;
+			potential += Mutual(b, i, j, G, softening, -1.0);
+			Formed++;
+		}
+		return potential;
+	}
+
+private:
+	struct KsCandidate
+	{
+		size_t A, B;
+		double Time;
+	};
+	// per body, its regularized partner (Count() if none), kept so Update doesn't allocate
+	std::vector<size_t> partner;
+	std::vector<KsCandidate> candidates;
+
+	static double Length(const double* a)
+	{
+		return std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+	}
+
+	static double Component(const Bodies& b, size_t i, int k)
+	{
+		return k == 0 ? b.ax[i] : k == 1 ? b.ay[i] : b.az[i];
+	}
+
+	static void Relative(const Bodies& b, size_t i, size_t j, double* q, double* v)
+	{
+		q[0] = b.x[j] - b.x[i]; q[1] = b.y[j] - b.y[i]; q[2] = b.z[j] - b.z[i];
+		v[0] = b.vx[j] - b.vx[i]; v[1] = b.vy[j] - b.vy[i]; v[2] = b.vz[j] - b.vz[i];
+	}
+
+	// Shorter of the orbital timescale at this separation and the time to cross it, but for a
+	// pair heading in, taken at the closest approach a straight line would reach
+	static double Timescale(double gm, const double* q, const double* v)
+	{
+		const double r2 = q[0] * q[0] + q[1] * q[1] + q[2] * q[2];
+		const double v2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+		const double qv = q[0] * v[0] + q[1] * v[1] + q[2] * v[2];
+		double d2 = r2;
+		if (qv < 0.0 && v2 > 0.0)
+			d2 = r2 - qv * qv / v2;
+		const double orbital = std::sqrt(d2 * std::sqrt(d2) / gm);
+		const double crossing = v2 > 0.0 ? std::sqrt(d2 / v2) : HUGE_VAL;
+		return orbital < crossing ? orbital : crossing;
+	}
+
+	// Adds (sign 1) or removes (sign -1) the softened mutual pull of i and j, and returns the
+	// matching change to the potential: the softened term added and the exact one taken away,
+	// or the other way round
+	static double Mutual(Bodies& b, size_t i, size_t j, double G, double softening, double sign)
+	{
+		double q[3], v[3];
+		Relative(b, i, j, q, v);
+		const double r2 = q[0] * q[0] + q[1] * q[1] + q[2] * q[2];
+		const double invR = 1.0 / std::sqrt(r2 + softening * softening);
+		const double invR3 = sign * G * invR * invR * invR;
+		b.ax[i] += q[0] * b.mass[j] * invR3; b.ay[i] += q[1] * b.mass[j] * invR3; b.az[i] += q[2] * b.mass[j] * invR3;
+		b.ax[j] -= q[0] * b.mass[i] * invR3; b.ay[j] -= q[1] * b.mass[i] * invR3; b.az[j] -= q[2] * b.mass[i] * invR3;
+		const double exact = r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0;
+		return sign * G * b.mass[i] * b.mass[j] * (exact - invR);
+	}
+};
+#endif
@@ -0,0 +1,733 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "EmbeddedAssets.h"
+#include "Simulation.h"
+#include "Checksum.h"
+
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+// Default scene values
+const char SCENE_MAGIC[8] = { 'S', 'S', 'I', 'M', 'S', 'C', 'N', 'E' };
+const uint32_t SCENE_VERSION = 1;
+const uint32_t SCENE_NONE = 0xFFFFFFFFu; //no texture, or not attached to a body
+const int SCENE_VERTEX_FLOATS = 5; //x y z u v, what cubeVertexShader reads
+const uint64_t SCENE_SECTION_ALIGNMENT = 8;
+const char* const SCENE_DEFAULT_NAME = "scene.txt";
+const char* const SCENE_DEFAULT_OWNER = "scene"; //VRAM owner for textures that don't name one
+
+enum SceneObjectFlags
+{
+	SCENE_HUD = 1 //hidden along with the title text
+};
+
+enum SceneSection
+{
+	SCENE_STRINGS,
+	SCENE_SHADERS,
+	SCENE_TEXTURES,
+	SCENE_MESHES,
+	SCENE_VERTICES,
+	SCENE_MATERIALS,
+	SCENE_BODIES,
+	SCENE_OBJECTS,
+	SCENE_SECTION_COUNT
+};
+
+// Everything below is plain data so the compiled form is these arrays written out as they are.
+// Names and paths are offsets into the string table.
+struct SceneShader
+{
+	uint32_t Name;
+	uint32_t Vertex;
+	uint32_t Fragment;
+};
+
+struct SceneTexture
+{
+	uint32_t Name;
+	uint32_t Path;
+	uint32_t Owner;
+};
+
+struct SceneMesh
+{
+	uint32_t Name;
+	uint32_t FirstVertex; //into the shared vertex array, in vertices
+	uint32_t VertexCount;
+};
+
+struct SceneMaterial
+{
+	uint32_t Name;
+	uint32_t Shader;
+	uint32_t Texture; //SCENE_NONE for untextured shaders like the lamp
+	float Colour[3]; //objectColour uniform
+};
+
+struct SceneBody
+{
+	double Position[3];
+	double Velocity[3];
+	double Mass;
+	double Radius;
+};
+
+struct SceneObject
+{
+	uint32_t Name;
+	uint32_t Mesh;
+	uint32_t Material;
+	uint32_t Body; //drawn where the simulation has this body, SCENE_NONE to stay at Position
+	uint32_t Flags;
+	float Position[3];
+	float Axis[3];
+	float Angle; //radians, fixed tilt about Axis
+	float Spin; //radians per second about Axis
+	float Scale;
+};
+
+struct SceneLight
+{
+	float Position[3];
+	float Colour[3];
+};
+
+// Compiled scene: this header, then each section SCENE_SECTION_ALIGNMENT aligned
+struct SceneFileHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t Reserved;
+	uint64_t Count[SCENE_SECTION_COUNT]; //in elements
+	uint64_t Offset[SCENE_SECTION_COUNT]; //from the start of the file
+	SceneLight Light;
+	uint64_t Checksum; //Hash64 of everything after the header
+};
+
+// What the game shows: shaders, textures, meshes, materials, bodies and the objects that draw
+// them, read from a scene file instead of being compiled into main.cpp.
+//
+// The text form is one declaration per line, # starts a comment:
+//   light position X Y Z colour R G B
+//   shader NAME VERTEX_FILE FRAGMENT_FILE
+//   texture NAME IMAGE_FILE [VRAM_OWNER]
+//   mesh NAME cube SIZE
+//   mesh NAME quad X0 Y0 X1 Y1                   (two triangles in the z = 0 plane)
+//   mesh NAME triangles                          (followed by "v X Y Z U V" lines)
+//   material NAME SHADER TEXTURE|none [colour R G B]
+//   body NAME mass M radius R [position X Y Z] [velocity X Y Z] [orbit PARENT DISTANCE] [drawing]
+//   object NAME [drawing]
+//   hud NAME [drawing]                           (an object that space hides with the title text)
+// where drawing is any of: mesh M material M position X Y Z axis X Y Z angle DEGREES spin RAD/S scale S.
+// A body without a mesh is simulated but not drawn. "orbit" puts the body DISTANCE along -x
+// from an earlier body, on a circular orbit in the x-z plane, and gives the parent the recoil
+// so the pair's momentum doesn't change.
+//
+// Every mesh lives in one vertex array so the renderer needs one buffer and one VAO. Objects are
+// sorted by shader, texture and mesh so drawing them changes as little GL state as possible.
+// The compiled form (SaveBinary) is those arrays written out as they are, so loading it is one
+// read and a few copies with no parsing.
+class Scene
+{
+public:
+	std::vector<char> Strings;
+	std::vector<SceneShader> Shaders;
+	std::vector<SceneTexture> Textures;
+	std::vector<SceneMesh> Meshes;
+	std::vector<float> Vertices; //SCENE_VERTEX_FLOATS per vertex
+	std::vector<SceneMaterial> Materials;
+	std::vector<SceneBody> Bodies;
+	std::vector<SceneObject> Objects;
+	SceneLight Light;
+
+	Scene()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		Strings.assign(1, '\0'); //offset 0 is the empty string
+		Shaders.clear();
+		Textures.clear();
+		Meshes.clear();
+		Vertices.clear();
+		Materials.clear();
+		Bodies.clear();
+		Objects.clear();
+		Light.Position[0] = 0.0f; Light.Position[1] = 0.0f; Light.Position[2] = -5.0f;
+		Light.Colour[0] = 1.0f; Light.Colour[1] = 1.0f; Light.Colour[2] = 1.0f;
+	}
+
+	const char* Text(uint32_t offset) const
+	{
+		return &Strings[offset];
+	}
+
+	size_t VertexCount() const
+	{
+		return Vertices.size() / SCENE_VERTEX_FLOATS;
+	}
+
+	// Reads path from the executable, pack or disk (in that order), text or compiled
+	bool Load(const char* path, const AssetPack* pack = NULL)
+	{
+		AssetView view = EmbeddedAssets::Find(path);
+		if (!view.Valid() && pack)
+			view = pack->Find(path);
+		if (view.Valid())
+			return Load(view.Data, view.Size, path);
+
+		FILE* file = fopen(path, "rb");
+		if (!file)
+		{
+			std::cout << "ERROR::SCENE can't open " << path << std::endl;
+			return false;
+		}
+		std::vector<unsigned char> data;
+		bool ok = fseek(file, 0, SEEK_END) == 0;
+		long size = ok ? ftell(file) : -1;
+		ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+		if (ok)
+		{
+			data.resize((size_t)size + 1);
+			ok = fread(data.data(), 1, (size_t)size, file) == (size_t)size;
+		}
+		fclose(file);
+		if (!ok)
+		{
+			std::cout << "ERROR::SCENE can't read " << path << std::endl;
+			return false;
+		}
+		return Load(data.data(), (size_t)size, path);
+	}
+
+	bool Load(const unsigned char* data, size_t size, const char* source)
+	{
+		if (size >= sizeof(SCENE_MAGIC) && memcmp(data, SCENE_MAGIC, sizeof(SCENE_MAGIC)) == 0)
+			return LoadBinary(data, size, source);
+		return Parse((const char*)data, size, source);
+	}
+
+	// Text form, see the class comment. Leaves the scene empty and says where on failure.
+	bool Parse(const char* text, size_t length, const char* source)
+	{
+		Clear();
+		std::string buffer(text, length);
+		ParseState state;
+		size_t lineNumber = 0;
+		size_t start = 0;
+		while (start < buffer.size())
+		{
+			size_t end = buffer.find('\n', start);
+			if (end == std::string::npos)
+				end = buffer.size();
+			if (end < buffer.size())
+				buffer[end] = '\0';
+			lineNumber++;
+			if (!ParseLine(&buffer[start], end - start, state))
+			{
+				std::cout << "ERROR::SCENE " << source << ":" << lineNumber << " " << state.Error << std::endl;
+				Clear();
+				return false;
+			}
+			start = end + 1;
+		}
+		if (!FinishMesh(state))
+		{
+			std::cout << "ERROR::SCENE " << source << " " << state.Error << std::endl;
+			Clear();
+			return false;
+		}
+		SortObjects();
+		return true;
+	}
+
+	// Compiled form, see SceneFileHeader. Checked as thoroughly as the text so a bad file
+	// can't hand the renderer an index out of range.
+	bool LoadBinary(const unsigned char* data, size_t size, const char* source)
+	{
+		Clear();
+		if (size < sizeof(SceneFileHeader))
+			return Fail(source, "too small to be a compiled scene");
+		SceneFileHeader h;
+		memcpy(&h, data, sizeof(h));
+		if (memcmp(h.Magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0 || h.Version != SCENE_VERSION)
+			return Fail(source, "not a compiled scene (or an old one)");
+		for (int k = 0; k < SCENE_SECTION_COUNT; k++)
+			if (h.Count[k] > size || h.Offset[k] > size || h.Count[k] * ElementBytes(k) > size - h.Offset[k])
+				return Fail(source, "section runs off the end of the file");
+		if (Checksum::Hash64(data + sizeof(h), size - sizeof(h)) != h.Checksum)
+			return Fail(source, "checksum mismatch");
+		CopySection(Strings, data, h, SCENE_STRINGS);
+		CopySection(Shaders, data, h, SCENE_SHADERS);
+		CopySection(Textures, data, h, SCENE_TEXTURES);
+		CopySection(Meshes, data, h, SCENE_MESHES);
+		CopySection(Vertices, data, h, SCENE_VERTICES);
+		CopySection(Materials, data, h, SCENE_MATERIALS);
+		CopySection(Bodies, data, h, SCENE_BODIES);
+		CopySection(Objects, data, h, SCENE_OBJECTS);
+		Light = h.Light;
+		if (!Validate())
+			return Fail(source, "references something that isn't there");
+		return true;
+	}
+
+	bool SaveBinary(const char* path) const
+	{
+		SceneFileHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.Magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+		h.Version = SCENE_VERSION;
+		h.Light = Light;
+		const void* sections[SCENE_SECTION_COUNT] = { Strings.data(), Shaders.data(), Textures.data(), Meshes.data(),
+			Vertices.data(), Materials.data(), Bodies.data(), Objects.data() };
+		h.Count[SCENE_STRINGS] = Strings.size();
+		h.Count[SCENE_SHADERS] = Shaders.size();
+		h.Count[SCENE_TEXTURES] = Textures.size();
+		h.Count[SCENE_MESHES] = Meshes.size();
+		h.Count[SCENE_VERTICES] = Vertices.size();
+		h.Count[SCENE_MATERIALS] = Materials.size();
+		h.Count[SCENE_BODIES] = Bodies.size();
+		h.Count[SCENE_OBJECTS] = Objects.size();
+		uint64_t offset = sizeof(h);
+		for (int k = 0; k < SCENE_SECTION_COUNT; k++)
+		{
+			offset = (offset + SCENE_SECTION_ALIGNMENT - 1) / SCENE_SECTION_ALIGNMENT * SCENE_SECTION_ALIGNMENT;
+			h.Offset[k] = offset;
+			offset += h.Count[k] * ElementBytes(k);
+		}
+
+		//built in memory so the checksum and the write are one pass each
+		std::vector<unsigned char> file((size_t)offset, 0);
+		for (int k = 0; k < SCENE_SECTION_COUNT; k++)
+			if (h.Count[k] > 0)
+				memcpy(&file[(size_t)h.Offset[k]], sections[k], (size_t)(h.Count[k] * ElementBytes(k)));
+		h.Checksum = Checksum::Hash64(file.data() + sizeof(h), file.size() - sizeof(h));
+		memcpy(file.data(), &h, sizeof(h));
+
+		FILE* out = fopen(path, "wb");
+		if (!out)
+			return false;
+		bool ok = fwrite(file.data(), 1, file.size(), out) == file.size();
+		ok = fclose(out) == 0 && ok;
+		if (!ok)
+			remove(path);
+		return ok;
+	}
+
+	// Replaces the simulation's bodies with the scene's, in declaration order
+	void Populate(Simulation& sim) const
+	{
+		sim.State.Clear();
+		for (size_t k = 0; k < Bodies.size(); k++)
+		{
+			const SceneBody& b = Bodies[k];
+			sim.State.Add(b.Position[0], b.Position[1], b.Position[2], b.Velocity[0], b.Velocity[1], b.Velocity[2], b.Mass, b.Radius);
+		}
+		sim.Time = 0.0;
+		sim.Invalidate();
+	}
+
+	static size_t ElementBytes(int section)
+	{
+		static const size_t bytes[SCENE_SECTION_COUNT] = { sizeof(char), sizeof(SceneShader), sizeof(SceneTexture),
+			sizeof(SceneMesh), sizeof(float), sizeof(SceneMaterial), sizeof(SceneBody), sizeof(SceneObject) };
+		return bytes[section];
+	}
+
+private:
+	//lookup tables and the line being worked on, only alive while parsing
+	struct ParseState
+	{
+		std::map<std::string, uint32_t> Shaders, Textures, Meshes, Materials, Bodies;
+		std::vector<char*> Tokens;
+		uint32_t OpenMesh; //mesh still taking "v" lines
+		std::string Error;
+
+		ParseState() : OpenMesh(SCENE_NONE)
+		{
+		}
+	};
+
+	bool ParseLine(char* line, size_t length, ParseState& state)
+	{
+		//split in place on whitespace, stopping at a comment
+		state.Tokens.clear();
+		for (size_t k = 0; k < length;)
+		{
+			while (k < length && (line[k] == ' ' || line[k] == '\t' || line[k] == '\r'))
+				line[k++] = '\0';
+			if (k >= length || line[k] == '#' || line[k] == '\0')
+				break;
+			state.Tokens.push_back(line + k);
+			while (k < length && line[k] != ' ' && line[k] != '\t' && line[k] != '\r' && line[k] != '\0')
+				k++;
+		}
+		if (state.Tokens.empty())
+			return true;
+		const std::vector<char*>& t = state.Tokens;
+		std::string kind = t[0];
+
+		if (kind == "v")
+		{
+			if (state.OpenMesh == SCENE_NONE)
+				return Error(state, "vertex outside a triangles mesh");
+			if (t.size() != 1 + SCENE_VERTEX_FLOATS)
+				return Error(state, "a vertex is X Y Z U V");
+			float v[SCENE_VERTEX_FLOATS];
+			for (int k = 0; k < SCENE_VERTEX_FLOATS; k++)
+				if (!Number(t[1 + k], v[k], state))
+					return false;
+			Vertices.insert(Vertices.end(), v, v + SCENE_VERTEX_FLOATS);
+			Meshes[state.OpenMesh].VertexCount++;
+			return true;
+		}
+		if (!FinishMesh(state))
+			return false;
+
+		if (kind == "light")
+		{
+			for (size_t k = 1; k < t.size(); k++)
+			{
+				std::string key = t[k];
+				if (key == "position" && Vector(t, k, Light.Position, state)) continue;
+				if (key == "colour" && Vector(t, k, Light.Colour, state)) continue;
+				return state.Error.empty() ? Error(state, "unknown light setting " + key) : false;
+			}
+			return true;
+		}
+		if (t.size() < 2)
+			return Error(state, kind + " needs a name");
+		std::string name = t[1];
+
+		if (kind == "shader")
+		{
+			if (t.size() != 4)
+				return Error(state, "shader is NAME VERTEX_FILE FRAGMENT_FILE");
+			if (!Declare(state.Shaders, name, (uint32_t)Shaders.size(), state))
+				return false;
+			SceneShader s = { String(t[1]), String(t[2]), String(t[3]) };
+			Shaders.push_back(s);
+			return true;
+		}
+		if (kind == "texture")
+		{
+			if (t.size() != 3 && t.size() != 4)
+				return Error(state, "texture is NAME IMAGE_FILE [OWNER]");
+			if (!Declare(state.Textures, name, (uint32_t)Textures.size(), state))
+				return false;
+			SceneTexture s = { String(t[1]), String(t[2]), String(t.size() == 4 ? t[3] : SCENE_DEFAULT_OWNER) };
+			Textures.push_back(s);
+			return true;
+		}
+		if (kind == "mesh")
+			return ParseMesh(t, state);
+		if (kind == "material")
+		{
+			if (t.size() != 4 && !(t.size() == 8 && std::string(t[4]) == "colour"))
+				return Error(state, "material is NAME SHADER TEXTURE|none [colour R G B]");
+			SceneMaterial m;
+			m.Name = String(t[1]);
+			m.Colour[0] = m.Colour[1] = m.Colour[2] = 1.0f;
+			if (!Reference(state.Shaders, t[2], "shader", m.Shader, state))
+				return false;
+			m.Texture = SCENE_NONE;
+			if (std::string(t[3]) != "none" && !Reference(state.Textures, t[3], "texture", m.Texture, state))
+				return false;
+			size_t k = 4;
+			if (t.size() == 8 && !Vector(t, k, m.Colour, state))
+				return false;
+			if (!Declare(state.Materials, name, (uint32_t)Materials.size(), state))
+				return false;
+			Materials.push_back(m);
+			return true;
+		}
+		if (kind == "body" || kind == "object" || kind == "hud")
+			return ParseObject(kind, t, state);
+		return Error(state, "unknown declaration " + kind);
+	}
+
+	bool ParseMesh(const std::vector<char*>& t, ParseState& state)
+	{
+		std::string shape = t.size() > 2 ? t[2] : "";
+		SceneMesh mesh = { String(t[1]), (uint32_t)VertexCount(), 0 };
+		if (!Declare(state.Meshes, t[1], (uint32_t)Meshes.size(), state))
+			return false;
+		if (shape == "cube" && t.size() == 4)
+		{
+			float size;
+			if (!Number(t[3], size, state))
+				return false;
+			AddCube(size);
+		}
+		else if (shape == "quad" && t.size() == 7)
+		{
+			float c[4];
+			for (int k = 0; k < 4; k++)
+				if (!Number(t[3 + k], c[k], state))
+					return false;
+			AddQuad(c[0], c[1], c[2], c[3]);
+		}
+		else if (shape == "triangles" && t.size() == 3)
+			state.OpenMesh = (uint32_t)Meshes.size();
+		else
+			return Error(state, "mesh is NAME cube SIZE, NAME quad X0 Y0 X1 Y1 or NAME triangles");
+		mesh.VertexCount = (uint32_t)VertexCount() - mesh.FirstVertex;
+		Meshes.push_back(mesh);
+		return true;
+	}
+
+	bool ParseObject(const std::string& kind, const std::vector<char*>& t, ParseState& state)
+	{
+		SceneObject o;
+		memset(&o, 0, sizeof(o));
+		o.Name = String(t[1]);
+		o.Mesh = SCENE_NONE;
+		o.Material = SCENE_NONE;
+		o.Body = SCENE_NONE;
+		o.Flags = kind == "hud" ? SCENE_HUD : 0;
+		o.Axis[1] = 1.0f;
+		o.Scale = 1.0f;
+		SceneBody b;
+		memset(&b, 0, sizeof(b));
+		uint32_t parent = SCENE_NONE;
+		double distance = 0.0;
+		bool isBody = kind == "body";
+
+		for (size_t k = 2; k < t.size(); k++)
+		{
+			std::string key = t[k];
+			float degrees;
+			if (key == "mesh" && k + 1 < t.size() && Reference(state.Meshes, t[++k], "mesh", o.Mesh, state)) continue;
+			if (key == "material" && k + 1 < t.size() && Reference(state.Materials, t[++k], "material", o.Material, state)) continue;
+			if (key == "position" && Vector(t, k, o.Position, state)) continue;
+			if (key == "axis" && Vector(t, k, o.Axis, state)) continue;
+			if (key == "angle" && k + 1 < t.size() && Number(t[++k], degrees, state)) { o.Angle = degrees * 3.14159265358979f / 180.0f; continue; }
+			if (key == "spin" && k + 1 < t.size() && Number(t[++k], o.Spin, state)) continue;
+			if (key == "scale" && k + 1 < t.size() && Number(t[++k], o.Scale, state)) continue;
+			if (isBody && key == "mass" && k + 1 < t.size() && Number(t[++k], b.Mass, state)) continue;
+			if (isBody && key == "radius" && k + 1 < t.size() && Number(t[++k], b.Radius, state)) continue;
+			if (isBody && key == "velocity" && Vector(t, k, b.Velocity, state)) continue;
+			if (isBody && key == "orbit" && k + 2 < t.size() && Reference(state.Bodies, t[k + 1], "body", parent, state) &&
+				Number(t[k + 2], distance, state)) { k += 2; continue; }
+			return state.Error.empty() ? Error(state, "unknown or incomplete " + kind + " setting " + key) : false;
+		}
+		if ((o.Mesh == SCENE_NONE) != (o.Material == SCENE_NONE))
+			return Error(state, "needs both a mesh and a material to be drawn");
+		if (!isBody && o.Mesh == SCENE_NONE)
+			return Error(state, kind + " without a mesh draws nothing");
+
+		if (isBody)
+		{
+			if (!(b.Mass > 0.0))
+				return Error(state, "body needs a positive mass");
+			for (int k = 0; k < 3; k++)
+				b.Position[k] = o.Position[k];
+			if (parent != SCENE_NONE)
+			{
+				//circular speed v = sqrt(GM/r), the parent recoils so momentum is conserved
+				SceneBody& p = Bodies[parent];
+				if (!(distance > 0.0))
+					return Error(state, "orbit distance must be positive");
+				double speed = sqrt(SIM_G * p.Mass / distance);
+				b.Position[0] = p.Position[0] - distance;
+				b.Position[1] = p.Position[1];
+				b.Position[2] = p.Position[2];
+				b.Velocity[0] = p.Velocity[0];
+				b.Velocity[1] = p.Velocity[1];
+				b.Velocity[2] = p.Velocity[2] - speed;
+				p.Velocity[2] += speed * b.Mass / p.Mass;
+			}
+			if (!Declare(state.Bodies, t[1], (uint32_t)Bodies.size(), state))
+				return false;
+			o.Body = (uint32_t)Bodies.size();
+			Bodies.push_back(b);
+		}
+		if (o.Mesh != SCENE_NONE)
+			Objects.push_back(o);
+		return true;
+	}
+
+	bool FinishMesh(ParseState& state)
+	{
+		if (state.OpenMesh == SCENE_NONE)
+			return true;
+		uint32_t count = Meshes[state.OpenMesh].VertexCount;
+		state.OpenMesh = SCENE_NONE;
+		if (count == 0 || count % 3 != 0)
+			return Error(state, "triangles mesh needs a multiple of 3 vertices");
+		return true;
+	}
+
+	// Unit cube scaled to size, textured the same on every face
+	void AddCube(float size)
+	{
+		static const float cube[36 * SCENE_VERTEX_FLOATS] =
+		{
+			//x		y		z	  texX	texY
+			-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
+			0.5f, 0.5f, -0.5f, 1.0f, 1.0f, -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
+
+			-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
+			0.5f, 0.5f, 0.5f, 1.0f, 1.0f, -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
+
+			-0.5f, 0.5f, 0.5f, 1.0f, 0.0f, -0.5f, 0.5f, -0.5f, 1.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+			-0.5f, -0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, -0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
+
+			0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+			0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
+
+			-0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
+			0.5f, -0.5f, 0.5f, 1.0f, 0.0f, -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+
+			-0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
+			0.5f, 0.5f, 0.5f, 1.0f, 0.0f, -0.5f, 0.5f, 0.5f, 0.0f, 0.0f, -0.5f, 0.5f, -0.5f, 0.0f, 1.0f
+		};
+		for (int k = 0; k < 36 * SCENE_VERTEX_FLOATS; k++)
+			Vertices.push_back(k % SCENE_VERTEX_FLOATS < 3 ? cube[k] * size : cube[k]);
+	}
+
+	// Rectangle from (x0, y0) to (x1, y1), texture the right way up
+	void AddQuad(float x0, float y0, float x1, float y1)
+	{
+		const float corner[4][SCENE_VERTEX_FLOATS] =
+		{
+			{ x0, y1, 0.0f, 0.0f, 1.0f },
+			{ x1, y1, 0.0f, 1.0f, 1.0f },
+			{ x0, y0, 0.0f, 0.0f, 0.0f },
+			{ x1, y0, 0.0f, 1.0f, 0.0f }
+		};
+		const int order[6] = { 0, 2, 3, 0, 1, 3 };
+		for (int k = 0; k < 6; k++)
+			Vertices.insert(Vertices.end(), corner[order[k]], corner[order[k]] + SCENE_VERTEX_FLOATS);
+	}
+
+	// Groups objects by shader, then texture, then mesh, keeping declaration order within a group
+	void SortObjects()
+	{
+		const std::vector<SceneMaterial>& materials = Materials;
+		std::stable_sort(Objects.begin(), Objects.end(), [&materials](const SceneObject& a, const SceneObject& b) {
+			const SceneMaterial& ma = materials[a.Material];
+			const SceneMaterial& mb = materials[b.Material];
+			if (ma.Shader != mb.Shader)
+				return ma.Shader < mb.Shader;
+			if (ma.Texture != mb.Texture)
+				return ma.Texture < mb.Texture;
+			if (a.Material != b.Material)
+				return a.Material < b.Material;
+			return a.Mesh < b.Mesh;
+		});
+	}
+
+	bool Validate() const
+	{
+		if (Strings.empty() || Strings.back() != '\0' || Vertices.size() % SCENE_VERTEX_FLOATS != 0)
+			return false;
+		uint32_t strings = (uint32_t)Strings.size();
+		for (size_t k = 0; k < Shaders.size(); k++)
+			if (Shaders[k].Name >= strings || Shaders[k].Vertex >= strings || Shaders[k].Fragment >= strings)
+				return false;
+		for (size_t k = 0; k < Textures.size(); k++)
+			if (Textures[k].Name >= strings || Textures[k].Path >= strings || Textures[k].Owner >= strings)
+				return false;
+		for (size_t k = 0; k < Meshes.size(); k++)
+			if (Meshes[k].Name >= strings || (uint64_t)Meshes[k].FirstVertex + Meshes[k].VertexCount > VertexCount())
+				return false;
+		for (size_t k = 0; k < Materials.size(); k++)
+			if (Materials[k].Name >= strings || Materials[k].Shader >= Shaders.size() ||
+				(Materials[k].Texture != SCENE_NONE && Materials[k].Texture >= Textures.size()))
+				return false;
+		for (size_t k = 0; k < Objects.size(); k++)
+			if (Objects[k].Name >= strings || Objects[k].Mesh >= Meshes.size() || Objects[k].Material >= Materials.size() ||
+				(Objects[k].Body != SCENE_NONE && Objects[k].Body >= Bodies.size()))
+				return false;
+		return true;
+	}
+
+	template <typename T>
+	static void CopySection(std::vector<T>& out, const unsigned char* data, const SceneFileHeader& h, int section)
+	{
+		out.resize((size_t)h.Count[section]);
+		if (!out.empty())
+			memcpy(out.data(), data + h.Offset[section], out.size() * sizeof(T));
+	}
+
+	uint32_t String(const char* text)
+	{
+		uint32_t offset = (uint32_t)Strings.size();
+		Strings.insert(Strings.end(), text, text + strlen(text) + 1);
+		return offset;
+	}
+
+	static bool Number(const char* token, float& value, ParseState& state)
+	{
+		double d;
+		if (!Number(token, d, state))
+			return false;
+		value = (float)d;
+		return true;
+	}
+
+	static bool Number(const char* token, double& value, ParseState& state)
+	{
+		char* end;
+		value = strtod(token, &end);
+		if (end == token || *end != '\0')
+			return Error(state, std::string("expected a number, got ") + token);
+		return true;
+	}
+
+	// Reads the three numbers after t[k] and leaves k on the last of them
+	template <typename T>
+	static bool Vector(const std::vector<char*>& t, size_t& k, T* out, ParseState& state)
+	{
+		if (k + 3 >= t.size())
+			return Error(state, std::string(t[k]) + " needs three numbers");
+		for (int c = 0; c < 3; c++)
+			if (!Number(t[k + 1 + c], out[c], state))
+				return false;
+		k += 3;
+		return true;
+	}
+
+	static bool Declare(std::map<std::string, uint32_t>& names, const std::string& name, uint32_t index, ParseState& state)
+	{
+		if (!names.insert(std::make_pair(name, index)).second)
+			return Error(state, name + " is declared twice");
+		return true;
+	}
+
+	static bool Reference(const std::map<std::string, uint32_t>& names, const char* name, const char* what, uint32_t& index, ParseState& state)
+	{
+		std::map<std::string, uint32_t>::const_iterator found = names.find(name);
+		if (found == names.end())
+			return Error(state, std::string("unknown ") + what + " " + name);
+		index = found->second;
+		return true;
+	}
+
+	static bool Error(ParseState& state, const std::string& message)
+	{
+		state.Error = message;
+		return false;
+	}
+
+	bool Fail(const char* source, const char* why)
+	{
+		std::cout << "ERROR::SCENE " << source << ": " << why << std::endl;
+		Clear();
+		return false;
+	}
+};
+#endif
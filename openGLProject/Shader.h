@@ -8,59 +8,50 @@
 
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <iostream>
 
+#include "GpuMemory.h"
+#include "AllocTracker.h"
+#include "EmbeddedAssets.h"
+
 class Shader
 {
 public:
 	unsigned int ID;
 	// constructor generates the shader on the fly
+	// sources come from the executable (EmbedAssets builds) or pack when they're in there (no
+	// copy, GL is given the lengths), otherwise they're read from disk
 	// ------------------------------------------------------------------------
-	Shader(const char* vertexPath, const char* fragmentPath)
+	Shader(const char* vertexPath, const char* fragmentPath, const AssetPack* pack = NULL)
 	{
-		// 1. retrieve the vertex/fragment source code from filePath
+		AllocScope allocScope(ALLOC_SHADERS);
+		// 1. retrieve the vertex/fragment source code from the pack or filePath
 		std::string vertexCode;
 		std::string fragmentCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
-		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-		}
-		catch (std::ifstream::failure e)
+		AssetView vertexView = EmbeddedAssets::Find(vertexPath);
+		AssetView fragmentView = EmbeddedAssets::Find(fragmentPath);
+		if (pack && !vertexView.Valid())
+			vertexView = pack->Find(vertexPath);
+		if (pack && !fragmentView.Valid())
+			fragmentView = pack->Find(fragmentPath);
+		if ((!vertexView.Valid() && !readFile(vertexPath, vertexCode)) || (!fragmentView.Valid() && !readFile(fragmentPath, fragmentCode)))
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
+		const char* vShaderCode = vertexView.Valid() ? (const char*)vertexView.Data : vertexCode.c_str();
+		const char * fShaderCode = fragmentView.Valid() ? (const char*)fragmentView.Data : fragmentCode.c_str();
+		GLint vShaderLength = (GLint)(vertexView.Valid() ? vertexView.Size : vertexCode.size());
+		GLint fShaderLength = (GLint)(fragmentView.Valid() ? fragmentView.Size : fragmentCode.size());
 		// 2. compile shaders
 		unsigned int vertex, fragment;
-		int success;
-		char infoLog[512];
 		// vertex shader
 		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
+		glShaderSource(vertex, 1, &vShaderCode, &vShaderLength);
 		glCompileShader(vertex);
 		checkCompileErrors(vertex, "VERTEX");
 		// fragment Shader
 		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
+		glShaderSource(fragment, 1, &fShaderCode, &fShaderLength);
 		glCompileShader(fragment);
 		checkCompileErrors(fragment, "FRAGMENT");
 		// shader Program
@@ -69,6 +60,8 @@ public:
 		glAttachShader(ID, fragment);
 		glLinkProgram(ID);
 		checkCompileErrors(ID, "PROGRAM");
+		// the driver keeps its own copy of the program, source size is our best guess at it
+		GpuMemory::Get().RegisterProgram(ID, (size_t)vShaderLength + (size_t)fShaderLength, "shaders");
 		// delete the shaders as they're linked into our program now and no longer necessary
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
@@ -80,64 +73,82 @@ public:
 		glUseProgram(ID);
 	}
 	// utility uniform functions
+	// names are plain C strings so passing a literal doesn't build a std::string every call
 	// ------------------------------------------------------------------------
-	void setBool(const std::string &name, bool value) const
+	void setBool(const char* name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(glGetUniformLocation(ID, name), (int)value);
 	}
 	// ------------------------------------------------------------------------
-	void setInt(const std::string &name, int value) const
+	void setInt(const char* name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(glGetUniformLocation(ID, name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setFloat(const std::string &name, float value) const
+	void setFloat(const char* name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(glGetUniformLocation(ID, name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setVec2(const std::string &name, const glm::vec2 &value) const
+	void setVec2(const char* name, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(glGetUniformLocation(ID, name), 1, &value[0]);
 	}
-	void setVec2(const std::string &name, float x, float y) const
+	void setVec2(const char* name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(glGetUniformLocation(ID, name), x, y);
 	}
 	// ------------------------------------------------------------------------
-	void setVec3(const std::string &name, const glm::vec3 &value) const
+	void setVec3(const char* name, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(glGetUniformLocation(ID, name), 1, &value[0]);
 	}
-	void setVec3(const std::string &name, float x, float y, float z) const
+	void setVec3(const char* name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(glGetUniformLocation(ID, name), x, y, z);
 	}
 	// ------------------------------------------------------------------------
-	void setVec4(const std::string &name, const glm::vec4 &value) const
+	void setVec4(const char* name, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(glGetUniformLocation(ID, name), 1, &value[0]);
 	}
-	void setVec4(const std::string &name, float x, float y, float z, float w) const
+	void setVec4(const char* name, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(glGetUniformLocation(ID, name), x, y, z, w);
 	}
 	// ------------------------------------------------------------------------
-	void setMat2(const std::string &name, const glm::mat2 &mat) const
+	void setMat2(const char* name, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat3(const std::string &name, const glm::mat3 &mat) const
+	void setMat3(const char* name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	void setMat4(const char* name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 	}
 private:
+	// reads a whole file straight into out with one allocation, no stringstream in between
+	// ------------------------------------------------------------------------
+	static bool readFile(const char* path, std::string& out)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		if (!file)
+			return false;
+		file.seekg(0, std::ios::end);
+		std::streamoff size = file.tellg();
+		if (size < 0)
+			return false;
+		file.seekg(0, std::ios::beg);
+		out.resize((size_t)size);
+		if (size > 0)
+			file.read(&out[0], size);
+		return !file.fail();
+	}
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(unsigned int shader, std::string type)
@@ -0,0 +1,232 @@
+#ifndef SHARED_MEMORY_H
+#define SHARED_MEMORY_H
+
+#include <string>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#endif
+
+// Default shared memory values
+const size_t SHARED_MEMORY_OWNER_BYTES = 8; //POSIX: the creator's pid, after the caller's bytes
+
+// A named block of memory other local processes can map by name.
+// Windows: pagefile-backed file mapping in the session namespace. POSIX: shm_open + mmap.
+// The creator owns the name and removes it when closed; openers just unmap.
+// Create never takes over a name somebody else is using. Windows mappings go away with the
+// last handle, so an existing one is always live. POSIX names outlive a crash, so the creator's
+// pid sits in a few bytes past the end of the block (the caller's layout doesn't move), and
+// a leftover region is only unlinked once that process is gone.
+class SharedMemory
+{
+public:
+	SharedMemory() : data(NULL), size(0), owner(false)
+#ifdef _WIN32
+		, mapping(NULL)
+#else
+		, mappedSize(0)
+#endif
+	{
+	}
+
+	~SharedMemory()
+	{
+		Close();
+	}
+
+	// Creates name with size bytes, zero filled. Returns false on failure, including when
+	// another running process already has the name.
+	bool Create(const char* name, size_t bytes)
+	{
+		Close();
+		this->name = name;
+#ifdef _WIN32
+		unsigned long long size64 = bytes;
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size64 >> 32), (DWORD)size64, ("Local\\" + this->name).c_str());
+		if (!mapping)
+			return false;
+		if (GetLastError() == ERROR_ALREADY_EXISTS)
+		{
+			std::cout << "ERROR::SHARED_MEMORY '" << this->name << "' is already open in another process" << std::endl;
+			CloseHandle(mapping);
+			mapping = NULL;
+			return false;
+		}
+		data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+		if (!data)
+		{
+			Close();
+			return false;
+		}
+		memset(data, 0, bytes);
+#else
+		std::string path = "/" + this->name;
+		int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0 && errno == EEXIST)
+		{
+			long long pid = ownerPid(path);
+			if (pid != 0)
+			{
+				std::cout << "ERROR::SHARED_MEMORY '" << this->name << "' belongs to running process " << pid << std::endl;
+				return false;
+			}
+			//left behind by a run that crashed
+			shm_unlink(path.c_str());
+			fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		}
+		if (fd < 0)
+			return false;
+		size_t mapped = bytes + SHARED_MEMORY_OWNER_BYTES;
+		if (ftruncate(fd, (off_t)mapped) != 0)
+		{
+			::close(fd);
+			shm_unlink(path.c_str());
+			return false;
+		}
+		void* p = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+		{
+			shm_unlink(path.c_str());
+			return false;
+		}
+		int64_t pid = (int64_t)getpid();
+		memcpy((unsigned char*)p + bytes, &pid, sizeof(pid));
+		data = p;
+#endif
+		size = bytes;
+#ifndef _WIN32
+		mappedSize = bytes + SHARED_MEMORY_OWNER_BYTES;
+#endif
+		owner = true;
+		return true;
+	}
+
+	// Maps an existing region created by another process
+	bool Open(const char* name, bool writable = false)
+	{
+		Close();
+		this->name = name;
+#ifdef _WIN32
+		mapping = OpenFileMappingA(writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, FALSE, ("Local\\" + this->name).c_str());
+		if (!mapping)
+			return false;
+		data = MapViewOfFile(mapping, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0);
+		if (!data)
+		{
+			Close();
+			return false;
+		}
+		MEMORY_BASIC_INFORMATION info;
+		VirtualQuery(data, &info, sizeof(info));
+		size = info.RegionSize;
+#else
+		std::string path = "/" + this->name;
+		int fd = shm_open(path.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void* p = mmap(NULL, (size_t)st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		data = p;
+		mappedSize = (size_t)st.st_size;
+		//the owner pid isn't part of the caller's block
+		size = mappedSize > SHARED_MEMORY_OWNER_BYTES ? mappedSize - SHARED_MEMORY_OWNER_BYTES : mappedSize;
+#endif
+		owner = false;
+		return true;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		mapping = NULL;
+#else
+		if (data)
+			munmap(data, mappedSize);
+		if (owner)
+			shm_unlink(("/" + name).c_str());
+		mappedSize = 0;
+#endif
+		data = NULL;
+		size = 0;
+		owner = false;
+	}
+
+	void* Data() const
+	{
+		return data;
+	}
+
+	size_t Size() const
+	{
+		return size;
+	}
+
+	bool IsOpen() const
+	{
+		return data != NULL;
+	}
+
+private:
+	std::string name;
+	void* data;
+	size_t size;
+	bool owner;
+#ifdef _WIN32
+	HANDLE mapping;
+#else
+	size_t mappedSize; //size plus the owner pid
+
+	// pid of the live process that created path, 0 when it's gone. A region with no pid in it
+	// (one from before owners were recorded, or a crash between shm_open and writing the pid)
+	// counts as gone too.
+	static long long ownerPid(const std::string& path)
+	{
+		int fd = shm_open(path.c_str(), O_RDONLY, 0);
+		if (fd < 0)
+			return 0;
+		struct stat st;
+		int64_t pid = 0;
+		if (fstat(fd, &st) != 0 || (size_t)st.st_size <= SHARED_MEMORY_OWNER_BYTES ||
+			pread(fd, &pid, sizeof(pid), st.st_size - (off_t)SHARED_MEMORY_OWNER_BYTES) != (ssize_t)sizeof(pid))
+			pid = 0;
+		::close(fd);
+		if (pid <= 0 || pid > INT32_MAX || (kill((pid_t)pid, 0) != 0 && errno == ESRCH))
+			return 0;
+		return pid;
+	}
+#endif
+
+	SharedMemory(const SharedMemory&);
+	SharedMemory& operator=(const SharedMemory&);
+};
+#endif
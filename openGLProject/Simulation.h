@@ -0,0 +1,426 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "Bodies.h"
+#include "ParticleMesh.h"
+#include "FastMultipole.h"
+#include "TestParticles.h"
+#include "Encke.h"
+#include "Encounters.h"
+#include "Regularization.h"
+#include "Events.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <vector>
+
+// Default simulation values
+const double SIM_TIMESTEP = 1.0 / 120.0;
+const double SIM_G = 1.0;
+const double SIM_SOFTENING = 0.01;
+// never run more than this many fixed steps per Advance call, so a long stall can't spiral
+const int SIM_MAX_STEPS_PER_ADVANCE = 16;
+// kicks and drifts are split over threads above this many bodies (below it the sums come out
+// in exactly the serial order, so small runs are bit-for-bit what they always were)
+const size_t SIM_PARALLEL_BODIES = 1 << 16;
+
+enum ForceMethod
+{
+	FORCE_DIRECT, //every pair, exact, O(N^2)
+	FORCE_PM, //particle mesh (see ParticleMesh.h), O(N + M^3 log M), for very large N
+	FORCE_FMM //fast multipole (see FastMultipole.h), O(N), accuracy set by order and theta
+};
+
+// Conserved quantities of the whole system, see Simulation::Conserved()
+struct Invariants
+{
+	double Kinetic;
+	double Potential;
+	double Px, Py, Pz; //linear momentum
+	double Lx, Ly, Lz; //angular momentum about the origin
+	//the scales only normalise drift against a reference state, so Observe() refreshes them and steps don't
+	double MomentumScale; //sum of |m v|, so momentum drift can be made relative even when P is ~0
+	double AngularMomentumScale; //sum of |m r x v|
+
+	double Energy() const
+	{
+		return Kinetic + Potential;
+	}
+};
+
+// Gravity (direct summation unless Method says otherwise) integrated with a fixed-step
+// kick-drift-kick leapfrog.
+// Advance() is fed wall-clock time by the render loop, but Step() can be driven on its own
+// (headless, benchmarks) since nothing in here touches the window or GL.
+class Simulation
+{
+public:
+	Bodies State;
+	// massless particles State pulls on (belts, rings), stepped alongside it but kept out of the
+	// force pass and the invariants
+	TestParticles Particles;
+	// massless minor bodies on near-Keplerian orbits about the heaviest body, integrated as
+	// deviations from Kepler reference orbits (see Encke.h)
+	EnckeParticles Minor;
+	// collisions and close encounters between steps, off unless Collisions.Enabled
+	Encounters Collisions;
+	// close pairs integrated in Kustaanheimo-Stiefel coordinates, off unless Binaries.Enabled
+	// (direct summation only)
+	KsRegularization Binaries;
+	// exact times of registered events between steps, idle until one is added
+	EventDetector Events;
+	double G;
+	double Softening;
+	double TimeStep;
+	double Time;
+	ForceMethod Method;
+	// grid, boundary and threads for FORCE_PM
+	ParticleMesh Mesh;
+	// order, opening angle and threads for FORCE_FMM
+	FastMultipole Multipole;
+	unsigned int Threads; //for kicks and drifts on big systems, 0 = every hardware thread
+
+	Simulation(double timeStep = SIM_TIMESTEP, double g = SIM_G, double softening = SIM_SOFTENING)
+		: G(g), Softening(softening), TimeStep(timeStep), Time(0.0), Method(FORCE_DIRECT), Threads(0), accumulator(0.0), forcesValid(false), measured(false)
+	{
+		conserved = Invariants();
+	}
+
+	// Invariants at Time, valid once Step() or Observe() has run. The potential falls out of the
+	// force pass; the kinetic energy and momenta are summed here the first time they're asked
+	// for after a step, so steps nobody looks at (several a frame, or a whole benchmark)
+	// don't pay for them. Positions and velocities line up after the closing kick, so the sums
+	// come out exactly as if the kick had taken them.
+	const Invariants& Conserved()
+	{
+		if (!measured)
+			Measure();
+		return conserved;
+	}
+
+	// Call after adding/removing bodies or editing positions by hand
+	void Invalidate()
+	{
+		forcesValid = false;
+		measured = false;
+		Collisions.Reset();
+		Binaries.Reset();
+		Events.Reset();
+	}
+
+	// Fills ax/ay/az for every body. Pairwise loop, each interaction is applied to both bodies.
+	// The (softened) potential energy falls out of the same 1/r, so it's summed here too rather
+	// than in a second O(N^2) pass.
+	void ComputeForces()
+	{
+		if (Method == FORCE_PM)
+		{
+			Mesh.Compute(State, G, Softening);
+			conserved.Potential = Mesh.Potential;
+			forcesValid = true;
+			return;
+		}
+		if (Method == FORCE_FMM)
+		{
+			Multipole.Compute(State, G, Softening);
+			conserved.Potential = Multipole.Potential;
+			forcesValid = true;
+			return;
+		}
+		Bodies& b = State;
+		const size_t n = b.Count();
+		const double eps2 = Softening * Softening;
+		double potential = 0.0;
+		for (size_t i = 0; i < n; i++)
+		{
+			b.ax[i] = 0.0; b.ay[i] = 0.0; b.az[i] = 0.0;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			const double xi = b.x[i], yi = b.y[i], zi = b.z[i];
+			const double mi = b.mass[i];
+			double axi = 0.0, ayi = 0.0, azi = 0.0;
+			double pei = 0.0;
+			for (size_t j = i + 1; j < n; j++)
+			{
+				const double dx = b.x[j] - xi;
+				const double dy = b.y[j] - yi;
+				const double dz = b.z[j] - zi;
+				const double r2 = dx * dx + dy * dy + dz * dz + eps2;
+				//a merged body's massless passenger sits right on it, unsoftened that's 0 * inf
+				const double invR = r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0;
+				const double invR3 = G * invR * invR * invR;
+				const double sj = b.mass[j] * invR3;
+				const double si = mi * invR3;
+				axi += dx * sj; ayi += dy * sj; azi += dz * sj;
+				b.ax[j] -= dx * si; b.ay[j] -= dy * si; b.az[j] -= dz * si;
+				pei += b.mass[j] * invR;
+			}
+			b.ax[i] += axi; b.ay[i] += ayi; b.az[i] += azi;
+			potential -= mi * pei;
+		}
+		conserved.Potential = G * potential;
+		if (Binaries.Enabled)
+			conserved.Potential += Binaries.RemoveMutual(b, G, Softening);
+		forcesValid = true;
+	}
+
+	// One kick-drift-kick leapfrog step of TimeStep
+	void Step()
+	{
+		if (!forcesValid)
+		{
+			ComputeForces();
+			UpdateBinaries();
+		}
+		if (Collisions.Enabled)
+			Collisions.Begin(State);
+		if (Events.Active())
+			Events.Begin(State, Time);
+		Kick(0.5 * TimeStep);
+		//before the drift, so the particles see the bodies where they are half way through it
+		Particles.Step(State, G, Softening, TimeStep, Threads);
+		Minor.Step(State, G, Softening, TimeStep, Threads);
+		const bool regularized = Binaries.Enabled && Method == FORCE_DIRECT;
+		if (regularized)
+			Binaries.Begin(State);
+		Drift(TimeStep);
+		if (regularized)
+			Binaries.Drift(State, G, TimeStep);
+		ComputeForces();
+		Kick(0.5 * TimeStep);
+		Time += TimeStep;
+		measured = false;
+		UpdateBinaries();
+		//merges and bounces move mass and momentum about, so forces and invariants are redone
+		if (Collisions.Enabled && Collisions.Check(State, Time - TimeStep, TimeStep))
+			PatchForces(Collisions.Moved);
+		if (Events.Active())
+			Events.Check(State, Time - TimeStep, TimeStep);
+	}
+
+	// Refreshes Conserved() for the current state without stepping (e.g. right after setup)
+	void Observe()
+	{
+		ComputeForces();
+		UpdateBinaries();
+		measured = false;
+		MeasureScales();
+	}
+
+	// Runs as many fixed steps as fit in the elapsed wall time, returns how many were taken
+	int Advance(double seconds)
+	{
+		accumulator += seconds;
+		int steps = 0;
+		while (accumulator >= TimeStep && steps < SIM_MAX_STEPS_PER_ADVANCE)
+		{
+			Step();
+			accumulator -= TimeStep;
+			steps++;
+		}
+		//drop whatever we couldn't catch up on rather than carrying the debt forever
+		if (steps == SIM_MAX_STEPS_PER_ADVANCE)
+			accumulator = 0.0;
+		return steps;
+	}
+
+private:
+	double accumulator;
+	bool forcesValid;
+	Invariants conserved;
+	bool measured; //conserved's kinetic energy and momenta are up to date
+	std::vector<double> measureSums;
+	std::vector<unsigned char> patched; //per body, set while PatchForces works on it
+
+	// Regularized pairs come and go after each force pass, with the accelerations and potential
+	// patched to match
+	void UpdateBinaries()
+	{
+		if (Binaries.Enabled && Method == FORCE_DIRECT)
+			conserved.Potential += Binaries.Update(State, G, Softening, TimeStep);
+	}
+
+	// After Encounters has moved or reweighted a few bodies. Direct summation only redoes the
+	// pairs those bodies are in, O(N) each: everyone else swaps the moved bodies' old pull for
+	// the new one, and the moved bodies' own accelerations are summed afresh. The other methods
+	// (and regularized pairs, whose patches depend on every pull) take a full force pass.
+	void PatchForces(const std::vector<EncounterMove>& moved)
+	{
+		if (Method != FORCE_DIRECT || Binaries.Enabled)
+		{
+			ComputeForces();
+			UpdateBinaries();
+			return;
+		}
+		Bodies& b = State;
+		const size_t n = b.Count();
+		const double eps2 = Softening * Softening;
+		patched.assign(n, 0);
+		for (size_t k = 0; k < moved.size(); k++)
+			patched[moved[k].Body] = 1;
+		double potential = 0.0;
+		for (size_t k = 0; k < moved.size(); k++)
+		{
+			const EncounterMove& old = moved[k];
+			const size_t i = old.Body;
+			const double mi = b.mass[i];
+			double axi = 0.0, ayi = 0.0, azi = 0.0;
+			for (size_t j = 0; j < n; j++)
+			{
+				if (j == i)
+					continue;
+				const double dx = b.x[j] - b.x[i], dy = b.y[j] - b.y[i], dz = b.z[j] - b.z[i];
+				const double r2 = dx * dx + dy * dy + dz * dz + eps2;
+				const double invR = r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0;
+				const double invR3 = G * invR * invR * invR;
+				axi += dx * b.mass[j] * invR3; ayi += dy * b.mass[j] * invR3; azi += dz * b.mass[j] * invR3;
+				//pairs of moved bodies are summed below, from both old states
+				if (patched[j])
+					continue;
+				const double ox = b.x[j] - old.X, oy = b.y[j] - old.Y, oz = b.z[j] - old.Z;
+				const double o2 = ox * ox + oy * oy + oz * oz + eps2;
+				const double oldInvR = o2 > 0.0 ? 1.0 / std::sqrt(o2) : 0.0;
+				const double oldInvR3 = G * oldInvR * oldInvR * oldInvR;
+				b.ax[j] += ox * old.Mass * oldInvR3 - dx * mi * invR3;
+				b.ay[j] += oy * old.Mass * oldInvR3 - dy * mi * invR3;
+				b.az[j] += oz * old.Mass * oldInvR3 - dz * mi * invR3;
+				potential -= b.mass[j] * (mi * invR - old.Mass * oldInvR);
+			}
+			b.ax[i] = axi; b.ay[i] = ayi; b.az[i] = azi;
+		}
+		for (size_t k = 0; k < moved.size(); k++)
+			for (size_t l = k + 1; l < moved.size(); l++)
+			{
+				const EncounterMove& p = moved[k];
+				const EncounterMove& q = moved[l];
+				const double dx = b.x[q.Body] - b.x[p.Body], dy = b.y[q.Body] - b.y[p.Body], dz = b.z[q.Body] - b.z[p.Body];
+				const double r2 = dx * dx + dy * dy + dz * dz + eps2;
+				const double ox = q.X - p.X, oy = q.Y - p.Y, oz = q.Z - p.Z;
+				const double o2 = ox * ox + oy * oy + oz * oz + eps2;
+				potential -= b.mass[p.Body] * b.mass[q.Body] * (r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0) -
+					p.Mass * q.Mass * (o2 > 0.0 ? 1.0 / std::sqrt(o2) : 0.0);
+			}
+		conserved.Potential += G * potential;
+	}
+
+	void Kick(double h)
+	{
+		Bodies& b = State;
+		const size_t n = b.Count();
+		//small systems take the plain loop, the threaded path costs more than the kick itself
+		if (n < SIM_PARALLEL_BODIES)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				b.vx[i] += b.ax[i] * h;
+				b.vy[i] += b.ay[i] * h;
+				b.vz[i] += b.az[i] * h;
+			}
+			return;
+		}
+		ParallelFor(n, ParallelThreads(Threads), [&b, h](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				b.vx[i] += b.ax[i] * h;
+				b.vy[i] += b.ay[i] * h;
+				b.vz[i] += b.az[i] * h;
+			}
+		});
+	}
+
+	// Sums kinetic energy and momenta into conserved
+	void Measure()
+	{
+		const Bodies& b = State;
+		const size_t n = b.Count();
+		double total[7] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+		if (n < SIM_PARALLEL_BODIES)
+			MeasureRange(b, 0, n, total);
+		else
+		{
+			//per thread sums of kinetic, px, py, pz, lx, ly, lz; kept so the frame loop doesn't allocate
+			unsigned int threads = ParallelThreads(Threads);
+			measureSums.resize((size_t)threads * 7);
+			double* sums = measureSums.data();
+			ParallelFor(n, threads, [&b, sums](size_t begin, size_t end, unsigned int t)
+			{
+				MeasureRange(b, begin, end, sums + (size_t)t * 7);
+			});
+			for (unsigned int t = 0; t < threads; t++)
+				for (int k = 0; k < 7; k++)
+					total[k] += sums[(size_t)t * 7 + k];
+		}
+		conserved.Kinetic = 0.5 * total[0];
+		conserved.Px = total[1]; conserved.Py = total[2]; conserved.Pz = total[3];
+		conserved.Lx = total[4]; conserved.Ly = total[5]; conserved.Lz = total[6];
+		measured = true;
+	}
+
+	// What Measure needs from bodies [begin, end), into out[7]
+	static void MeasureRange(const Bodies& b, size_t begin, size_t end, double* out)
+	{
+		double kinetic = 0.0;
+		double px = 0.0, py = 0.0, pz = 0.0;
+		double lx = 0.0, ly = 0.0, lz = 0.0;
+		for (size_t i = begin; i < end; i++)
+		{
+			const double vx = b.vx[i], vy = b.vy[i], vz = b.vz[i];
+			const double m = b.mass[i];
+			kinetic += m * (vx * vx + vy * vy + vz * vz);
+			px += m * vx; py += m * vy; pz += m * vz;
+			lx += m * (b.y[i] * vz - b.z[i] * vy);
+			ly += m * (b.z[i] * vx - b.x[i] * vz);
+			lz += m * (b.x[i] * vy - b.y[i] * vx);
+		}
+		out[0] = kinetic;
+		out[1] = px; out[2] = py; out[3] = pz;
+		out[4] = lx; out[5] = ly; out[6] = lz;
+	}
+
+	// Sums of |m v| and |m r x v|, two square roots a body
+	void MeasureScales()
+	{
+		const Bodies& b = State;
+		double pScale = 0.0, lScale = 0.0;
+		for (size_t i = 0; i < b.Count(); i++)
+		{
+			const double m = b.mass[i];
+			const double vx = b.vx[i], vy = b.vy[i], vz = b.vz[i];
+			const double cx = b.y[i] * vz - b.z[i] * vy;
+			const double cy = b.z[i] * vx - b.x[i] * vz;
+			const double cz = b.x[i] * vy - b.y[i] * vx;
+			pScale += m * std::sqrt(vx * vx + vy * vy + vz * vz);
+			lScale += m * std::sqrt(cx * cx + cy * cy + cz * cz);
+		}
+		conserved.MomentumScale = pScale;
+		conserved.AngularMomentumScale = lScale;
+	}
+
+	void Drift(double h)
+	{
+		Bodies& b = State;
+		const size_t n = b.Count();
+		if (n < SIM_PARALLEL_BODIES)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				b.x[i] += b.vx[i] * h;
+				b.y[i] += b.vy[i] * h;
+				b.z[i] += b.vz[i] * h;
+			}
+			return;
+		}
+		ParallelFor(n, ParallelThreads(Threads), [&b, h](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				b.x[i] += b.vx[i] * h;
+				b.y[i] += b.vy[i] * h;
+				b.z[i] += b.vz[i] * h;
+			}
+		});
+	}
+};
+#endif
@@ -0,0 +1,279 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Simulation.h"
+#include "MappedFile.h"
+#include "Checksum.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <iostream>
+
+// Default snapshot values
+const char SNAPSHOT_MAGIC[8] = { 'S', 'S', 'I', 'M', 'S', 'N', 'A', 'P' };
+const uint32_t SNAPSHOT_VERSION = 2;
+const uint32_t SNAPSHOT_ALIGNMENT = 64; //every column starts on a cache line
+const int SNAPSHOT_MAX_COLUMNS = 32;
+const int SNAPSHOT_COLUMNS = 20; //8 per body, 6 per belt particle ("p:"), 6 per minor body ("m:")
+const char* const SNAPSHOT_COLUMN_NAMES[SNAPSHOT_COLUMNS] = {
+	"x", "y", "z", "vx", "vy", "vz", "mass", "radius",
+	"p:x", "p:y", "p:z", "p:vx", "p:vy", "p:vz",
+	"m:x", "m:y", "m:z", "m:vx", "m:vy", "m:vz"
+};
+
+// Where one column lives in the file
+struct SnapshotColumn
+{
+	char Name[8];
+	uint64_t Offset;
+	uint64_t Bytes;
+};
+
+// Fixed 1024-byte header at the start of every checkpoint. Little-endian, no pointers, so a
+// mapped file can be used in place.
+struct SnapshotHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t HeaderBytes;
+	uint64_t BodyCount;
+	uint64_t ParticleCount; //Simulation::Particles
+	uint64_t MinorCount; //Simulation::Minor
+	uint32_t ColumnCount;
+	uint32_t Alignment;
+	double Time;
+	double G;
+	double Softening;
+	double TimeStep;
+	uint64_t DataChecksum; //Hash64 over every column in order, padding excluded
+	uint64_t HeaderChecksum; //Hash64 over this header with HeaderChecksum zeroed
+	SnapshotColumn Columns[SNAPSHOT_MAX_COLUMNS];
+	unsigned char Reserved[160];
+};
+static_assert(sizeof(SnapshotHeader) == 1024, "snapshot header layout changed, bump SNAPSHOT_VERSION");
+
+// Checkpoint file for a Simulation: header, then one 64-byte aligned column per body quantity
+// (x y z vx vy vz mass radius), then the belt particles' and the minor bodies' positions and
+// velocities. Saving is one write per column; loading maps the file and points straight at the
+// columns, nothing is parsed. Accelerations aren't stored, the next step recomputes them from
+// positions and gets the same answer. Minor bodies are stored where they are rather than as
+// reference orbit plus deviation, and start fresh reference orbits on load (a rectification).
+// Encounter, KS pair and event state isn't stored either; Restore() resets it, as after any
+// hand edit, and the next step picks it up from the restored positions.
+class Snapshot
+{
+public:
+	// Writes sim to path. Goes through path.tmp and a rename, so a crash mid-save leaves the
+	// previous checkpoint intact.
+	static bool Save(const char* path, const Simulation& sim)
+	{
+		const Bodies& b = sim.State;
+		const TestParticles& p = sim.Particles;
+		std::vector<double> minor[6];
+		for (int k = 0; k < 6; k++)
+			minor[k].resize(sim.Minor.Count());
+		for (size_t i = 0; i < sim.Minor.Count(); i++)
+		{
+			double position[3], velocity[3];
+			sim.Minor.Get(i, position, velocity);
+			for (int k = 0; k < 3; k++)
+			{
+				minor[k][i] = position[k];
+				minor[k + 3][i] = velocity[k];
+			}
+		}
+		const std::vector<double>* columns[SNAPSHOT_COLUMNS] = { &b.x, &b.y, &b.z, &b.vx, &b.vy, &b.vz, &b.mass, &b.radius,
+			&p.x, &p.y, &p.z, &p.vx, &p.vy, &p.vz, &minor[0], &minor[1], &minor[2], &minor[3], &minor[4], &minor[5] };
+		const int columnCount = SNAPSHOT_COLUMNS;
+
+		SnapshotHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.Magic, SNAPSHOT_MAGIC, 8);
+		header.Version = SNAPSHOT_VERSION;
+		header.HeaderBytes = sizeof(SnapshotHeader);
+		header.BodyCount = b.Count();
+		header.ParticleCount = p.Count();
+		header.MinorCount = sim.Minor.Count();
+		header.ColumnCount = columnCount;
+		header.Alignment = SNAPSHOT_ALIGNMENT;
+		header.Time = sim.Time;
+		header.G = sim.G;
+		header.Softening = sim.Softening;
+		header.TimeStep = sim.TimeStep;
+
+		uint64_t offset = sizeof(SnapshotHeader);
+		uint64_t checksum = 0;
+		for (int c = 0; c < columnCount; c++)
+		{
+			SnapshotColumn& column = header.Columns[c];
+			strncpy(column.Name, SNAPSHOT_COLUMN_NAMES[c], sizeof(column.Name));
+			column.Offset = offset;
+			column.Bytes = Rows(header, column.Name) * sizeof(double);
+			offset = AlignUp(offset + column.Bytes);
+			checksum = Checksum::Hash64(columns[c]->data(), (size_t)column.Bytes, checksum);
+		}
+		header.DataChecksum = checksum;
+		header.HeaderChecksum = Checksum::Hash64(&header, sizeof(header));
+
+		std::string temp = std::string(path) + ".tmp";
+		FILE* file = fopen(temp.c_str(), "wb");
+		if (!file)
+			return false;
+		static const unsigned char padding[SNAPSHOT_ALIGNMENT] = { 0 };
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		for (int c = 0; c < columnCount && ok; c++)
+		{
+			size_t bytes = (size_t)header.Columns[c].Bytes;
+			if (bytes > 0)
+				ok = fwrite(columns[c]->data(), 1, bytes, file) == bytes;
+			size_t pad = (size_t)(AlignUp(header.Columns[c].Offset + bytes) - (header.Columns[c].Offset + bytes));
+			if (ok && pad > 0)
+				ok = fwrite(padding, 1, pad, file) == pad;
+		}
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+		{
+			remove(temp.c_str());
+			return false;
+		}
+		return ReplaceFile(temp.c_str(), path);
+	}
+
+	Snapshot() : header(NULL)
+	{
+	}
+
+	// Maps path and checks the header. verify also hashes the column data, which costs one
+	// read of the file; skip it when the file is known good and load time matters.
+	bool Open(const char* path, bool verify = true)
+	{
+		header = NULL;
+		if (!file.Open(path) || !file.Map())
+			return Fail(path, "can't open/map file");
+		if (file.Length() < sizeof(SnapshotHeader))
+			return Fail(path, "too small to be a snapshot");
+		const SnapshotHeader* h = (const SnapshotHeader*)file.Data();
+		if (memcmp(h->Magic, SNAPSHOT_MAGIC, 8) != 0)
+			return Fail(path, "not a snapshot file");
+		if (h->Version != SNAPSHOT_VERSION || h->HeaderBytes != sizeof(SnapshotHeader) || h->ColumnCount > SNAPSHOT_MAX_COLUMNS)
+			return Fail(path, "unsupported snapshot version");
+		SnapshotHeader copy = *h;
+		copy.HeaderChecksum = 0;
+		if (Checksum::Hash64(&copy, sizeof(copy)) != h->HeaderChecksum)
+			return Fail(path, "header checksum mismatch");
+		uint64_t checksum = 0;
+		for (uint32_t c = 0; c < h->ColumnCount; c++)
+		{
+			const SnapshotColumn& column = h->Columns[c];
+			if (column.Offset % SNAPSHOT_ALIGNMENT != 0 || column.Offset + column.Bytes > file.Length() ||
+				column.Bytes != Rows(*h, column.Name) * sizeof(double))
+				return Fail(path, "column table is corrupt");
+			if (verify)
+				checksum = Checksum::Hash64(file.Data() + column.Offset, (size_t)column.Bytes, checksum);
+		}
+		if (verify && checksum != h->DataChecksum)
+			return Fail(path, "data checksum mismatch");
+		header = h;
+		return true;
+	}
+
+	const SnapshotHeader* Header() const
+	{
+		return header;
+	}
+
+	// Column straight out of the mapping, NULL if the snapshot doesn't have it
+	const double* Column(const char* name) const
+	{
+		if (!header)
+			return NULL;
+		for (uint32_t c = 0; c < header->ColumnCount; c++)
+			if (strncmp(header->Columns[c].Name, name, sizeof(header->Columns[c].Name)) == 0)
+				return (const double*)(file.Data() + header->Columns[c].Offset);
+		return NULL;
+	}
+
+	// Copies the mapped columns into sim (one memcpy each) and restores its settings. Belt
+	// particles and minor bodies are replaced by the snapshot's, so none are left over from
+	// whatever sim was running before.
+	bool Restore(Simulation& sim) const
+	{
+		if (!header)
+			return false;
+		for (int c = 0; c < SNAPSHOT_COLUMNS; c++)
+			if (!Column(SNAPSHOT_COLUMN_NAMES[c]))
+				return false;
+		Bodies& b = sim.State;
+		TestParticles& p = sim.Particles;
+		std::vector<double>* columns[] = { &b.x, &b.y, &b.z, &b.vx, &b.vy, &b.vz, &b.mass, &b.radius,
+			&p.x, &p.y, &p.z, &p.vx, &p.vy, &p.vz };
+		b.Resize((size_t)header->BodyCount);
+		p.Resize((size_t)header->ParticleCount);
+		for (int c = 0; c < 14; c++)
+			if (!columns[c]->empty())
+				memcpy(columns[c]->data(), Column(SNAPSHOT_COLUMN_NAMES[c]), columns[c]->size() * sizeof(double));
+
+		//Add() takes absolute states against the restored bodies
+		const double* minor[6];
+		for (int k = 0; k < 6; k++)
+			minor[k] = Column(SNAPSHOT_COLUMN_NAMES[14 + k]);
+		sim.Minor.Clear();
+		for (size_t i = 0; i < (size_t)header->MinorCount; i++)
+		{
+			const double position[3] = { minor[0][i], minor[1][i], minor[2][i] };
+			const double velocity[3] = { minor[3][i], minor[4][i], minor[5][i] };
+			sim.Minor.Add(b, position, velocity);
+		}
+		sim.Time = header->Time;
+		sim.G = header->G;
+		sim.Softening = header->Softening;
+		sim.TimeStep = header->TimeStep;
+		sim.Invalidate();
+		return true;
+	}
+
+	// Open + Restore in one go
+	static bool Load(const char* path, Simulation& sim, bool verify = true)
+	{
+		Snapshot snapshot;
+		return snapshot.Open(path, verify) && snapshot.Restore(sim);
+	}
+
+private:
+	MappedFile file;
+	const SnapshotHeader* header;
+
+	// Rows in the column called name: bodies, belt particles ("p:") or minor bodies ("m:")
+	static uint64_t Rows(const SnapshotHeader& h, const char* name)
+	{
+		if (strncmp(name, "p:", 2) == 0)
+			return h.ParticleCount;
+		if (strncmp(name, "m:", 2) == 0)
+			return h.MinorCount;
+		return h.BodyCount;
+	}
+
+	static uint64_t AlignUp(uint64_t offset)
+	{
+		return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+	}
+
+	bool Fail(const char* path, const char* why)
+	{
+		std::cout << "ERROR::SNAPSHOT " << path << ": " << why << std::endl;
+		file.Close();
+		return false;
+	}
+
+	static bool ReplaceFile(const char* from, const char* to)
+	{
+#ifdef _WIN32
+		return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return rename(from, to) == 0;
+#endif
+	}
+};
+#endif
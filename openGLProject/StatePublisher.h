@@ -0,0 +1,117 @@
+#ifndef STATE_PUBLISHER_H
+#define STATE_PUBLISHER_H
+
+#include "StateShare.h"
+#include "SharedMemory.h"
+#include "Bodies.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// Default state publisher values
+const uint32_t STATE_SHARE_SLOTS = 4;
+const uint32_t STATE_SHARE_MIN_CAPACITY = 1024; //room for bodies added after Open
+
+// Simulator side of StateShare.h. Publish() copies the bodies' columns into the oldest slot
+// under its seqlock and points Latest at it: eight memcpys and a few stores, no locks and no
+// waiting on readers, however many are attached or however slow they are.
+class StatePublisher
+{
+public:
+	StatePublisher() : header(NULL), slots(NULL), published(0), steps(0)
+	{
+	}
+
+	// capacity is bodies per slot; the region can't grow once readers have it mapped, so
+	// leave headroom
+	bool Open(uint32_t capacity, const char* name = STATE_SHARE_NAME, uint32_t slotCount = STATE_SHARE_SLOTS)
+	{
+		if (capacity < STATE_SHARE_MIN_CAPACITY)
+			capacity = STATE_SHARE_MIN_CAPACITY;
+		if (slotCount < 2)
+			slotCount = 2;
+		//columns start on a cache line, and so does every slot
+		uint64_t slotBytes = STATE_SHARE_SLOT_HEADER_BYTES + (uint64_t)capacity * STATE_SHARE_COLUMNS * sizeof(double);
+		slotBytes = (slotBytes + 63) & ~(uint64_t)63;
+		if (!memory.Create(name, (size_t)(STATE_SHARE_HEADER_BYTES + slotBytes * slotCount)))
+			return false;
+		header = (StateShareHeader*)memory.Data();
+		slots = (unsigned char*)memory.Data() + STATE_SHARE_HEADER_BYTES;
+		header->Version = STATE_SHARE_VERSION;
+		header->HeaderBytes = STATE_SHARE_HEADER_BYTES;
+		header->SlotCount = slotCount;
+		header->Capacity = capacity;
+		header->SlotBytes = slotBytes;
+		header->Latest.store(0, std::memory_order_relaxed);
+		published = 0;
+		steps = 0;
+		//readers check the magic first, so it goes in last
+		std::atomic_thread_fence(std::memory_order_release);
+		header->Magic = STATE_SHARE_MAGIC;
+		return true;
+	}
+
+	bool IsOpen() const
+	{
+		return header != NULL;
+	}
+
+	// Publishes the current state. stepsTaken adds to the running step count readers see.
+	void Publish(const Bodies& bodies, double time, int stepsTaken)
+	{
+		if (!header)
+			return;
+		steps += stepsTaken;
+		//the slot after the newest is the oldest, nobody should still be reading it
+		uint32_t index = header->Latest.load(std::memory_order_relaxed) % header->SlotCount;
+		StateShareSlot* slot = (StateShareSlot*)(slots + header->SlotBytes * index);
+		uint32_t sequence = slot->Sequence.load(std::memory_order_relaxed);
+		slot->Sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		size_t count = bodies.Count();
+		slot->Flags = 0;
+		if (count > header->Capacity)
+		{
+			count = header->Capacity;
+			slot->Flags |= STATE_SHARE_TRUNCATED;
+		}
+		const std::vector<double>* columns[STATE_SHARE_COLUMNS] = {
+			&bodies.x, &bodies.y, &bodies.z, &bodies.vx, &bodies.vy, &bodies.vz, &bodies.mass, &bodies.radius };
+		double* out = (double*)((unsigned char*)slot + STATE_SHARE_SLOT_HEADER_BYTES);
+		for (int c = 0; c < STATE_SHARE_COLUMNS; c++)
+			if (count > 0)
+				memcpy(out + (size_t)header->Capacity * c, columns[c]->data(), count * sizeof(double));
+		slot->Count = (uint32_t)count;
+		slot->Publish = ++published;
+		slot->Step = steps;
+		slot->Time = time;
+
+		slot->Sequence.store(sequence + 2, std::memory_order_release);
+		header->Latest.store(index + 1, std::memory_order_release);
+	}
+
+	uint64_t Published() const
+	{
+		return published;
+	}
+
+	uint32_t Capacity() const
+	{
+		return header ? header->Capacity : 0;
+	}
+
+	size_t Bytes() const
+	{
+		return memory.Size();
+	}
+
+private:
+	SharedMemory memory;
+	StateShareHeader* header;
+	unsigned char* slots;
+	uint64_t published;
+	uint64_t steps;
+};
+#endif
@@ -0,0 +1,285 @@
+#ifndef STATE_SHARE_H
+#define STATE_SHARE_H
+
+// Live body states in shared memory, for visualisers and analysis tools running next to the
+// simulator. This header is the whole reader API and compiles as C or C++, so anything that can
+// include a C header (or load the layout below with ctypes/numpy) can attach without sockets or
+// serialisation. The simulator side is StatePublisher.h.
+//
+// Layout: a StateShareHeader padded to HeaderBytes, then SlotCount slots of SlotBytes each.
+// A slot is a StateShareSlot padded to STATE_SHARE_SLOT_HEADER_BYTES followed by the state as
+// STATE_SHARE_COLUMNS columns of Capacity doubles (x, y, z, vx, vy, vz, mass, radius), the
+// first Count entries of each valid. The simulator writes each new state into the slot after
+// Latest, never into the newest one, and bumps the slot's Sequence to odd before writing and
+// back to even after (a seqlock). Readers use the newest slot in place and check afterwards
+// that its Sequence hasn't moved; with the default four slots that leaves three publishes'
+// worth of time to finish with a view before it can be overwritten.
+//
+// Python can map the same region: /dev/shm/SpaceSimulatorState on Linux, or
+// mmap.mmap(-1, size, tagname="Local\\SpaceSimulatorState") on Windows.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+#include <atomic>
+typedef std::atomic<uint32_t> StateShareCounter;
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+typedef volatile uint32_t StateShareCounter;
+#endif
+
+#if defined(_MSC_VER) && !defined(__cplusplus)
+#define STATE_SHARE_INLINE static __inline
+#else
+#define STATE_SHARE_INLINE static inline
+#endif
+
+// Default state share values
+#define STATE_SHARE_NAME "SpaceSimulatorState"
+#define STATE_SHARE_MAGIC 0x54415453u //"STAT"
+#define STATE_SHARE_VERSION 1u
+#define STATE_SHARE_HEADER_BYTES 64u
+#define STATE_SHARE_SLOT_HEADER_BYTES 64u
+#define STATE_SHARE_RETRIES 16 //reads that raced the writer before StateShareRead gives up
+#define STATE_SHARE_TRUNCATED 1u //slot flag: the simulation had more bodies than Capacity
+
+enum StateShareColumn
+{
+	STATE_SHARE_X,
+	STATE_SHARE_Y,
+	STATE_SHARE_Z,
+	STATE_SHARE_VX,
+	STATE_SHARE_VY,
+	STATE_SHARE_VZ,
+	STATE_SHARE_MASS,
+	STATE_SHARE_RADIUS,
+	STATE_SHARE_COLUMNS
+};
+
+typedef struct StateShareHeader
+{
+	uint32_t Magic; //written last, readers ignore the region until it's there
+	uint32_t Version;
+	uint32_t HeaderBytes;
+	uint32_t SlotCount;
+	uint32_t Capacity; //bodies a slot has room for
+	StateShareCounter Latest; //index + 1 of the slot holding the newest state, 0 before the first
+	uint64_t SlotBytes;
+} StateShareHeader;
+
+typedef struct StateShareSlot
+{
+	StateShareCounter Sequence; //odd while the simulator is writing this slot
+	uint32_t Count; //bodies in this state
+	uint64_t Publish; //1 for the first state published, 2 for the next...
+	uint64_t Step; //simulation steps taken so far
+	double Time; //simulation time
+	uint32_t Flags;
+	uint32_t Padding;
+} StateShareSlot;
+
+// A mapped region, fill in with StateShareAttach
+typedef struct StateShareReader
+{
+	const StateShareHeader* Header;
+	const unsigned char* Base;
+	size_t Size;
+#ifdef _WIN32
+	HANDLE Mapping;
+#endif
+} StateShareReader;
+
+// One state, read in place. The pointers are into shared memory and only mean anything if
+// StateShareValidate still says so once you've finished with them.
+typedef struct StateShareView
+{
+	uint64_t Publish;
+	uint64_t Step;
+	double Time;
+	uint32_t Count;
+	uint32_t Flags;
+	const double* Columns[STATE_SHARE_COLUMNS]; //Columns[STATE_SHARE_X][i] is body i's x
+	const StateShareSlot* Slot;
+	uint32_t Sequence;
+} StateShareView;
+
+STATE_SHARE_INLINE void StateShareAcquireFence(void)
+{
+#ifdef __cplusplus
+	std::atomic_thread_fence(std::memory_order_acquire);
+#elif defined(_MSC_VER)
+	_ReadWriteBarrier(); //x86 never reorders loads with loads, only the compiler might
+#else
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+STATE_SHARE_INLINE uint32_t StateShareLoad(const StateShareCounter* counter)
+{
+#ifdef __cplusplus
+	return counter->load(std::memory_order_acquire);
+#else
+	uint32_t value = *counter;
+	StateShareAcquireFence();
+	return value;
+#endif
+}
+
+STATE_SHARE_INLINE const StateShareSlot* StateShareSlotAt(const StateShareReader* reader, uint32_t index)
+{
+	return (const StateShareSlot*)(reader->Base + reader->Header->HeaderBytes + reader->Header->SlotBytes * index);
+}
+
+STATE_SHARE_INLINE void StateShareDetach(StateShareReader* reader)
+{
+#ifdef _WIN32
+	if (reader->Base)
+		UnmapViewOfFile(reader->Base);
+	if (reader->Mapping)
+		CloseHandle(reader->Mapping);
+	reader->Mapping = NULL;
+#else
+	if (reader->Base)
+		munmap((void*)reader->Base, reader->Size);
+#endif
+	reader->Header = NULL;
+	reader->Base = NULL;
+	reader->Size = 0;
+}
+
+// Maps a running simulator's states read-only. name NULL means STATE_SHARE_NAME.
+// Returns 1 on success, 0 if there's nothing there (or it isn't a layout we understand).
+STATE_SHARE_INLINE int StateShareAttach(StateShareReader* reader, const char* name)
+{
+	char path[256];
+	const StateShareHeader* header;
+	memset(reader, 0, sizeof(*reader));
+	if (!name)
+		name = STATE_SHARE_NAME;
+#ifdef _WIN32
+	{
+		MEMORY_BASIC_INFORMATION info;
+		snprintf(path, sizeof(path), "Local\\%s", name);
+		reader->Mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, path);
+		if (!reader->Mapping)
+			return 0;
+		reader->Base = (const unsigned char*)MapViewOfFile(reader->Mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!reader->Base)
+		{
+			StateShareDetach(reader);
+			return 0;
+		}
+		VirtualQuery(reader->Base, &info, sizeof(info));
+		reader->Size = info.RegionSize;
+	}
+#else
+	{
+		struct stat st;
+		void* p;
+		int fd;
+		snprintf(path, sizeof(path), "/%s", name);
+		fd = shm_open(path, O_RDONLY, 0);
+		if (fd < 0)
+			return 0;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0)
+		{
+			close(fd);
+			return 0;
+		}
+		p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+			return 0;
+		reader->Base = (const unsigned char*)p;
+		reader->Size = (size_t)st.st_size;
+	}
+#endif
+	header = (const StateShareHeader*)reader->Base;
+	if (reader->Size < STATE_SHARE_HEADER_BYTES || header->Magic != STATE_SHARE_MAGIC || header->Version != STATE_SHARE_VERSION ||
+		header->SlotCount == 0 || header->SlotBytes < STATE_SHARE_SLOT_HEADER_BYTES + (uint64_t)header->Capacity * STATE_SHARE_COLUMNS * sizeof(double) ||
+		header->HeaderBytes + header->SlotBytes * header->SlotCount > reader->Size)
+	{
+		StateShareDetach(reader);
+		return 0;
+	}
+	StateShareAcquireFence();
+	reader->Header = header;
+	return 1;
+}
+
+// Points view at the newest state without copying anything. Returns 0 if nothing has been
+// published yet (or the writer lapped us STATE_SHARE_RETRIES times in a row).
+STATE_SHARE_INLINE int StateShareBegin(const StateShareReader* reader, StateShareView* view)
+{
+	int attempt, c;
+	for (attempt = 0; attempt < STATE_SHARE_RETRIES; attempt++)
+	{
+		uint32_t latest = StateShareLoad(&reader->Header->Latest);
+		const StateShareSlot* slot;
+		if (latest == 0 || latest > reader->Header->SlotCount)
+			return 0;
+		slot = StateShareSlotAt(reader, latest - 1);
+		view->Sequence = StateShareLoad(&slot->Sequence);
+		if (view->Sequence & 1)
+			continue; //we were slow enough for the writer to come round to it again
+		view->Slot = slot;
+		view->Publish = slot->Publish;
+		view->Step = slot->Step;
+		view->Time = slot->Time;
+		view->Count = slot->Count <= reader->Header->Capacity ? slot->Count : reader->Header->Capacity;
+		view->Flags = slot->Flags;
+		for (c = 0; c < STATE_SHARE_COLUMNS; c++)
+			view->Columns[c] = (const double*)((const unsigned char*)slot + STATE_SHARE_SLOT_HEADER_BYTES) + (size_t)reader->Header->Capacity * c;
+		return 1;
+	}
+	return 0;
+}
+
+// 1 if nothing in view has been overwritten since StateShareBegin. Call it after you've used
+// the data; if it says 0, throw away whatever you worked out and begin again.
+STATE_SHARE_INLINE int StateShareValidate(const StateShareView* view)
+{
+	StateShareAcquireFence();
+	return StateShareLoad(&view->Slot->Sequence) == view->Sequence;
+}
+
+// The copying version: the newest state into columns[c * maxBodies + i], at most maxBodies
+// bodies. Fills in view (its Columns still point into shared memory) and returns the number
+// of bodies copied, or -1 if there's nothing consistent to read.
+STATE_SHARE_INLINE int StateShareRead(const StateShareReader* reader, StateShareView* view, double* columns, uint32_t maxBodies)
+{
+	int attempt, c;
+	for (attempt = 0; attempt < STATE_SHARE_RETRIES; attempt++)
+	{
+		uint32_t count;
+		if (!StateShareBegin(reader, view))
+			return -1;
+		count = view->Count < maxBodies ? view->Count : maxBodies;
+		for (c = 0; c < STATE_SHARE_COLUMNS; c++)
+			memcpy(columns + (size_t)maxBodies * c, view->Columns[c], count * sizeof(double));
+		if (StateShareValidate(view))
+			return (int)count;
+	}
+	return -1;
+}
+#endif
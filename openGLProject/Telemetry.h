@@ -0,0 +1,183 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "SharedMemory.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+// Default telemetry values
+const char* const TELEMETRY_NAME = "SpaceSimulatorTelemetry";
+const uint32_t TELEMETRY_CAPACITY = 4096; //records in the ring, ~68 s of history at 60 fps
+const uint32_t TELEMETRY_MAGIC = 0x4D4C4554; //"TELM"
+const uint32_t TELEMETRY_VERSION = 1;
+
+// One frame's worth of numbers. Plain data, the layout is the wire format.
+struct TelemetryRecord
+{
+	uint64_t Frame;
+	double Time; //seconds since start
+	double FrameMs;
+	double SimStepMs; //wall time spent stepping the simulation this frame
+	int32_t SimSteps;
+	int32_t BodyCount;
+	int64_t HeapLiveBytes;
+	int64_t VramBytes;
+	int64_t FrameAllocations;
+	double EnergyDrift;
+};
+
+// Shared region layout: header, then Capacity slots. Each slot carries a sequence number the
+// writer sets to (index + 1) after filling it, so a reader can tell a finished record from one
+// being overwritten without any lock.
+struct TelemetrySlot
+{
+	std::atomic<uint64_t> Sequence;
+	TelemetryRecord Record;
+};
+
+struct TelemetryHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t RecordSize;
+	uint32_t Capacity;
+	std::atomic<uint64_t> WriteIndex; //number of records ever published
+};
+
+// Engine side. Publish() is a copy and two stores, it never waits on readers.
+class TelemetryPublisher
+{
+public:
+	TelemetryPublisher() : header(NULL), slots(NULL)
+	{
+	}
+
+	bool Open(const char* name = TELEMETRY_NAME, uint32_t capacity = TELEMETRY_CAPACITY)
+	{
+		if (!memory.Create(name, sizeof(TelemetryHeader) + sizeof(TelemetrySlot) * capacity))
+			return false;
+		header = (TelemetryHeader*)memory.Data();
+		slots = (TelemetrySlot*)(header + 1);
+		header->Version = TELEMETRY_VERSION;
+		header->RecordSize = sizeof(TelemetryRecord);
+		header->Capacity = capacity;
+		header->WriteIndex.store(0, std::memory_order_relaxed);
+		//readers check the magic last, so it goes in last
+		std::atomic_thread_fence(std::memory_order_release);
+		header->Magic = TELEMETRY_MAGIC;
+		return true;
+	}
+
+	bool IsOpen() const
+	{
+		return header != NULL;
+	}
+
+	void Publish(const TelemetryRecord& record)
+	{
+		if (!header)
+			return;
+		uint64_t index = header->WriteIndex.load(std::memory_order_relaxed);
+		TelemetrySlot& slot = slots[index % header->Capacity];
+		//0 marks the slot as in-flight, readers that catch it mid-copy will see the mismatch
+		slot.Sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.Record = record;
+		slot.Sequence.store(index + 1, std::memory_order_release);
+		header->WriteIndex.store(index + 1, std::memory_order_release);
+	}
+
+private:
+	SharedMemory memory;
+	TelemetryHeader* header;
+	TelemetrySlot* slots;
+};
+
+// Dashboard side. Keeps its own cursor; if it falls more than Capacity behind it skips ahead
+// and counts what it missed instead of slowing anybody down.
+class TelemetryReader
+{
+public:
+	uint64_t Dropped;
+
+	TelemetryReader() : Dropped(0), header(NULL), slots(NULL), cursor(0)
+	{
+	}
+
+	// fromStart = false starts at the newest record instead of the oldest still in the ring
+	bool Attach(const char* name = TELEMETRY_NAME, bool fromStart = true)
+	{
+		if (!memory.Open(name))
+			return false;
+		header = (const TelemetryHeader*)memory.Data();
+		if (memory.Size() < sizeof(TelemetryHeader) || header->Magic != TELEMETRY_MAGIC ||
+			header->Version != TELEMETRY_VERSION || header->RecordSize != sizeof(TelemetryRecord))
+		{
+			memory.Close();
+			header = NULL;
+			return false;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		slots = (const TelemetrySlot*)(header + 1);
+		uint64_t written = header->WriteIndex.load(std::memory_order_acquire);
+		if (!fromStart)
+			cursor = written;
+		else
+			cursor = written > header->Capacity ? written - header->Capacity : 0;
+		return true;
+	}
+
+	// Copies the next record out, false when there is nothing new yet
+	bool Next(TelemetryRecord& out)
+	{
+		if (!header)
+			return false;
+		while (true)
+		{
+			uint64_t written = header->WriteIndex.load(std::memory_order_acquire);
+			if (cursor >= written)
+				return false;
+			if (written - cursor > header->Capacity)
+			{
+				Dropped += written - header->Capacity - cursor;
+				cursor = written - header->Capacity;
+			}
+			const TelemetrySlot& slot = slots[cursor % header->Capacity];
+			uint64_t before = slot.Sequence.load(std::memory_order_acquire);
+			memcpy(&out, (const void*)&slot.Record, sizeof(TelemetryRecord));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t after = slot.Sequence.load(std::memory_order_relaxed);
+			if (before == cursor + 1 && after == before)
+			{
+				cursor++;
+				return true;
+			}
+			//lapped by the writer while copying, that record is gone
+			Dropped++;
+			cursor++;
+		}
+	}
+
+	// CSV column names matching WriteCsv
+	static const char* CsvHeader()
+	{
+		return "frame,time,frame_ms,sim_step_ms,sim_steps,bodies,heap_live_bytes,vram_bytes,frame_allocs,energy_drift";
+	}
+
+	static void WriteCsv(FILE* out, const TelemetryRecord& r)
+	{
+		fprintf(out, "%llu,%.6f,%.4f,%.4f,%d,%d,%lld,%lld,%lld,%.6e\n", (unsigned long long)r.Frame, r.Time, r.FrameMs,
+			r.SimStepMs, r.SimSteps, r.BodyCount, (long long)r.HeapLiveBytes, (long long)r.VramBytes,
+			(long long)r.FrameAllocations, r.EnergyDrift);
+	}
+
+private:
+	SharedMemory memory;
+	const TelemetryHeader* header;
+	const TelemetrySlot* slots;
+	uint64_t cursor;
+};
+#endif
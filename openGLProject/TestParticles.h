@@ -0,0 +1,140 @@
+#ifndef TEST_PARTICLES_H
+#define TEST_PARTICLES_H
+
+#include "Bodies.h"
+#include "Parallel.h"
+#include "AllocTracker.h"
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+// Default test particle values
+const size_t TEST_PARTICLE_BLOCK = 256; //particles per kernel block, sources loop over each block
+const size_t TEST_PARTICLE_PARALLEL = 1 << 14; //split over threads above this many particles
+
+// Massless particles (asteroid belts, rings): pulled by the massive bodies, pulling nothing
+// back, so a step costs O(massive x particles) instead of O(N^2) and they never need the force
+// pass. Positions and velocities are plain SoA columns and nothing else is stored per particle.
+//
+// Each step is one fused pass of drift-kick-drift against the massive bodies' positions half
+// way through their own drift, which is exactly where the kick-drift-kick leapfrog has them
+// then, so particles and bodies stay on the same second-order, time-symmetric scheme. The
+// kernel works a block at a time with the sources in the outer loop, so the inner loop is
+// straight SoA arithmetic over particles and vectorises.
+class TestParticles
+{
+public:
+	std::vector<double> x, y, z;
+	std::vector<double> vx, vy, vz;
+
+	size_t Count() const
+	{
+		return x.size();
+	}
+
+	// Appends a particle and returns its index
+	size_t Add(double px, double py, double pz, double pvx, double pvy, double pvz)
+	{
+		x.push_back(px); y.push_back(py); z.push_back(pz);
+		vx.push_back(pvx); vy.push_back(pvy); vz.push_back(pvz);
+		return x.size() - 1;
+	}
+
+	void Resize(size_t n)
+	{
+		x.resize(n); y.resize(n); z.resize(n);
+		vx.resize(n); vy.resize(n); vz.resize(n);
+	}
+
+	void Clear()
+	{
+		Resize(0);
+	}
+
+	// Massive bodies pulling on the particles in the last step
+	size_t Sources() const
+	{
+		return gm.size();
+	}
+
+	// Advances every particle by h. massive is the bodies after their opening half kick and
+	// before their drift, i.e. velocities are at t + h/2 and positions at t.
+	void Step(const Bodies& massive, double G, double softening, double h, unsigned int threads)
+	{
+		const size_t n = Count();
+		if (n == 0)
+			return;
+		//where the bodies are at t + h/2, only the ones with mass
+		sx.clear(); sy.clear(); sz.clear(); gm.clear();
+		if (sx.capacity() < massive.Count())
+		{
+			ColdRegion cold;//grows on the first step and when bodies are added, not per frame
+			sx.reserve(massive.Count()); sy.reserve(massive.Count()); sz.reserve(massive.Count()); gm.reserve(massive.Count());
+		}
+		for (size_t j = 0; j < massive.Count(); j++)
+		{
+			if (massive.mass[j] <= 0.0)
+				continue;
+			sx.push_back(massive.x[j] + massive.vx[j] * 0.5 * h);
+			sy.push_back(massive.y[j] + massive.vy[j] * 0.5 * h);
+			sz.push_back(massive.z[j] + massive.vz[j] * 0.5 * h);
+			gm.push_back(G * massive.mass[j]);
+		}
+		const double eps2 = softening * softening;
+		ParallelFor((n + TEST_PARTICLE_BLOCK - 1) / TEST_PARTICLE_BLOCK, n < TEST_PARTICLE_PARALLEL ? 1 : ParallelThreads(threads),
+			[this, n, h, eps2](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t block = begin; block < end; block++)
+			{
+				size_t first = block * TEST_PARTICLE_BLOCK;
+				size_t last = first + TEST_PARTICLE_BLOCK < n ? first + TEST_PARTICLE_BLOCK : n;
+				StepBlock(first, last, h, eps2);
+			}
+		});
+	}
+
+private:
+	//massive bodies at the half step, G m
+	std::vector<double> sx, sy, sz, gm;
+
+	void StepBlock(size_t first, size_t last, double h, double eps2)
+	{
+		const size_t count = last - first;
+		double* px = &x[first]; double* py = &y[first]; double* pz = &z[first];
+		double* pvx = &vx[first]; double* pvy = &vy[first]; double* pvz = &vz[first];
+		double ax[TEST_PARTICLE_BLOCK], ay[TEST_PARTICLE_BLOCK], az[TEST_PARTICLE_BLOCK];
+		const double half = 0.5 * h;
+		for (size_t i = 0; i < count; i++)
+		{
+			px[i] += pvx[i] * half;
+			py[i] += pvy[i] * half;
+			pz[i] += pvz[i] * half;
+			ax[i] = 0.0; ay[i] = 0.0; az[i] = 0.0;
+		}
+		for (size_t s = 0; s < gm.size(); s++)
+		{
+			const double cx = sx[s], cy = sy[s], cz = sz[s], g = gm[s];
+			for (size_t i = 0; i < count; i++)
+			{
+				const double dx = cx - px[i];
+				const double dy = cy - py[i];
+				const double dz = cz - pz[i];
+				const double r2 = dx * dx + dy * dy + dz * dz + eps2;
+				const double invR = 1.0 / std::sqrt(r2);
+				const double f = g * invR * invR * invR;
+				ax[i] += dx * f; ay[i] += dy * f; az[i] += dz * f;
+			}
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			pvx[i] += ax[i] * h;
+			pvy[i] += ay[i] * h;
+			pvz[i] += az[i] * h;
+			px[i] += pvx[i] * half;
+			py[i] += pvy[i] * half;
+			pz[i] += pvz[i] * half;
+		}
+	}
+};
+#endif
@@ -0,0 +1,258 @@
+#ifndef TRAJECTORY_PLAYER_H
+#define TRAJECTORY_PLAYER_H
+
+#include "TrajectoryWriter.h"
+#include "MappedFile.h"
+#include "Bodies.h"
+
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+
+// Default playback values
+const size_t TRAJECTORY_WINDOW_BYTES = 64 * 1024 * 1024; //how much of the file is mapped at once
+
+// Plays back a file written by TrajectoryWriter. Nothing is read up front: the time index at
+// the end of the file is mapped and binary searched, and frames are read through a mapped
+// window that is moved when playback leaves it, so seeking anywhere in a huge recording
+// costs a couple of page faults. States between recorded frames are cubic Hermite
+// interpolated from positions and velocities (linear if the file has no velocities).
+class TrajectoryPlayer
+{
+public:
+	double Time; //current playback time, in simulation seconds
+	double Speed; //simulation seconds per wall second, negative plays backwards
+
+	TrajectoryPlayer() : Time(0.0), Speed(1.0), frameCount(0), hasIndex(false), windowFirst(0), windowFrames(0), lastFrame(0)
+	{
+		memset(&header, 0, sizeof(header));
+	}
+
+	bool Open(const char* path)
+	{
+		Close();
+		if (!file.Open(path) || !file.Map(0, TRAJECTORY_HEADER_BYTES) || file.Length() < sizeof(TrajectoryHeader))
+			return Fail(path, "can't open/map file");
+		memcpy(&header, file.Data(), sizeof(header));
+		if (memcmp(header.Magic, TRAJECTORY_MAGIC, 8) != 0)
+			return Fail(path, "not a trajectory file");
+		if (header.Version != TRAJECTORY_VERSION || header.HeaderBytes != TRAJECTORY_HEADER_BYTES ||
+			header.BodyCount == 0 || header.FrameBytes != TrajectoryWriter::FrameBytes((size_t)header.BodyCount, header.Columns))
+			return Fail(path, "unsupported trajectory version");
+
+		uint64_t frameSpace = file.FileSize() - TRAJECTORY_HEADER_BYTES;
+		if (header.FrameCount > 0 && header.IndexOffset + header.FrameCount * sizeof(double) <= file.FileSize())
+		{
+			frameCount = header.FrameCount;
+			hasIndex = index.Open(path) && index.Map(header.IndexOffset, (size_t)(frameCount * sizeof(double)));
+		}
+		else
+		{
+			//never closed (crash, still recording): take whole frames and read times from them
+			frameCount = frameSpace / header.FrameBytes;
+			probe.Open(path);
+		}
+		if (frameCount == 0)
+			return Fail(path, "no frames recorded");
+
+		windowFrames = TRAJECTORY_WINDOW_BYTES / header.FrameBytes;
+		if (windowFrames < 2)
+			windowFrames = 2;
+		if (windowFrames > frameCount)
+			windowFrames = frameCount;
+		windowFirst = frameCount; //nothing mapped yet
+		lastFrame = 0;
+		Time = StartTime();
+		return true;
+	}
+
+	void Close()
+	{
+		file.Close();
+		index.Close();
+		probe.Close();
+		frameCount = 0;
+		hasIndex = false;
+		windowFrames = 0;
+	}
+
+	bool IsOpen() const
+	{
+		return frameCount > 0;
+	}
+
+	const TrajectoryHeader& Header() const
+	{
+		return header;
+	}
+
+	uint64_t FrameCount() const
+	{
+		return frameCount;
+	}
+
+	double StartTime()
+	{
+		return FrameTime(0);
+	}
+
+	double EndTime()
+	{
+		return FrameTime(frameCount - 1);
+	}
+
+	// Moves the playback clock by wall seconds at the current speed, stopping at either end
+	void Advance(double seconds)
+	{
+		if (!IsOpen())
+			return;
+		Time += seconds * Speed;
+		double start = StartTime(), end = EndTime();
+		if (Time < start)
+			Time = start;
+		if (Time > end)
+			Time = end;
+	}
+
+	// Index of the last frame at or before time (0 if time is before the recording)
+	uint64_t FindFrame(double time)
+	{
+		//normal playback moves a frame or two at a time, try around the last answer first
+		if (lastFrame + 1 < frameCount && FrameTime(lastFrame) <= time && time < FrameTime(lastFrame + 1))
+			return lastFrame;
+		if (lastFrame + 2 < frameCount && FrameTime(lastFrame + 1) <= time && time < FrameTime(lastFrame + 2))
+			return ++lastFrame;
+		if (lastFrame > 0 && lastFrame < frameCount && FrameTime(lastFrame - 1) <= time && time < FrameTime(lastFrame))
+			return --lastFrame;
+		uint64_t lo = 0, hi = frameCount;
+		while (hi - lo > 1)
+		{
+			uint64_t mid = lo + (hi - lo) / 2;
+			if (FrameTime(mid) <= time)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		lastFrame = lo;
+		return lo;
+	}
+
+	// Fills out's positions and velocities at time. out is resized to the recorded body count
+	// (only allocates if that changes).
+	bool Sample(double time, Bodies& out)
+	{
+		if (!IsOpen())
+			return false;
+		if (out.Count() != header.BodyCount)
+			out.Resize((size_t)header.BodyCount);
+		uint64_t k = FindFrame(time);
+		uint64_t k1 = k + 1 < frameCount ? k + 1 : k;
+		if (!MapFrames(k, k1))
+			return false;
+		const TrajectoryFrame* f0 = (const TrajectoryFrame*)FrameData(k);
+		const TrajectoryFrame* f1 = (const TrajectoryFrame*)FrameData(k1);
+		double h = f1->Time - f0->Time;
+		double s = h > 0.0 ? (time - f0->Time) / h : 0.0;
+		if (s < 0.0)
+			s = 0.0;
+		if (s > 1.0)
+			s = 1.0;
+
+		const size_t n = (size_t)header.BodyCount;
+		const size_t column = (TrajectoryWriter::FrameBytes(n, TRAJ_POSITIONS) - sizeof(TrajectoryFrame)) / 3;
+		const unsigned char* c0 = (const unsigned char*)f0 + sizeof(TrajectoryFrame);
+		const unsigned char* c1 = (const unsigned char*)f1 + sizeof(TrajectoryFrame);
+		double* positions[3] = { out.x.data(), out.y.data(), out.z.data() };
+		double* velocities[3] = { out.vx.data(), out.vy.data(), out.vz.data() };
+		bool hermite = (header.Columns & TRAJ_VELOCITIES) && h > 0.0;
+
+		//Hermite basis and its derivative (divided by h) at s
+		const double s2 = s * s, s3 = s2 * s;
+		const double h00 = 2.0 * s3 - 3.0 * s2 + 1.0, h10 = s3 - 2.0 * s2 + s;
+		const double h01 = -2.0 * s3 + 3.0 * s2, h11 = s3 - s2;
+		const double d00 = 6.0 * s2 - 6.0 * s, d10 = 3.0 * s2 - 4.0 * s + 1.0;
+		const double d01 = -d00, d11 = 3.0 * s2 - 2.0 * s;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const double* p0 = (const double*)(c0 + axis * column);
+			const double* p1 = (const double*)(c1 + axis * column);
+			double* p = positions[axis];
+			double* v = velocities[axis];
+			if (hermite)
+			{
+				const double* v0 = (const double*)(c0 + (axis + 3) * column);
+				const double* v1 = (const double*)(c1 + (axis + 3) * column);
+				for (size_t i = 0; i < n; i++)
+				{
+					p[i] = h00 * p0[i] + h10 * h * v0[i] + h01 * p1[i] + h11 * h * v1[i];
+					v[i] = (d00 * p0[i] + d01 * p1[i]) / h + d10 * v0[i] + d11 * v1[i];
+				}
+			}
+			else
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					p[i] = p0[i] + (p1[i] - p0[i]) * s;
+					v[i] = h > 0.0 ? (p1[i] - p0[i]) / h : 0.0;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Time stamp of frame k, from the index if there is one
+	double FrameTime(uint64_t k)
+	{
+		if (hasIndex)
+			return ((const double*)index.Data())[k];
+		if (k >= windowFirst && k < windowFirst + windowFrames)
+			return ((const TrajectoryFrame*)FrameData(k))->Time;
+		if (!probe.Map(TRAJECTORY_HEADER_BYTES + k * header.FrameBytes, sizeof(TrajectoryFrame)))
+			return 0.0;
+		return ((const TrajectoryFrame*)probe.Data())->Time;
+	}
+
+private:
+	MappedFile file; //frame window
+	MappedFile index; //time index, when the writer finished properly
+	MappedFile probe; //single frame headers, when it didn't
+	TrajectoryHeader header;
+	uint64_t frameCount;
+	bool hasIndex;
+	uint64_t windowFirst;
+	uint64_t windowFrames;
+	uint64_t lastFrame;
+
+	const unsigned char* FrameData(uint64_t k) const
+	{
+		return file.Data() + (k - windowFirst) * header.FrameBytes;
+	}
+
+	// Makes sure frames a..b (b = a or a + 1) are inside the mapped window. The window is
+	// centred on a so it lasts as long going backwards as forwards, but never starts so far back
+	// that b falls off the end (a two-frame window is exactly a and b).
+	bool MapFrames(uint64_t a, uint64_t b)
+	{
+		if (a >= windowFirst && b < windowFirst + windowFrames)
+			return true;
+		const uint64_t before = (windowFrames - 1) / 2;
+		uint64_t first = a > before ? a - before : 0;
+		if (first + windowFrames > frameCount)
+			first = frameCount - windowFrames;
+		if (!file.Map(TRAJECTORY_HEADER_BYTES + first * header.FrameBytes, (size_t)(windowFrames * header.FrameBytes)))
+		{
+			windowFirst = frameCount;
+			return false;
+		}
+		windowFirst = first;
+		return true;
+	}
+
+	bool Fail(const char* path, const char* why)
+	{
+		std::cout << "ERROR::TRAJECTORY " << path << ": " << why << std::endl;
+		Close();
+		return false;
+	}
+};
+#endif
@@ -0,0 +1,371 @@
+#ifndef TRAJECTORY_WRITER_H
+#define TRAJECTORY_WRITER_H
+
+#include "Simulation.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+// Default trajectory values
+const char TRAJECTORY_MAGIC[8] = { 'S', 'S', 'I', 'M', 'T', 'R', 'A', 'J' };
+const uint32_t TRAJECTORY_VERSION = 1;
+const uint32_t TRAJECTORY_HEADER_BYTES = 4096; //frames start on a page boundary
+const uint32_t TRAJECTORY_ALIGNMENT = 64;
+const size_t TRAJECTORY_RING_BYTES = 64 * 1024 * 1024; //~1 s of 100k bodies at 60 fps
+const size_t TRAJECTORY_BATCH_BYTES = 4 * 1024 * 1024; //writer waits for this much before writing
+const int TRAJECTORY_FLUSH_MS = 100; //...or this long, whichever comes first
+
+// Which columns a recording holds. Velocities let playback use Hermite interpolation.
+enum TrajectoryColumns {
+	TRAJ_POSITIONS = 1,
+	TRAJ_VELOCITIES = 2
+};
+
+// What Record() does when the writer has fallen behind and the ring is full
+enum TrajectoryOverflow {
+	TRAJ_DROP, //throw the frame away and count it, the sim never waits
+	TRAJ_BLOCK //wait for a free slot, nothing is lost but the frame loop can stall
+};
+
+// File header. FrameCount and IndexOffset are filled in on Close(); a file from a crashed
+// run has them zero and readers fall back to the file size and the per-frame times.
+struct TrajectoryHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t HeaderBytes;
+	uint64_t BodyCount;
+	uint32_t Columns; //TrajectoryColumns flags
+	uint32_t FrameBytes; //stride between frames
+	uint64_t FrameCount;
+	uint64_t IndexOffset; //FrameCount doubles, the time of each frame
+	double G;
+	double TimeStep;
+	uint32_t StepInterval;
+	uint32_t Reserved0;
+};
+
+// Start of every frame, columns follow at 64-byte aligned offsets (x y z [vx vy vz])
+struct TrajectoryFrame
+{
+	double Time;
+	uint64_t Step;
+	unsigned char Reserved[48];
+};
+static_assert(sizeof(TrajectoryFrame) == TRAJECTORY_ALIGNMENT, "trajectory frame header must fill one cache line");
+
+// Records body states to a trajectory file without the sim thread touching the disk.
+// Record() copies the columns into a preallocated slot of a ring and returns; a background
+// thread drains ready slots in runs of several MB (slots are contiguous, so a run is a single
+// fwrite straight out of the ring) and keeps the time index.
+// One producer thread only.
+class TrajectoryWriter
+{
+public:
+	int StepInterval; //Sample() records every this many simulation steps
+	TrajectoryOverflow Overflow;
+
+	TrajectoryWriter() : StepInterval(1), Overflow(TRAJ_DROP), file(NULL), bodyCount(0), columns(0), frameBytes(0),
+		slotCount(0), ring(NULL), produced(0), consumed(0), closing(false), stepsSinceRecord(0), stepCount(0),
+		dropped(0), bytesWritten(0), writeSeconds(0.0), writeFailed(false)
+	{
+		memset(&header, 0, sizeof(header));
+	}
+
+	~TrajectoryWriter()
+	{
+		Close();
+	}
+
+	// Bytes one frame takes in the file and in the ring
+	static size_t FrameBytes(size_t bodies, unsigned int cols)
+	{
+		size_t column = AlignUp(bodies * sizeof(double));
+		return sizeof(TrajectoryFrame) + column * ColumnCount(cols);
+	}
+
+	static int ColumnCount(unsigned int cols)
+	{
+		return ((cols & TRAJ_POSITIONS) ? 3 : 0) + ((cols & TRAJ_VELOCITIES) ? 3 : 0);
+	}
+
+	// Records the first bodies bodies of whatever Simulation is handed to Record() later.
+	// ringBytes is rounded to whole frames, at least 4 of them.
+	bool Open(const char* path, size_t bodies, const Simulation& sim, unsigned int cols = TRAJ_POSITIONS | TRAJ_VELOCITIES,
+		size_t ringBytes = TRAJECTORY_RING_BYTES)
+	{
+		Close();
+		if (bodies == 0 || !(cols & TRAJ_POSITIONS))
+			return false;
+		file = fopen(path, "wb");
+		if (!file)
+			return false;
+		//our runs are already large, stdio's buffer would only add a copy
+		setvbuf(file, NULL, _IONBF, 0);
+
+		bodyCount = bodies;
+		columns = cols;
+		frameBytes = FrameBytes(bodies, cols);
+		slotCount = ringBytes / frameBytes;
+		if (slotCount < 4)
+			slotCount = 4;
+		batchSlots = TRAJECTORY_BATCH_BYTES / frameBytes;
+		if (batchSlots < 1)
+			batchSlots = 1;
+		if (batchSlots > slotCount / 2)
+			batchSlots = slotCount / 2;
+		storage.assign(slotCount * frameBytes + 4096, 0);
+		ring = storage.data() + (4096 - (uintptr_t)storage.data() % 4096) % 4096;
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.Magic, TRAJECTORY_MAGIC, 8);
+		header.Version = TRAJECTORY_VERSION;
+		header.HeaderBytes = TRAJECTORY_HEADER_BYTES;
+		header.BodyCount = bodies;
+		header.Columns = cols;
+		header.FrameBytes = (uint32_t)frameBytes;
+		header.G = sim.G;
+		header.TimeStep = sim.TimeStep;
+		header.StepInterval = StepInterval;
+		if (!WriteHeader())
+		{
+			fclose(file);
+			file = NULL;
+			return false;
+		}
+
+		produced = 0;
+		consumed = 0;
+		closing = false;
+		stepsSinceRecord = 0;
+		stepCount = 0;
+		dropped = 0;
+		bytesWritten = 0;
+		writeSeconds = 0.0;
+		writeFailed = false;
+		times.clear();
+		times.reserve(1 << 16);
+		writer = std::thread(&TrajectoryWriter::WriterLoop, this);
+		return true;
+	}
+
+	bool IsOpen() const
+	{
+		return file != NULL;
+	}
+
+	// Call after the simulation has taken steps; records once StepInterval steps have gone by.
+	// Returns true if a frame was queued.
+	bool Sample(const Simulation& sim, int steps)
+	{
+		if (!file || steps <= 0)
+			return false;
+		stepCount += steps;
+		stepsSinceRecord += steps;
+		if (stepsSinceRecord < StepInterval)
+			return false;
+		stepsSinceRecord = 0;
+		return Record(sim, stepCount);
+	}
+
+	// Copies the current state into the next free slot. Never allocates and, with TRAJ_DROP,
+	// never waits: a full ring just counts the frame as dropped.
+	bool Record(const Simulation& sim, uint64_t step)
+	{
+		if (!file || sim.State.Count() < bodyCount)
+			return false;
+		uint64_t head = produced.load(std::memory_order_relaxed);
+		if (head - consumed.load(std::memory_order_acquire) >= slotCount)
+		{
+			if (Overflow == TRAJ_DROP)
+			{
+				dropped++;
+				return false;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			while (head - consumed.load(std::memory_order_acquire) >= slotCount)
+				spaceFree.wait_for(lock, std::chrono::milliseconds(1));
+		}
+
+		unsigned char* slot = ring + (head % slotCount) * frameBytes;
+		TrajectoryFrame* frame = (TrajectoryFrame*)slot;
+		frame->Time = sim.Time;
+		frame->Step = step;
+		const Bodies& b = sim.State;
+		const double* sources[6] = { b.x.data(), b.y.data(), b.z.data(), b.vx.data(), b.vy.data(), b.vz.data() };
+		size_t column = AlignUp(bodyCount * sizeof(double));
+		unsigned char* out = slot + sizeof(TrajectoryFrame);
+		for (int c = 0; c < 6; c++)
+		{
+			if (c >= 3 && !(columns & TRAJ_VELOCITIES))
+				break;
+			memcpy(out, sources[c], bodyCount * sizeof(double));
+			out += column;
+		}
+		produced.store(head + 1, std::memory_order_release);
+		//the writer also wakes on a timer, so a missed notify only delays it
+		if ((head + 1 - consumed.load(std::memory_order_relaxed)) % batchSlots == 0)
+			dataReady.notify_one();
+		return true;
+	}
+
+	// Drains everything still queued, writes the time index and final header, closes the file
+	void Close()
+	{
+		if (!file)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		dataReady.notify_one();
+		writer.join();
+
+		uint64_t frames = times.size();
+		header.FrameCount = frames;
+		header.IndexOffset = TRAJECTORY_HEADER_BYTES + frames * frameBytes;
+		if (frames > 0 && fwrite(times.data(), sizeof(double), times.size(), file) != times.size())
+			writeFailed = true;
+		if (!writeFailed && (fseek(file, 0, SEEK_SET) != 0 || !WriteHeader()))
+			writeFailed = true;
+		if (fclose(file) != 0)
+			writeFailed = true;
+		file = NULL;
+		std::vector<unsigned char>().swap(storage);
+		ring = NULL;
+	}
+
+	// Frames queued so far, frames written to disk, frames lost to a full ring
+	uint64_t Recorded() const
+	{
+		return produced.load();
+	}
+
+	uint64_t Written() const
+	{
+		return consumed.load();
+	}
+
+	uint64_t Dropped() const
+	{
+		return dropped;
+	}
+
+	// Disk throughput of the writer thread alone, MB/s
+	double WriteMegabytesPerSecond() const
+	{
+		double seconds = writeSeconds.load();
+		return seconds > 0.0 ? bytesWritten.load() / (1024.0 * 1024.0) / seconds : 0.0;
+	}
+
+	uint64_t BytesWritten() const
+	{
+		return bytesWritten.load();
+	}
+
+	// Set if any write failed, the file is not to be trusted
+	bool Failed() const
+	{
+		return writeFailed;
+	}
+
+	size_t SlotCount() const
+	{
+		return slotCount;
+	}
+
+private:
+	FILE* file;
+	TrajectoryHeader header;
+	size_t bodyCount;
+	unsigned int columns;
+	size_t frameBytes;
+	size_t slotCount;
+	size_t batchSlots;
+	std::vector<unsigned char> storage;
+	unsigned char* ring; //page aligned start of storage
+	std::atomic<uint64_t> produced; //frames ever put in the ring
+	std::atomic<uint64_t> consumed; //frames ever written out
+	std::mutex mutex;
+	std::condition_variable dataReady;
+	std::condition_variable spaceFree;
+	bool closing;
+	std::thread writer;
+	int stepsSinceRecord;
+	uint64_t stepCount;
+	uint64_t dropped;
+	std::atomic<uint64_t> bytesWritten;
+	std::atomic<double> writeSeconds;
+	bool writeFailed;
+	std::vector<double> times; //writer thread only until Close()
+
+	static size_t AlignUp(size_t bytes)
+	{
+		return (bytes + TRAJECTORY_ALIGNMENT - 1) / TRAJECTORY_ALIGNMENT * TRAJECTORY_ALIGNMENT;
+	}
+
+	bool WriteHeader()
+	{
+		unsigned char block[TRAJECTORY_HEADER_BYTES];
+		memset(block, 0, sizeof(block));
+		memcpy(block, &header, sizeof(header));
+		return fwrite(block, 1, sizeof(block), file) == sizeof(block);
+	}
+
+	void WriterLoop()
+	{
+		for (;;)
+		{
+			uint64_t tail = consumed.load(std::memory_order_relaxed);
+			uint64_t ready = produced.load(std::memory_order_acquire) - tail;
+			bool finishing;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				finishing = closing;
+				if (ready < batchSlots && !finishing)
+				{
+					//not a full batch yet, give the producer a while before writing a short run
+					dataReady.wait_for(lock, std::chrono::milliseconds(TRAJECTORY_FLUSH_MS));
+					finishing = closing;
+					ready = produced.load(std::memory_order_acquire) - tail;
+				}
+			}
+			if (ready == 0)
+			{
+				if (finishing)
+					return;
+				continue;
+			}
+
+			//one contiguous run, up to the end of the ring
+			size_t start = (size_t)(tail % slotCount);
+			size_t run = (size_t)ready;
+			if (run > slotCount - start)
+				run = slotCount - start;
+			const unsigned char* data = ring + start * frameBytes;
+			for (size_t i = 0; i < run; i++)
+				times.push_back(((const TrajectoryFrame*)(data + i * frameBytes))->Time);
+
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			if (!writeFailed && fwrite(data, frameBytes, run, file) != run)
+				writeFailed = true;
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			writeSeconds.store(writeSeconds.load(std::memory_order_relaxed) + seconds, std::memory_order_relaxed);
+			bytesWritten.fetch_add(run * frameBytes, std::memory_order_relaxed);
+
+			consumed.store(tail + run, std::memory_order_release);
+			spaceFree.notify_one();
+		}
+	}
+
+	TrajectoryWriter(const TrajectoryWriter&);
+	TrajectoryWriter& operator=(const TrajectoryWriter&);
+};
+#endif
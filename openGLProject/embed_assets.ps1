@@ -0,0 +1,107 @@
+# Generates EmbeddedAssetData.h for EmbedAssets builds (see EmbeddedAssets.h).
+# Every file in assets.manifest becomes a constexpr byte array plus compile-time checks, and an
+# entry in embeddedAssets[]. The output is only rewritten when it changes, so an unchanged
+# asset set doesn't force main.cpp to recompile.
+param(
+	[Parameter(Mandatory = $true)][string]$ProjectDir,
+	[Parameter(Mandatory = $true)][string]$Output
+)
+$ErrorActionPreference = 'Stop'
+
+# hashing and hex dumping a few MB is far too slow in script, let C# do it
+Add-Type -TypeDefinition @"
+using System.Text;
+public static class EmbedWriter
+{
+	// must match EmbedHash/EmbedHashRuntime in EmbeddedAssets.h
+	public static ulong Hash(byte[] data)
+	{
+		ulong hash = 0;
+		unchecked
+		{
+			foreach (byte b in data)
+				hash = hash * 0x100000001B3UL + b;
+		}
+		return hash;
+	}
+
+	public static string Bytes(byte[] data)
+	{
+		if (data.Length == 0)
+			return "0";
+		StringBuilder text = new StringBuilder(data.Length * 5 + data.Length / 8);
+		for (int k = 0; k < data.Length; k++)
+		{
+			if (k % 24 == 0)
+				text.Append("\n\t");
+			text.Append("0x").Append(data[k].ToString("X2")).Append(',');
+		}
+		return text.ToString();
+	}
+}
+"@
+
+$compileTimeHashLimit = 16 * 1024 # EMBED_COMPILE_TIME_HASH_LIMIT
+$manifest = Join-Path $ProjectDir 'assets.manifest'
+$names = @(Get-Content $manifest | ForEach-Object { $_.Trim() } | Where-Object { $_ -ne '' -and -not $_.StartsWith('#') })
+if ($names.Count -eq 0) { throw "embed_assets: $manifest lists no files" }
+
+$code = New-Object System.Text.StringBuilder
+$table = New-Object System.Text.StringBuilder
+[void]$code.AppendLine('// Generated by embed_assets.ps1 from assets.manifest, do not edit')
+[void]$code.AppendLine('#ifndef EMBEDDED_ASSET_DATA_H')
+[void]$code.AppendLine('#define EMBEDDED_ASSET_DATA_H')
+[void]$code.AppendLine('')
+
+for ($index = 0; $index -lt $names.Count; $index++)
+{
+	$name = $names[$index]
+	$path = Join-Path $ProjectDir $name
+	if (-not (Test-Path $path)) { throw "embed_assets: $name is in assets.manifest but doesn't exist" }
+	$data = [System.IO.File]::ReadAllBytes($path)
+	$hash = '0x{0:X16}ULL' -f [EmbedWriter]::Hash($data)
+	$normal = $name.Replace('\', '/').ToLowerInvariant()
+	while ($normal.StartsWith('./')) { $normal = $normal.Substring(2) }
+	$symbol = "embeddedAsset$index"
+	$extension = [System.IO.Path]::GetExtension($name).ToLowerInvariant()
+
+	[void]$code.AppendLine("// $name, $($data.Length) bytes")
+	[void]$code.AppendLine("constexpr unsigned char $symbol[] = {$([EmbedWriter]::Bytes($data))`n};")
+	if ($name -match 'shader' -or $extension -eq '.glsl' -or $extension -eq '.vert' -or $extension -eq '.frag')
+	{
+		[void]$code.AppendLine("static_assert(EmbedStartsWith($symbol, $($data.Length), `"#version`"), `"$name doesn't start with #version`");")
+	}
+	elseif ($extension -eq '.jpg' -or $extension -eq '.jpeg')
+	{
+		[void]$code.AppendLine("static_assert(EmbedStartsWith($symbol, $($data.Length), `"\xFF\xD8\xFF`"), `"$name isn't a JPEG`");")
+	}
+	elseif ($extension -eq '.png')
+	{
+		[void]$code.AppendLine("static_assert(EmbedStartsWith($symbol, $($data.Length), `"\x89PNG`"), `"$name isn't a PNG`");")
+	}
+	if ($data.Length -gt 0 -and $data.Length -le $compileTimeHashLimit)
+	{
+		[void]$code.AppendLine("static_assert(EmbedHash($symbol, 0, $($data.Length)) == $hash, `"$name doesn't match the hash taken when it was embedded`");")
+	}
+	[void]$code.AppendLine('')
+	[void]$table.AppendLine("`t{ `"$normal`", $symbol, $($data.Length), $hash },")
+}
+
+[void]$code.AppendLine('const EmbeddedAsset embeddedAssets[] = {')
+[void]$code.Append($table.ToString())
+[void]$code.AppendLine('};')
+[void]$code.AppendLine("const size_t embeddedAssetCount = $($names.Count);")
+[void]$code.AppendLine('#endif')
+
+$text = $code.ToString()
+$directory = Split-Path -Parent $Output
+if ($directory -and -not (Test-Path $directory)) { New-Item -ItemType Directory -Path $directory | Out-Null }
+if ((Test-Path $Output) -and ([System.IO.File]::ReadAllText($Output) -eq $text))
+{
+	Write-Host "embed_assets: $Output is up to date"
+}
+else
+{
+	[System.IO.File]::WriteAllText($Output, $text)
+	Write-Host "embed_assets: embedded $($names.Count) files into $Output"
+}
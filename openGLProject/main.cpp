@@ -3,6 +3,8 @@
 #include <iostream>
 #include <string>
 #include <sstream>//string stream
+#include <thread>
+#include <chrono>
 #include "Shader.h"
 
 #include <glm/glm.hpp>
@@ -13,6 +15,29 @@
 #include "stb_image.h"
 
 #include "Camera.h"
+#include "Simulation.h"
+#include "PerfGate.h"
+#include "ConservationMonitor.h"
+#include "GpuMemory.h"
+
+#include "Telemetry.h"
+#include "StatePublisher.h"
+#include "Snapshot.h"
+#include "TrajectoryWriter.h"
+#include "TrajectoryPlayer.h"
+#include "CatalogImporter.h"
+#include "ChebyshevArchive.h"
+#include "EmbeddedAssets.h"
+#include "Scene.h"
+#include "OffscreenTarget.h"
+#include "HeadlessContext.h"
+#include "FrameEncoder.h"
+#include "BroadPhase.h"
+#include "Ensemble.h"
+#include "Parareal.h"
+
+#define ALLOC_TRACKER_IMPLEMENTATION //global operator new/delete live in this file
+#include "AllocTracker.h"
 
 
 using namespace std;
@@ -24,7 +49,37 @@ int selectedColour = 1;
 
 bool isHideText = false;
 
-//lighting globals
+//F1 toggles extra stats (VRAM etc) in the title bar
+bool showDebugOverlay = false;
+
+//shaders and textures, read out of assets.pack when there is one (see --pack)
+AssetPack assets;
+//what --pack puts in the pack (and EmbedAssets builds compile in) when it isn't given a list
+const char* assetManifest = "assets.manifest";
+
+//F5 saves the simulation here, F9 loads it back
+const char* checkpointPath = "checkpoint.snap";
+
+//what gets drawn, read from scene.txt (or a compiled scene, see --compile-scene)
+Scene scene;
+//model matrix per scene object, filled in by UpdateFrame
+vector<glm::mat4> objectModels;
+//matrices of objects that never move (no body, no spin), worked out once when the scene loads
+vector<glm::mat4> objectRestModels;
+//GL side of the scene: every mesh in one buffer, one program per scene shader
+unsigned int sceneVAO = 0;
+unsigned int sceneVBO = 0;
+vector<unsigned int> sceneTextures;
+vector<Shader> sceneShaders;
+//massless particles (see --belt) drawn as points with the scene's lamp shader, positions streamed each frame
+unsigned int particleVAO = 0;
+unsigned int particleVBO = 0;
+size_t particleCapacity = 0; //particles the VBO has room for
+vector<float> particlePoints;
+int particleShader = -1;
+glm::vec3 particleColour(0.55f, 0.5f, 0.45f);
+
+//lighting globals, the scene's light line sets these
 glm::vec3 lightPos(0.0f, 0.0f, -5.0f);
 glm::vec3 lightColour(1.0f, 1.0f, 1.0f);
 
@@ -32,11 +87,43 @@ glm::vec3 lightColour(1.0f, 1.0f, 1.0f);
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = 400, lastY = 300;
 bool firstMouse = true;
+//width / height of whatever we're drawing into, kept up to date by the resize callback
+float viewAspect = 800.0f / 600.0f;
+//offscreen modes given --context egl|osmesa render through this instead of a window
+HeadlessContext headless;
 
 //Time management stuff
 float deltaTime = 0.0f;//time between current frame and last frame
 float lastFrame = 0.0f;//time of last frame
 
+//simulation: the scene's bodies, by default the sun at the origin and the earth orbiting it
+Simulation simulation;
+//energy/momentum drift, shown in the title bar and logged to conservation_log.csv
+ConservationMonitor conservation;
+
+//body states recorded to disk for later analysis (see --record)
+TrajectoryWriter recorder;
+
+//when a recording is open (--play) the bodies come from it instead of the integrator
+TrajectoryPlayer player;
+
+//per-frame stats for external dashboards (see --telemetry-dump)
+TelemetryPublisher telemetry;
+unsigned long long frameNumber = 0;
+
+//live body states for visualisers and analysis tools (see StateShare.h and --state-watch)
+StatePublisher statePublisher;
+
+//everything the render loop needs for one frame, built without touching GL or the window
+struct SceneFrame
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	//how long the simulation took this frame
+	double simStepMs;
+	int simSteps;
+};
+
 
 //window resize call back function prototype
 void windowResizeCallBack(GLFWwindow* window, int width, int height);
@@ -51,466 +138,329 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 //scroll wheel callback
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
-//init the game
-GLFWwindow* GameInit();
-
-//Load Up Image file
-void LoadUpImage(const char* path);
-
-
-
-//Frames Per Second prototype
-void showFPS(GLFWwindow* window);
-
-//Vertex Shader Program Source Code
-const char* vertexShaderSource =
-"#version 330 core\n"
-"layout(location = 0) in vec3 aPos;\n" //variable location[0], read value in of type vec3
-"\n"
-"void main()\n"
-"{\n"
-"    gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);\n"
-"}\n\0";//need \0 to tell it its the end of the character string
-
-//Fragment Shader Program Source Code
-const char* fragmentShaderSource =
-"#version 330 core\n"
-"out vec4 FragColor;\n" //value passed on to next shader when done
-"\n"
-"void main()\n"
-"{\n"
-"FragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);\n"
-"}\n\0";
-
-
-void main()
-{
-	GLFWwindow *window = GameInit();
-
-	Shader shaderProgram("cubeVertexShader.txt", "cubeFragmentShader.txt");
-	Shader shaderProgram1("cubeVertexShader.txt", "cubeFragmentShader.txt");
-	Shader shaderProgram2("cubeVertexShader.txt", "cubeFragmentShader.txt");
-	Shader shaderProgram3("cubeVertexShader.txt", "cubeFragmentShader.txt");
-	Shader lightShaderProgram("lightCubeVertexShader.txt", "lightFragmentShader.txt");
-	Shader lampShaderProgram("cubeVertexShader.txt", "lampFragmentShader.txt");
-	
-
-	//Compile Shader Source into shader programs
-	//vertex shader first
-	int vertexShaderID = glCreateShader(GL_VERTEX_SHADER);//gives id for a vertex shader
-	//give it the source code
-	//params:
-	//		shader id
-	//		number of source strings
-	//		source strings (1 or array)
-	//		length of string or NULL if it ends in a \0
-	glShaderSource(vertexShaderID, 1, &vertexShaderSource, NULL);
-	//compile the code on the gpu
-	glCompileShader(vertexShaderID);
-
-	//check for errors
-	int success;
-	char infoLog[512];
-	//check compile status for our program, store result in success
-	glGetShaderiv(vertexShaderID, GL_COMPILE_STATUS, &success);
-	//failed?
-	if (!success)
-	{
-		//get error for the log and store in infoLog
-		glGetShaderInfoLog(vertexShaderID, 512, NULL, infoLog);
-		cout << "Vertex shader error!: " << infoLog << endl;
-		system("pause");
-	}
-	//Fragment shader
-	int fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShaderID, 1, &fragmentShaderSource, NULL);
-	glCompileShader(fragmentShaderID);
-
-	glGetShaderiv(fragmentShaderID, GL_COMPILE_STATUS, &success);
-	//failed?
-	if (!success)
-	{
-		//get error for the log and store in infoLog
-		glGetShaderInfoLog(fragmentShaderID, 512, NULL, infoLog);
-		cout << "Fragment shader error!: " << infoLog << endl;
-		system("pause");
-	}
-	//Create a Shader Program which links a bunch of shaders together for a full pipeline
-	int shaderProgramID = glCreateProgram();
-	//attach our shaders to this program
-	glAttachShader(shaderProgramID, vertexShaderID);
-	glAttachShader(shaderProgramID, fragmentShaderID);
-	//link the attached shaders
-	glLinkProgram(shaderProgramID);
-	//check for linking errors
-	glGetProgramiv(shaderProgramID, GL_LINK_STATUS, &success);
-	if (!success)
-	{
-		glGetProgramInfoLog(shaderProgramID, 512, NULL, infoLog);
-		cout << "Shader Program Linking Error!: " << infoLog << endl;
-		system("pause");
-	}
-	//our shaders were used to help make the full shader program, we dont need them individually anymore
-	glDeleteShader(vertexShaderID);
-	glDeleteShader(fragmentShaderID);
+//init the game, offscreen keeps the window hidden and returns NULL instead of pausing on failure
+GLFWwindow* GameInit(bool offscreen = false);
 
-	float polygon1[] =
-	{
-		//first triangle
-		-1.0f, 1.0f, 0.0f, 0.0f, 1.0f,//0
-		1.0f, 1.0f, 0.0f, 1.0f, 1.0f,//1
-		-1.0f, 0.5f, 0.0f, 0.0f, 0.0f,//2
-		1.0f, 0.5f, 0.0f, 1.0f, 0.0f//3
-	};
+//context for the offscreen modes: a hidden window's by default, contextApi "egl" or "osmesa" makes one with no window system at all
+bool OffscreenInit(const char* contextApi);
 
-	float polygon2[] =
-	{
-		//first triangle
-		-1.0f, -0.5f, 0.0f, 0.0f, 1.0f,//0
-		1.0f, -0.5f, 0.0f, 1.0f, 1.0f,//1
-		-1.0f, -1.0f, 0.0f, 0.0f, 0.0f,//2
-		1.0f, -1.0f, 0.0f, 1.0f, 0.0f//3
-	};
+//tears down whichever context OffscreenInit made
+void OffscreenRelease();
 
-	//the vertices order, treating each xyz as an index
-	unsigned int indices[] =
-	{
-		0, 2, 3,
-		0, 1, 3
-	};
+//Load Up Image file into textureID, owner is the subsystem it's booked against for VRAM accounting
+void LoadUpImage(const char* path, unsigned int textureID, const char* owner);
 
-	//earth Vertices
-	float textureCubVertices[] =
-	{
-		//x		y		z	  texX	texY
-		-0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-		0.5f, -0.5f, -0.5f, 1.0f, 0.0f,
-		0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		-0.5f, 0.5f, -0.5f, 0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-		0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-		-0.5f, 0.5f, 0.5f, 0.0f, 1.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-
-		-0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-		-0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-		-0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-		0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-
-		-0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		0.5f, -0.5f, -0.5f, 1.0f, 1.0f,
-		0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-		0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-
-		-0.5f, 0.5f, -0.5f, 0.0f, 1.0f,
-		0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-		-0.5f, 0.5f, 0.5f, 0.0f, 0.0f,
-		-0.5f, 0.5f, -0.5f, 0.0f, 1.0f
-	};
 
-	//Sun Vertices
-	float textureCubVertices1[] =
-	{
-		//x		y		z	  texX	texY
-		-0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-		0.5f, -0.5f, -0.5f, 1.0f, 0.0f,
-		0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		-0.5f, 0.5f, -0.5f, 0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-		0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-		-0.5f, 0.5f, 0.5f, 0.0f, 1.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-
-		-0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-		-0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-		-0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-		0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-
-		-0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-		0.5f, -0.5f, -0.5f, 1.0f, 1.0f,
-		0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-		0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-		-0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-
-		-0.5f, 0.5f, -0.5f, 0.0f, 1.0f,
-		0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-		0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-		-0.5f, 0.5f, 0.5f, 0.0f, 0.0f,
-		-0.5f, 0.5f, -0.5f, 0.0f, 1.0f
-	};
 
+//Frames Per Second prototype
+void showFPS(GLFWwindow* window);
 
-//----------------------------------------------------------------------------------------
-	unsigned int polygonVAO;
-	glGenVertexArrays(1, &polygonVAO);
-	glBindVertexArray(polygonVAO);
+//build the title bar text into buffer without touching the heap
+void FormatTitle(char* buffer, size_t size, double fps, double msPerFrame);
 
-	unsigned int polygonVBO;
-	glGenBuffers(1, &polygonVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, polygonVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(polygon1), polygon1, GL_STATIC_DRAW);
+//put the built-in sun and earth into the simulation, what the headless checks run (scene.txt declares the same pair)
+void SetupSolarSystem(Simulation& sim);
 
-	unsigned int polygonEBO;
-	glGenBuffers(1, &polygonEBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, polygonEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+//step the simulation and work out every matrix for this frame, no window needed
+void UpdateFrame(float time, float frameDeltaTime, float zoom, SceneFrame& frame);
 
-	
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+//fill a simulation with a deterministic random cluster of bodies (benchmarks and tests)
+void SetupRandomCluster(Simulation& sim, int count, unsigned int seed);
 
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+//exponential disk of count equal-mass bodies on roughly circular orbits, for the large-N solvers
+void SetupDisk(Simulation& sim, size_t count, unsigned int seed);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+//count massless particles on near-circular orbits between inner and outer round body centre, in its orbital plane (x-z)
+void SetupBelt(Simulation& sim, size_t count, size_t centre, double inner, double outer, unsigned int seed);
 
-	unsigned int topTextureID;
-	glGenTextures(1, &topTextureID);
-	//we bind the texture to make it the one we're working on
-	glBindTexture(GL_TEXTURE_2D, topTextureID);
-	//set wrapping options(repeat texture if texture coordinates dont fully cover polygons)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);//wraps on the s(x) axis
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);//wraps on the t(y) axis
-	//set filtering options
-	//Suggestion use nearest neightbour for pixel art, use bilinear for pretty much everything else
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);//GL_LINEAR(bilinear) or GL_NEAREST for shrinking
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);//for stretching
-
-	LoadUpImage("Assets/top.jpg");
-
-//---------------------------------------------------------------------------------------
-	unsigned int polygonVAO1;
-	glGenVertexArrays(1, &polygonVAO1);
-	glBindVertexArray(polygonVAO1);
-
-	unsigned int polygonVBO1;
-	glGenBuffers(1, &polygonVBO1);
-	glBindBuffer(GL_ARRAY_BUFFER, polygonVBO1);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(polygon2), polygon2, GL_STATIC_DRAW);
-
-	unsigned int polygonEBO1;
-	glGenBuffers(1, &polygonEBO1);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, polygonEBO1);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+//steps a big test-particle belt, and checks the fast path against the same particles as zero-mass bodies
+int RunBeltBench(int argc, char** argv);
 
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+//the built-in sun and earth plus planets more further out on circular, slightly tilted orbits
+void SetupPlanets(Simulation& sim, int planets);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+//asteroids under the planets integrated Encke's way and Cowell's way, error and throughput over step length
+int RunEnckeBench(int argc, char** argv);
 
-	unsigned int bottomTextureID;
-	glGenTextures(1, &bottomTextureID);
-	//we bind the texture to make it the one we're working on
-	glBindTexture(GL_TEXTURE_2D, bottomTextureID);
-	//set wrapping options(repeat texture if texture coordinates dont fully cover polygons)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);//wraps on the s(x) axis
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);//wraps on the t(y) axis
-																 //set filtering options
-																 //Suggestion use nearest neightbour for pixel art, use bilinear for pretty much everything else
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);//GL_LINEAR(bilinear) or GL_NEAREST for shrinking
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);//for stretching
+//collision broad phase timings on moving clusters, sweep and prune against the hashed grid
+int RunBroadPhaseBench(int argc, char** argv);
 
-	LoadUpImage("Assets/Bottom1.jpg");
+//continuous collision and close encounter detection against analytic cases, then its cost per step
+int RunCollisionCheck(int argc, char** argv);
 
-//---------------------------------------------------------------------------------------
+//Monte Carlo ensemble of perturbed asteroid orbits stepped in lockstep, summary streamed to ensemble.csv
+int RunEnsemble(int argc, char** argv);
 
-	//generate a texture in gpu, return id
-	unsigned int texture1ID;
-	glGenTextures(1, &texture1ID);
-	//we bind the texture to make it the one we're working on
-	glBindTexture(GL_TEXTURE_2D, texture1ID);
-	//set wrapping options(repeat texture if texture coordinates dont fully cover polygons)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);//wraps on the s(x) axis
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);//wraps on the t(y) axis
-	//set filtering options
-	//Suggestion use nearest neightbour for pixel art, use bilinear for pretty much everything else
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);//GL_LINEAR(bilinear) or GL_NEAREST for shrinking
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);//for stretching
+//KS regularized pairs: drifts against Kepler's, a hard binary at the normal step, then binary planets
+int RunKsCheck(int argc, char** argv);
 
+//event times refined on the dense output against analytic orbits, then what the checks add to a step
+int RunEventBench(int argc, char** argv);
 
+//parareal across time slices on a ten body planetary system, convergence per iteration and projected speedup
+int RunPararealBench(int argc, char** argv);
 
-	//1. Vertex represents what data? position(xyz), colour(rgb), texture Coordinates(Ts, Tt)
+//particle-mesh forces against direct summation, then timed steps of a big disk; fails if the in-plane force error is too big
+int RunPmBench(int argc, char** argv);
 
+//fast multipole error and time against direct summation, over body count and expansion order
+int RunFmmBench(int argc, char** argv);
 
-	//2. Vertex Buffer Object? stores vertices in the GPU
-	unsigned int cubeVBO;
-	glGenBuffers(1, &cubeVBO);
+//headless benchmark scenarios checked against a baseline, returns the process exit code
+int RunPerfGate(int argc, char** argv);
 
+//headless run that reports invariant drift for a given timestep, returns the process exit code
+int RunConservationCheck(int argc, char** argv);
 
-	//3. Vertex Array Object? tries to describe the data in the VBO and relay it to the first shader
-	unsigned int cubeVAO;
-	glGenVertexArrays(1, &cubeVAO);
+//hidden-context run of the whole frame body (step, draw, title, telemetry) that fails if steady-state frames touch the heap
+int RunAllocCheck(int argc, char** argv);
 
-	glBindVertexArray(cubeVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+//attach to a running instance's telemetry and print it as CSV, returns the process exit code
+int RunTelemetryDump(int argc, char** argv);
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(textureCubVertices), textureCubVertices, GL_STATIC_DRAW);
+//attach to a running instance's shared body states through the C API and print them, the reference reader
+int RunStateWatch(int argc, char** argv);
 
-	//xyz to location = 0
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+//publish cost and reader consistency of the shared body states, with readers hammering them
+int RunStateBench(int argc, char** argv);
 
-	//texture coordinates to location = 1
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+//fill in and publish this frame's telemetry record
+void PublishTelemetry(const SceneFrame& frame, float time, float frameDeltaTime);
 
+//replace the running simulation with a snapshot file, false (and nothing changed) if it can't
+bool LoadCheckpoint(const char* path);
 
-	//unbind stuff
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+//time saving and loading a snapshot of a large cluster, returns the process exit code
+int RunSnapshotBench(int argc, char** argv);
 
-	//Load up an image file
-	LoadUpImage("Assets/Earth.jpg");
+//record a large cluster as fast as possible and report writer throughput, returns the process exit code
+int RunTrajectoryBench(int argc, char** argv);
 
-//---------------------------------------------------------------------------------------
+//record a run, then check interpolation error and time seeks through the recording, returns the process exit code
+int RunPlaybackBench(int argc, char** argv);
 
-//generate a texture in gpu, return id
-	unsigned int texture2ID;
-	glGenTextures(1, &texture2ID);
-	//we bind the texture to make it the one we're working on
-	glBindTexture(GL_TEXTURE_2D, texture2ID);
-	//set wrapping options(repeat texture if texture coordinates dont fully cover polygons)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);//wraps on the s(x) axis
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);//wraps on the t(y) axis
-																 //set filtering options
-																 //Suggestion use nearest neightbour for pixel art, use bilinear for pretty much everything else
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);//GL_LINEAR(bilinear) or GL_NEAREST for shrinking
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);//for stretching
+//play back frames bigger than half the mapped window and check every sample against the exact state, returns the process exit code
+int RunPlaybackCheck(int argc, char** argv);
 
+//import an MPC orbit catalog and report how long it took, returns the process exit code
+int RunCatalogImport(int argc, char** argv);
 
+//archive a run as Chebyshev segments and check size and error against the raw states, returns the process exit code
+int RunArchiveBench(int argc, char** argv);
 
-	//1. Vertex represents what data? position(xyz), colour(rgb), texture Coordinates(Ts, Tt)
+//compress a recorded trajectory into a Chebyshev archive, returns the process exit code
+int RunArchiveTrajectory(int argc, char** argv);
 
+//build an asset pack from loose files, returns the process exit code
+int RunPackAssets(int argc, char** argv);
 
-	//2. Vertex Buffer Object? stores vertices in the GPU
-	unsigned int cubeVBO1;
-	glGenBuffers(1, &cubeVBO1);
+//scene text to the compiled form that loads with one read
+int RunCompileScene(int argc, char** argv);
 
+//times parsing a large generated scene against loading its compiled form
+int RunSceneBench(int argc, char** argv);
 
-	//3. Vertex Array Object? tries to describe the data in the VBO and relay it to the first shader
-	unsigned int cubeVAO1;
-	glGenVertexArrays(1, &cubeVAO1);
+//renders the scene offscreen to a numbered PNG (or raw) sequence, see OffscreenTarget and FrameEncoder
+int RunRenderFrames(int argc, char** argv);
 
-	glBindVertexArray(cubeVAO1);
-	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO1);
+//reads a scene file (text or compiled) into scene and sizes objectModels for it
+bool LoadScene(const char* path);
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(textureCubVertices1), textureCubVertices1, GL_STATIC_DRAW);
+//sizes objectModels for scene and works out objectRestModels
+void PrepareObjectModels();
 
-	//xyz to location = 0
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+//an object's model matrix at position, spun to where it is at time
+glm::mat4 ObjectModel(const SceneObject& object, const glm::vec3& position, float time);
 
-	//texture coordinates to location = 1
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+//scene meshes, textures and shaders onto the GPU, DrawScene draws them, ReleaseScene frees them
+void UploadScene();
+void DrawScene(const SceneFrame& frame);
+void ReleaseScene();
+//grows the particle VBO and its staging array to hold count points
+void ReserveParticles(size_t count);
 
+int main(int argc, char** argv)
+{
+	//headless modes, these never open a window
+	if (argc > 1 && string(argv[1]) == "--perf-gate")
+		return RunPerfGate(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--conservation-check")
+		return RunConservationCheck(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--alloc-check")
+		return RunAllocCheck(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--telemetry-dump")
+		return RunTelemetryDump(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--state-watch")
+		return RunStateWatch(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--state-bench")
+		return RunStateBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--snapshot-bench")
+		return RunSnapshotBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--trajectory-bench")
+		return RunTrajectoryBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--playback-bench")
+		return RunPlaybackBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--playback-check")
+		return RunPlaybackCheck(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--import-catalog")
+		return RunCatalogImport(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--archive-bench")
+		return RunArchiveBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--archive-trajectory")
+		return RunArchiveTrajectory(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--pack")
+		return RunPackAssets(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--compile-scene")
+		return RunCompileScene(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--scene-bench")
+		return RunSceneBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--render-frames")
+		return RunRenderFrames(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--pm-bench")
+		return RunPmBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--fmm-bench")
+		return RunFmmBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--belt-bench")
+		return RunBeltBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--broad-phase-bench")
+		return RunBroadPhaseBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--collision-check")
+		return RunCollisionCheck(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--ensemble")
+		return RunEnsemble(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--parareal-bench")
+		return RunPararealBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--encke-bench")
+		return RunEnckeBench(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--ks-check")
+		return RunKsCheck(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--event-bench")
+		return RunEventBench(argc, argv);
+
+	//--vram-budget <MB> overrides the default GPU memory warning threshold
+	//--strict-alloc reports every heap allocation made inside the frame loop
+	//--no-telemetry skips creating the shared memory telemetry ring
+	//--no-state-share doesn't publish body states to shared memory
+	//--resume <file> starts from a snapshot instead of the default solar system
+	//--record <file> writes a trajectory, --record-every <steps> thins it, --record-block never drops frames
+	//--play <file> shows a recorded trajectory instead of simulating
+	//--pack-file <file> reads assets from that pack instead of assets.pack next to the exe
+	//--scene <file> shows that scene instead of scene.txt
+	//--belt <count> adds an asteroid belt of that many massless particles outside the first orbit
+	//--collisions merge|bounce resolves collisions between steps and logs them and close encounters to encounters.csv
+	//--regularize integrates close pairs in KS coordinates rather than softening them
+	//--events logs every body's periapsis and apoapsis about the first one to events.csv
+	bool useTelemetry = true;
+	bool useStateShare = true;
+	const char* packPath = NULL;
+	const char* scenePath = SCENE_DEFAULT_NAME;
+	const char* resumePath = NULL;
+	const char* recordPath = NULL;
+	const char* playPath = NULL;
+	size_t beltCount = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "--no-telemetry")
+			useTelemetry = false;
+		if (string(argv[i]) == "--no-state-share")
+			useStateShare = false;
+		if (string(argv[i]) == "--vram-budget" && i + 1 < argc)
+			GpuMemory::Get().BudgetBytes = (size_t)(atof(argv[i + 1]) * 1024.0 * 1024.0);
+		if (string(argv[i]) == "--strict-alloc")
+			AllocTracker::Strict = true;
+		if (string(argv[i]) == "--resume" && i + 1 < argc)
+			resumePath = argv[i + 1];
+		if (string(argv[i]) == "--record" && i + 1 < argc)
+			recordPath = argv[i + 1];
+		if (string(argv[i]) == "--record-every" && i + 1 < argc)
+			recorder.StepInterval = atoi(argv[i + 1]) > 0 ? atoi(argv[i + 1]) : 1;
+		if (string(argv[i]) == "--record-block")
+			recorder.Overflow = TRAJ_BLOCK;
+		if (string(argv[i]) == "--play" && i + 1 < argc)
+			playPath = argv[i + 1];
+		if (string(argv[i]) == "--pack-file" && i + 1 < argc)
+			packPath = argv[i + 1];
+		if (string(argv[i]) == "--scene" && i + 1 < argc)
+			scenePath = argv[i + 1];
+		if (string(argv[i]) == "--belt" && i + 1 < argc)
+			beltCount = (size_t)atoll(argv[i + 1]);
+		if (string(argv[i]) == "--collisions" && i + 1 < argc)
+		{
+			simulation.Collisions.Enabled = true;
+			simulation.Collisions.Response = string(argv[i + 1]) == "bounce" ? COLLIDE_BOUNCE : COLLIDE_MERGE;
+		}
+		if (string(argv[i]) == "--regularize")
+			simulation.Binaries.Enabled = true;
+		if (string(argv[i]) == "--events")
+		{
+			simulation.Events.AddPeriapsis(0);
+			simulation.Events.AddApoapsis(0);
+		}
+	}
 
-	//unbind stuff
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	if (useTelemetry && !telemetry.Open())
+		cout << "Telemetry shared memory unavailable, carrying on without it" << endl;
 
-	//Load up an image file
-	LoadUpImage("Assets/Sun.jpg");
-	
-	//Generate a texture in our graphics card to work with
-	//unsigned int texture2ID;
-	//glGenTextures(1, &texture2ID); //generate 1 texture id and store in texture2ID
-	//glBindTexture(GL_TEXTURE_2D, texture2ID);//make this texutre the currently working texture, saying its a 2d texture (as opposed to 1d and 3d)
-	//
-	////how will texture repeat on large surfaces
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);//how wrap horizontally (S axis...)
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);//how to wrap vertically (T axis...)
-	////how will texture deal with shrink and stretch
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);//when shrinking texture use bilinear filter
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);//use nearest neighbour filtering on stretch
-
-	////Load up an image
-	//unsigned char *imageData2 = stbi_load("airplane.png", &width, &height, &numberChannels, 0);
-
-	//if (imageData2)
-	//{
-	//	//give the texture in our graphics card the data from this png file
-	//	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData2);
-	//	glGenerateMipmap(GL_TEXTURE_2D);
-	//}
-	//else
-	//{
-	//	cout << "failed to load airplane" << endl;
-	//}
-	////free image data from ram because theres a copy in the texture
-	//stbi_image_free(imageData2);
-
-
-
-
-
-	//array of 10 cube positions
-	/*glm::vec3 cubePositions[] = {
-		glm::vec3(0.0f, 0.0f, 0.0f),
-		glm::vec3(2.0f, 5.0f, -15.0f),
-		glm::vec3(-1.5f, -2.2f, -2.5f),
-		glm::vec3(-3.8f, -2.0f, -12.3f),
-		glm::vec3(2.4f, -0.4f, -3.5f),
-		glm::vec3(-1.7f, 3.0f, -7.5f),
-		glm::vec3(1.3f, -2.0f, -2.5f),
-		glm::vec3(1.5f, 2.0f, -2.5f),
-		glm::vec3(1.5f, 0.2f, -1.5f),
-		glm::vec3(-1.3f, 1.0f, -1.5f)
-	};*/
+	//anything missing from the executable and the pack still loads from the loose file
+	if (EmbeddedAssets::Count() > 0)
+		cout << EmbeddedAssets::Count() << " assets built into the executable" << endl;
+	if (packPath ? assets.Open(packPath) : assets.OpenDefault())
+		cout << "Assets from " << assets.Location() << " (" << assets.Count() << " files)" << endl;
+	else
+		cout << "No asset pack, loading loose files" << endl;
+
+	if (!LoadScene(scenePath))
+		return -1;
+	scene.Populate(simulation);
+	if (beltCount > 0)
+		SetupBelt(simulation, beltCount, 0, 6.5, 9.0, 1);
+	simulation.Observe();
+	if (useStateShare && !statePublisher.Open((uint32_t)simulation.State.Count() * 2))
+		cout << "State shared memory unavailable, carrying on without it" << endl;
+	conservation.OpenLog("conservation_log.csv");
+	if (simulation.Collisions.Enabled && !simulation.Collisions.OpenLog("encounters.csv"))
+		cout << "Couldn't open encounters.csv, collisions won't be logged" << endl;
+	if (simulation.Events.Active() && !simulation.Events.OpenLog("events.csv"))
+		cout << "Couldn't open events.csv, events won't be logged" << endl;
+	conservation.Reset(simulation.Conserved(), simulation.Time);
+	if (resumePath && !LoadCheckpoint(resumePath))
+		cout << "Couldn't resume from " << resumePath << ", starting fresh" << endl;
+	if (recordPath && !recorder.Open(recordPath, simulation.State.Count(), simulation))
+		cout << "Couldn't open " << recordPath << " for recording" << endl;
+	if (playPath && player.Open(playPath))
+	{
+		//the renderer draws the scene's bodies, so the recording has to have them
+		if (player.Header().BodyCount < scene.Bodies.size())
+		{
+			cout << playPath << " doesn't have enough bodies to show, simulating instead" << endl;
+			player.Close();
+		}
+		else
+			cout << "Playing " << player.FrameCount() << " frames, t = " << player.StartTime() << " to " << player.EndTime()
+				<< " ([ ] speed, R reverse, left/right scrub, Home/End jump)" << endl;
+	}
 
+	GLFWwindow *window = GameInit();
 
+	//shaders, textures and meshes the scene declared, all meshes in one buffer
+	UploadScene();
 
 	//GAME LOOP
 	while (!glfwWindowShouldClose(window))
 	{
+		//nothing in here should touch the heap once we're running, see --alloc-check
+		AllocTracker::BeginFrame();
+		HotRegion hotRegion("frame loop");
+		AllocScope allocScope(ALLOC_RENDER);
+
 		//update our time management stuff
 		float currentFrame = (float)glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
-		float radius = 10.0f;
-		float camX = sin(glfwGetTime()) * radius;
-		float camZ = cos(glfwGetTime()) * radius;
+		//advance the simulation and build this frame's matrices
+		SceneFrame frame;
+		UpdateFrame(currentFrame, deltaTime, camera.Zoom, frame);
 
 		//user inputs
 		processInputs(window);
@@ -523,188 +473,8 @@ void main()
 		//clear screen AND clear Z depth buffer
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		//-------------------------------------------------------------------------------
-		lightShaderProgram.use();
-		lightShaderProgram.setVec3("objectColour", 1.0f, 0.5f, 0.31f);
-		lightShaderProgram.setVec3("lightColour", lightColour);
-		lightShaderProgram.setVec3("lightPos", lightPos);
-		lightShaderProgram.setVec3("viewPos", camera.Position);
-
-		
-
-		//-------------------------------------------------------------------------------
-
-		if (!isHideText)
-		{
-			shaderProgram.use();
-			glBindVertexArray(polygonVAO);
-
-			//set active textures
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, topTextureID);
-
-			//set texture uniforms: tell each texture uniform which texture slot to use
-			glUniform1i(glGetUniformLocation(shaderProgram.ID, "texture1"), 0);//GL_TEXTURE0
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-			glm::mat4 topView = glm::lookAt(glm::vec3(camX, 0.0, camZ), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
-			glm::mat4 topProjection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
-			glUniformMatrix4fv(glGetUniformLocation(shaderProgram.ID, "view"), 1, GL_FALSE, glm::value_ptr(topView));
-			glUniformMatrix4fv(glGetUniformLocation(shaderProgram.ID, "projection"), 1, GL_FALSE, glm::value_ptr(topProjection));
-
-			glm::mat4 topModel = glm::mat4(1.0f);
-			topModel = glm::translate(topModel, glm::vec3(0.0f, 0.2f, 0.0f));
-			//bottomModel = glm::rotate(bottomModel, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-			/*if (i % 2 == 0)
-			model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-			else
-			model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-			*/
-			glUniformMatrix4fv(glGetUniformLocation(shaderProgram.ID, "model"), 1, GL_FALSE, glm::value_ptr(topModel));
-		}
-
-		//------------------------------------------------------------------------------------------
-		if (!isHideText)
-		{
-			shaderProgram1.use();
-			glBindVertexArray(polygonVAO1);
-
-			//set active textures
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, bottomTextureID);
-
-			//set texture uniforms: tell each texture uniform which texture slot to use
-			glUniform1i(glGetUniformLocation(shaderProgram1.ID, "texture1"), 0);//GL_TEXTURE0
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-			glm::mat4 bottomView = glm::lookAt(glm::vec3(camX, 0.0, camZ), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
-			glm::mat4 bottomProjection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
-			glUniformMatrix4fv(glGetUniformLocation(shaderProgram1.ID, "view"), 1, GL_FALSE, glm::value_ptr(bottomView));
-			glUniformMatrix4fv(glGetUniformLocation(shaderProgram1.ID, "projection"), 1, GL_FALSE, glm::value_ptr(bottomProjection));
-
-			glm::mat4 bottomModel = glm::mat4(1.0f);
-			bottomModel = glm::translate(bottomModel, glm::vec3(0.0f, -0.3f, 0.0f));
-			//bottomModel = glm::rotate(bottomModel, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-			/*if (i % 2 == 0)
-			model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-			else
-			model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-			*/
-			glUniformMatrix4fv(glGetUniformLocation(shaderProgram1.ID, "model"), 1, GL_FALSE, glm::value_ptr(bottomModel));
-		}
-
-		//------------------------------------------------------------------------------------------
-
-		shaderProgram2.use();
-		//bind VAO to draw with
-		glBindVertexArray(cubeVAO);
-
-
-
-		//set active textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture1ID);
-
-		//set texture uniforms: tell each texture uniform which texture slot to use
-		glUniform1i(glGetUniformLocation(shaderProgram2.ID, "texture1"), 0);//GL_TEXTURE0
+		DrawScene(frame);
 
-
-		//Coordinate systems:
-		//cube's vertices are in LOCAL SPACE, we need to convert it to WORLD space
-		//glm::mat4 model = glm::mat4(1.0f);
-		//rotate our cube
-		//model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-		//convert WORLD SPACE TO VIEW SPACE (adjust stuff based on where camera is looking)
-		glm::mat4 view = glm::lookAt(glm::vec3(camX, 0.0, camZ), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0)); //glm::mat4 view = glm::mat4(1.0f);
-		//view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));//push objects away to simulate moving camera backwards
-		/*float radius = 5.0f;
-		float camX = sin(glfwGetTime())*radius;
-		float camZ = cos(glfwGetTime())*radius;*/
-
-		//lookat			cameraPosition				target position				which way is up
-		//view = glm::lookAt(glm::vec3(camX, 0, camZ), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-
-
-		//projection matrix helps create the mathematical illusion of perspective
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
-
-		//to set uniform values on shader
-		//glUniformMatrix4fv(glGetUniformLocation(shaderProgram4.ID, "model"), 1, GL_FALSE, glm::value_ptr(model));
-		glUniformMatrix4fv(glGetUniformLocation(shaderProgram2.ID, "view"), 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(glGetUniformLocation(shaderProgram2.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-
-		//loop through to create a model matrix per position
-		//for (int i = 0; i < 10; i++)
-		//{
-		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(-5.0f, 0.0f, 0.0f));
-		model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-		/*if (i % 2 == 0)
-		model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-		else
-		model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-		*/
-		glUniformMatrix4fv(glGetUniformLocation(shaderProgram2.ID, "model"), 1, GL_FALSE, glm::value_ptr(model));
-		glDrawArrays(GL_TRIANGLES, 0, 36);//starting at stride0, draw 36 rows of vertex data
-										  //}
-
-
-		//------------------------------------------------------------------------------------------
-
-		shaderProgram3.use();
-		//bind VAO to draw with
-		glBindVertexArray(cubeVAO1);
-
-		//set active textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture2ID);
-
-		//set texture uniforms: tell each texture uniform which texture slot to use
-		glUniform1i(glGetUniformLocation(shaderProgram3.ID, "texture1"), 0);//GL_TEXTURE0
-
-
-		glm::mat4 view1 = glm::lookAt(glm::vec3(camX, 0.0, camZ), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
-		glm::mat4 projection1 = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
-
-		//to set uniform values on shader
-		//glUniformMatrix4fv(glGetUniformLocation(shaderProgram4.ID, "model"), 1, GL_FALSE, glm::value_ptr(model));
-		glUniformMatrix4fv(glGetUniformLocation(shaderProgram3.ID, "view"), 1, GL_FALSE, glm::value_ptr(view1));
-		glUniformMatrix4fv(glGetUniformLocation(shaderProgram3.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection1));
-
-		glm::mat4 bottomModel1 = glm::mat4(1.0f);
-		bottomModel1 = glm::translate(bottomModel1, glm::vec3(0.0f, 0.0f, 0.0f));
-		bottomModel1 = glm::rotate(bottomModel1, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-		//bottomModel = glm::rotate(bottomModel, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-		/*if (i % 2 == 0)
-		model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-		else
-		model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-		*/
-		glUniformMatrix4fv(glGetUniformLocation(shaderProgram3.ID, "model"), 1, GL_FALSE, glm::value_ptr(bottomModel1));
-		glDrawArrays(GL_TRIANGLES, 0, 36);//starting at stride0, draw 36 rows of vertex data
-
-		//------------------------------------------------------------------------------------------
-
-		//LAMP
-		lampShaderProgram.use();
-		lampShaderProgram.setVec3("lightColour", lightColour);
-		//bind our cube vao so we can draw a cube shape
-		glBindVertexArray(cubeVAO);
-		glm::mat4 lampModel = glm::mat4(1.0f);//matrix describing where our lamp is in world space
-		lampModel = glm::translate(lampModel, lightPos);//takes an existing matrix and moves(translates) it to the new position
-		lampModel = glm::rotate(lampModel, glm::radians(45.0f), glm::vec3(0.5f, 0.5f, 0.5f));
-		lampModel = glm::scale(lampModel, glm::vec3(2.0f, 2.0f, 2.0f));
-		lampShaderProgram.setMat4("model", lampModel);
-		lampShaderProgram.setMat4("view", view);
-		lampShaderProgram.setMat4("projection", projection);
-		//draw our lamp from the currently bound VBO
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		
-
-			
-
-		
 		//Input for window
 		glfwPollEvents();
 
@@ -712,26 +482,35 @@ void main()
 		glfwSwapBuffers(window);
 
 		showFPS(window);
+		PublishTelemetry(frame, currentFrame, deltaTime);
 	}
 
-	//optional: de-allocate all resources
-
-
-	//glDeleteBuffers(2, VBOs); //example of deleting 2 VBO ids from the VBOs array
+	//de-allocate all resources, and take them off the VRAM books
+	ReleaseScene();
 
+	if (recorder.IsOpen())
+	{
+		recorder.Close();
+		cout << "Recorded " << recorder.Written() << " frames to " << recordPath << ", " << recorder.Dropped() << " dropped" << endl;
+	}
 
 	glfwTerminate();
+	return 0;
 }
 
 //window resize call back function prototype
 void windowResizeCallBack(GLFWwindow* window, int width, int height)
 {
 	glViewport(0, 0, width, height);
+	//minimised windows report 0x0
+	if (width > 0 && height > 0)
+		viewAspect = (float)width / height;
 }
 
 //user inputs
 void processInputs(GLFWwindow* window)
 {
+	AllocScope allocScope(ALLOC_UI);
 	//if esc pressed, set window to 'should close'
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
@@ -745,6 +524,71 @@ void processInputs(GLFWwindow* window)
 		else
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	}
+	//F1 debug overlay, only flip on the press not every frame it's held
+	static bool f1WasDown = false;
+	bool f1Down = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+	if (f1Down && !f1WasDown)
+	{
+		showDebugOverlay = !showDebugOverlay;
+		if (showDebugOverlay)
+		{
+			ColdRegion cold;//one-off dump, allowed to allocate
+			GpuMemory::Get().Report(cout);
+			AllocTracker::Report(stdout);
+		}
+	}
+	f1WasDown = f1Down;
+
+	//F5 quick save, F9 quick load
+	static bool f5WasDown = false, f9WasDown = false;
+	bool f5Down = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+	bool f9Down = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+	if (f5Down && !f5WasDown)
+	{
+		ColdRegion cold;//saving builds a temp file name
+		if (Snapshot::Save(checkpointPath, simulation))
+			cout << "Saved " << simulation.State.Count() << " bodies and " << simulation.Particles.Count() + simulation.Minor.Count()
+				<< " particles to " << checkpointPath << endl;
+		else
+			cout << "Couldn't save " << checkpointPath << endl;
+	}
+	if (f9Down && !f9WasDown)
+	{
+		ColdRegion cold;//loading may grow the body arrays
+		LoadCheckpoint(checkpointPath);
+	}
+	f5WasDown = f5Down;
+	f9WasDown = f9Down;
+
+	//playback controls, only while a recording is open
+	if (player.IsOpen())
+	{
+		static bool slowerWasDown = false, fasterWasDown = false, reverseWasDown = false;
+		bool slowerDown = glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS;
+		bool fasterDown = glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS;
+		bool reverseDown = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+		if (slowerDown && !slowerWasDown)
+			player.Speed *= 0.5;
+		if (fasterDown && !fasterWasDown)
+			player.Speed *= 2.0;
+		if (reverseDown && !reverseWasDown)
+			player.Speed = -player.Speed;
+		slowerWasDown = slowerDown;
+		fasterWasDown = fasterDown;
+		reverseWasDown = reverseDown;
+
+		//holding left/right scrubs through a quarter of the recording per second
+		double scrub = (player.EndTime() - player.StartTime()) * 0.25 * deltaTime;
+		if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+			player.Time -= scrub;
+		if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+			player.Time += scrub;
+		if (glfwGetKey(window, GLFW_KEY_HOME) == GLFW_PRESS)
+			player.Time = player.StartTime();
+		if (glfwGetKey(window, GLFW_KEY_END) == GLFW_PRESS)
+			player.Time = player.EndTime();
+	}
+
 	if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
 	{
 		//hide the text
@@ -788,112 +632,2717 @@ void showFPS(GLFWwindow* window)
 		double fps = frameCount / elapsedSeconds;
 		double msPerFrame = 1000.0 / fps;
 
-		stringstream ss;
-		ss.precision(3);//3 decimal places
-		ss << fixed << "Game1 FPS: " << fps << " Frame Time: " << msPerFrame << "(ms)";
-
-		glfwSetWindowTitle(window, ss.str().c_str());
+		char title[512];
+		FormatTitle(title, sizeof(title), fps, msPerFrame);
+		glfwSetWindowTitle(window, title);
 		frameCount = 0;
 	}
 	frameCount++;
 }
 
-//mouse callback
-void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+void SetupSolarSystem(Simulation& sim)
 {
-	if (firstMouse)
+	const double sunMass = 12.0;
+	const double earthMass = 0.01;
+	const double earthDistance = 5.0;
+	//circular orbit speed, v = sqrt(GM/r)
+	double earthSpeed = sqrt(sim.G * sunMass / earthDistance);
+
+	sim.State.Clear();
+	//the sun gets the opposite momentum so the centre of mass stays put
+	sim.State.Add(0.0, 0.0, 0.0, 0.0, 0.0, earthSpeed * earthMass / sunMass, sunMass, 0.5);
+	sim.State.Add(-earthDistance, 0.0, 0.0, 0.0, 0.0, -earthSpeed, earthMass, 0.5);
+	sim.Time = 0.0;
+	sim.Invalidate();
+}
+
+void SetupRandomCluster(Simulation& sim, int count, unsigned int seed)
+{
+	sim.State.Clear();
+	unsigned int state = seed;
+	for (int i = 0; i < count; i++)
 	{
-		//helps not make a massive camera rotation jump when mouse first touches the screen
-		lastX = xpos;
-		lastY = ypos;
-		firstMouse = false;
+		double p[6];
+		for (int k = 0; k < 6; k++)
+		{
+			//LCG, good enough to scatter bodies and identical on every platform
+			state = state * 1664525u + 1013904223u;
+			p[k] = (state >> 8) / double(1 << 24) * 2.0 - 1.0;
+		}
+		sim.State.Add(p[0] * 10.0, p[1] * 10.0, p[2] * 10.0, p[3] * 0.1, p[4] * 0.1, p[5] * 0.1, 1.0 / count, 0.05);
 	}
-
-	float xoffset = xpos - lastX;
-	float yoffset = lastY - ypos;
-	lastX = xpos;
-	lastY = ypos;
-
-	camera.ProcessMouseMovement(xoffset, yoffset);
+	sim.Time = 0.0;
+	sim.Invalidate();
 }
 
-//scroll wheel callback
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+void SetupDisk(Simulation& sim, size_t count, unsigned int seed)
 {
-	camera.ProcessMouseScroll(yoffset);
+	//scale length 1, scale height 0.1, total mass 1
+	Bodies& b = sim.State;
+	b.Clear();
+	b.Resize(count);
+	unsigned int state = seed;
+	auto uniform = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+		return ((state >> 8) + 0.5) / double(1 << 24);
+	};
+	const double mass = 1.0 / count;
+	for (size_t i = 0; i < count; i++)
+	{
+		//radius from the exponential's cumulative mass by bisection, sech^2 heights
+		double target = uniform() * 0.99, lo = 0.0, hi = 10.0;
+		for (int k = 0; k < 40; k++)
+		{
+			double mid = 0.5 * (lo + hi);
+			(1.0 - (1.0 + mid) * exp(-mid) < target ? lo : hi) = mid;
+		}
+		double r = 0.5 * (lo + hi);
+		double angle = 2.0 * FFT_PI * uniform();
+		double height = 0.1 * atanh(2.0 * uniform() - 1.0);
+		double enclosed = 1.0 - (1.0 + r) * exp(-r);
+		//circular speed of the enclosed mass as if it were spherical, plus a little random motion
+		double v = sqrt(sim.G * enclosed / (r > 0.05 ? r : 0.05));
+		double dispersion = 0.1 * v;
+		b.x[i] = r * cos(angle);
+		b.y[i] = r * sin(angle);
+		b.z[i] = height;
+		b.vx[i] = -v * sin(angle) + dispersion * (uniform() - 0.5);
+		b.vy[i] = v * cos(angle) + dispersion * (uniform() - 0.5);
+		b.vz[i] = dispersion * (uniform() - 0.5);
+		b.ax[i] = b.ay[i] = b.az[i] = 0.0;
+		b.mass[i] = mass;
+		b.radius[i] = 0.0;
+	}
+	sim.Time = 0.0;
+	sim.Invalidate();
 }
 
+void SetupPlanets(Simulation& sim, int planets)
+{
+	SetupSolarSystem(sim);
+	for (int p = 1; p < planets; p++)
+	{
+		double r = 5.0 * pow(1.45, p);
+		double v = sqrt(sim.G * sim.State.mass[0] / r);
+		double tilt = 0.02 * p;
+		double angle = 2.399 * p;
+		double c = cos(angle), s = sin(angle);
+		sim.State.Add(r * c, r * s * tilt, r * s, -v * s, v * c * tilt, v * c, 0.002 * p, 0.2);
+	}
+	sim.Invalidate();
+}
 
-GLFWwindow* GameInit()
+void SetupBelt(Simulation& sim, size_t count, size_t centre, double inner, double outer, unsigned int seed)
 {
-	glfwInit(); 
-	//tell glfw that we want to work with openGL 3.3 core profile
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3); //the first 3 of 3.3
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3); //the .3 of 3.3
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE); //core profile
+	TestParticles& p = sim.Particles;
+	const Bodies& b = sim.State;
+	size_t first = p.Count();
+	p.Resize(first + count);
+	unsigned int state = seed;
+	auto uniform = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+		return ((state >> 8) + 0.5) / double(1 << 24);
+	};
+	double cx = 0.0, cy = 0.0, cz = 0.0, cvx = 0.0, cvy = 0.0, cvz = 0.0, gm = 0.0;
+	if (centre < b.Count())
+	{
+		cx = b.x[centre]; cy = b.y[centre]; cz = b.z[centre];
+		cvx = b.vx[centre]; cvy = b.vy[centre]; cvz = b.vz[centre];
+		gm = sim.G * b.mass[centre];
+	}
+	for (size_t i = first; i < first + count; i++)
+	{
+		//even over the annulus' area, a few percent off circular speed and a few degrees of tilt
+		double r = sqrt(inner * inner + uniform() * (outer * outer - inner * inner));
+		double angle = 2.0 * FFT_PI * uniform();
+		double v = sqrt(gm / r) * (1.0 + 0.06 * (uniform() - 0.5));
+		double tilt = 0.1 * (uniform() - 0.5);
+		//same sense as the scene's orbits: at -x the earth heads for -z
+		p.x[i] = cx + r * cos(angle);
+		p.y[i] = cy;
+		p.z[i] = cz + r * sin(angle);
+		p.vx[i] = cvx - v * sin(angle);
+		p.vy[i] = cvy + v * tilt;
+		p.vz[i] = cvz + v * cos(angle);
+	}
+}
 
-																   //build window
-	GLFWwindow *window = glfwCreateWindow(800, 600, "My first OpenGL thing", NULL, NULL);
-	//if it fails
-	if (window == NULL)
+void UpdateFrame(float time, float frameDeltaTime, float zoom, SceneFrame& frame)
+{
+	//only telemetry reads the step time, and two clock reads cost about as much as a small system's step
+	const bool timed = telemetry.IsOpen();
+	const chrono::steady_clock::time_point simStart = timed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
 	{
-		//try report error
-		cout << "failed to create window" << endl;
-		glfwTerminate(); //cleanup glfw stuff
-		system("pause");
+		AllocScope allocScope(ALLOC_SIMULATION);
+		if (player.IsOpen())
+		{
+			//playback: nothing is integrated, the recording says where everything is
+			player.Advance(frameDeltaTime);
+			player.Sample(player.Time, simulation.State);
+			simulation.Time = player.Time;
+			frame.simSteps = 0;
+		}
+		else
+			frame.simSteps = simulation.Advance(frameDeltaTime);
+	}
+	frame.simStepMs = timed ? chrono::duration<double, milli>(chrono::steady_clock::now() - simStart).count() : 0.0;
+	{
+		AllocScope allocScope(ALLOC_TOOLS);
+		if (frame.simSteps > 0)
+			conservation.Update(simulation.Conserved(), simulation.Time);
+		recorder.Sample(simulation, frame.simSteps);
+		if (frame.simSteps > 0 || player.IsOpen())
+			statePublisher.Publish(simulation.State, simulation.Time, frame.simSteps);
 	}
-	//make this window the current one
-	glfwMakeContextCurrent(window);
 
-	//initialise GLAD
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-		//if this fails, then
-		cout << "GLAD failed to initialise" << endl;
-		glfwTerminate(); //cleanup glfw stuff
-		system("pause");
+	//camera circles the origin
+	float radius = 10.0f;
+	float camX = sin(time) * radius;
+	float camZ = cos(time) * radius;
+
+	//convert WORLD SPACE TO VIEW SPACE (adjust stuff based on where camera is looking)
+	//lookat			cameraPosition				target position				which way is up
+	frame.view = glm::lookAt(glm::vec3(camX, 0.0, camZ), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
+	//projection matrix helps create the mathematical illusion of perspective
+	frame.projection = glm::perspective(glm::radians(zoom), viewAspect, 0.1f, 100.0f);
+
+	//object vertices are in LOCAL SPACE, move them to where the simulation (or the scene) says and spin them
+	const Bodies& b = simulation.State;
+	for (size_t k = 0; k < scene.Objects.size(); k++)
+	{
+		const SceneObject& object = scene.Objects[k];
+		if (object.Body < b.Count())
+			objectModels[k] = ObjectModel(object, glm::vec3((float)b.x[object.Body], (float)b.y[object.Body], (float)b.z[object.Body]), time);
+		else if (object.Spin != 0.0f)
+			objectModels[k] = ObjectModel(object, glm::vec3(object.Position[0], object.Position[1], object.Position[2]), time);
+		else
+			objectModels[k] = objectRestModels[k];
 	}
+}
 
-	//set up openGL viewport x,y,w,h
-	glViewport(0, 0, 800, 600);//you dont have to use the full window for openGL but we will
+glm::mat4 ObjectModel(const SceneObject& object, const glm::vec3& position, float time)
+{
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+	float angle = object.Angle + object.Spin * time;
+	if (angle != 0.0f)
+		model = glm::rotate(model, angle, glm::vec3(object.Axis[0], object.Axis[1], object.Axis[2]));
+	if (object.Scale != 1.0f)
+		model = glm::scale(model, glm::vec3(object.Scale));
+	return model;
+}
 
-							   //set z buffering on
-	glEnable(GL_DEPTH_TEST);
+void PrepareObjectModels()
+{
+	objectModels.assign(scene.Objects.size(), glm::mat4(1.0f));
+	objectRestModels.resize(scene.Objects.size());
+	for (size_t k = 0; k < scene.Objects.size(); k++)
+	{
+		const SceneObject& object = scene.Objects[k];
+		objectRestModels[k] = ObjectModel(object, glm::vec3(object.Position[0], object.Position[1], object.Position[2]), 0.0f);
+	}
+}
 
+int RunPerfGate(int argc, char** argv)
+{
+	//usage: --perf-gate [baseline.json] [--update-baseline]
+	const char* baselinePath = "perf_baseline.json";
+	bool updateBaseline = false;
+	for (int i = 2; i < argc; i++)
+	{
+		if (string(argv[i]) == "--update-baseline")
+			updateBaseline = true;
+		else
+			baselinePath = argv[i];
+	}
 
-	//load images in, flip them
-	stbi_set_flip_vertically_on_load(true);
+	PerfGate::StabiliseProcess();
+	PerfGate gate;
+
+	//same fixed step the live loop uses, so the gate measures what players get
+	const float frameStep = (float)SIM_TIMESTEP;
+	static Simulation cluster;
+	static float frameTime = 0.0f;
+	static vector<glm::mat4> bodyModels;
+
+	//render prep works out a matrix per scene object, so it wants the scene the game shows
+	if (!LoadScene(SCENE_DEFAULT_NAME))
+		cout << "No scene, render_prep_1000_frames only covers the camera" << endl;
+
+	gate.Add("sim_solar_1000_steps",
+		[]() { SetupSolarSystem(simulation); },
+		[]() {
+			for (int i = 0; i < 1000; i++)
+				simulation.Step();
+		});
+	gate.Add("sim_step_direct_512",
+		[]() { SetupRandomCluster(cluster, 512, 1); },
+		[]() { cluster.Step(); });
+	gate.Add("sim_step_direct_2048",
+		[]() { SetupRandomCluster(cluster, 2048, 2); },
+		[]() { cluster.Step(); });
+	gate.Add("render_prep_1000_frames",
+		[]() { SetupSolarSystem(simulation); frameTime = 0.0f; },
+		[frameStep]() {
+			SceneFrame frame;
+			for (int i = 0; i < 1000; i++)
+			{
+				frameTime += frameStep;
+				UpdateFrame(frameTime, frameStep, ZOOM, frame);
+			}
+		});
+	gate.Add("render_prep_bodies_4096",
+		[]() { SetupRandomCluster(cluster, 4096, 3); bodyModels.resize(4096); },
+		[]() {
+			const Bodies& b = cluster.State;
+			for (size_t i = 0; i < b.Count(); i++)
+			{
+				glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3((float)b.x[i], (float)b.y[i], (float)b.z[i]));
+				bodyModels[i] = glm::scale(model, glm::vec3((float)b.radius[i]));
+			}
+		});
+
+	map<string, PerfMetric> baseline;
+	bool haveBaseline = PerfGate::LoadBaseline(baselinePath, baseline);
+
+	cout << "Running perf gate scenarios..." << endl;
+	map<string, PerfStats> results = updateBaseline ? gate.RunAll() : gate.RunConfirmed(baseline);
+	if (updateBaseline)
+	{
+		if (!PerfGate::SaveBaseline(baselinePath, results, baseline))
+		{
+			cout << "Could not write baseline " << baselinePath << endl;
+			return 2;
+		}
+		cout << "Baseline written to " << baselinePath << endl;
+		return 0;
+	}
+	if (!haveBaseline)
+	{
+		cout << "Could not read baseline " << baselinePath << " (run with --update-baseline to create it)" << endl;
+		return 2;
+	}
 
+	int regressions = PerfGate::Compare(results, baseline);
+	if (regressions > 0)
+	{
+		cout << "\nPERF GATE FAILED: " << regressions << " metric(s) regressed" << endl;
+		return 1;
+	}
+	cout << "\nPerf gate passed" << endl;
+	return 0;
+}
 
+int RunConservationCheck(int argc, char** argv)
+{
+	//usage: --conservation-check [timestep] [simulated seconds] [bodies, 0 = solar system]
+	double timeStep = argc > 2 ? atof(argv[2]) : SIM_TIMESTEP;
+	double duration = argc > 3 ? atof(argv[3]) : 100.0;
+	int bodyCount = argc > 4 ? atoi(argv[4]) : 0;
+	if (timeStep <= 0.0 || duration <= 0.0)
+	{
+		cout << "timestep and duration must be positive" << endl;
+		return 2;
+	}
 
+	Simulation sim(timeStep);
+	if (bodyCount > 0)
+		SetupRandomCluster(sim, bodyCount, 1);
+	else
+		SetupSolarSystem(sim);
+	sim.Observe();
 
-	//add window resize callback, params: window to check events on, function to call
-	//when it resizes
-	glfwSetFramebufferSizeCallback(window, windowResizeCallBack);
+	ConservationMonitor monitor;
+	monitor.LogInterval = duration / 100.0;
+	monitor.OpenLog("conservation_check.csv");
+	monitor.Reset(sim.Conserved(), sim.Time);
 
-	//register our mouse callbacks
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
+	PerfTimer timer;
+	long long steps = 0;
+	while (sim.Time < duration)
+	{
+		sim.Step();
+		monitor.Update(sim.Conserved(), sim.Time);
+		steps++;
+	}
+	double elapsed = timer.ElapsedMs();
 
-	//hide cursor and lock mouse within window area
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	char drift[128];
+	monitor.Format(drift, sizeof(drift));
+	printf("dt %g, %lld steps, %zu bodies, %.1f ms (%.3f us/step)\n%s\n", timeStep, steps, sim.State.Count(),
+		elapsed, elapsed * 1000.0 / steps, drift);
+	return 0;
+}
 
-	return window;
+void FormatTitle(char* buffer, size_t size, double fps, double msPerFrame)
+{
+	AllocScope allocScope(ALLOC_UI);
+	char drift[128];
+	conservation.Format(drift, sizeof(drift));
+	//3 decimal places
+	int used = snprintf(buffer, size, "Game1 FPS: %.3f Frame Time: %.3f(ms) %s", fps, msPerFrame, drift);
+	if (player.IsOpen() && used > 0 && (size_t)used < size)
+		used += snprintf(buffer + used, size - used, " Playback t: %.2f x%g", player.Time, player.Speed);
+	if (showDebugOverlay && used > 0 && (size_t)used < size)
+	{
+		char vram[160];
+		GpuMemory::Get().Format(vram, sizeof(vram));
+		snprintf(buffer + used, size - used, " %s allocs/frame: %lld (%lld B)", vram,
+			AllocTracker::FrameAllocations(), AllocTracker::FrameBytes());
+	}
 }
 
-void LoadUpImage(const char* path)
+int RunAllocCheck(int argc, char** argv)
 {
-	//LOAD UP IMAGE FILE (JPEG FIRST)
-	int width, height, numberChannels; //as we load an image, we'll get values from it to fill these in
-	unsigned char *image1Data = stbi_load(path, &width, &height, &numberChannels, 0);
-	//if it loaded
-	if (image1Data)
+	//usage: --alloc-check [frames] [--belt N] [--threads N] [--context egl|osmesa]
+	int frames = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 2000;
+	const char* contextApi = NULL;
+	//by default a belt big enough to be split over threads, on a fixed thread count so the
+	//worker pool is checked on any machine
+	size_t beltCount = 2 * TEST_PARTICLE_PARALLEL;
+	unsigned int threads = 4;
+	for (int i = 2; i + 1 < argc; i++)
 	{
-		cout << "Success! Image is " << width << " by " << height << " pixels" << endl;
-		//Lets associate our texture with this image data
-		//params:
-		//	texture type
-		//	0 = mipmap level(if you want to set manually, zero = nah)
-		//	GL_RGB = format we want to store the texture data in
+		if (string(argv[i]) == "--context")
+			contextApi = argv[i + 1];
+		if (string(argv[i]) == "--belt")
+			beltCount = (size_t)atoll(argv[i + 1]);
+		if (string(argv[i]) == "--threads")
+			threads = (unsigned int)atoi(argv[i + 1]);
+	}
+	//first frames may fill lazily-sized buffers (stdio, statics), only steady state counts
+	const int warmupFrames = 10;
+	AllocTracker::Strict = true;
+	showDebugOverlay = true;
+
+	if (!LoadScene(SCENE_DEFAULT_NAME))
+		cout << "No scene, only the camera and simulation are checked" << endl;
+	SetupSolarSystem(simulation);
+	simulation.Threads = threads;
+	if (beltCount > 0)
+		SetupBelt(simulation, beltCount, 0, 6.5, 9.0, 1);
+	simulation.Observe();
+	conservation.Reset(simulation.Conserved(), simulation.Time);
+
+	//the whole frame body is checked, drawing included, so it needs a context (hidden, or headless)
+	if (!OffscreenInit(contextApi))
+	{
+		cout << "No GL context, can't check the draw" << endl;
+		return 2;
+	}
+	UploadScene();
+
+	const float frameStep = 1.0f / 60.0f;
+	float time = 0.0f;
+	long long steadyAllocations = 0;
+	long long steadyBytes = 0;
+	long long violationsBefore = 0;
+	for (int i = 0; i < frames; i++)
+	{
+		if (i == warmupFrames)
+			violationsBefore = AllocTracker::HotViolations;
+		AllocTracker::BeginFrame();
+		{
+			HotRegion hotRegion("frame loop");
+			AllocScope allocScope(ALLOC_RENDER);
+			SceneFrame frame;
+			time += frameStep;
+			UpdateFrame(time, frameStep, ZOOM, frame);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			DrawScene(frame);
+			char title[512];
+			FormatTitle(title, sizeof(title), 60.0, 1000.0 * frameStep);
+			PublishTelemetry(frame, time, frameStep);
+		}
+		if (i >= warmupFrames)
+		{
+			steadyAllocations += AllocTracker::FrameAllocations();
+			steadyBytes += AllocTracker::FrameBytes();
+		}
+	}
+	long long violations = AllocTracker::HotViolations - violationsBefore;
+	ReleaseScene();
+	OffscreenRelease();
+
+	printf("%d frames (%d warm-up, %zu belt particles, %u threads): %lld steady-state allocations, %lld bytes, %lld hot region violations\n",
+		frames, warmupFrames, beltCount, ParallelThreads(threads), steadyAllocations, steadyBytes, violations);
+	AllocTracker::Report(stdout);
+	return steadyAllocations == 0 && violations == 0 ? 0 : 1;
+}
+
+void PublishTelemetry(const SceneFrame& frame, float time, float frameDeltaTime)
+{
+	AllocScope allocScope(ALLOC_TOOLS);
+	TelemetryRecord record;
+	record.Frame = frameNumber++;
+	record.Time = time;
+	record.FrameMs = frameDeltaTime * 1000.0;
+	record.SimStepMs = frame.simStepMs;
+	record.SimSteps = frame.simSteps;
+	record.BodyCount = (int32_t)simulation.State.Count();
+	record.HeapLiveBytes = AllocTracker::LiveBytes();
+	record.VramBytes = (int64_t)GpuMemory::Get().TotalBytes();
+	record.FrameAllocations = AllocTracker::FrameAllocations();
+	record.EnergyDrift = conservation.EnergyDrift;
+	telemetry.Publish(record);
+}
+
+bool LoadCheckpoint(const char* path)
+{
+	Snapshot snapshot;
+	if (!snapshot.Open(path))
+		return false;
+	//the renderer draws the scene's bodies, so the snapshot has to have them
+	size_t needed = scene.Bodies.size();
+	if (snapshot.Header()->BodyCount < needed)
+	{
+		cout << "ERROR::SNAPSHOT " << path << " has " << snapshot.Header()->BodyCount << " bodies, need at least " << needed << endl;
+		return false;
+	}
+	if (!snapshot.Restore(simulation))
+		return false;
+	simulation.Observe();
+	conservation.Reset(simulation.Conserved(), simulation.Time);
+	cout << "Loaded " << simulation.State.Count() << " bodies and " << simulation.Particles.Count() + simulation.Minor.Count()
+		<< " particles at t = " << simulation.Time << " from " << path << endl;
+	return true;
+}
+
+int RunSnapshotBench(int argc, char** argv)
+{
+	//usage: --snapshot-bench [bodies] [file]
+	int bodyCount = argc > 2 ? atoi(argv[2]) : 1000000;
+	const char* path = argc > 3 ? argv[3] : "snapshot_bench.snap";
+	if (bodyCount <= 0)
+	{
+		cout << "body count must be positive" << endl;
+		return 2;
+	}
+
+	//a belt and a few minor bodies about body 0 ride along, so their columns round-trip too
+	Simulation original;
+	SetupRandomCluster(original, bodyCount, 1);
+	SetupBelt(original, bodyCount / 8, 0, 1.0, 2.0, 1);
+	for (size_t i = 0; i < 64 && i < original.Particles.Count(); i++)
+	{
+		const TestParticles& p = original.Particles;
+		const double position[3] = { p.x[i], p.y[i], p.z[i] }, velocity[3] = { p.vx[i], p.vy[i], p.vz[i] };
+		original.Minor.Add(original.State, position, velocity);
+	}
+	original.Time = 123.25;
+	double megabytes = (bodyCount * 8.0 + original.Particles.Count() * 6.0) * sizeof(double) / (1024.0 * 1024.0);
+
+	PerfTimer timer;
+	if (!Snapshot::Save(path, original))
+	{
+		cout << "Couldn't write " << path << endl;
+		return 1;
+	}
+	double saveMs = timer.ElapsedMs();
+
+	Simulation restored;
+	timer.Restart();
+	bool loaded = Snapshot::Load(path, restored, false);
+	double loadMs = timer.ElapsedMs();
+	timer.Restart();
+	bool verified = loaded && Snapshot::Load(path, restored, true);
+	double verifiedMs = timer.ElapsedMs();
+	if (!verified)
+	{
+		cout << "Couldn't read " << path << " back" << endl;
+		return 1;
+	}
+
+	const Bodies& a = original.State;
+	const Bodies& b = restored.State;
+	bool same = b.Count() == a.Count() && restored.Time == original.Time && b.x == a.x && b.y == a.y && b.z == a.z &&
+		b.vx == a.vx && b.vy == a.vy && b.vz == a.vz && b.mass == a.mass && b.radius == a.radius;
+	const TestParticles& pa = original.Particles;
+	const TestParticles& pb = restored.Particles;
+	same = same && pb.x == pa.x && pb.y == pa.y && pb.z == pa.z && pb.vx == pa.vx && pb.vy == pa.vy && pb.vz == pa.vz;
+	//minor bodies come back on new reference orbits, so only to rounding
+	same = same && restored.Minor.Count() == original.Minor.Count();
+	for (size_t i = 0; same && i < original.Minor.Count(); i++)
+	{
+		double before[6], after[6];
+		original.Minor.Get(i, before, before + 3);
+		restored.Minor.Get(i, after, after + 3);
+		for (int k = 0; k < 6; k++)
+			same = same && fabs(after[k] - before[k]) <= 1e-12 * (fabs(before[k]) + 1.0);
+	}
+	printf("%d bodies, %zu particles, %.1f MB: save %.1f ms (%.0f MB/s), load %.1f ms (%.0f MB/s), load + verify %.1f ms%s\n",
+		bodyCount, original.Particles.Count() + original.Minor.Count(), megabytes, saveMs, megabytes * 1000.0 / saveMs, loadMs, megabytes * 1000.0 / loadMs, verifiedMs,
+		same ? "" : "  MISMATCH");
+	remove(path);
+	return same ? 0 : 1;
+}
+
+int RunTrajectoryBench(int argc, char** argv)
+{
+	//usage: --trajectory-bench [bodies] [frames] [file] [--drop]
+	int bodyCount = 100000;
+	int frames = 2000;
+	const char* path = "trajectory_bench.traj";
+	TrajectoryOverflow overflow = TRAJ_BLOCK;
+	int positional = 0;
+	for (int i = 2; i < argc; i++)
+	{
+		if (string(argv[i]) == "--drop")
+			overflow = TRAJ_DROP;
+		else if (positional == 0 && ++positional)
+			bodyCount = atoi(argv[i]);
+		else if (positional == 1 && ++positional)
+			frames = atoi(argv[i]);
+		else
+			path = argv[i];
+	}
+	if (bodyCount <= 0 || frames <= 0)
+	{
+		cout << "body count and frame count must be positive" << endl;
+		return 2;
+	}
+
+	Simulation sim;
+	SetupRandomCluster(sim, bodyCount, 1);
+	TrajectoryWriter writer;
+	writer.Overflow = overflow;
+	if (!writer.Open(path, sim.State.Count(), sim))
+	{
+		cout << "Couldn't open " << path << endl;
+		return 1;
+	}
+
+	//the producer side is what the frame loop would pay, time it separately from the drain
+	double worstRecordMs = 0.0;
+	PerfTimer total;
+	PerfTimer timer;
+	for (int f = 0; f < frames; f++)
+	{
+		sim.Time += sim.TimeStep;
+		timer.Restart();
+		writer.Record(sim, f);
+		double ms = timer.ElapsedMs();
+		if (ms > worstRecordMs)
+			worstRecordMs = ms;
+	}
+	double producerMs = total.ElapsedMs();
+	writer.Close();
+	double totalMs = total.ElapsedMs();
+
+	double megabytes = writer.BytesWritten() / (1024.0 * 1024.0);
+	printf("%d bodies x %d frames (%s): %llu written, %llu dropped, %.1f MB\n", bodyCount, frames,
+		overflow == TRAJ_DROP ? "drop" : "block", (unsigned long long)writer.Written(), (unsigned long long)writer.Dropped(), megabytes);
+	printf("record %.3f ms/frame avg, %.3f ms worst; end to end %.0f MB/s, writer %.0f MB/s\n", producerMs / frames,
+		worstRecordMs, megabytes * 1000.0 / totalMs, writer.WriteMegabytesPerSecond());
+	remove(path);
+	return writer.Failed() ? 1 : 0;
+}
+
+int RunPlaybackBench(int argc, char** argv)
+{
+	//usage: --playback-bench [bodies, 0 = solar system] [recorded frames] [seeks]
+	int bodyCount = argc > 2 ? atoi(argv[2]) : 1000;
+	int frames = argc > 3 ? atoi(argv[3]) : 2000;
+	int seeks = argc > 4 ? atoi(argv[4]) : 10000;
+	const int stepsPerFrame = 8;
+	const char* path = "playback_bench.traj";
+	if (bodyCount < 0 || frames < 2 || seeks <= 0)
+	{
+		cout << "need at least 2 frames and 1 seek" << endl;
+		return 2;
+	}
+
+	Simulation sim;
+	if (bodyCount > 0)
+		SetupRandomCluster(sim, bodyCount, 1);
+	else
+		SetupSolarSystem(sim);
+	TrajectoryWriter writer;
+	writer.Overflow = TRAJ_BLOCK;
+	writer.StepInterval = stepsPerFrame;
+	if (!writer.Open(path, sim.State.Count(), sim))
+	{
+		cout << "Couldn't open " << path << endl;
+		return 1;
+	}
+	//keep the true state halfway between recorded frames to measure interpolation error against
+	size_t n = sim.State.Count();
+	vector<double> truthTime, truthX;
+	writer.Record(sim, 0);
+	for (int f = 1; f < frames; f++)
+	{
+		for (int s = 0; s < stepsPerFrame; s++)
+		{
+			sim.Step();
+			if (s == stepsPerFrame / 2 - 1)
+			{
+				truthTime.push_back(sim.Time);
+				truthX.insert(truthX.end(), sim.State.x.begin(), sim.State.x.end());
+			}
+		}
+		writer.Sample(sim, stepsPerFrame);
+	}
+	writer.Close();
+
+	TrajectoryPlayer playback;
+	if (!playback.Open(path))
+		return 1;
+	Bodies state;
+	double worstError = 0.0;
+	for (size_t t = 0; t < truthTime.size(); t++)
+	{
+		playback.Sample(truthTime[t], state);
+		for (size_t i = 0; i < n; i++)
+		{
+			double error = fabs(state.x[i] - truthX[t * n + i]);
+			if (error > worstError)
+				worstError = error;
+		}
+	}
+
+	//random access, worst case for the window
+	double start = playback.StartTime(), span = playback.EndTime() - start;
+	unsigned int seed = 12345;
+	PerfTimer timer;
+	for (int i = 0; i < seeks; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		playback.Sample(start + span * (seed >> 8) / 16777216.0, state);
+	}
+	double seekMs = timer.ElapsedMs();
+
+	//straight playback backwards at 4x the recording rate
+	timer.Restart();
+	int played = 0;
+	for (double t = playback.EndTime(); t >= start; t -= 4.0 * sim.TimeStep)
+	{
+		playback.Sample(t, state);
+		played++;
+	}
+	double reverseMs = timer.ElapsedMs();
+
+	printf("%zu bodies, %llu frames every %d steps: max interpolation error in x %.3g\n", n,
+		(unsigned long long)playback.FrameCount(), stepsPerFrame, worstError);
+	printf("random seek + sample %.2f us, reverse playback %.2f us per sample\n", seekMs * 1000.0 / seeks, reverseMs * 1000.0 / played);
+	playback.Close();
+	remove(path);
+	return 0;
+}
+
+int RunPlaybackCheck(int argc, char** argv)
+{
+	//usage: --playback-check [bodies] [frames]
+	//default frames (positions + velocities) are just over half of TRAJECTORY_WINDOW_BYTES, so the
+	//player can only map two at a time and every sample needs both of them in the window
+	int bodyCount = argc > 2 ? atoi(argv[2]) : (int)(TRAJECTORY_WINDOW_BYTES / 2 / (6 * sizeof(double))) + 1024;
+	int frames = argc > 3 ? atoi(argv[3]) : 6;
+	const char* path = "playback_check.traj";
+	if (bodyCount <= 0 || frames < 2)
+	{
+		cout << "need at least 1 body and 2 frames" << endl;
+		return 2;
+	}
+
+	//straight lines at constant velocity, which Hermite interpolation reproduces exactly
+	Simulation sim;
+	SetupRandomCluster(sim, bodyCount, 1);
+	Bodies start = sim.State;
+	TrajectoryWriter writer;
+	writer.Overflow = TRAJ_BLOCK;
+	if (!writer.Open(path, sim.State.Count(), sim))
+	{
+		cout << "Couldn't open " << path << endl;
+		return 1;
+	}
+	for (int f = 0; f < frames; f++)
+	{
+		sim.Time = f * sim.TimeStep;
+		for (int i = 0; i < bodyCount; i++)
+		{
+			sim.State.x[i] = start.x[i] + start.vx[i] * sim.Time;
+			sim.State.y[i] = start.y[i] + start.vy[i] * sim.Time;
+			sim.State.z[i] = start.z[i] + start.vz[i] * sim.Time;
+		}
+		writer.Record(sim, f);
+	}
+	writer.Close();
+
+	TrajectoryPlayer playback;
+	if (!playback.Open(path))
+	{
+		remove(path);
+		return 1;
+	}
+	size_t frameBytes = playback.Header().FrameBytes;
+	//forwards through every gap, then backwards, so the window has to move both ways
+	Bodies state;
+	double worstError = 0.0;
+	int samples = 0;
+	for (int pass = 0; pass < 2; pass++)
+		for (int g = 0; g < frames - 1; g++)
+		{
+			int gap = pass == 0 ? g : frames - 2 - g;
+			double t = (gap + 0.5) * sim.TimeStep;
+			if (!playback.Sample(t, state))
+			{
+				worstError = 1.0;
+				continue;
+			}
+			samples++;
+			for (int i = 0; i < bodyCount; i++)
+			{
+				double error = fabs(state.x[i] - (start.x[i] + start.vx[i] * t)) + fabs(state.vx[i] - start.vx[i]);
+				if (error > worstError)
+					worstError = error;
+			}
+		}
+	playback.Close();
+	remove(path);
+
+	bool passed = samples == 2 * (frames - 1) && worstError < 1e-9;
+	printf("%d bodies x %d frames of %.1f MB (window %.0f MB): %d samples, worst error %.3g  %s\n", bodyCount, frames,
+		frameBytes / (1024.0 * 1024.0), TRAJECTORY_WINDOW_BYTES / (1024.0 * 1024.0), samples, worstError, passed ? "ok" : "WRONG");
+	return passed ? 0 : 1;
+}
+
+int RunCatalogImport(int argc, char** argv)
+{
+	//usage: --import-catalog <MPCORB.DAT> [threads, 0 = all]
+	if (argc < 3)
+	{
+		cout << "usage: --import-catalog <file> [threads]" << endl;
+		return 2;
+	}
+	unsigned int threads = argc > 3 ? (unsigned int)atoi(argv[3]) : 0;
+	OrbitalElements elements;
+	CatalogImporter importer;
+	if (!importer.Import(argv[2], elements, threads))
+	{
+		cout << "Couldn't read " << argv[2] << endl;
+		return 1;
+	}
+	printf("%zu records (%zu other lines skipped) in %.1f ms\n", elements.Count(), importer.Skipped, importer.Milliseconds);
+	for (size_t k = 0; k < elements.Count() && k < 3; k++)
+	{
+		double x, y, z, vx, vy, vz;
+		elements.StateAt(k, elements.epoch[k], x, y, z, vx, vy, vz);
+		printf("  %-7s a %.7f e %.7f i %.5f epoch JD %.1f -> r (%.6f, %.6f, %.6f) AU\n", elements.Designation(k),
+			elements.a[k], elements.e[k], elements.i[k], elements.epoch[k], x, y, z);
+	}
+	return 0;
+}
+
+int RunArchiveBench(int argc, char** argv)
+{
+	//usage: --archive-bench [bodies, 0 = solar system] [simulated seconds] [tolerance] [segment seconds]
+	int bodyCount = argc > 2 ? atoi(argv[2]) : 0;
+	double duration = argc > 3 ? atof(argv[3]) : 200.0;
+	double tolerance = argc > 4 ? atof(argv[4]) : 1e-6;
+	double segmentSeconds = argc > 5 ? atof(argv[5]) : 5.0;
+	const char* path = "archive_bench.cheb";
+	if (bodyCount < 0 || duration <= 0.0 || tolerance <= 0.0 || segmentSeconds <= 0.0)
+	{
+		cout << "duration, tolerance and segment length must be positive" << endl;
+		return 2;
+	}
+
+	Simulation sim;
+	if (bodyCount > 0)
+		SetupRandomCluster(sim, bodyCount, 1);
+	else
+		SetupSolarSystem(sim);
+	size_t n = sim.State.Count();
+	ChebyshevWriter writer;
+	if (!writer.Open(path, n, sim.Time, segmentSeconds, tolerance))
+	{
+		cout << "Couldn't open " << path << endl;
+		return 1;
+	}
+	//every step goes in; every 7th state is also kept to check the archive against
+	vector<double> truthTime, truthPosition;
+	PerfTimer timer;
+	double fitMs = 0.0;
+	long long steps = 0;
+	writer.Add(sim.Time, sim.State);
+	while (sim.Time < duration)
+	{
+		sim.Step();
+		timer.Restart();
+		writer.Add(sim.Time, sim.State);
+		fitMs += timer.ElapsedMs();
+		if (++steps % 7 == 0)
+		{
+			truthTime.push_back(sim.Time);
+			for (size_t i = 0; i < n; i++)
+			{
+				truthPosition.push_back(sim.State.x[i]);
+				truthPosition.push_back(sim.State.y[i]);
+				truthPosition.push_back(sim.State.z[i]);
+			}
+		}
+	}
+	//missing the tolerance fails Close() too, but the archive is still worth checking
+	if (!writer.Close() && writer.ToleranceMisses == 0)
+	{
+		cout << "Couldn't write " << path << endl;
+		return 1;
+	}
+
+	ChebyshevReader reader;
+	if (!reader.Open(path))
+		return 1;
+	double worstError = 0.0;
+	timer.Restart();
+	for (size_t t = 0; t < truthTime.size(); t++)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			double position[3];
+			reader.Evaluate(i, truthTime[t], position);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				double error = fabs(position[axis] - truthPosition[(t * n + i) * 3 + axis]);
+				if (error > worstError)
+					worstError = error;
+			}
+		}
+	}
+	double evaluateMs = timer.ElapsedMs();
+
+	printf("%zu bodies, %lld steps, %llu segments of %gs: %.1f KB raw -> %.1f KB (%.0fx)\n", n, steps,
+		(unsigned long long)writer.Segments, segmentSeconds, writer.RawBytes() / 1024.0, writer.BytesWritten / 1024.0,
+		(double)writer.RawBytes() / writer.BytesWritten);
+	printf("tolerance %g: max fit error %.3g, max error at checked states %.3g, %llu segments over tolerance\n", tolerance,
+		writer.MaxError, worstError, (unsigned long long)writer.ToleranceMisses);
+	printf("fitting %.3f ms per step, evaluate %.3f us per body\n", fitMs / steps,
+		evaluateMs * 1000.0 / (truthTime.size() * n));
+	reader.Close();
+	remove(path);
+	return writer.ToleranceMisses == 0 && worstError <= tolerance * 2.0 ? 0 : 1;
+}
+
+int RunArchiveTrajectory(int argc, char** argv)
+{
+	//usage: --archive-trajectory <in.traj> <out.cheb> [tolerance] [segment seconds]
+	if (argc < 4)
+	{
+		cout << "usage: --archive-trajectory <in.traj> <out.cheb> [tolerance] [segment seconds]" << endl;
+		return 2;
+	}
+	double tolerance = argc > 4 ? atof(argv[4]) : 1e-6;
+	double segmentSeconds = argc > 5 ? atof(argv[5]) : 5.0;
+	TrajectoryPlayer recording;
+	if (!recording.Open(argv[2]))
+		return 1;
+	ChebyshevWriter writer;
+	if (!writer.Open(argv[3], (size_t)recording.Header().BodyCount, recording.StartTime(), segmentSeconds, tolerance))
+	{
+		cout << "Couldn't open " << argv[3] << endl;
+		return 1;
+	}
+	//sampling exactly at a frame's time returns that frame as recorded
+	Bodies state;
+	for (uint64_t k = 0; k < recording.FrameCount(); k++)
+	{
+		double time = recording.FrameTime(k);
+		recording.Sample(time, state);
+		writer.Add(time, state);
+	}
+	if (!writer.Close() && writer.ToleranceMisses == 0)
+	{
+		cout << "Couldn't write " << argv[3] << endl;
+		return 1;
+	}
+	uint64_t rawBytes = recording.FrameCount() * recording.Header().FrameBytes;
+	printf("%llu frames, %.1f MB -> %.3f MB (%.0fx), max fit error %.3g, %llu segments over tolerance\n",
+		(unsigned long long)recording.FrameCount(), rawBytes / (1024.0 * 1024.0), writer.BytesWritten / (1024.0 * 1024.0),
+		(double)rawBytes / writer.BytesWritten, writer.MaxError, (unsigned long long)writer.ToleranceMisses);
+	//an archive that doesn't hold its tolerance isn't one anybody should be reading positions from
+	return writer.ToleranceMisses == 0 ? 0 : 1;
+}
+
+int RunPackAssets(int argc, char** argv)
+{
+	//usage: --pack [output.pack] [files...], no files packs everything in assets.manifest
+	const char* output = argc > 2 ? argv[2] : ASSET_PACK_DEFAULT_NAME;
+	vector<string> files;
+	for (int i = 3; i < argc; i++)
+		files.push_back(argv[i]);
+	if (files.empty())
+	{
+		ifstream manifest(assetManifest);
+		string line;
+		while (getline(manifest, line))
+		{
+			size_t first = line.find_first_not_of(" \t\r");
+			size_t last = line.find_last_not_of(" \t\r");
+			if (first != string::npos && line[first] != '#')
+				files.push_back(line.substr(first, last - first + 1));
+		}
+		if (files.empty())
+		{
+			cout << "Nothing to pack, " << assetManifest << " is missing or empty" << endl;
+			return 2;
+		}
+	}
+
+	PerfTimer timer;
+	if (!AssetPack::Build(output, files))
+	{
+		cout << "Couldn't build " << output << endl;
+		return 1;
+	}
+	double buildMs = timer.ElapsedMs();
+
+	//read it back the way the game will
+	AssetPack pack;
+	timer.Restart();
+	if (!pack.Open(output) || !pack.Verify())
+	{
+		cout << output << " didn't verify" << endl;
+		return 1;
+	}
+	double openMs = timer.ElapsedMs();
+	for (uint32_t k = 0; k < pack.Count(); k++)
+		printf("  %-32s %10zu bytes\n", pack.Name(k), pack.Find(pack.Name(k)).Size);
+	printf("%u files packed into %s in %.1f ms, open + verify %.2f ms\n", pack.Count(), output, buildMs, openMs);
+	return 0;
+}
+
+int RunCompileScene(int argc, char** argv)
+{
+	//usage: --compile-scene [scene.txt] [scene.bin]
+	const char* input = argc > 2 ? argv[2] : SCENE_DEFAULT_NAME;
+	const char* output = argc > 3 ? argv[3] : "scene.bin";
+	PerfTimer timer;
+	Scene source;
+	if (!source.Load(input))
+		return 1;
+	double parseMs = timer.ElapsedMs();
+	if (!source.SaveBinary(output))
+	{
+		cout << "ERROR::SCENE can't write " << output << endl;
+		return 1;
+	}
+
+	//read it back the way the game will
+	Scene compiled;
+	timer.Restart();
+	if (!compiled.Load(output))
+		return 1;
+	double loadMs = timer.ElapsedMs();
+	if (compiled.Objects.size() != source.Objects.size() || compiled.Bodies.size() != source.Bodies.size() ||
+		compiled.Vertices != source.Vertices)
+	{
+		cout << output << " doesn't match " << input << endl;
+		return 1;
+	}
+	printf("%s -> %s: %zu bodies, %zu objects, %zu meshes (%zu vertices), parse %.2f ms, compiled load %.2f ms\n",
+		input, output, compiled.Bodies.size(), compiled.Objects.size(), compiled.Meshes.size(), compiled.VertexCount(), parseMs, loadMs);
+	return 0;
+}
+
+int RunSceneBench(int argc, char** argv)
+{
+	//usage: --scene-bench [bodies] [file]
+	int bodyCount = argc > 2 ? atoi(argv[2]) : 100000;
+	const char* path = argc > 3 ? argv[3] : "scene_bench.bin";
+	if (bodyCount < 1)
+		bodyCount = 1;
+
+	//the default scene's shaders, textures and meshes with a swarm of drawn bodies round the sun
+	string text =
+		"shader textured cubeVertexShader.txt cubeFragmentShader.txt\n"
+		"texture earth Assets/Earth.jpg planets\n"
+		"texture sun Assets/Sun.jpg planets\n"
+		"mesh cube cube 1\n"
+		"material earth textured earth\n"
+		"material sun textured sun\n"
+		"body sun mass 12 radius 0.5 mesh cube material sun axis 0.5 1 0 spin 1\n";
+	char line[256];
+	for (int i = 0; i < bodyCount; i++)
+	{
+		double distance = 2.0 + 40.0 * (i + 0.5) / bodyCount;
+		snprintf(line, sizeof(line), "body b%d mass %.9g radius 0.05 position 0 %.6f 0 orbit sun %.9f mesh cube material earth scale 0.1 spin %.3f\n",
+			i, 1e-6, 0.01 * (i % 100), distance, 0.5 + (i % 7) * 0.25);
+		text += line;
+	}
+
+	Scene parsed;
+	PerfTimer timer;
+	if (!parsed.Parse(text.data(), text.size(), "generated"))
+		return 1;
+	double parseMs = timer.ElapsedMs();
+	if (!parsed.SaveBinary(path))
+	{
+		cout << "ERROR::SCENE can't write " << path << endl;
+		return 1;
+	}
+
+	Scene compiled;
+	timer.Restart();
+	if (!compiled.Load(path))
+		return 1;
+	double loadMs = timer.ElapsedMs();
+
+	//and what the renderer would do with it every frame
+	scene = compiled;
+	PrepareObjectModels();
+	compiled.Populate(simulation);
+	SceneFrame frame;
+	timer.Restart();
+	UpdateFrame(0.0f, 0.0f, ZOOM, frame);
+	double prepMs = timer.ElapsedMs();
+
+	ifstream sizeCheck(path, ios::binary | ios::ate);
+	double compiledMB = (double)sizeCheck.tellg() / (1024.0 * 1024.0);
+	remove(path);
+	printf("%d bodies: text %.1f MB parsed in %.1f ms, compiled %.1f MB loaded in %.1f ms (%.0fx), %zu object matrices in %.2f ms\n",
+		bodyCount, text.size() / (1024.0 * 1024.0), parseMs, compiledMB, loadMs, parseMs / (loadMs > 0.0 ? loadMs : 1e-3),
+		compiled.Objects.size(), prepMs);
+	return 0;
+}
+
+int RunPmBench(int argc, char** argv)
+{
+	//usage: --pm-bench [particles] [grid] [steps] [--periodic] [--threads N] [--max-error median,p90]
+	size_t count = argc > 2 && argv[2][0] != '-' ? (size_t)atoll(argv[2]) : 1000000;
+	int grid = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : PM_GRID;
+	int steps = argc > 4 && argv[4][0] != '-' ? atoi(argv[4]) : 5;
+	PmBoundary boundary = PM_ISOLATED;
+	unsigned int threads = 0;
+	//in-plane percent; with no short-range correction the error is about a cell's worth of force,
+	//a 200k disk on the default grid comes out near 6% and 15%
+	double maxMedian = 10.0, maxP90 = 25.0;
+	for (int i = 2; i < argc; i++)
+	{
+		if (string(argv[i]) == "--periodic")
+			boundary = PM_PERIODIC;
+		if (string(argv[i]) == "--threads" && i + 1 < argc)
+			threads = (unsigned int)atoi(argv[i + 1]);
+		if (string(argv[i]) == "--max-error" && i + 1 < argc)
+			sscanf(argv[i + 1], "%lf,%lf", &maxMedian, &maxP90);
+	}
+	if (count < 2)
+		count = 2;
+
+	Simulation sim(0.01, 1.0, 0.01);
+	PerfTimer timer;
+	SetupDisk(sim, count, 1);
+	double setupMs = timer.ElapsedMs();
+	sim.Method = FORCE_PM;
+	sim.Threads = threads;
+	//a periodic box with room round the disk, so its images barely matter
+	sim.Mesh = ParticleMesh(grid, boundary, boundary == PM_PERIODIC ? 16.0 : 0.0);
+	sim.Mesh.Threads = threads;
+	timer.Restart();
+	sim.Observe();
+	double firstMs = timer.ElapsedMs();
+	printf("%zu particles (set up in %.0f ms), %d^3 %s grid, cell %.4g, %u threads\n", count, setupMs, sim.Mesh.Grid,
+		boundary == PM_PERIODIC ? "periodic" : "isolated", sim.Mesh.Spacing(), ParallelThreads(threads));
+	printf("first solve %.0f ms: assign %.0f, FFTs %.0f, interpolate %.0f (includes building the Green's function)\n",
+		firstMs, sim.Mesh.AssignMs, sim.Mesh.FftMs, sim.Mesh.InterpolateMs);
+
+	//against direct summation for a sample of particles, on every other one
+	size_t samples = (size_t)(2e9 / count);
+	samples = samples > 256 ? 256 : samples < 16 ? 16 : samples;
+	//a thin disk's vertical pull is below mesh resolution, so in-plane is the fairer figure
+	vector<double> errors, planeErrors;
+	const Bodies& b = sim.State;
+	const double eps2 = sim.Softening * sim.Softening;
+	for (size_t s = 0; s < samples; s++)
+	{
+		size_t i = s * (count / samples);
+		double ax = 0.0, ay = 0.0, az = 0.0;
+		for (size_t j = 0; j < count; j++)
+		{
+			double dx = b.x[j] - b.x[i], dy = b.y[j] - b.y[i], dz = b.z[j] - b.z[i];
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			double f = j == i ? 0.0 : sim.G * b.mass[j] / (r2 * sqrt(r2));
+			ax += dx * f; ay += dy * f; az += dz * f;
+		}
+		double ex = b.ax[i] - ax, ey = b.ay[i] - ay, ez = b.az[i] - az;
+		errors.push_back(sqrt((ex * ex + ey * ey + ez * ez) / (ax * ax + ay * ay + az * az)));
+		planeErrors.push_back(sqrt((ex * ex + ey * ey) / (ax * ax + ay * ay)));
+	}
+	sort(errors.begin(), errors.end());
+	sort(planeErrors.begin(), planeErrors.end());
+	const double planeMedian = 100.0 * planeErrors[errors.size() / 2], planeP90 = 100.0 * planeErrors[errors.size() * 9 / 10];
+	const bool passed = planeMedian < maxMedian && planeP90 < maxP90;
+	printf("force error against direct summation (%zu particles): median %.2f%% (in-plane %.2f%%), 90th percentile %.2f%% (%.2f%%)%s\n",
+		samples, 100.0 * errors[errors.size() / 2], planeMedian, 100.0 * errors[errors.size() * 9 / 10],
+		planeP90, boundary == PM_PERIODIC ? " (periodic images included in PM, not in direct)" : "");
+	printf("in-plane limits: median %.1f%%, 90th percentile %.1f%%  %s\n", maxMedian, maxP90, passed ? "ok" : "WRONG");
+
+	double startEnergy = sim.Conserved().Energy();
+	double totalMs = 0.0, assignMs = 0.0, fftMs = 0.0, interpolateMs = 0.0;
+	for (int step = 0; step < steps; step++)
+	{
+		timer.Restart();
+		sim.Step();
+		totalMs += timer.ElapsedMs();
+		assignMs += sim.Mesh.AssignMs;
+		fftMs += sim.Mesh.FftMs;
+		interpolateMs += sim.Mesh.InterpolateMs;
+	}
+	if (steps > 0)
+		printf("%d steps: %.0f ms per step (assign %.0f, FFTs %.0f, interpolate %.0f, kick/drift %.0f), energy drift %.2e, %d grid refits\n",
+			steps, totalMs / steps, assignMs / steps, fftMs / steps, interpolateMs / steps, (totalMs - assignMs - fftMs - interpolateMs) / steps,
+			(sim.Conserved().Energy() - startEnergy) / fabs(startEnergy), sim.Mesh.Refits);
+	return passed ? 0 : 1;
+}
+
+int RunFmmBench(int argc, char** argv)
+{
+	//usage: --fmm-bench [max particles] [--orders 2,4,6,8] [--theta t] [--threads N]
+	size_t maxCount = argc > 2 && argv[2][0] != '-' ? (size_t)atoll(argv[2]) : 100000;
+	vector<int> orders;
+	double theta = FMM_THETA;
+	unsigned int threads = 0;
+	for (int i = 2; i < argc; i++)
+	{
+		if (string(argv[i]) == "--orders" && i + 1 < argc)
+		{
+			stringstream list(argv[i + 1]);
+			string order;
+			while (getline(list, order, ','))
+				if (atoi(order.c_str()) > 0)
+					orders.push_back(atoi(order.c_str()));
+		}
+		if (string(argv[i]) == "--theta" && i + 1 < argc)
+			theta = atof(argv[i + 1]);
+		if (string(argv[i]) == "--threads" && i + 1 < argc)
+			threads = (unsigned int)atoi(argv[i + 1]);
+	}
+	if (orders.empty())
+		orders = { 2, 4, 6, 8 };
+	if (maxCount < 1000)
+		maxCount = 1000;
+
+	printf("uniform cloud, theta %.2f, leaves of %d, %u threads\n", theta, FMM_LEAF_SIZE, ParallelThreads(threads));
+	printf("%9s %5s %10s %10s %8s %10s %10s %9s %12s   (build/up/interact/down ms)\n",
+		"bodies", "order", "fmm ms", "direct ms", "speedup", "rms err", "max err", "M2L", "P2P pairs");
+	for (size_t count = 1000; count <= maxCount; count *= 10)
+	{
+		Simulation sim(0.01, 1.0, 0.01);
+		SetupRandomCluster(sim, (int)count, 1);
+		const Bodies& b = sim.State;
+		const double eps2 = sim.Softening * sim.Softening;
+
+		//exact accelerations for a sample of bodies, and direct summation's time from them
+		size_t samples = count < 1000 ? count : 1000;
+		vector<double> exact(samples * 3);
+		PerfTimer timer;
+		for (size_t s = 0; s < samples; s++)
+		{
+			size_t i = s * (count / samples);
+			double ax = 0.0, ay = 0.0, az = 0.0;
+			for (size_t j = 0; j < count; j++)
+			{
+				double dx = b.x[j] - b.x[i], dy = b.y[j] - b.y[i], dz = b.z[j] - b.z[i];
+				double r2 = dx * dx + dy * dy + dz * dz + eps2;
+				double f = j == i ? 0.0 : sim.G * b.mass[j] / (r2 * sqrt(r2));
+				ax += dx * f; ay += dy * f; az += dz * f;
+			}
+			exact[s * 3] = ax; exact[s * 3 + 1] = ay; exact[s * 3 + 2] = az;
+		}
+		//ComputeForces does each pair once for both bodies
+		double directMs = timer.ElapsedMs() * count / samples / 2.0;
+
+		for (size_t o = 0; o < orders.size(); o++)
+		{
+			sim.Method = FORCE_FMM;
+			sim.Multipole = FastMultipole(orders[o], theta);
+			sim.Multipole.Threads = threads;
+			sim.ComputeForces(); //first call sizes the buffers
+			timer.Restart();
+			sim.ComputeForces();
+			double fmmMs = timer.ElapsedMs();
+			double sum2 = 0.0, worst = 0.0;
+			for (size_t s = 0; s < samples; s++)
+			{
+				size_t i = s * (count / samples);
+				double ex = b.ax[i] - exact[s * 3], ey = b.ay[i] - exact[s * 3 + 1], ez = b.az[i] - exact[s * 3 + 2];
+				double error = sqrt((ex * ex + ey * ey + ez * ez) /
+					(exact[s * 3] * exact[s * 3] + exact[s * 3 + 1] * exact[s * 3 + 1] + exact[s * 3 + 2] * exact[s * 3 + 2]));
+				sum2 += error * error;
+				worst = error > worst ? error : worst;
+			}
+			const FastMultipole& fmm = sim.Multipole;
+			printf("%9zu %5d %10.1f %10.1f %7.1fx %10.2e %10.2e %9zu %12zu   (%.1f/%.1f/%.1f/%.1f)\n",
+				count, fmm.Order, fmmMs, directMs, directMs / (fmmMs > 0.0 ? fmmMs : 1e-3), sqrt(sum2 / samples), worst,
+				fmm.M2LCount, fmm.P2PCount, fmm.BuildMs, fmm.UpwardMs, fmm.InteractMs, fmm.DownwardMs);
+		}
+	}
+	return 0;
+}
+
+int RunBeltBench(int argc, char** argv)
+{
+	//usage: --belt-bench [particles] [steps] [--threads N]
+	size_t count = argc > 2 && argv[2][0] != '-' ? (size_t)atoll(argv[2]) : 10000000;
+	int steps = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 10;
+	unsigned int threads = 0;
+	for (int i = 2; i < argc; i++)
+		if (string(argv[i]) == "--threads" && i + 1 < argc)
+			threads = (unsigned int)atoi(argv[i + 1]);
+
+	//the solar system plus a jupiter outside the belt, so the belt feels three bodies
+	Simulation sim;
+	sim.Threads = threads;
+	SetupSolarSystem(sim);
+	double jupiterSpeed = sqrt(sim.G * sim.State.mass[0] / 12.0);
+	sim.State.Add(0.0, 0.0, 12.0, jupiterSpeed, 0.0, 0.0, 0.05, 0.5);
+	PerfTimer timer;
+	SetupBelt(sim, count, 0, 6.5, 9.0, 1);
+	double setupMs = timer.ElapsedMs();
+	sim.Observe();
+	printf("%zu particles (%.0f MB, set up in %.0f ms) round %zu bodies, %u threads\n", count,
+		count * 6.0 * sizeof(double) / (1024.0 * 1024.0), setupMs, sim.State.Count(), ParallelThreads(threads));
+
+	double totalMs = 0.0;
+	for (int step = 0; step < steps; step++)
+	{
+		timer.Restart();
+		sim.Step();
+		totalMs += timer.ElapsedMs();
+	}
+	if (steps > 0)
+	{
+		double perStep = totalMs / steps;
+		printf("%d steps: %.1f ms per step, %.0f M particle steps/s, %.2f ns per particle-body pull, %.1f steps per 60 Hz frame\n",
+			steps, perStep, count / (perStep * 1e3), perStep * 1e6 / ((double)count * sim.Particles.Sources()),
+			(1000.0 / 60.0) / (perStep > 0.0 ? perStep : 1e-3));
+	}
+
+	//the fast path against the same particles as zero-mass bodies through direct summation: both
+	//are second-order leapfrogs (drift-kick-drift vs kick-drift-kick), so they differ at h^2, not more
+	Simulation fast, full;
+	SetupSolarSystem(fast);
+	fast.State.Add(0.0, 0.0, 12.0, jupiterSpeed, 0.0, 0.0, 0.05, 0.5);
+	full.State = fast.State;
+	SetupBelt(fast, 256, 0, 6.5, 9.0, 2);
+	const TestParticles& p = fast.Particles;
+	for (size_t i = 0; i < p.Count(); i++)
+		full.State.Add(p.x[i], p.y[i], p.z[i], p.vx[i], p.vy[i], p.vz[i], 0.0, 0.0);
+	fast.Observe();
+	full.Observe();
+	const int checkSteps = 5000;
+	for (int step = 0; step < checkSteps; step++)
+	{
+		fast.Step();
+		full.Step();
+	}
+	double worst = 0.0;
+	size_t massive = fast.State.Count();
+	for (size_t i = 0; i < p.Count(); i++)
+	{
+		double dx = p.x[i] - full.State.x[massive + i], dy = p.y[i] - full.State.y[massive + i], dz = p.z[i] - full.State.z[massive + i];
+		double d = sqrt(dx * dx + dy * dy + dz * dz) / sqrt(p.x[i] * p.x[i] + p.y[i] * p.y[i] + p.z[i] * p.z[i]);
+		worst = d > worst ? d : worst;
+	}
+	bool bodiesMatch = fast.State.x[1] == full.State.x[1] && fast.State.z[2] == full.State.z[2];
+	printf("%zu particles over %d steps (t = %.1f) against zero-mass bodies: worst position difference %.2e of orbit radius, massive bodies %s\n",
+		p.Count(), checkSteps, fast.Time, worst, bodiesMatch ? "identical" : "DIFFER");
+	return bodiesMatch && worst < 1e-4 ? 0 : 1;
+}
+
+int RunBroadPhaseBench(int argc, char** argv)
+{
+	//usage: --broad-phase-bench [bodies] [steps] [--threads N]
+	int count = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 100000;
+	int steps = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 100;
+	unsigned int threads = 0;
+	for (int i = 2; i < argc; i++)
+		if (string(argv[i]) == "--threads" && i + 1 < argc)
+			threads = (unsigned int)atoi(argv[i + 1]);
+	if (count < 2)
+		count = 2;
+	if (steps < 1)
+		steps = 1;
+
+	//pairs as a sorted list, to compare methods
+	auto sortedPairs = [](const vector<BroadPair>& pairs)
+	{
+		vector<uint64_t> keys(pairs.size());
+		for (size_t k = 0; k < pairs.size(); k++)
+			keys[k] = ((uint64_t)pairs[k].A << 32) | pairs[k].B;
+		sort(keys.begin(), keys.end());
+		return keys;
+	};
+
+	printf("%d bodies drifting for %d steps, %u threads\n", count, steps, ParallelThreads(threads));
+	printf("%-7s %-6s %9s %9s %9s %11s\n", "scene", "method", "mean ms", "max ms", "pairs", "tests");
+	bool agree = true;
+	const char* sceneNames[2] = { "dense", "sparse" };
+	const double radii[2] = { 0.05, 0.0005 };
+	for (int sceneIndex = 0; sceneIndex < 2; sceneIndex++)
+	{
+		const BroadPhaseMethod methods[3] = { BROAD_SWEEP, BROAD_GRID, BROAD_AUTO };
+		vector<uint64_t> reference;
+		for (int m = 0; m < 3; m++)
+		{
+			Simulation sim;
+			SetupRandomCluster(sim, count, 1);
+			Bodies& b = sim.State;
+			for (int i = 0; i < count; i++)
+				b.radius[i] = radii[sceneIndex];
+			BroadPhase broad(methods[m]);
+			broad.Threads = threads;
+			broad.Find(b); //first call sorts from scratch
+			double totalMs = 0.0, worstMs = 0.0;
+			for (int step = 0; step < steps; step++)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					b.x[i] += b.vx[i] * SIM_TIMESTEP;
+					b.y[i] += b.vy[i] * SIM_TIMESTEP;
+					b.z[i] += b.vz[i] * SIM_TIMESTEP;
+				}
+				broad.Find(b);
+				totalMs += broad.FindMs;
+				worstMs = broad.FindMs > worstMs ? broad.FindMs : worstMs;
+			}
+			printf("%-7s %-6s %9.3f %9.3f %9zu %11zu\n", sceneNames[sceneIndex],
+				methods[m] == BROAD_AUTO ? (broad.Used == BROAD_GRID ? "auto-g" : "auto-s") : methods[m] == BROAD_GRID ? "grid" : "sweep",
+				totalMs / steps, worstMs, broad.Pairs.size(), broad.Tests);
+			vector<uint64_t> keys = sortedPairs(broad.Pairs);
+			if (m == 0)
+			{
+				reference = keys;
+				//every pair against every pair, on a slice small enough to afford it
+				size_t checked = count < 4000 ? (size_t)count : 4000;
+				size_t missing = 0;
+				for (size_t i = 0; i < checked; i++)
+					for (size_t j = i + 1; j < (size_t)count; j++)
+					{
+						double dx = b.x[j] - b.x[i], dy = b.y[j] - b.y[i], dz = b.z[j] - b.z[i];
+						double reach = b.radius[i] + b.radius[j];
+						if (dx * dx + dy * dy + dz * dz < reach * reach && !binary_search(keys.begin(), keys.end(), ((uint64_t)i << 32) | j))
+							missing++;
+					}
+				if (missing > 0)
+				{
+					printf("ERROR::BROAD_PHASE sweep missed %zu overlapping pairs\n", missing);
+					agree = false;
+				}
+			}
+			else if (keys != reference)
+			{
+				printf("ERROR::BROAD_PHASE %s found different pairs to the sweep\n", methods[m] == BROAD_GRID ? "grid" : "auto");
+				agree = false;
+			}
+		}
+	}
+	return agree ? 0 : 1;
+}
+
+int RunCollisionCheck(int argc, char** argv)
+{
+	//usage: --collision-check [bodies] [steps]
+	int count = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 10000;
+	int steps = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 100;
+	bool passed = true;
+
+	//two small bodies head on, no gravity, each step moving them five diameters: checking for
+	//overlap at the steps alone never sees them touch
+	for (int bounce = 0; bounce < 2; bounce++)
+	{
+		Simulation sim(SIM_TIMESTEP, 0.0, SIM_SOFTENING);
+		sim.State.Add(-1.0, 0.0, 0.0, 30.0, 0.0, 0.0, 1.0, 0.05);
+		sim.State.Add(1.0, 0.01, 0.0, -30.0, 0.0, 0.0, 1.0, 0.05);
+		sim.Collisions.Enabled = true;
+		sim.Collisions.Response = bounce ? COLLIDE_BOUNCE : COLLIDE_MERGE;
+		sim.Observe();
+		//first contact: centres 0.1 apart, 0.01 of it sideways
+		double expected = (2.0 - sqrt(0.1 * 0.1 - 0.01 * 0.01)) / 60.0;
+		double px = sim.Conserved().Px;
+		bool sawOverlap = false;
+		const EncounterEvent* event = NULL;
+		EncounterEvent found;
+		for (int step = 0; step < 8; step++)
+		{
+			sim.Step();
+			const Bodies& b = sim.State;
+			double dx = b.x[1] - b.x[0], dy = b.y[1] - b.y[0];
+			if (b.mass[1] > 0.0 && sqrt(dx * dx + dy * dy) < b.radius[0] + b.radius[1])
+				sawOverlap = true;
+			for (size_t k = 0; k < sim.Collisions.Events.size(); k++)
+				if (sim.Collisions.Events[k].Kind != ENCOUNTER_CLOSE && !event)
+				{
+					found = sim.Collisions.Events[k];
+					event = &found;
+				}
+		}
+		const Bodies& b = sim.State;
+		if (!event)
+		{
+			printf("ERROR::COLLISION head-on %s never detected\n", bounce ? "bounce" : "merge");
+			passed = false;
+			continue;
+		}
+		bool ok = fabs(event->Time - expected) < 1e-9 && fabs(sim.Conserved().Px - px) < 1e-12;
+		if (bounce)
+			ok = ok && b.vx[0] < 0.0 && b.vx[1] > 0.0 && b.x[0] < b.x[1];
+		else
+			ok = ok && b.mass[0] == 2.0 && b.mass[1] == 0.0 && fabs(b.vx[0]) < 1e-12 && sim.Collisions.MergedInto[1] == 0;
+		printf("head-on %-6s at t = %.9f (exact %.9f), momentum change %.1e, overlap seen at a step: %s, after: v = %+.3f %+.3f  %s\n",
+			bounce ? "bounce" : "merge", event->Time, expected, sim.Conserved().Px - px, sawOverlap ? "yes" : "no", b.vx[0], b.vx[1],
+			ok ? "ok" : "WRONG");
+		passed = passed && ok;
+	}
+
+	//a fly-by that never touches: closest approach time and distance
+	{
+		Simulation sim(0.05, 0.0, SIM_SOFTENING);
+		sim.State.Add(0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.1);
+		sim.State.Add(-3.0, 0.35, 0.0, 4.0, 0.0, 0.0, 1.0, 0.1);
+		sim.Collisions.Enabled = true;
+		sim.Observe();
+		EncounterEvent e = EncounterEvent();
+		int events = 0;
+		for (int step = 0; step < 40; step++)
+		{
+			sim.Step();
+			for (size_t k = 0; k < sim.Collisions.Events.size(); k++, events++)
+				e = sim.Collisions.Events[k];
+		}
+		bool ok = events == 1 && e.Kind == ENCOUNTER_CLOSE && fabs(e.Time - 0.75) < 1e-9 && fabs(e.Distance - 0.35) < 1e-9;
+		printf("fly-by: %d event, closest at t = %.9f (exact 0.75), %.9f apart (exact 0.35)  %s\n", events, e.Time, e.Distance, ok ? "ok" : "WRONG");
+		passed = passed && ok;
+	}
+
+	//unsoftened, the absorbed body sits exactly on the survivor: nothing may turn NaN
+	{
+		Simulation sim(0.01, 1.0, 0.0);
+		sim.State.Add(-1.0, 0.0, 0.0, 30.0, 0.0, 0.0, 1.0, 0.05);
+		sim.State.Add(1.0, 0.01, 0.0, -30.0, 0.0, 0.0, 1.0, 0.05);
+		sim.State.Add(0.0, 5.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.05);
+		sim.Collisions.Enabled = true;
+		sim.Observe();
+		for (int step = 0; step < 8; step++)
+			sim.Step();
+		const Bodies& b = sim.State;
+		bool finite = std::isfinite(sim.Conserved().Potential);
+		for (size_t i = 0; i < b.Count(); i++)
+			finite = finite && std::isfinite(b.x[i]) && std::isfinite(b.vx[i]) && std::isfinite(b.ax[i]) &&
+				std::isfinite(b.y[i]) && std::isfinite(b.vy[i]) && std::isfinite(b.ay[i]);
+		bool ok = finite && sim.Collisions.Merges == 1;
+		printf("unsoftened merge: %zu merge, positions, velocities, accelerations and potential finite: %s  %s\n",
+			sim.Collisions.Merges, finite ? "yes" : "no", ok ? "ok" : "WRONG");
+		passed = passed && ok;
+	}
+
+	//merges and bounces patch the forces for the bodies they moved, which must match a full pass
+	for (int bounce = 0; bounce < 2; bounce++)
+	{
+		Simulation sim;
+		SetupRandomCluster(sim, 1000, 2);
+		for (size_t i = 0; i < sim.State.Count(); i++)
+			sim.State.radius[i] = 0.4;
+		sim.Collisions.Enabled = true;
+		sim.Collisions.Response = bounce ? COLLIDE_BOUNCE : COLLIDE_MERGE;
+		sim.Observe();
+		double worst = 0.0, worstPotential = 0.0;
+		int patchedSteps = 0;
+		for (int step = 0; step < 40; step++)
+		{
+			sim.Step();
+			if (sim.Collisions.Moved.empty())
+				continue;
+			patchedSteps++;
+			Simulation full = sim;
+			full.ComputeForces();
+			const Bodies& a = sim.State;
+			const Bodies& f = full.State;
+			for (size_t i = 0; i < a.Count(); i++)
+			{
+				double scale = fabs(f.ax[i]) + fabs(f.ay[i]) + fabs(f.az[i]) + 1e-300;
+				double error = (fabs(a.ax[i] - f.ax[i]) + fabs(a.ay[i] - f.ay[i]) + fabs(a.az[i] - f.az[i])) / scale;
+				worst = error > worst ? error : worst;
+			}
+			double error = fabs(sim.Conserved().Potential - full.Conserved().Potential) / fabs(full.Conserved().Potential);
+			worstPotential = error > worstPotential ? error : worstPotential;
+		}
+		bool ok = patchedSteps > 0 && worst < 1e-9 && worstPotential < 1e-12;
+		printf("patched forces after %-7s (%d steps): worst acceleration %.1e, potential %.1e off a full pass  %s\n",
+			bounce ? "bounces" : "merges", patchedSteps, worst, worstPotential, ok ? "ok" : "WRONG");
+		passed = passed && ok;
+	}
+
+	//what it costs on a crowded cluster
+	double plainMs = 0.0, checkedMs = 0.0;
+	size_t merges = 0, closeCalls = 0;
+	for (int checked = 0; checked < 2; checked++)
+	{
+		Simulation sim;
+		SetupRandomCluster(sim, count, 1);
+		sim.Collisions.Enabled = checked == 1;
+		sim.Observe();
+		PerfTimer timer;
+		for (int step = 0; step < steps; step++)
+			sim.Step();
+		(checked ? checkedMs : plainMs) = timer.ElapsedMs() / steps;
+		merges = sim.Collisions.Merges;
+		closeCalls = sim.Collisions.CloseCalls;
+	}
+	printf("%d body cluster, %d steps: %.2f ms per step, %.2f ms with collisions (%zu merges, %zu close encounters)\n",
+		count, steps, plainMs, checkedMs, merges, closeCalls);
+	return passed ? 0 : 1;
+}
+
+int RunEnsemble(int argc, char** argv)
+{
+	//usage: --ensemble [members] [simulated seconds] [velocity spread]
+	int members = argc > 2 ? atoi(argv[2]) : 4096;
+	double duration = argc > 3 ? atof(argv[3]) : 100.0;
+	double spread = argc > 4 ? atof(argv[4]) : 0.05;
+	if (members <= 0 || duration <= 0.0)
+	{
+		cout << "members and duration must be positive" << endl;
+		return 2;
+	}
+
+	//the sun and earth, plus an asteroid on an earth-crossing orbit whose starting velocity
+	//each member scatters by up to spread either way
+	Simulation base;
+	SetupSolarSystem(base);
+	const double asteroidDistance = 3.0;
+	const double asteroidSpeed = sqrt(base.G * base.State.mass[0] / asteroidDistance) * 1.2;
+	base.State.Add(asteroidDistance, 0.0, 0.0, 0.0, 0.1, asteroidSpeed, 1e-4, 0.05);
+
+	Ensemble ensemble;
+	ensemble.EscapeRadius = 50.0;
+	ensemble.WatchA = 1;
+	ensemble.WatchB = 2;
+	ensemble.Resize(members, base.State.Count());
+	unsigned int state = 1;
+	for (int m = 0; m < members; m++)
+	{
+		Bodies member = base.State;
+		//member 0 is the unperturbed orbit
+		double factor = 1.0;
+		if (m > 0)
+		{
+			state = state * 1664525u + 1013904223u;
+			factor += spread * ((state >> 8) / double(1 << 24) * 2.0 - 1.0);
+		}
+		member.vx[2] *= factor; member.vy[2] *= factor; member.vz[2] *= factor;
+		ensemble.Set(m, member);
+	}
+	if (!ensemble.OpenLog("ensemble.csv"))
+		cout << "Couldn't open ensemble.csv, the summary won't be logged" << endl;
+
+	PerfTimer timer;
+	EnsembleSummary end = ensemble.Run(duration);
+	double ensembleMs = timer.ElapsedMs();
+	ensemble.CloseLog();
+
+	//member 0 again as a plain simulation, should be the same leapfrog to rounding
+	Simulation single;
+	single.State = base.State;
+	single.Invalidate();
+	int steps = (int)(duration / single.TimeStep + 0.5);
+	if (ensemble.Outcome[0] != ENSEMBLE_RUNNING)
+		steps = (int)(ensemble.StopTime[0] / single.TimeStep + 0.5);
+	timer.Restart();
+	for (int step = 0; step < steps; step++)
+		single.Step();
+	double singleMs = timer.ElapsedMs();
+	Bodies lane;
+	ensemble.Get(0, lane);
+	double worst = 0.0;
+	for (size_t i = 0; i < lane.Count(); i++)
+	{
+		worst = max(worst, fabs(lane.x[i] - single.State.x[i]));
+		worst = max(worst, fabs(lane.y[i] - single.State.y[i]));
+		worst = max(worst, fabs(lane.z[i] - single.State.z[i]));
+	}
+
+	printf("%d members x %zu bodies, %.0f s at dt %g: %.1f ms (%.2f us per member-step)\n", members, ensemble.BodyCount(),
+		duration, ensemble.TimeStep, ensembleMs, ensembleMs * 1000.0 / ((double)members * (ensemble.Time / ensemble.TimeStep)));
+	printf("one member as a plain Simulation: %.1f ms for %d steps (%.2f us per step), member 0 differs by %.1e\n",
+		singleMs, steps, steps > 0 ? singleMs * 1000.0 / steps : 0.0, worst);
+	printf("at t = %.1f: %zu running, %zu escaped, %zu hit something; energy drift mean %.1e max %.1e; earth-asteroid distance %.3f +- %.3f (min %.3f)\n",
+		end.Time, end.Running, end.Escaped, end.Collided, end.MeanEnergyDrift, end.MaxEnergyDrift,
+		end.MeanSeparation, end.SeparationSpread, end.MinSeparation);
+	return worst < 1e-9 ? 0 : 1;
+}
+
+int RunPararealBench(int argc, char** argv)
+{
+	//usage: --parareal-bench [slices] [simulated seconds] [coarse factor] [kepler|leapfrog]
+	Parareal parareal;
+	if (argc > 2)
+		parareal.Slices = atoi(argv[2]);
+	double duration = argc > 3 ? atof(argv[3]) : 640.0;
+	if (argc > 4)
+		parareal.CoarseFactor = atoi(argv[4]);
+	if (argc > 5 && string(argv[5]) == "leapfrog")
+		parareal.Coarse = PARAREAL_LEAPFROG;
+	if (parareal.Slices <= 0 || parareal.CoarseFactor <= 0 || duration <= 0.0)
+	{
+		cout << "slices, duration and coarse factor must be positive" << endl;
+		return 2;
+	}
+
+	//the sun and nine planets, spaced out and tilted a little so they tug on each other
+	Simulation serial;
+	SetupPlanets(serial, 9);
+	serial.Observe();
+	Simulation parallel;
+	parallel.State = serial.State;
+	parallel.Invalidate();
+	parallel.Observe();
+
+	//the serial fine run over exactly the steps parareal takes
+	int steps = parareal.FineStepsPerSlice(serial, duration) * parareal.Slices;
+	PerfTimer timer;
+	for (int step = 0; step < steps; step++)
+		serial.Step();
+	double serialMs = timer.ElapsedMs();
+
+	timer.Restart();
+	bool converged = parareal.Run(parallel, duration);
+	double pararealMs = timer.ElapsedMs();
+
+	double worst = 0.0, scale = 0.0;
+	for (size_t i = 0; i < serial.State.Count(); i++)
+	{
+		double dx = parallel.State.x[i] - serial.State.x[i], dy = parallel.State.y[i] - serial.State.y[i], dz = parallel.State.z[i] - serial.State.z[i];
+		worst = max(worst, sqrt(dx * dx + dy * dy + dz * dz));
+		scale = max(scale, sqrt(serial.State.x[i] * serial.State.x[i] + serial.State.y[i] * serial.State.y[i] + serial.State.z[i] * serial.State.z[i]));
+	}
+
+	printf("%zu bodies, %.0f s in %d slices of %d steps, %s coarse step x%d, %u hardware threads\n", serial.State.Count(), parallel.Time,
+		parareal.Slices, steps / parareal.Slices, parareal.Coarse == PARAREAL_KEPLER ? "Kepler" : "leapfrog", parareal.CoarseFactor,
+		ParallelThreads(0));
+	printf(" iter      change  exact slices  coarse ms   fine ms  slowest slice ms\n");
+	double projectedMs = 0.0;
+	for (size_t k = 0; k < parareal.Iterations.size(); k++)
+	{
+		const PararealIteration& it = parareal.Iterations[k];
+		printf("%5zu  %10.2e  %12d  %9.2f  %8.2f  %16.2f\n", k + 1, it.Change, it.Converged, it.CoarseMs, it.FineMs, it.SliceMs);
+		projectedMs += it.CoarseMs + it.SliceMs;
+	}
+	printf("%s after %zu iterations, final positions %.1e from the serial run (relative)\n", converged ? "converged" : "NOT converged",
+		parareal.Iterations.size(), scale > 0.0 ? worst / scale : worst);
+	printf("serial %.1f ms, parareal %.1f ms here (%.2fx); with a core per slice %.1f ms, %.2fx (at most %.1fx for %zu iterations)\n",
+		serialMs, pararealMs, serialMs / pararealMs, projectedMs, serialMs / projectedMs,
+		(double)parareal.Slices / parareal.Iterations.size(), parareal.Iterations.size());
+	return converged ? 0 : 1;
+}
+
+int RunEnckeBench(int argc, char** argv)
+{
+	//usage: --encke-bench [asteroids] [simulated seconds]
+	size_t count = argc > 2 ? (size_t)atoll(argv[2]) : 2000;
+	double duration = argc > 3 ? atof(argv[3]) : 200.0;
+	if (count == 0 || duration <= 0.0)
+	{
+		cout << "asteroids and duration must be positive" << endl;
+		return 2;
+	}
+
+	//an asteroid belt inside the first orbit, the planets always stepped at the normal
+	//timestep and the asteroids every k of those steps
+	Simulation planets;
+	SetupPlanets(planets, 9);
+	SetupBelt(planets, count, 0, 2.5, 3.2, 1);
+	const TestParticles start = planets.Particles;
+	planets.Particles.Clear();
+	const double dt = planets.TimeStep;
+	const int steps = (int)(duration / dt + 0.5);
+
+	//one run: positions at the end, and how long the asteroids took
+	auto run = [&](bool encke, int k, vector<double>& out, double& ms, size_t& rectified)
+	{
+		Simulation sim;
+		sim.State = planets.State;
+		sim.Invalidate();
+		TestParticles cowell = start;
+		EnckeParticles minor;
+		if (encke)
+			for (size_t i = 0; i < start.Count(); i++)
+			{
+				double p[3] = { start.x[i], start.y[i], start.z[i] }, v[3] = { start.vx[i], start.vy[i], start.vz[i] };
+				minor.Add(sim.State, p, v);
+			}
+		//what Step expects: positions at t and velocities that take them to t + k dt
+		Bodies feed;
+		double particleMs = 0.0;
+		PerfTimer timer;
+		for (int step = 0; step + k <= steps; step += k)
+		{
+			feed = sim.State;
+			for (int s = 0; s < k; s++)
+				sim.Step();
+			const double h = k * dt;
+			for (size_t j = 0; j < feed.Count(); j++)
+			{
+				feed.vx[j] = (sim.State.x[j] - feed.x[j]) / h;
+				feed.vy[j] = (sim.State.y[j] - feed.y[j]) / h;
+				feed.vz[j] = (sim.State.z[j] - feed.z[j]) / h;
+			}
+			timer.Restart();
+			if (encke)
+				minor.Step(feed, sim.G, sim.Softening, h, sim.Threads);
+			else
+				cowell.Step(feed, sim.G, sim.Softening, h, sim.Threads);
+			particleMs += timer.ElapsedMs();
+		}
+		out.resize(count * 3);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (encke)
+			{
+				double v[3];
+				minor.Get(i, &out[i * 3], v);
+			}
+			else
+			{
+				out[i * 3] = cowell.x[i]; out[i * 3 + 1] = cowell.y[i]; out[i * 3 + 2] = cowell.z[i];
+			}
+		}
+		ms = particleMs;
+		rectified = minor.TotalRectified;
+	};
+	//median position difference, a handful of asteroids meeting planets diverge whatever the integrator
+	auto error = [count](const vector<double>& a, const vector<double>& b)
+	{
+		vector<double> errors(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			double dx = a[i * 3] - b[i * 3], dy = a[i * 3 + 1] - b[i * 3 + 1], dz = a[i * 3 + 2] - b[i * 3 + 2];
+			errors[i] = sqrt(dx * dx + dy * dy + dz * dz);
+		}
+		nth_element(errors.begin(), errors.begin() + count / 2, errors.end());
+		return errors[count / 2];
+	};
+
+	//reference: Encke at every step, checked against Cowell at every step
+	vector<double> reference, cowellFine;
+	double ms;
+	size_t rectified;
+	run(true, 1, reference, ms, rectified);
+	run(false, 1, cowellFine, ms, rectified);
+	printf("%zu asteroids under %zu planets for %.0f s, planets at dt %g; Encke and Cowell at dt agree to %.1e\n",
+		count, planets.State.Count() - 1, steps * dt, dt, error(reference, cowellFine));
+	printf("   k   step  Cowell error  Cowell ms  Encke error  Encke ms  rectified\n");
+	double cowellBaseError = 0.0, cowellBaseMs = 0.0;
+	double matchMs = 0.0;
+	int matchK = 0;
+	const int ks[] = { 1, 2, 4, 8, 16, 32, 64 };
+	for (size_t n = 0; n < sizeof(ks) / sizeof(ks[0]); n++)
+	{
+		vector<double> cowellOut, enckeOut;
+		double cowellMs, enckeMs;
+		run(false, ks[n], cowellOut, cowellMs, rectified);
+		run(true, ks[n], enckeOut, enckeMs, rectified);
+		double cowellError = error(cowellOut, ks[n] == 1 ? cowellFine : reference);
+		double enckeError = error(enckeOut, reference);
+		if (ks[n] == 1)
+		{
+			//Cowell at the normal step is what Encke has to match
+			cowellBaseError = error(cowellFine, reference);
+			cowellError = cowellBaseError;
+			cowellBaseMs = cowellMs;
+		}
+		else if (enckeError <= cowellBaseError)
+		{
+			matchMs = enckeMs;
+			matchK = ks[n];
+		}
+		printf("%4d  %5.3f  %12.2e  %9.1f  %11.2e  %8.1f  %9zu\n", ks[n], ks[n] * dt, cowellError, cowellMs,
+			ks[n] == 1 ? 0.0 : enckeError, enckeMs, rectified);
+	}
+	if (matchK > 0)
+		printf("Encke at %dx the step is as accurate as Cowell at the normal step and %.1fx faster (%.1f ms against %.1f)\n",
+			matchK, cowellBaseMs / matchMs, matchMs, cowellBaseMs);
+	else
+		printf("Encke never got as accurate as Cowell at the normal step with a longer step\n");
+	return matchK > 0 ? 0 : 1;
+}
+
+int RunKsCheck(int argc, char** argv)
+{
+	//usage: --ks-check [planets] [simulated seconds]
+	int planets = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 9;
+	double duration = argc > 3 && argv[3][0] != '-' ? atof(argv[3]) : 10.0;
+	if (planets < 2 || duration <= 0.0)
+	{
+		cout << "planets must be at least 2 and duration positive" << endl;
+		return 2;
+	}
+	bool passed = true;
+
+	//the KS drift against the universal-variable one, over every kind of conic and a long drift
+	{
+		const double orbits[4][6] = {
+			{ 1.0, 0.0, 0.0, 0.0, 0.7, 0.1 },
+			{ 1.0, 0.2, -0.1, 0.3, 1.6, 0.0 },
+			{ 0.5, 0.5, 0.0, -0.5, 1.0, 0.2 },
+			{ -0.3, 0.8, 0.2, 0.9, 0.1, -0.4 } };
+		const double times[3] = { 0.01, 2.7, 1000.3 };
+		double worst = 0.0;
+		for (int o = 0; o < 4; o++)
+			for (int t = 0; t < 3; t++)
+			{
+				double q[3] = { orbits[o][0], orbits[o][1], orbits[o][2] }, v[3] = { orbits[o][3], orbits[o][4], orbits[o][5] };
+				double r[3] = { q[0], q[1], q[2] }, w[3] = { v[0], v[1], v[2] };
+				if (!KsDrift(1.0, q, v, times[t]) || !KeplerDrift(1.0, r, w, times[t]))
+				{
+					printf("ERROR::KS drift %d over %g didn't converge\n", o, times[t]);
+					passed = false;
+					continue;
+				}
+				double scale = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+				for (int k = 0; k < 3; k++)
+					worst = max(worst, fabs(q[k] - r[k]) / scale);
+			}
+		//drop from rest, where Kepler's drift can't go: through the collision at half a period and
+		//back out the same way, so three quarters of a period mirrors one quarter
+		const double period = FFT_PI / sqrt(2.0);
+		double q[3][3], v[3][3];
+		const double fractions[3] = { 0.25, 0.5, 0.75 };
+		bool ok = worst < 1e-9;
+		for (int k = 0; k < 3; k++)
+		{
+			q[k][0] = 1.0; q[k][1] = 0.0; q[k][2] = 0.0;
+			v[k][0] = 0.0; v[k][1] = 0.0; v[k][2] = 0.0;
+			ok = KsDrift(1.0, q[k], v[k], fractions[k] * period) && ok;
+		}
+		double mirror = fabs(q[2][0] - q[0][0]) + fabs(v[2][0] + v[0][0]);
+		ok = ok && fabs(q[1][0]) < 1e-9 && mirror < 1e-9;
+		printf("KS drift against Kepler's: worst relative difference %.1e; radial drop reaches r = %.1e at half a period, comes back out %.1e off the mirror  %s\n",
+			worst, fabs(q[1][0]), mirror, ok ? "ok" : "WRONG");
+		passed = passed && ok;
+	}
+
+	//an e = 0.9 binary whose period is under one step, unsoftened: the leapfrog has nothing to
+	//work with, the regularized pair follows Kepler exactly
+	{
+		const double a = 0.01, e = 0.9;
+		const double apo = a * (1.0 + e), speed = sqrt(1.0 / a * (1.0 - e) / (1.0 + e));
+		double error[2] = { 0.0, 0.0 }, position = 0.0;
+		for (int regularized = 0; regularized < 2; regularized++)
+		{
+			Simulation sim(SIM_TIMESTEP, 1.0, 0.0);
+			sim.State.Add(-0.5 * apo, 0.0, 0.0, 0.3, -0.5 * speed, 0.0, 0.5, 0.001);
+			sim.State.Add(0.5 * apo, 0.0, 0.0, 0.3, 0.5 * speed, 0.0, 0.5, 0.001);
+			sim.Binaries.Enabled = regularized == 1;
+			sim.Observe();
+			const double energy = sim.Conserved().Energy();
+			const int steps = (int)(duration / sim.TimeStep);
+			for (int step = 0; step < steps; step++)
+				sim.Step();
+			error[regularized] = fabs(sim.Conserved().Energy() / energy - 1.0);
+			if (regularized)
+			{
+				double q[3] = { apo, 0.0, 0.0 }, v[3] = { 0.0, speed, 0.0 };
+				KeplerDrift(1.0, q, v, sim.Time);
+				const Bodies& b = sim.State;
+				position = fabs(b.x[1] - b.x[0] - q[0]) + fabs(b.y[1] - b.y[0] - q[1]) + fabs(b.z[1] - b.z[0] - q[2]);
+				position /= a;
+			}
+		}
+		const double period = 2.0 * FFT_PI * a * sqrt(a);
+		bool ok = error[1] < 1e-9 && position < 1e-6;
+		printf("e = %.1f binary, period %.2f steps, %.0f orbits: energy error %.1e plain, %.1e regularized, separation off Kepler's by %.1e of a  %s\n",
+			e, period / SIM_TIMESTEP, duration / period, error[0], error[1], position, ok ? "ok" : "WRONG");
+		passed = passed && ok;
+	}
+
+	//the planets each split into a hard, eccentric binary under the sun's tides, unsoftened:
+	//regularized at the normal step against the plain leapfrog at the normal step and at one
+	//small enough for the binaries
+	const int fine = 256;
+	double ms[3], error[3];
+	size_t formed = 0, dissolved = 0, pairs = 0;
+	for (int run = 0; run < 3; run++)
+	{
+		Simulation sim(run == 2 ? SIM_TIMESTEP / fine : SIM_TIMESTEP, SIM_G, 0.0);
+		SetupPlanets(sim, planets);
+		Bodies& b = sim.State;
+		for (int p = 1; p < planets; p++)
+		{
+			//a = 0.01, e = 0.7, started at apocentre in a plane of its own
+			const size_t i = (size_t)p + 1;
+			const double m = 0.5 * b.mass[i], a = 0.01, e = 0.7;
+			const double apo = a * (1.0 + e), speed = sqrt(sim.G * 2.0 * m / a * (1.0 - e) / (1.0 + e));
+			const double phi = 1.1 * p, tilt = 0.4 * p;
+			const double d[3] = { cos(phi), 0.0, sin(phi) };
+			const double w[3] = { -sin(phi) * cos(tilt), sin(tilt), cos(phi) * cos(tilt) };
+			const double x[3] = { b.x[i], b.y[i], b.z[i] }, v[3] = { b.vx[i], b.vy[i], b.vz[i] };
+			b.mass[i] = m;
+			b.x[i] = x[0] - 0.5 * apo * d[0]; b.y[i] = x[1] - 0.5 * apo * d[1]; b.z[i] = x[2] - 0.5 * apo * d[2];
+			b.vx[i] = v[0] - 0.5 * speed * w[0]; b.vy[i] = v[1] - 0.5 * speed * w[1]; b.vz[i] = v[2] - 0.5 * speed * w[2];
+			sim.State.Add(x[0] + 0.5 * apo * d[0], x[1] + 0.5 * apo * d[1], x[2] + 0.5 * apo * d[2],
+				v[0] + 0.5 * speed * w[0], v[1] + 0.5 * speed * w[1], v[2] + 0.5 * speed * w[2], m, 0.001);
+		}
+		sim.Invalidate();
+		sim.Binaries.Enabled = run == 1;
+		sim.Observe();
+		const double energy = sim.Conserved().Energy();
+		const int steps = (int)(duration / sim.TimeStep + 0.5);
+		PerfTimer timer;
+		for (int step = 0; step < steps; step++)
+			sim.Step();
+		ms[run] = timer.ElapsedMs() / (duration / SIM_TIMESTEP);
+		error[run] = fabs(sim.Conserved().Energy() / energy - 1.0);
+		if (run == 1)
+		{
+			formed = sim.Binaries.Formed;
+			dissolved = sim.Binaries.Dissolved;
+			pairs = sim.Binaries.Pairs.size();
+			if (sim.Binaries.Failures)
+			{
+				printf("ERROR::KS %zu drifts failed to converge\n", sim.Binaries.Failures);
+				passed = false;
+			}
+		}
+	}
+	bool ok = error[1] < 1e-6 && pairs == (size_t)planets - 1;
+	printf("%d binary planets, %.0f s unsoftened (%zu pairs formed, %zu dissolved, %zu at the end):\n", planets - 1, duration, formed, dissolved, pairs);
+	printf("  plain leapfrog, normal step: energy error %.1e, %.3f ms per normal step\n", error[0], ms[0]);
+	printf("  regularized, normal step:    energy error %.1e, %.3f ms per normal step  %s\n", error[1], ms[1], ok ? "ok" : "WRONG");
+	printf("  plain leapfrog, step / %-4d: energy error %.1e, %.3f ms per normal step\n", fine, error[2], ms[2]);
+	passed = passed && ok;
+	return passed ? 0 : 1;
+}
+
+int RunEventBench(int argc, char** argv)
+{
+	//usage: --event-bench [bodies] [steps]
+	int count = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 2000;
+	int steps = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 20;
+	if (count < 2 || steps < 1)
+	{
+		cout << "bodies must be at least 2 and steps positive" << endl;
+		return 2;
+	}
+	bool passed = true;
+
+	//near-massless bodies about the sun, so every event time is known in closed form: a planet
+	//and an outer body on circles (conjunction, and the outer body through the planet's shadow),
+	//an e = 0.6 orbit started at apoapsis, and a body dropped onto the sun's surface. Refined
+	//times carry the leapfrog's own O(dt^2) error in the orbits, so they're run at a quarter step too
+	for (int pass = 0; pass < 2; pass++)
+	{
+		Simulation sim(SIM_TIMESTEP / (pass ? 4.0 : 1.0), SIM_G, 0.0);
+		SetupSolarSystem(sim);
+		Bodies& b = sim.State;
+		const double sun = b.mass[0], gm = sim.G * sun;
+		b.vz[0] = 0.0;
+		b.mass[1] = 1e-12;
+		const double inner = 5.0, outer = 7.0, start = 1.0;
+		const double wInner = sqrt(gm / (inner * inner * inner)), wOuter = sqrt(gm / (outer * outer * outer));
+		b.x[1] = inner; b.y[1] = 0.0; b.z[1] = 0.0;
+		b.vx[1] = 0.0; b.vy[1] = 0.0; b.vz[1] = wInner * inner;
+		sim.State.Add(outer * cos(start), 0.0, outer * sin(start), -wOuter * outer * sin(start), 0.0, wOuter * outer * cos(start), 1e-12, 0.1);
+		const double a = 3.0, e = 0.6, apo = a * (1.0 + e);
+		sim.State.Add(-apo, 0.0, 0.0, 0.0, 0.0, -sqrt(gm / a * (1.0 - e) / (1.0 + e)), 1e-12, 0.1);
+		const double drop = 5.0;
+		sim.State.Add(0.0, 0.0, -drop, 0.0, 0.0, 0.0, 1e-12, 0.1);
+		sim.Invalidate();
+		const double normal[3] = { 0.0, 1.0, 0.0 };
+		const std::vector<uint32_t> outerBody(1, 2), eccentric(1, 3), dropped(1, 4);
+		sim.Events.AddConjunction(0, 1, normal, outerBody);
+		sim.Events.AddEclipse(0, 1, outerBody);
+		sim.Events.AddPeriapsis(0, eccentric);
+		sim.Events.AddApoapsis(0, eccentric);
+		sim.Events.AddSurface(0, 0.0, dropped);
+		sim.Observe();
+
+		//closed forms: the outer body falls behind the planet at wInner - wOuter, its shadow is
+		//asin(radius / outer) either side; half and whole periods; and the free fall time to R
+		const double lag = wInner - wOuter, shadow = asin(b.radius[1] / outer);
+		const double period = 2.0 * FFT_PI * sqrt(a * a * a / gm);
+		const double x = b.radius[0] / drop;
+		const double fall = sqrt(drop * drop * drop / (2.0 * gm)) * (sqrt(x * (1.0 - x)) + acos(sqrt(x)));
+		const char* names[6] = { "conjunction", "eclipse in", "eclipse out", "periapsis", "apoapsis", "surface" };
+		const double exact[6] = { start / lag, (start - shadow) / lag, (start + shadow) / lag, 0.5 * period, period, fall };
+		double found[6] = { -1.0, -1.0, -1.0, -1.0, -1.0, -1.0 }, sampled[6] = { -1.0, -1.0, -1.0, -1.0, -1.0, -1.0 };
+		const int total = (int)(1.05 * period / sim.TimeStep);
+		for (int step = 0; step < total; step++)
+		{
+			sim.Step();
+			for (size_t k = 0; k < sim.Events.Hits.size(); k++)
+			{
+				const EventHit& hit = sim.Events.Hits[k];
+				int which = hit.Event == 0 ? 0 : hit.Event == 1 ? (hit.Rising ? 2 : 1) : (int)hit.Event + 1;
+				//the first one of each, and where a check once per step (or frame) would have put it
+				if (found[which] < 0.0)
+				{
+					found[which] = hit.Time;
+					sampled[which] = sim.Time;
+				}
+			}
+		}
+		printf("step %g:\n%-12s %12s %12s %12s %12s\n", sim.TimeStep, "event", "exact", "refined", "error", "per step");
+		for (int k = 0; k < 6; k++)
+		{
+			//a check once per step is off by up to a step, refined ones by the orbit's own error
+			bool ok = found[k] >= 0.0 && fabs(found[k] - exact[k]) < 0.02 * sim.TimeStep;
+			printf("%-12s %12.6f %12.6f %12.1e %12.1e  %s\n", names[k], exact[k], found[k], found[k] - exact[k], sampled[k] - exact[k], ok ? "ok" : "WRONG");
+			passed = passed && ok;
+		}
+	}
+
+	//what the checks cost: periapsis, apoapsis and a surface on every body of a cluster
+	{
+		double ms[2];
+		size_t hits = 0;
+		for (int checked = 0; checked < 2; checked++)
+		{
+			Simulation sim;
+			SetupRandomCluster(sim, count, 1);
+			if (checked)
+			{
+				sim.Events.AddPeriapsis(0);
+				sim.Events.AddApoapsis(0);
+				sim.Events.AddSurface(0, 1.0);
+			}
+			sim.Observe();
+			PerfTimer timer;
+			for (int step = 0; step < steps; step++)
+			{
+				sim.Step();
+				hits += sim.Events.Hits.size();
+			}
+			ms[checked] = timer.ElapsedMs() / steps;
+		}
+		//and the checks alone, on a state where nothing crosses
+		Simulation still;
+		SetupRandomCluster(still, count, 1);
+		still.Events.AddPeriapsis(0);
+		still.Events.AddApoapsis(0);
+		still.Events.AddSurface(0, 1.0);
+		still.Observe();
+		still.Events.Begin(still.State, 0.0);
+		PerfTimer timer;
+		const int repeats = 200;
+		for (int k = 0; k < repeats; k++)
+			still.Events.Check(still.State, 0.0, still.TimeStep);
+		double checkNs = timer.ElapsedMs() * 1e6 / (repeats * 3.0 * (count - 1));
+		printf("%d body cluster, 3 events on every body: %.2f ms per step, %.2f ms with events (%+.1f%%, %zu hits), %.1f ns per target check\n",
+			count, ms[0], ms[1], 100.0 * (ms[1] / ms[0] - 1.0), hits, checkNs);
+	}
+	return passed ? 0 : 1;
+}
+
+int RunRenderFrames(int argc, char** argv)
+{
+	//usage: --render-frames [dir] [frames] [--size WxH] [--fps N] [--threads N] [--raw] [--scene file] [--context egl|osmesa]
+	const char* dir = argc > 2 && argv[2][0] != '-' ? argv[2] : "frames";
+	int frames = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 600;
+	int width = 1280, height = 720;
+	float fps = 60.0f;
+	int threads = (int)thread::hardware_concurrency() - 1;
+	FrameFormat format = FRAME_PNG;
+	const char* scenePath = SCENE_DEFAULT_NAME;
+	const char* contextApi = NULL;
+	for (int i = 2; i < argc; i++)
+	{
+		if (string(argv[i]) == "--size" && i + 1 < argc)
+			sscanf(argv[i + 1], "%dx%d", &width, &height);
+		if (string(argv[i]) == "--fps" && i + 1 < argc)
+			fps = (float)atof(argv[i + 1]);
+		if (string(argv[i]) == "--threads" && i + 1 < argc)
+			threads = atoi(argv[i + 1]);
+		if (string(argv[i]) == "--raw")
+			format = FRAME_RAW;
+		if (string(argv[i]) == "--scene" && i + 1 < argc)
+			scenePath = argv[i + 1];
+		if (string(argv[i]) == "--context" && i + 1 < argc)
+			contextApi = argv[i + 1];
+	}
+	if (frames < 1 || width < 1 || height < 1 || fps <= 0.0f)
+	{
+		cout << "Nothing to render (" << frames << " frames at " << width << "x" << height << ", " << fps << " fps)" << endl;
+		return 2;
+	}
+	if (threads < 1)
+		threads = 1;
+
+	assets.OpenDefault();
+	if (!LoadScene(scenePath))
+		return 1;
+	scene.Populate(simulation);
+	simulation.Observe();
+	conservation.Reset(simulation.Conserved(), simulation.Time);
+
+	if (!OffscreenInit(contextApi))
+		return 1;
+	OffscreenTarget target;
+	if (!target.Create(width, height))
+	{
+		OffscreenRelease();
+		return 1;
+	}
+	UploadScene();
+	FrameEncoder encoder;
+	if (!encoder.Open(dir, width, height, format, threads))
+	{
+		ReleaseScene();
+		target.Destroy();
+		OffscreenRelease();
+		return 1;
+	}
+	viewAspect = (float)width / height;
+	cout << "Rendering " << frames << " frames at " << width << "x" << height << " (" << (const char*)glGetString(GL_RENDERER) << ") into "
+		<< dir << " on " << threads << " encoder threads" << endl;
+
+	//frames come out of the PBO ring a few behind the one being drawn, copied straight into an encoder buffer
+	auto consume = [&encoder](const unsigned char* pixels, long long frame)
+	{
+		unsigned char* buffer = encoder.Acquire();
+		memcpy(buffer, pixels, encoder.FrameBytes());
+		encoder.Submit(buffer, frame);
+	};
+
+	//fixed steps rather than the wall clock, so a sequence comes out the same however long it takes
+	const float frameStep = 1.0f / fps;
+	double renderMs = 0.0;
+	PerfTimer total;
+	for (int i = 0; i < frames; i++)
+	{
+		PerfTimer timer;
+		SceneFrame frame;
+		UpdateFrame((i + 1) * frameStep, frameStep, ZOOM, frame);
+		target.Bind();
+		glClearColor(0.1255f, 0.1412f, 0.1608f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		DrawScene(frame);
+		renderMs += timer.ElapsedMs();
+		target.Capture(consume);
+	}
+	target.Flush(consume);
+	double renderedMs = total.ElapsedMs();
+	encoder.Close();
+	double totalMs = total.ElapsedMs();
+
+	ReleaseScene();
+	target.Destroy();
+	OffscreenRelease();
+
+	//whatever the render loop spent waiting on is what's holding it back
+	double stallMs = target.StallMs;
+	double waitMs = encoder.WaitMs();
+	const char* bound = waitMs > 0.1 * renderedMs ? "encoding" : stallMs > 0.1 * renderedMs ? "readback" : "rendering";
+	printf("%lld/%d frames written (%lld failed), %.1f MB, %.1f fps overall (%.1f ms to render, %.1f ms more to finish encoding)\n",
+		encoder.Written(), frames, encoder.Failed(), encoder.BytesOut() / (1024.0 * 1024.0), frames * 1000.0 / totalMs, renderedMs, totalMs - renderedMs);
+	printf("per frame: draw %.2f ms, readback stall %.2f ms, encoder wait %.2f ms, encode %.2f ms (x%d threads) -> bound by %s\n",
+		renderMs / frames, stallMs / frames, waitMs / frames, encoder.EncodeMs() / frames, threads, bound);
+	return encoder.Failed() > 0 ? 1 : 0;
+}
+
+bool LoadScene(const char* path)
+{
+	PerfTimer timer;
+	if (!scene.Load(path, &assets))
+		return false;
+	PrepareObjectModels();
+	lightPos = glm::vec3(scene.Light.Position[0], scene.Light.Position[1], scene.Light.Position[2]);
+	lightColour = glm::vec3(scene.Light.Colour[0], scene.Light.Colour[1], scene.Light.Colour[2]);
+	printf("Scene %s: %zu bodies, %zu objects, %zu meshes (%zu vertices) in %.2f ms\n",
+		path, scene.Bodies.size(), scene.Objects.size(), scene.Meshes.size(), scene.VertexCount(), timer.ElapsedMs());
+	return true;
+}
+
+void UploadScene()
+{
+	//one VAO and one VBO hold every mesh, each object draws its own range of vertices
+	glGenVertexArrays(1, &sceneVAO);
+	glBindVertexArray(sceneVAO);
+	glGenBuffers(1, &sceneVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, sceneVBO);
+	size_t vertexBytes = scene.Vertices.size() * sizeof(float);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, scene.Vertices.empty() ? NULL : scene.Vertices.data(), GL_STATIC_DRAW);
+	GpuMemory::Get().RegisterBuffer(sceneVBO, vertexBytes, GL_STATIC_DRAW, "scene");
+
+	//xyz to location = 0
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, SCENE_VERTEX_FLOATS * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	//texture coordinates to location = 1
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, SCENE_VERTEX_FLOATS * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+
+	//unbind stuff
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	sceneTextures.assign(scene.Textures.size(), 0);
+	if (!sceneTextures.empty())
+		glGenTextures((GLsizei)sceneTextures.size(), sceneTextures.data());
+	for (size_t k = 0; k < scene.Textures.size(); k++)
+	{
+		glBindTexture(GL_TEXTURE_2D, sceneTextures[k]);
+		//set wrapping options(repeat texture if texture coordinates dont fully cover polygons)
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);//wraps on the s(x) axis
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);//wraps on the t(y) axis
+		//set filtering options
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);//GL_LINEAR(bilinear) or GL_NEAREST for shrinking
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);//for stretching
+		LoadUpImage(scene.Text(scene.Textures[k].Path), sceneTextures[k], scene.Text(scene.Textures[k].Owner));
+	}
+
+	sceneShaders.clear();
+	sceneShaders.reserve(scene.Shaders.size());
+	for (size_t k = 0; k < scene.Shaders.size(); k++)
+		sceneShaders.push_back(Shader(scene.Text(scene.Shaders[k].Vertex), scene.Text(scene.Shaders[k].Fragment), &assets));
+
+	//particles are bare xyz points in their own VAO, sized here for the belt the scene starts with
+	particleShader = -1;
+	for (size_t k = 0; k < scene.Shaders.size(); k++)
+		if (string(scene.Text(scene.Shaders[k].Name)) == "lamp")
+			particleShader = (int)k;
+	if (simulation.Particles.Count() > 0 && particleShader < 0)
+		cout << "ERROR::PARTICLES the scene has no lamp shader, belt particles won't be drawn" << endl;
+	glGenVertexArrays(1, &particleVAO);
+	glBindVertexArray(particleVAO);
+	glGenBuffers(1, &particleVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	particleCapacity = 0;
+	particlePoints.clear();
+	ReserveParticles(simulation.Particles.Count());
+}
+
+void ReserveParticles(size_t count)
+{
+	if (count <= particleCapacity)
+		return;
+	particleCapacity = count;
+	particlePoints.reserve(count * 3);
+	glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
+	glBufferData(GL_ARRAY_BUFFER, particleCapacity * 3 * sizeof(float), NULL, GL_STREAM_DRAW);
+	GpuMemory::Get().RegisterBuffer(particleVBO, particleCapacity * 3 * sizeof(float), GL_STREAM_DRAW, "particles");
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DrawScene(const SceneFrame& frame)
+{
+	//objects come sorted by shader then texture, so programs and textures only change between groups
+	glBindVertexArray(sceneVAO);
+	glActiveTexture(GL_TEXTURE0);
+	uint32_t shader = SCENE_NONE;
+	uint32_t material = SCENE_NONE;
+	for (size_t k = 0; k < scene.Objects.size(); k++)
+	{
+		const SceneObject& object = scene.Objects[k];
+		if ((object.Flags & SCENE_HUD) && isHideText)
+			continue;
+		if (object.Material != material)
+		{
+			material = object.Material;
+			const SceneMaterial& m = scene.Materials[material];
+			if (m.Shader != shader)
+			{
+				shader = m.Shader;
+				Shader& program = sceneShaders[shader];
+				program.use();
+				program.setMat4("view", frame.view);
+				program.setMat4("projection", frame.projection);
+				program.setVec3("lightColour", lightColour);
+				program.setVec3("lightPos", lightPos);
+				program.setVec3("viewPos", camera.Position);
+				//tell the texture uniform which texture slot to use
+				program.setInt("texture1", 0);//GL_TEXTURE0
+			}
+			sceneShaders[shader].setVec3("objectColour", m.Colour[0], m.Colour[1], m.Colour[2]);
+			glBindTexture(GL_TEXTURE_2D, m.Texture != SCENE_NONE ? sceneTextures[m.Texture] : 0);
+		}
+		const SceneMesh& mesh = scene.Meshes[object.Mesh];
+		sceneShaders[shader].setMat4("model", objectModels[k]);
+		glDrawArrays(GL_TRIANGLES, mesh.FirstVertex, mesh.VertexCount);
+	}
+	glBindVertexArray(0);
+
+	//massless particles: one point each, in one draw
+	const TestParticles& particles = simulation.Particles;
+	const size_t count = particles.Count();
+	if (count == 0 || particleShader < 0)
+		return;
+	if (count > particleCapacity)
+	{
+		ColdRegion cold;//only when particles were added after UploadScene
+		ReserveParticles(count);
+	}
+	particlePoints.resize(count * 3);
+	float* points = particlePoints.data();
+	ParallelFor(count, count < TEST_PARTICLE_PARALLEL ? 1 : ParallelThreads(simulation.Threads), [&particles, points](size_t begin, size_t end, unsigned int)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			points[i * 3] = (float)particles.x[i];
+			points[i * 3 + 1] = (float)particles.y[i];
+			points[i * 3 + 2] = (float)particles.z[i];
+		}
+	});
+	glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * 3 * sizeof(float), points);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	Shader& program = sceneShaders[particleShader];
+	program.use();
+	program.setMat4("view", frame.view);
+	program.setMat4("projection", frame.projection);
+	program.setMat4("model", glm::mat4(1.0f));
+	//the lamp shader draws flat lightColour
+	program.setVec3("lightColour", particleColour);
+	glBindVertexArray(particleVAO);
+	glDrawArrays(GL_POINTS, 0, (GLsizei)count);
+	glBindVertexArray(0);
+}
+
+void ReleaseScene()
+{
+	if (!sceneTextures.empty())
+		glDeleteTextures((GLsizei)sceneTextures.size(), sceneTextures.data());
+	for (size_t k = 0; k < sceneTextures.size(); k++)
+		GpuMemory::Get().Release(GPU_TEXTURE, sceneTextures[k]);
+	glDeleteBuffers(1, &sceneVBO);
+	GpuMemory::Get().Release(GPU_BUFFER, sceneVBO);
+	glDeleteVertexArrays(1, &sceneVAO);
+	glDeleteBuffers(1, &particleVBO);
+	GpuMemory::Get().Release(GPU_BUFFER, particleVBO);
+	glDeleteVertexArrays(1, &particleVAO);
+	particleCapacity = 0;
+	for (size_t k = 0; k < sceneShaders.size(); k++)
+	{
+		glDeleteProgram(sceneShaders[k].ID);
+		GpuMemory::Get().Release(GPU_PROGRAM, sceneShaders[k].ID);
+	}
+	sceneTextures.clear();
+	sceneShaders.clear();
+}
+
+int RunStateWatch(int argc, char** argv)
+{
+	//usage: --state-watch [states to print, 0 = forever] [--bodies N]
+	//only uses StateShare.h, the same as an outside tool would
+	long long count = 0;
+	uint32_t shown = 3;
+	for (int i = 2; i < argc; i++)
+	{
+		if (string(argv[i]) == "--bodies" && i + 1 < argc)
+			shown = (uint32_t)atoi(argv[++i]);
+		else
+			count = atoll(argv[i]);
+	}
+
+	StateShareReader reader;
+	if (!StateShareAttach(&reader, NULL))
+	{
+		fprintf(stderr, "No shared state found, is the simulator running?\n");
+		return 2;
+	}
+	printf("publish,step,time,bodies,body,x,y,z,vx,vy,vz\n");
+	uint64_t last = 0;
+	long long printed = 0, skipped = 0, raced = 0;
+	char text[16384];
+	while (count == 0 || printed < count)
+	{
+		StateShareView view;
+		if (!StateShareBegin(&reader, &view) || view.Publish == last)
+		{
+			fflush(stdout);
+			this_thread::sleep_for(chrono::milliseconds(1));
+			continue;
+		}
+		//format straight out of shared memory, and only print it once we know it wasn't overwritten
+		int length = 0;
+		for (uint32_t i = 0; i < view.Count && i < shown && length < (int)sizeof(text) - 256; i++)
+			length += snprintf(text + length, sizeof(text) - length, "%llu,%llu,%.6f,%u,%u,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+				(unsigned long long)view.Publish, (unsigned long long)view.Step, view.Time, view.Count, i,
+				view.Columns[STATE_SHARE_X][i], view.Columns[STATE_SHARE_Y][i], view.Columns[STATE_SHARE_Z][i],
+				view.Columns[STATE_SHARE_VX][i], view.Columns[STATE_SHARE_VY][i], view.Columns[STATE_SHARE_VZ][i]);
+		if (!StateShareValidate(&view))
+		{
+			raced++;
+			continue;
+		}
+		if (last > 0 && view.Publish > last + 1)
+			skipped += (long long)(view.Publish - last - 1);
+		fwrite(text, 1, length, stdout);
+		last = view.Publish;
+		printed++;
+	}
+	StateShareDetach(&reader);
+	fprintf(stderr, "%lld states printed, %lld published in between polls, %lld reads raced the simulator and were retried\n",
+		printed, skipped, raced);
+	return 0;
+}
+
+int RunStateBench(int argc, char** argv)
+{
+	//usage: --state-bench [bodies] [publishes] [readers]
+	int bodyCount = argc > 2 ? atoi(argv[2]) : 10000;
+	int publishes = argc > 3 ? atoi(argv[3]) : 5000;
+	int readerCount = argc > 4 ? atoi(argv[4]) : 3;
+	if (bodyCount < 1)
+		bodyCount = 1;
+	if (publishes < 1)
+		publishes = 1;
+	const char* name = "SpaceSimulatorStateBench";
+	StatePublisher publisher;
+	if (!publisher.Open((uint32_t)bodyCount, name))
+	{
+		cout << "ERROR::STATE_SHARE can't create " << name << endl;
+		return 1;
+	}
+	Bodies bodies;
+	bodies.Resize(bodyCount);
+
+	//every value in a state is its publish number, so a reader can tell a torn copy from a good one
+	auto publishAll = [&](int n) -> double
+	{
+		double publishMs = 0.0;
+		for (int p = 0; p < n; p++)
+		{
+			double value = (double)(publisher.Published() + 1);
+			std::fill(bodies.x.begin(), bodies.x.end(), value);
+			std::fill(bodies.y.begin(), bodies.y.end(), value);
+			std::fill(bodies.z.begin(), bodies.z.end(), value);
+			std::fill(bodies.vx.begin(), bodies.vx.end(), value);
+			std::fill(bodies.vy.begin(), bodies.vy.end(), value);
+			std::fill(bodies.vz.begin(), bodies.vz.end(), value);
+			std::fill(bodies.mass.begin(), bodies.mass.end(), value);
+			std::fill(bodies.radius.begin(), bodies.radius.end(), value);
+			PerfTimer timer;
+			publisher.Publish(bodies, value, 1);
+			publishMs += timer.ElapsedMs();
+		}
+		return publishMs / n;
+	};
+	double aloneMs = publishAll(publishes);
+
+	atomic<bool> stop(false);
+	vector<long long> good(readerCount, 0), retried(readerCount, 0), wrong(readerCount, 0);
+	vector<thread> readers;
+	for (int r = 0; r < readerCount; r++)
+		readers.push_back(thread([&, r]()
+		{
+			StateShareReader reader;
+			if (!StateShareAttach(&reader, name))
+				return;
+			while (!stop.load(memory_order_relaxed))
+			{
+				StateShareView view;
+				if (!StateShareBegin(&reader, &view))
+					continue;
+				//in place, every column, the way an analysis tool would
+				bool consistent = true;
+				double expected = (double)view.Publish;
+				for (int c = 0; c < STATE_SHARE_COLUMNS; c++)
+					for (uint32_t i = 0; i < view.Count; i++)
+						consistent &= view.Columns[c][i] == expected;
+				if (!StateShareValidate(&view))
+					retried[r]++;
+				else if (consistent && view.Time == expected)
+					good[r]++;
+				else
+					wrong[r]++;
+			}
+			StateShareDetach(&reader);
+		}));
+	this_thread::sleep_for(chrono::milliseconds(20));
+	PerfTimer wall;
+	double contendedMs = publishAll(publishes);
+	double wallMs = wall.ElapsedMs();
+	stop = true;
+	for (size_t r = 0; r < readers.size(); r++)
+		readers[r].join();
+
+	long long goodTotal = 0, retriedTotal = 0, wrongTotal = 0;
+	for (int r = 0; r < readerCount; r++)
+	{
+		goodTotal += good[r];
+		retriedTotal += retried[r];
+		wrongTotal += wrong[r];
+	}
+	printf("%d bodies, %.1f MB shared: publish %.3f ms alone, %.3f ms with %d readers attached\n",
+		bodyCount, publisher.Bytes() / (1024.0 * 1024.0), aloneMs, contendedMs, readerCount);
+	printf("readers: %lld consistent snapshots (%.0f/s each), %lld caught mid-write and retried, %lld inconsistent accepted\n",
+		goodTotal, readerCount > 0 ? goodTotal * 1000.0 / wallMs / readerCount : 0.0, retriedTotal, wrongTotal);
+	return wrongTotal == 0 ? 0 : 1;
+}
+
+int RunTelemetryDump(int argc, char** argv)
+{
+	//usage: --telemetry-dump [record count, 0 = forever] [--latest]
+	long long count = 0;
+	bool fromStart = true;
+	for (int i = 2; i < argc; i++)
+	{
+		if (string(argv[i]) == "--latest")
+			fromStart = false;
+		else
+			count = atoll(argv[i]);
+	}
+
+	TelemetryReader reader;
+	if (!reader.Attach(TELEMETRY_NAME, fromStart))
+	{
+		fprintf(stderr, "No telemetry found, is the simulator running?\n");
+		return 2;
+	}
+	printf("%s\n", TelemetryReader::CsvHeader());
+	long long printed = 0;
+	TelemetryRecord record;
+	while (count == 0 || printed < count)
+	{
+		if (reader.Next(record))
+		{
+			TelemetryReader::WriteCsv(stdout, record);
+			printed++;
+		}
+		else
+		{
+			fflush(stdout);
+			this_thread::sleep_for(chrono::milliseconds(5));
+		}
+	}
+	if (reader.Dropped > 0)
+		fprintf(stderr, "%llu records were overwritten before they could be read\n", (unsigned long long)reader.Dropped);
+	return 0;
+}
+
+//mouse callback
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+	if (firstMouse)
+	{
+		//helps not make a massive camera rotation jump when mouse first touches the screen
+		lastX = xpos;
+		lastY = ypos;
+		firstMouse = false;
+	}
+
+	float xoffset = xpos - lastX;
+	float yoffset = lastY - ypos;
+	lastX = xpos;
+	lastY = ypos;
+
+	camera.ProcessMouseMovement(xoffset, yoffset);
+}
+
+//scroll wheel callback
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	camera.ProcessMouseScroll(yoffset);
+}
+
+
+GLFWwindow* GameInit(bool offscreen)
+{
+	if (!glfwInit() && offscreen)
+	{
+		cout << "failed to initialise GLFW" << endl;
+		return NULL;
+	}
+	//tell glfw that we want to work with openGL 3.3 core profile
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3); //the first 3 of 3.3
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3); //the .3 of 3.3
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE); //core profile
+	//offscreen renders go into a framebuffer object, the window only exists to own the context
+	if (offscreen)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+																   //build window
+	GLFWwindow *window = glfwCreateWindow(800, 600, "My first OpenGL thing", NULL, NULL);
+	//if it fails
+	if (window == NULL)
+	{
+		//try report error
+		cout << "failed to create window" << endl;
+		glfwTerminate(); //cleanup glfw stuff
+		if (offscreen)
+			return NULL;
+		system("pause");
+	}
+	//make this window the current one
+	glfwMakeContextCurrent(window);
+
+	//initialise GLAD
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		//if this fails, then
+		cout << "GLAD failed to initialise" << endl;
+		glfwTerminate(); //cleanup glfw stuff
+		if (offscreen)
+			return NULL;
+		system("pause");
+	}
+
+	//set up openGL viewport x,y,w,h
+	glViewport(0, 0, 800, 600);//you dont have to use the full window for openGL but we will
+
+							   //set z buffering on
+	glEnable(GL_DEPTH_TEST);
+
+
+	//load images in, flip them
+	stbi_set_flip_vertically_on_load(true);
+
+
+
+
+	//add window resize callback, params: window to check events on, function to call
+	//when it resizes
+	glfwSetFramebufferSizeCallback(window, windowResizeCallBack);
+
+	//register our mouse callbacks
+	glfwSetCursorPosCallback(window, mouse_callback);
+	glfwSetScrollCallback(window, scroll_callback);
+
+	//hide cursor and lock mouse within window area
+	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+	return window;
+}
+
+bool OffscreenInit(const char* contextApi)
+{
+	if (contextApi == NULL)
+		return GameInit(true) != NULL;
+	//no glfwInit here, GLFW would go looking for X11 or Wayland
+	if (!headless.Create(contextApi))
+		return false;
+	glEnable(GL_DEPTH_TEST);
+	stbi_set_flip_vertically_on_load(true);
+	return true;
+}
+
+void OffscreenRelease()
+{
+	headless.Destroy();
+	glfwTerminate(); //does nothing when GLFW was never initialised
+}
+
+void LoadUpImage(const char* path, unsigned int textureID, const char* owner)
+{
+	//LOAD UP IMAGE FILE (JPEG FIRST), decoded straight out of the executable or asset pack if it's in there
+	int width, height, numberChannels; //as we load an image, we'll get values from it to fill these in
+	AssetView packed = EmbeddedAssets::Find(path);
+	if (!packed.Valid())
+		packed = assets.Find(path);
+	unsigned char *image1Data = packed.Valid() ?
+		stbi_load_from_memory(packed.Data, (int)packed.Size, &width, &height, &numberChannels, 0) :
+		stbi_load(path, &width, &height, &numberChannels, 0);
+	//if it loaded
+	if (image1Data)
+	{
+		cout << "Success! Image is " << width << " by " << height << " pixels" << endl;
+		//Lets associate our texture with this image data
+		//params:
+		//	texture type
+		//	0 = mipmap level(if you want to set manually, zero = nah)
+		//	GL_RGB = format we want to store the texture data in
 		//	width/height = size of texture
 		//	0 = must always be zero, some lagacy shit
 		//	GL_RGB = if jpg, its considered RGB
@@ -906,6 +3355,9 @@ void LoadUpImage(const char* path)
 		glGenerateMipmap(GL_TEXTURE_2D);
 		//generates a bunch of smaller versions of the texture to be used at great distances so save on
 		//processing
+
+		//book the full chain against whoever asked for it
+		GpuMemory::Get().RegisterTexture(textureID, width, height, GL_RGB, GpuMemory::MipCount(width, height), owner);
 	}
 	else
 	{